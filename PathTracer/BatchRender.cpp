@@ -0,0 +1,478 @@
+#include "BatchRender.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <EASTL/fixed_vector.h>
+
+#include "IO/MeshImporter.h"
+#include "CpuPathTracer.h"
+#include "ObjImporter.h"
+#include "ProcessStats.h"
+#include "SceneCache.h"
+#include "Timing.h"
+
+namespace Priv_BatchRender {
+  const char * USAGE =
+      "Usage: -batch -scene <path> [-out <path.pfm>] [-width <n>] [-height <n>] [-spp <n>] [-bounces <n>] "
+      "[-seed <n>] [-cam-pos <x> <y> <z>] [-cam-target <x> <y> <z>] [-fov <degrees>] [-light-instance <n>] "
+      "[-light-strength <f>] [-sky-intensity <f>] [-sky-lookup <integrate|sky-view|radiance>] [-wavefront] "
+      "[-no-cache] [-no-nee] [-light-sampling <alias|bvh>] [-light-benchmark <n>] [-no-rr] [-adaptive <error>] "
+      "[-sampler <random|halton|sobol|blue-noise>] [-sampler-benchmark] [-scheduler-benchmark] "
+      "[-reference <path.pfm>] [-check-allocations] [-tlas-benchmark <n>] [-vertex-format <full|compact>] "
+      "[-vertex-format-benchmark] [-texture-budget <MiB>] [-stream-geometry <MiB>]";
+
+  const float CAMERA_NEAR = 1.0f;  // Same as the interactive camera
+
+  bool ParseUint( const char * aString, uint & aValueOut ) {
+    char *                   end = nullptr;
+    const unsigned long long value = strtoull( aString, &end, 10 );
+    if ( end == aString || *end != '\0' || aString[ 0 ] == '-' || value > UINT_MAX )
+      return false;
+    aValueOut = ( uint ) value;
+    return true;
+  }
+
+  bool ParseFloat( const char * aString, float & aValueOut ) {
+    char *      end = nullptr;
+    const float value = strtof( aString, &end );
+    if ( end == aString || *end != '\0' )
+      return false;
+    aValueOut = value;
+    return true;
+  }
+
+  // Parses the aNumValues values following someArguments[ anArgIdx ] and advances anArgIdx past them
+  bool ParseFloats( const char ** someArguments, uint aNumArguments, uint & anArgIdx, float * someValuesOut,
+                    uint aNumValues ) {
+    if ( anArgIdx + aNumValues >= aNumArguments )
+      return false;
+    for ( uint i = 0u; i < aNumValues; ++i ) {
+      if ( !ParseFloat( someArguments[ ++anArgIdx ], someValuesOut[ i ] ) )
+        return false;
+    }
+    return true;
+  }
+
+  bool ParseUintArgument( const char ** someArguments, uint aNumArguments, uint & anArgIdx, uint & aValueOut ) {
+    return anArgIdx + 1u < aNumArguments && ParseUint( someArguments[ ++anArgIdx ], aValueOut );
+  }
+
+  // Same construction as Camera::GetVerticesOnNearPlane(): the corner is the bottom-left one, the axes span the
+  // whole near plane
+  void SetCamera( const BatchRenderSettings & someSettings, CpuRtConsts & someConstsInOut ) {
+    glm::float3 forward = someSettings.myCameraTarget - someSettings.myCameraPos;
+    forward = glm::length( forward ) > 0.0f ? glm::normalize( forward ) : glm::float3( 0.0f, 0.0f, 1.0f );
+
+    glm::float3 up( 0.0f, 1.0f, 0.0f );
+    if ( glm::abs( glm::dot( forward, up ) ) > 0.999f )
+      up = glm::float3( 0.0f, 0.0f, 1.0f );
+    const glm::float3 right = glm::normalize( glm::cross( up, forward ) );
+    up = glm::cross( forward, right );
+
+    const float nearHeight = 2.0f * CAMERA_NEAR * glm::tan( glm::radians( someSettings.myFovDeg ) * 0.5f );
+    const float nearWidth = nearHeight * ( float ) someSettings.myWidth / ( float ) someSettings.myHeight;
+
+    someConstsInOut.myCameraPos = someSettings.myCameraPos;
+    someConstsInOut.myXAxis = right * nearWidth;
+    someConstsInOut.myYAxis = up * nearHeight;
+    someConstsInOut.myNearPlaneCorner = someSettings.myCameraPos + forward * CAMERA_NEAR -
+                                        someConstsInOut.myXAxis * 0.5f - someConstsInOut.myYAxis * 0.5f;
+  }
+
+  bool LoadScene( const BatchRenderSettings & someSettings, CpuPathTracer & aPathTracer, SceneData & aSceneDataOut ) {
+    eastl::fixed_vector< VertexShaderAttributeDesc, 16 > vertexAttributes = {
+      { VertexAttributeSemantic::POSITION, 0, DataFormat::RGB_32F },
+      { VertexAttributeSemantic::NORMAL, 0, DataFormat::RGB_32F },
+      { VertexAttributeSemantic::TEXCOORD, 0, DataFormat::RG_32F }
+    };
+
+    const char * path = someSettings.myScenePath.c_str();
+    const bool   streamGeometry = someSettings.myBlasStreamingBudget > 0u;
+
+    // A streamed scene reads its BLAS from the cache and needs no mesh data
+    SceneData & sceneData = aSceneDataOut;
+    SceneCache  sceneCache;
+    bool        fromCache = someSettings.myUseSceneCache &&
+                            sceneCache.Open( path, vertexAttributes.data(), ( uint ) vertexAttributes.size() ) &&
+                            sceneCache.ReadScene( sceneData, !streamGeometry );
+    if ( fromCache ) {
+      aPathTracer.InitScene( sceneData, &sceneCache, someSettings.myVertexFormat,
+                             someSettings.myBlasStreamingBudget );
+
+      // The CPU part of the cache is invalid or written with another vertex format, it's rewritten below
+      if ( streamGeometry && aPathTracer.GetScene().GetBlasCache() == nullptr ) {
+        fromCache = false;
+        sceneData = SceneData();
+      }
+    }
+    sceneCache.Close();
+
+    if ( !fromCache ) {
+      bool importSuccess;
+      if ( ObjImporter::IsObjFile( path ) ) {
+        ObjImporter importer( aPathTracer.GetThreadPool() );
+        importSuccess = importer.Import( path, vertexAttributes, sceneData );
+      } else {
+        MeshImporter importer;
+        importSuccess = importer.Import( path, vertexAttributes, sceneData );
+      }
+
+      if ( !importSuccess ) {
+        Log( "Failed importing scene %s", path );
+        return false;
+      }
+      aPathTracer.InitScene( sceneData, nullptr, someSettings.myVertexFormat );
+    }
+
+    if ( someSettings.myUseSceneCache && !fromCache ) {
+      if ( !SceneCache::Write( path, vertexAttributes.data(), ( uint ) vertexAttributes.size(), sceneData,
+                               aPathTracer.GetScene() ) )
+        Log( "Failed writing scene cache %s", SceneCache::GetCachePath( path ).c_str() );
+    }
+
+    // The first load of a streamed scene needs all of it in memory to build the BLAS. Once they are in the cache, the
+    // scene is loaded again from there, which drops the resident ones.
+    if ( streamGeometry && !fromCache ) {
+      sceneData = SceneData();
+      const bool isStreamed = sceneCache.Open( path, vertexAttributes.data(), ( uint ) vertexAttributes.size() ) &&
+                              sceneCache.ReadScene( sceneData, false );
+      if ( isStreamed )
+        aPathTracer.InitScene( sceneData, &sceneCache, someSettings.myVertexFormat,
+                               someSettings.myBlasStreamingBudget );
+      sceneCache.Close();
+
+      if ( !isStreamed || aPathTracer.GetScene().GetBlasCache() == nullptr ) {
+        Log( "Failed streaming the geometry of %s from its scene cache", path );
+        return false;
+      }
+    }
+    return true;
+  }
+}  // namespace Priv_BatchRender
+
+bool IsBatchRender( const char ** someArguments, uint aNumArguments ) {
+  for ( uint i = 0u; i < aNumArguments; ++i ) {
+    if ( strcmp( someArguments[ i ], "-batch" ) == 0 )
+      return true;
+  }
+  return false;
+}
+
+bool ParseBatchRenderSettings( const char ** someArguments, uint aNumArguments, BatchRenderSettings & aSettingsOut ) {
+  using namespace Priv_BatchRender;
+
+  aSettingsOut = BatchRenderSettings();
+
+  // The first argument is the executable
+  bool isValid = true;
+  for ( uint i = 1u; i < aNumArguments && isValid; ++i ) {
+    const char * argument = someArguments[ i ];
+    if ( strcmp( argument, "-batch" ) == 0 ) {
+      continue;
+    } else if ( strcmp( argument, "-scene" ) == 0 && i + 1u < aNumArguments ) {
+      aSettingsOut.myScenePath = someArguments[ ++i ];
+    } else if ( strcmp( argument, "-out" ) == 0 && i + 1u < aNumArguments ) {
+      aSettingsOut.myOutputPath = someArguments[ ++i ];
+    } else if ( strcmp( argument, "-width" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.myWidth );
+    } else if ( strcmp( argument, "-height" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.myHeight );
+    } else if ( strcmp( argument, "-spp" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.mySamplesPerPixel );
+    } else if ( strcmp( argument, "-bounces" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.myMaxBounces );
+    } else if ( strcmp( argument, "-seed" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.mySeed );
+    } else if ( strcmp( argument, "-light-instance" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.myLightInstanceIdx );
+    } else if ( strcmp( argument, "-cam-pos" ) == 0 ) {
+      isValid = ParseFloats( someArguments, aNumArguments, i, &aSettingsOut.myCameraPos.x, 3u );
+    } else if ( strcmp( argument, "-cam-target" ) == 0 ) {
+      isValid = ParseFloats( someArguments, aNumArguments, i, &aSettingsOut.myCameraTarget.x, 3u );
+    } else if ( strcmp( argument, "-fov" ) == 0 ) {
+      isValid = ParseFloats( someArguments, aNumArguments, i, &aSettingsOut.myFovDeg, 1u );
+    } else if ( strcmp( argument, "-light-strength" ) == 0 ) {
+      isValid = ParseFloats( someArguments, aNumArguments, i, &aSettingsOut.myLightStrength, 1u );
+    } else if ( strcmp( argument, "-sky-intensity" ) == 0 ) {
+      isValid = ParseFloats( someArguments, aNumArguments, i, &aSettingsOut.mySkyIntensity, 1u );
+      aSettingsOut.mySampleSky = false;
+    } else if ( strcmp( argument, "-sky-lookup" ) == 0 && i + 1u < aNumArguments ) {
+      const char * lookup = someArguments[ ++i ];
+      if ( strcmp( lookup, "integrate" ) == 0 )
+        aSettingsOut.mySkyLookup = SkyLookup::INTEGRATE;
+      else if ( strcmp( lookup, "sky-view" ) == 0 )
+        aSettingsOut.mySkyLookup = SkyLookup::SKY_VIEW_LUT;
+      else if ( strcmp( lookup, "radiance" ) == 0 )
+        aSettingsOut.mySkyLookup = SkyLookup::RADIANCE_LUT;
+      else
+        isValid = false;
+    } else if ( strcmp( argument, "-wavefront" ) == 0 ) {
+      aSettingsOut.myWavefront = true;
+    } else if ( strcmp( argument, "-no-cache" ) == 0 ) {
+      aSettingsOut.myUseSceneCache = false;
+    } else if ( strcmp( argument, "-no-nee" ) == 0 ) {
+      aSettingsOut.myNextEventEstimation = false;
+    } else if ( strcmp( argument, "-light-sampling" ) == 0 && i + 1u < aNumArguments ) {
+      const char * sampling = someArguments[ ++i ];
+      if ( strcmp( sampling, "alias" ) == 0 )
+        aSettingsOut.myLightSampling = LightSampling::ALIAS_TABLE;
+      else if ( strcmp( sampling, "bvh" ) == 0 )
+        aSettingsOut.myLightSampling = LightSampling::LIGHT_BVH;
+      else
+        isValid = false;
+    } else if ( strcmp( argument, "-light-benchmark" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.myNumBenchmarkLights );
+    } else if ( strcmp( argument, "-no-rr" ) == 0 ) {
+      aSettingsOut.myRussianRoulette = false;
+    } else if ( strcmp( argument, "-adaptive" ) == 0 ) {
+      isValid = ParseFloats( someArguments, aNumArguments, i, &aSettingsOut.myAdaptiveErrorThreshold, 1u ) &&
+                aSettingsOut.myAdaptiveErrorThreshold > 0.0f;
+    } else if ( strcmp( argument, "-sampler" ) == 0 && i + 1u < aNumArguments ) {
+      const char * sampler = someArguments[ ++i ];
+      if ( strcmp( sampler, "random" ) == 0 )
+        aSettingsOut.mySampler = SamplerType::RANDOM;
+      else if ( strcmp( sampler, "halton" ) == 0 )
+        aSettingsOut.mySampler = SamplerType::HALTON;
+      else if ( strcmp( sampler, "sobol" ) == 0 )
+        aSettingsOut.mySampler = SamplerType::SOBOL;
+      else if ( strcmp( sampler, "blue-noise" ) == 0 )
+        aSettingsOut.mySampler = SamplerType::BLUE_NOISE;
+      else
+        isValid = false;
+    } else if ( strcmp( argument, "-sampler-benchmark" ) == 0 ) {
+      aSettingsOut.myRunSamplerBenchmark = true;
+    } else if ( strcmp( argument, "-scheduler-benchmark" ) == 0 ) {
+      aSettingsOut.myRunSchedulerBenchmark = true;
+    } else if ( strcmp( argument, "-reference" ) == 0 && i + 1u < aNumArguments ) {
+      aSettingsOut.myReferencePath = someArguments[ ++i ];
+    } else if ( strcmp( argument, "-check-allocations" ) == 0 ) {
+      aSettingsOut.myCheckAllocations = true;
+    } else if ( strcmp( argument, "-tlas-benchmark" ) == 0 ) {
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, aSettingsOut.myNumTlasBenchmarkInstances );
+    } else if ( strcmp( argument, "-vertex-format" ) == 0 && i + 1u < aNumArguments ) {
+      const char * vertexFormat = someArguments[ ++i ];
+      if ( strcmp( vertexFormat, "full" ) == 0 )
+        aSettingsOut.myVertexFormat = RtVertexFormat::FULL;
+      else if ( strcmp( vertexFormat, "compact" ) == 0 )
+        aSettingsOut.myVertexFormat = RtVertexFormat::COMPACT;
+      else
+        isValid = false;
+    } else if ( strcmp( argument, "-vertex-format-benchmark" ) == 0 ) {
+      aSettingsOut.myRunVertexFormatBenchmark = true;
+    } else if ( strcmp( argument, "-texture-budget" ) == 0 ) {
+      uint budgetMiB = 0u;
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, budgetMiB ) && budgetMiB > 0u;
+      aSettingsOut.myTextureBudget = ( uint64 ) budgetMiB * 1024u * 1024u;
+    } else if ( strcmp( argument, "-stream-geometry" ) == 0 ) {
+      uint budgetMiB = 0u;
+      isValid = ParseUintArgument( someArguments, aNumArguments, i, budgetMiB ) && budgetMiB > 0u;
+      aSettingsOut.myBlasStreamingBudget = ( uint64 ) budgetMiB * 1024u * 1024u;
+    } else {
+      isValid = false;
+    }
+
+    if ( !isValid )
+      Log( "Invalid batch render argument %s", argument );
+  }
+
+  isValid &= !aSettingsOut.myScenePath.empty() && aSettingsOut.myWidth > 0u && aSettingsOut.myHeight > 0u &&
+             aSettingsOut.mySamplesPerPixel > 0u;
+  isValid &= aSettingsOut.myBlasStreamingBudget == 0u ||
+             ( aSettingsOut.myUseSceneCache && !aSettingsOut.myRunVertexFormatBenchmark );
+  if ( !isValid )
+    Log( "%s", USAGE );
+  return isValid;
+}
+
+bool RunBatchRender( const BatchRenderSettings & someSettings, BatchRenderStats & aStatsOut ) {
+  using namespace Priv_BatchRender;
+
+  aStatsOut = BatchRenderStats();
+
+  CpuPathTracer pathTracer;
+  pathTracer.GetTextureCache().SetBudget( someSettings.myTextureBudget );
+
+  const float64 loadStartMs = SampleTimeMs();
+  const uint64  loadStartNumAllocations = GetNumHeapAllocations();
+  // Kept for the benchmarks that rebuild the scene
+  SceneData sceneData;
+  if ( !LoadScene( someSettings, pathTracer, sceneData ) )
+    return false;
+  aStatsOut.myLoadTimeMs = SampleTimeMs() - loadStartMs;
+  aStatsOut.myNumLoadAllocations = GetNumHeapAllocations() - loadStartNumAllocations;
+
+  if ( someSettings.myNumBenchmarkLights > 0u )
+    RunLightSamplingBenchmark( pathTracer.GetScene(), someSettings.myNumBenchmarkLights );
+  if ( someSettings.myNumTlasBenchmarkInstances > 0u )
+    pathTracer.RunTlasUpdateBenchmark( someSettings.myNumTlasBenchmarkInstances );
+
+  CpuRtConsts rtConsts;
+  SetCamera( someSettings, rtConsts );
+  rtConsts.myMaxRecursionDepth = someSettings.myMaxBounces;
+  rtConsts.myLightInstanceId = someSettings.myLightInstanceIdx;
+  rtConsts.myLightEmission = glm::float3( someSettings.myLightStrength );
+  rtConsts.mySampleSky = someSettings.mySampleSky;
+  SetupEarthAtmosphere( rtConsts.mySkyParams.myAtmosphere );
+  rtConsts.mySkyLookup = someSettings.mySkyLookup;
+  rtConsts.mySkyFallbackEmission = glm::float3( someSettings.mySkyIntensity );
+  rtConsts.myWavefront = someSettings.myWavefront;
+  rtConsts.myNextEventEstimation = someSettings.myNextEventEstimation;
+  rtConsts.myLightSampling = someSettings.myLightSampling;
+  rtConsts.myRussianRoulette = someSettings.myRussianRoulette;
+  rtConsts.myAdaptiveSampling = someSettings.myAdaptiveErrorThreshold > 0.0f;
+  rtConsts.myAdaptiveErrorThreshold = someSettings.myAdaptiveErrorThreshold;
+  rtConsts.mySampler = someSettings.mySampler;
+  rtConsts.mySamplerSeed = someSettings.mySeed;
+
+  pathTracer.SetResolution( someSettings.myWidth, someSettings.myHeight );
+  if ( someSettings.myRunSamplerBenchmark )
+    pathTracer.RunSamplerBenchmark( rtConsts );
+  if ( someSettings.myRunSchedulerBenchmark )
+    pathTracer.RunSchedulerBenchmark( rtConsts );
+  CpuVertexFormatBenchmarkResults vertexFormatResults;
+  if ( someSettings.myRunVertexFormatBenchmark )
+    vertexFormatResults = pathTracer.RunVertexFormatBenchmark( sceneData, rtConsts );
+  pathTracer.RestartAccumulation();
+
+  // The frame seeds of different seeds don't overlap for the same sample count
+  const float64 renderStartMs = SampleTimeMs();
+  float64       pathLengthSum = 0.0;
+  for ( uint i = 0u; i < someSettings.mySamplesPerPixel && !( rtConsts.myAdaptiveSampling && pathTracer.IsConverged() );
+        ++i ) {
+    rtConsts.myFrameRandomSeed = someSettings.mySeed * someSettings.mySamplesPerPixel + i;
+    const uint64 frameStartNumAllocations = GetNumHeapAllocations();
+    pathTracer.RenderFrame( rtConsts );
+    pathLengthSum += pathTracer.GetAveragePathLength();
+
+    const uint64 numFrameAllocations = GetNumHeapAllocations() - frameStartNumAllocations;
+    if ( i == 0u )
+      aStatsOut.myNumFirstFrameAllocations = numFrameAllocations;
+    else
+      aStatsOut.myNumSteadyStateAllocations += numFrameAllocations;
+  }
+  aStatsOut.myRenderTimeMs = SampleTimeMs() - renderStartMs;
+  aStatsOut.myNumFrames = pathTracer.GetNumAccumulationFrames();
+  aStatsOut.myNumSamples = pathTracer.GetNumAccumulatedSamples();
+  aStatsOut.myAveragePathLength = ( float ) ( pathLengthSum / glm::max( aStatsOut.myNumFrames, 1u ) );
+  aStatsOut.mySamplesPerSecond =
+      ( float64 ) aStatsOut.myNumSamples / ( glm::max( aStatsOut.myRenderTimeMs, 0.001 ) / 1000.0 );
+
+  if ( !WritePfm( someSettings.myOutputPath.c_str(), pathTracer.GetAccumulationBuffer(), someSettings.myWidth,
+                  someSettings.myHeight ) ) {
+    Log( "Failed writing %s", someSettings.myOutputPath.c_str() );
+    return false;
+  }
+
+  Log( "Rendered %s at %ux%u, %u spp: load %.2f ms, render %.2f ms, %.2f Msamples/s, %.2f rays per path, peak RSS "
+       "%.1f MiB",
+       someSettings.myScenePath.c_str(), someSettings.myWidth, someSettings.myHeight, someSettings.mySamplesPerPixel,
+       aStatsOut.myLoadTimeMs, aStatsOut.myRenderTimeMs, aStatsOut.mySamplesPerSecond / 1000000.0,
+       aStatsOut.myAveragePathLength, ( float ) GetPeakResidentMemory() / ( 1024.0f * 1024.0f ) );
+  Log( "Heap allocations: load %u, first frame %u, later frames %u", ( uint ) aStatsOut.myNumLoadAllocations,
+       ( uint ) aStatsOut.myNumFirstFrameAllocations, ( uint ) aStatsOut.myNumSteadyStateAllocations );
+
+  const CpuTextureCacheStats textureStats = pathTracer.GetTextureCache().GetStats();
+  if ( textureStats.myNumTextures > 0u ) {
+    Log( "Texture cache: %u textures, %.1f MiB decoded, %.1f of %.1f MiB resident, %.2f%% hit rate, %u misses, "
+         "%u evictions",
+         textureStats.myNumTextures, ( float ) textureStats.myTextureSize / ( 1024.0f * 1024.0f ),
+         ( float ) textureStats.myResidentSize / ( 1024.0f * 1024.0f ),
+         ( float ) textureStats.myBudget / ( 1024.0f * 1024.0f ), textureStats.GetHitRate() * 100.0f,
+         ( uint ) textureStats.myNumMisses, ( uint ) textureStats.myNumEvictions );
+  }
+
+  if ( const CpuBlasCache * blasCache = pathTracer.GetScene().GetBlasCache() ) {
+    const CpuBlasCacheStats blasStats = blasCache->GetStats();
+    Log( "Geometry streaming: %u of %u BLAS resident, %.1f MiB peak of %.1f MiB budget (%.1f MiB total), %.2f%% hit "
+         "rate, %u page-ins (%.1f MiB, %.2f ms, %.2f%% of the render time), %u evictions",
+         blasStats.myNumResidentBlas, blasStats.myNumBlas,
+         ( float ) blasStats.myPeakResidentSize / ( 1024.0f * 1024.0f ),
+         ( float ) blasStats.myBudget / ( 1024.0f * 1024.0f ), ( float ) blasStats.myTotalSize / ( 1024.0f * 1024.0f ),
+         blasStats.GetHitRate() * 100.0f, ( uint ) blasStats.myNumPageIns,
+         ( float ) blasStats.myPageInSize / ( 1024.0f * 1024.0f ), blasStats.myPageInTimeMs,
+         blasStats.myPageInTimeMs / glm::max( aStatsOut.myRenderTimeMs, 0.001 ) * 100.0,
+         ( uint ) blasStats.myNumEvictions );
+  }
+
+  if ( someSettings.myCheckAllocations && aStatsOut.myNumSteadyStateAllocations > 0u ) {
+    Log( "Allocation check failed: the frames after the first one allocated heap memory" );
+    return false;
+  }
+
+  if ( someSettings.myRunVertexFormatBenchmark && !vertexFormatResults.IsFormatWithinNoise() ) {
+    Log( "Vertex format check failed: the compact format changes the image by a relative RMSE of %.5f, the limit is "
+         "%.5f",
+         vertexFormatResults.myFormatRmse, vertexFormatResults.myMaxFormatRmse );
+    return false;
+  }
+
+  if ( rtConsts.myAdaptiveSampling ) {
+    const uint numPixels = someSettings.myWidth * someSettings.myHeight;
+    Log( "Adaptive sampling: %u frames, %.2f samples per pixel on average, %u of %u tiles above the error",
+         aStatsOut.myNumFrames, ( float ) ( ( float64 ) aStatsOut.myNumSamples / numPixels ),
+         pathTracer.GetNumActiveTiles(), pathTracer.GetNumTiles() );
+  }
+
+  if ( someSettings.myReferencePath.empty() )
+    return true;
+
+  eastl::vector< glm::float4 > reference;
+  uint                         referenceWidth, referenceHeight;
+  if ( !ReadPfm( someSettings.myReferencePath.c_str(), reference, referenceWidth, referenceHeight ) ||
+       referenceWidth != someSettings.myWidth || referenceHeight != someSettings.myHeight ) {
+    Log( "Failed reading %s or its size doesn't match the render", someSettings.myReferencePath.c_str() );
+    return false;
+  }
+
+  aStatsOut.myReferenceRmse = ComputeRelativeRmse( pathTracer.GetAccumulationBuffer(), reference.data(),
+                                                   someSettings.myWidth * someSettings.myHeight );
+  Log( "Relative RMSE against %s: %.5f", someSettings.myReferencePath.c_str(), aStatsOut.myReferenceRmse );
+  return true;
+}
+
+bool WritePfm( const char * aPath, const glm::float4 * somePixels, uint aWidth, uint aHeight ) {
+  FILE * file = fopen( aPath, "wb" );
+  if ( file == nullptr )
+    return false;
+
+  // A negative scale marks little-endian data. PFM stores the rows bottom to top.
+  bool                         isValid = fprintf( file, "PF\n%u %u\n-1.0\n", aWidth, aHeight ) > 0;
+  eastl::vector< glm::float3 > row( aWidth );
+  for ( uint y = aHeight; y > 0u && isValid; --y ) {
+    const glm::float4 * srcRow = somePixels + ( uint64 ) ( y - 1u ) * aWidth;
+    for ( uint x = 0u; x < aWidth; ++x )
+      row[ x ] = glm::float3( srcRow[ x ] );
+    isValid = fwrite( row.data(), sizeof( glm::float3 ), aWidth, file ) == aWidth;
+  }
+
+  isValid &= fclose( file ) == 0;
+  return isValid;
+}
+
+bool ReadPfm( const char * aPath, eastl::vector< glm::float4 > & somePixelsOut, uint & aWidthOut, uint & aHeightOut ) {
+  FILE * file = fopen( aPath, "rb" );
+  if ( file == nullptr )
+    return false;
+
+  // The header ends with a single whitespace character after the scale
+  float scale = 0.0f;
+  bool  isValid = fscanf( file, "PF %u %u %f", &aWidthOut, &aHeightOut, &scale ) == 3 && fgetc( file ) != EOF &&
+                 scale < 0.0f;
+
+  eastl::vector< glm::float3 > row;
+  if ( isValid ) {
+    row.resize( aWidthOut );
+    somePixelsOut.resize( ( uint64 ) aWidthOut * aHeightOut );
+  }
+  for ( uint y = aHeightOut; y > 0u && isValid; --y ) {
+    isValid = fread( row.data(), sizeof( glm::float3 ), aWidthOut, file ) == aWidthOut;
+    glm::float4 * dstRow = somePixelsOut.data() + ( uint64 ) ( y - 1u ) * aWidthOut;
+    for ( uint x = 0u; x < aWidthOut && isValid; ++x )
+      dstRow[ x ] = glm::float4( row[ x ], 0.0f );
+  }
+
+  fclose( file );
+  return isValid;
+}
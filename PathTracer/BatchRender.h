@@ -0,0 +1,104 @@
+#pragma once
+
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+#include "CpuRtLights.h"
+#include "CpuRtSampler.h"
+#include "CpuRtScene.h"
+#include "CpuSky.h"
+#include "CpuTextureCache.h"
+
+using namespace Fancy;
+
+// Settings of a headless render, parsed from the command line:
+//   -batch -scene <path> [-out <path.pfm>] [-width <n>] [-height <n>] [-spp <n>] [-bounces <n>] [-seed <n>]
+//   [-cam-pos <x> <y> <z>] [-cam-target <x> <y> <z>] [-fov <degrees>] [-light-instance <n>] [-light-strength <f>]
+//   [-sky-intensity <f>] [-sky-lookup <integrate|sky-view|radiance>] [-wavefront] [-no-cache] [-no-nee]
+//   [-light-sampling <alias|bvh>] [-light-benchmark <n>] [-no-rr] [-adaptive <error>]
+//   [-sampler <random|halton|sobol|blue-noise>] [-sampler-benchmark] [-scheduler-benchmark] [-reference <path.pfm>]
+//   [-check-allocations] [-tlas-benchmark <n>] [-vertex-format <full|compact>] [-vertex-format-benchmark]
+//   [-texture-budget <MiB>] [-stream-geometry <MiB>]
+// The defaults match the interactive mode. -sky-intensity replaces the atmosphere with a constant sky. -no-nee only
+// samples the BRDF, -no-rr traces every path to -bounces. -adaptive only samples the tiles whose estimated relative
+// RMSE is above the error and stops before -spp once none are left. -reference logs the relative RMSE of the render
+// against a PFM of the same size.
+// -light-benchmark runs RunLightSamplingBenchmark() with n lights on the scene before rendering, -sampler-benchmark
+// and -scheduler-benchmark run CpuPathTracer::RunSamplerBenchmark() and RunSchedulerBenchmark() with the render
+// settings.
+// -check-allocations fails the render if a frame after the first one allocates heap memory. -tlas-benchmark runs
+// CpuRtScene::RunTlasUpdateBenchmark() with n instances before rendering. -vertex-format selects the layout of the
+// shading attributes, -vertex-format-benchmark runs CpuPathTracer::RunVertexFormatBenchmark() with the render settings
+// and fails the render if the compact format changes the image by more than a fixed share of the noise.
+// -texture-budget limits the decoded texture tiles the CPU keeps in memory, the hit rate of the cache is logged after
+// the render. -stream-geometry keeps the BLAS in the scene cache and only pages in as many as fit into the budget, see
+// CpuBlasCache. It needs the scene cache and can't be combined with -vertex-format-benchmark, which rebuilds the
+// scene from the mesh data.
+struct BatchRenderSettings {
+  eastl::string  myScenePath;
+  eastl::string  myOutputPath = "render.pfm";
+  glm::float3    myCameraPos = glm::float3( 0.0f );
+  glm::float3    myCameraTarget = glm::float3( 0.0f, 0.0f, 1.0f );
+  float          myFovDeg = 60.0f;
+  uint           myWidth = 1280u;
+  uint           myHeight = 720u;
+  uint           mySamplesPerPixel = 64u;
+  uint           myMaxBounces = 4u;
+  uint           mySeed = 0u;
+  uint           myLightInstanceIdx = 4u;  // UINT_MAX disables the light
+  float          myLightStrength = 100.0f;
+  float          mySkyIntensity = 100.0f;
+  bool           mySampleSky = true;  // Atmosphere with the default sun, otherwise a constant mySkyIntensity
+  SkyLookup      mySkyLookup = SkyLookup::SKY_VIEW_LUT;
+  bool           myWavefront = false;
+  bool           myUseSceneCache = true;
+  bool           myNextEventEstimation = true;
+  LightSampling  myLightSampling = LightSampling::LIGHT_BVH;
+  uint           myNumBenchmarkLights = 0u;  // 0 skips the light sampling benchmark
+  bool           myRussianRoulette = true;
+  float          myAdaptiveErrorThreshold = 0.0f;  // 0 disables adaptive sampling
+  SamplerType    mySampler = SamplerType::SOBOL;
+  bool           myRunSamplerBenchmark = false;
+  bool           myRunSchedulerBenchmark = false;
+  eastl::string  myReferencePath;  // Optional
+  bool           myCheckAllocations = false;
+  uint           myNumTlasBenchmarkInstances = 0u;  // 0 skips the TLAS update benchmark
+  RtVertexFormat myVertexFormat = RtVertexFormat::FULL;
+  bool           myRunVertexFormatBenchmark = false;
+  uint64         myTextureBudget = CpuTextureCache::DEFAULT_BUDGET;
+  uint64         myBlasStreamingBudget = 0u;  // 0 keeps all BLAS resident
+};
+
+struct BatchRenderStats {
+  float64 myLoadTimeMs = 0.0;
+  float64 myRenderTimeMs = 0.0;
+  float64 mySamplesPerSecond = 0.0;  // Camera samples, one per pixel and SPP without adaptive sampling
+  uint64  myNumSamples = 0u;
+  uint    myNumFrames = 0u;  // Less than the SPP if adaptive sampling converged before
+  float   myAveragePathLength = 0.0f;  // Rays per camera sample, without shadow rays
+  float   myReferenceRmse = -1.0f;   // Relative RMSE against myReferencePath, -1 without a reference
+  uint64  myNumLoadAllocations = 0u;
+  uint64  myNumFirstFrameAllocations = 0u;  // Sets up the per-frame buffers
+  uint64  myNumSteadyStateAllocations = 0u;  // Of all frames after the first one
+};
+
+// True if the arguments ask for a batch render instead of the interactive application
+bool IsBatchRender( const char ** someArguments, uint aNumArguments );
+
+// Returns false and logs the usage on unknown or malformed arguments
+bool ParseBatchRenderSettings( const char ** someArguments, uint aNumArguments, BatchRenderSettings & aSettingsOut );
+
+// Renders the scene with the CPU path tracer to a fixed sample count and writes the accumulated HDR buffer as PFM.
+// Needs no window or GPU device. The output only depends on the settings, for a given build: every sample of a pixel
+// draws from its own RNG sequence, seeded with mySeed, and the accumulation is per pixel, so the thread scheduling
+// doesn't change the result.
+bool RunBatchRender( const BatchRenderSettings & someSettings, BatchRenderStats & aStatsOut );
+
+// Writes an RGB float PFM, with the rows of somePixels ordered top to bottom
+bool WritePfm( const char * aPath, const glm::float4 * somePixels, uint aWidth, uint aHeight );
+
+// Reads an RGB float PFM as written by WritePfm(), with the rows of somePixelsOut ordered top to bottom. Only
+// little-endian files are supported.
+bool ReadPfm( const char * aPath, eastl::vector< glm::float4 > & somePixelsOut, uint & aWidthOut, uint & aHeightOut );
@@ -0,0 +1,191 @@
+#include "CpuBlasCache.h"
+
+#include <algorithm>
+
+#include "Timing.h"
+
+namespace Priv_CpuBlasCache {
+  std::atomic< uint > ourNumCountedThreads { 0u };
+
+  // Assigned on the first lookup of a thread and shared by all caches. Threads past the last counter share it.
+  uint GetLookupCounterIndex() {
+    thread_local const uint counterIdx =
+        glm::min( ourNumCountedThreads.fetch_add( 1u, std::memory_order_relaxed ),
+                  ( uint ) CpuBlasCache::MAX_NUM_COUNTED_THREADS - 1u );
+    return counterIdx;
+  }
+}  // namespace Priv_CpuBlasCache
+
+CpuBlasCache::CpuBlasCache( const SharedPtr< MappedFile > & aFile, uint aNumBlas, uint64 aBudget )
+  : myFile( aFile ), myEntries( new BlasEntry[ aNumBlas ] ), myNumBlas( aNumBlas ), myBudget( aBudget ) {}
+
+CpuBlasCache::~CpuBlasCache() {
+  // No thread may still hold a pin
+  for ( uint iBlas = 0u; iBlas < myNumBlas; ++iBlas )
+    ASSERT( myEntries[ iBlas ].myNumPins.load() == 0u );
+}
+
+void CpuBlasCache::SetSource( uint aBlas, const SceneCacheReader & aReader, uint64 aSize ) {
+  BlasEntry & entry = myEntries[ aBlas ];
+  ASSERT( entry.myResidentBlas == nullptr );
+  myTotalSize += aSize - entry.mySize;
+  entry.mySource = aReader;
+  entry.mySize = aSize;
+  UpdateNeedsPins();
+}
+
+void CpuBlasCache::SetBudget( uint64 aBudget ) {
+  std::lock_guard< std::mutex > lock( myMutex );
+  myBudget.store( aBudget, std::memory_order_relaxed );
+  UpdateNeedsPins();
+  EvictDownTo( aBudget );
+}
+
+const CpuRtBlas & CpuBlasCache::Acquire( uint aBlas ) {
+  BlasEntry & entry = myEntries[ aBlas ];
+
+  // The pin comes before the load, so TryEvict() either sees the pin or this thread sees nullptr and waits for the lock
+  if ( myNeedsPins.load( std::memory_order_relaxed ) )
+    entry.myNumPins.fetch_add( 1u );
+  CountLookup();
+  const CpuRtBlas * blas = entry.myBlas.load();
+  if ( blas == nullptr )
+    blas = PageIn( aBlas );
+
+  // Only written when it changes, resident BLAS that many threads traverse would otherwise bounce the cache line
+  const uint64 useClock = myUseClock.load( std::memory_order_relaxed );
+  if ( entry.myLastUse.load( std::memory_order_relaxed ) != useClock )
+    entry.myLastUse.store( useClock, std::memory_order_relaxed );
+  return *blas;
+}
+
+void CpuBlasCache::Release( uint aBlas ) {
+  if ( !myNeedsPins.load( std::memory_order_relaxed ) )
+    return;
+
+  ASSERT( myEntries[ aBlas ].myNumPins.load( std::memory_order_relaxed ) > 0u );
+  myEntries[ aBlas ].myNumPins.fetch_sub( 1u, std::memory_order_release );
+}
+
+CpuBlasCacheStats CpuBlasCache::GetStats() const {
+  CpuBlasCacheStats stats;
+  std::lock_guard< std::mutex > lock( myMutex );
+  stats.myNumLookups = SumLookups() - myNumLookupsAtReset;
+  stats.myNumPageIns = myNumPageIns;
+  stats.myNumEvictions = myNumEvictions;
+  stats.myPageInSize = myPageInSize;
+  stats.myPageInTimeMs = myPageInTimeMs;
+  stats.myResidentSize = myResidentSize;
+  stats.myPeakResidentSize = myPeakResidentSize;
+  stats.myBudget = myBudget.load( std::memory_order_relaxed );
+  stats.myTotalSize = myTotalSize;
+  stats.myNumBlas = myNumBlas;
+  stats.myNumResidentBlas = ( uint ) myResidentBlas.size();
+  return stats;
+}
+
+void CpuBlasCache::ResetStats() {
+  // The counters are never cleared, the threads that own them may still be counting
+  std::lock_guard< std::mutex > lock( myMutex );
+  myNumLookupsAtReset = SumLookups();
+  myNumPageIns = 0u;
+  myNumEvictions = 0u;
+  myPageInSize = 0u;
+  myPageInTimeMs = 0.0;
+  myPeakResidentSize = myResidentSize;
+}
+
+const CpuRtBlas * CpuBlasCache::PageIn( uint aBlas ) {
+  std::lock_guard< std::mutex > lock( myMutex );
+
+  // Another thread may have paged it in while this one waited for the lock
+  BlasEntry &       entry = myEntries[ aBlas ];
+  const CpuRtBlas * blas = entry.myBlas.load();
+  if ( blas != nullptr )
+    return blas;
+
+  const float64 startTime = SampleTimeMs();
+
+  // Evicting first keeps the peak at the budget, unless the pinned BLAS alone exceed it
+  const uint64 budget = myBudget.load( std::memory_order_relaxed );
+  EvictDownTo( budget > entry.mySize ? budget - entry.mySize : 0u );
+
+  // Init() validated the BLAS of all meshes, so the reads can't fail
+  UniquePtr< CpuRtBlas > residentBlas( new CpuRtBlas() );
+  SceneCacheReader       reader = entry.mySource;
+  reader.ReadVector( residentBlas->myBvh.myNodes );
+  reader.ReadVector( residentBlas->myBvh.myPrimitiveIndices );
+  const bool isValid = residentBlas->myTriangleStore.ReadCache( reader ) && !reader.HasFailed();
+  ASSERT( isValid );
+  ( void ) isValid;
+
+  blas = residentBlas.get();
+  entry.myResidentBlas = std::move( residentBlas );
+  entry.myLastUse.store( myUseClock.fetch_add( 1u, std::memory_order_relaxed ) + 1u, std::memory_order_relaxed );
+  entry.myBlas.store( blas );
+
+  myResidentBlas.push_back( aBlas );
+  myResidentSize += entry.mySize;
+  myPeakResidentSize = glm::max( myPeakResidentSize, myResidentSize );
+  ++myNumPageIns;
+  myPageInSize += entry.mySize;
+  myPageInTimeMs += SampleTimeMs() - startTime;
+  return blas;
+}
+
+bool CpuBlasCache::TryEvict( uint aBlas ) {
+  // Hides the BLAS before looking at the pins. A thread that pins it afterwards sees nullptr and waits for the lock,
+  // one that pinned it before keeps it resident.
+  BlasEntry &       entry = myEntries[ aBlas ];
+  const CpuRtBlas * blas = entry.myBlas.exchange( nullptr );
+  if ( entry.myNumPins.load() > 0u ) {
+    entry.myBlas.store( blas );
+    return false;
+  }
+
+  entry.myResidentBlas.reset();
+  myResidentSize -= entry.mySize;
+  ++myNumEvictions;
+  return true;
+}
+
+void CpuBlasCache::EvictDownTo( uint64 aResidentSize ) {
+  // Candidates in LRU order. Evictions only happen on page-ins, which read from the file, so sorting the few resident
+  // BLAS is cheap in comparison.
+  std::sort( myResidentBlas.begin(), myResidentBlas.end(), [ & ]( uint aLeft, uint aRight ) {
+    return myEntries[ aLeft ].myLastUse.load( std::memory_order_relaxed ) <
+           myEntries[ aRight ].myLastUse.load( std::memory_order_relaxed );
+  } );
+
+  uint numKept = 0u;
+  for ( uint i = 0u; i < ( uint ) myResidentBlas.size(); ++i ) {
+    const uint blas = myResidentBlas[ i ];
+    if ( myResidentSize <= aResidentSize || !TryEvict( blas ) )
+      myResidentBlas[ numKept++ ] = blas;
+  }
+  myResidentBlas.resize( numKept );
+}
+
+void CpuBlasCache::UpdateNeedsPins() {
+  // Without evictions no BLAS can disappear under a traversal
+  myNeedsPins.store( myBudget.load( std::memory_order_relaxed ) < myTotalSize, std::memory_order_relaxed );
+}
+
+void CpuBlasCache::CountLookup() {
+  using namespace Priv_CpuBlasCache;
+
+  // A plain increment on a cache line of this thread, instead of a locked one on a line that all threads share
+  const uint              counterIdx = GetLookupCounterIndex();
+  std::atomic< uint64 > & numLookups = myLookupCounters[ counterIdx ].myNumLookups;
+  if ( counterIdx < MAX_NUM_COUNTED_THREADS - 1u )
+    numLookups.store( numLookups.load( std::memory_order_relaxed ) + 1u, std::memory_order_relaxed );
+  else
+    numLookups.fetch_add( 1u, std::memory_order_relaxed );
+}
+
+uint64 CpuBlasCache::SumLookups() const {
+  uint64 numLookups = 0u;
+  for ( const LookupCounter & counter : myLookupCounters )
+    numLookups += counter.myNumLookups.load( std::memory_order_relaxed );
+  return numLookups;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/Ptr.h"
+#include "CpuBvh4.h"
+#include "CpuRtTriangleStore.h"
+#include "MappedFile.h"
+#include "SceneCache.h"
+
+using namespace Fancy;
+
+// Intersection data of up to CpuBvh4::MAX_PRIMITIVES triangles of a mesh, what CpuRtMesh::myBlas holds for scenes
+// that aren't streamed
+struct CpuRtBlas {
+  CpuBvh4            myBvh;
+  CpuRtTriangleStore myTriangleStore;  // In the order of myBvh.myPrimitiveIndices
+};
+
+// Lookups and page-ins since the last CpuBlasCache::ResetStats()
+struct CpuBlasCacheStats {
+  float GetHitRate() const {
+    return myNumLookups > 0u ? 1.0f - ( float ) myNumPageIns / ( float ) myNumLookups : 1.0f;
+  }
+
+  uint64  myNumLookups = 0u;    // Instances whose BLAS a ray traversed
+  uint64  myNumPageIns = 0u;    // Lookups that read the BLAS from the scene cache
+  uint64  myNumEvictions = 0u;  // BLAS dropped to make room for a page-in or a smaller budget
+  uint64  myPageInSize = 0u;    // Bytes read by the page-ins
+  float64 myPageInTimeMs = 0.0;  // Summed over the page-ins, including the evictions they triggered
+  uint64  myResidentSize = 0u;
+  uint64  myPeakResidentSize = 0u;
+  uint64  myBudget = 0u;
+  uint64  myTotalSize = 0u;  // Of the BLAS of all meshes
+  uint    myNumBlas = 0u;
+  uint    myNumResidentBlas = 0u;
+};
+
+// BLAS of a streamed CpuRtScene, indexed by CpuRtMesh::myFirstBlas. They stay in the mapped scene cache and are only
+// copied out when a ray reaches an instance of their mesh, up to a memory budget. The least recently used BLAS that no
+// thread is traversing makes room for the next one. A single BLAS larger than the budget is still paged in, the budget
+// is then exceeded until it is no longer in use. The shading streams of the meshes are not part of the budget, they
+// are read in place from the mapping and the OS pages them in and out.
+// Lookups of resident BLAS don't lock: a pin count per BLAS keeps the BLAS from being evicted while a thread traverses
+// it. When the budget covers the BLAS of all meshes nothing is ever evicted and the pins are skipped. Lookups are
+// counted per thread and only summed by GetStats(). Page-ins and evictions are serialized by one lock. The LRU order is
+// approximate, the uses are only ordered by the number of page-ins before them.
+class CpuBlasCache {
+public:
+  enum : uint64 { DEFAULT_BUDGET = 512ull * 1024u * 1024u };
+  enum : uint { MAX_NUM_COUNTED_THREADS = 256 };  // Lookups of further threads share one atomic counter
+
+  // The readers of SetSource() point into aFile, which is kept open for the lifetime of the cache
+  CpuBlasCache( const SharedPtr< MappedFile > & aFile, uint aNumBlas, uint64 aBudget );
+  ~CpuBlasCache();
+
+  // aReader is positioned where CpuRtScene::WriteCache() wrote the BVH of aBlas. aSize is the memory the BLAS takes
+  // once paged in. Not thread safe, all sources are set before the first Acquire().
+  void SetSource( uint aBlas, const SceneCacheReader & aReader, uint64 aSize );
+
+  uint64 GetSize( uint aBlas ) const {
+    return myEntries[ aBlas ].mySize;
+  }
+
+  // Evicts the BLAS that aren't in use until the resident ones fit into the new budget. Whether Acquire() pins
+  // depends on the budget, so it must not be called while a thread traverses a BLAS.
+  void   SetBudget( uint64 aBudget );
+  uint64 GetBudget() const {
+    return myBudget.load( std::memory_order_relaxed );
+  }
+
+  // Pins BLAS aBlas and pages it in if it isn't resident. Every call has to be matched by Release( aBlas ) once
+  // the traversal is done, the BLAS may be evicted afterwards.
+  const CpuRtBlas & Acquire( uint aBlas );
+  void              Release( uint aBlas );
+
+  CpuBlasCacheStats GetStats() const;
+  void              ResetStats();
+
+private:
+  // Only written by the thread it belongs to, except for the shared last one
+  struct alignas( 64 ) LookupCounter {
+    std::atomic< uint64 > myNumLookups { 0u };
+  };
+
+  struct alignas( 64 ) BlasEntry {
+    std::atomic< const CpuRtBlas * > myBlas { nullptr };  // Published once paged in, nullptr while not resident
+    std::atomic< uint >              myNumPins { 0u };
+    std::atomic< uint64 >            myLastUse { 0u };  // myUseClock of the last lookup
+    UniquePtr< CpuRtBlas >           myResidentBlas;    // Owns myBlas, only changed under myMutex
+    SceneCacheReader                 mySource;
+    uint64                           mySize = 0u;
+  };
+
+  const CpuRtBlas * PageIn( uint aBlas );
+  bool              TryEvict( uint aBlas );
+  void              EvictDownTo( uint64 aResidentSize );
+  void              UpdateNeedsPins();
+  void              CountLookup();
+  uint64            SumLookups() const;
+
+  SharedPtr< MappedFile >  myFile;
+  UniquePtr< BlasEntry[] > myEntries;
+  uint                     myNumBlas;
+  std::atomic< uint64 >    myBudget;
+  std::atomic< bool >      myNeedsPins { true };  // False while the budget covers myTotalSize
+  std::atomic< uint64 >    myUseClock { 0u };     // Advanced by every page-in
+  LookupCounter            myLookupCounters[ MAX_NUM_COUNTED_THREADS ];
+
+  mutable std::mutex    myMutex;
+  eastl::vector< uint > myResidentBlas;
+  uint64                myResidentSize = 0u;
+  uint64                myPeakResidentSize = 0u;
+  uint64                myTotalSize = 0u;
+  uint64                myNumLookupsAtReset = 0u;  // SumLookups() at the last ResetStats()
+  uint64                myNumPageIns = 0u;
+  uint64                myNumEvictions = 0u;
+  uint64                myPageInSize = 0u;
+  float64               myPageInTimeMs = 0.0;
+};
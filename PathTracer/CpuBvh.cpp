@@ -0,0 +1,372 @@
+#include "CpuBvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <EASTL/fixed_vector.h>
+
+#include "CpuThreadPool.h"
+#include "LinearAllocator.h"
+#include "Timing.h"
+
+namespace Priv_CpuBvh {
+  // Relative cost of one traversal step compared to one primitive intersection
+  const float TRAVERSAL_COST = 1.0f;
+
+  // Nodes with more primitives than this are binned by all threads of the pool
+  const uint PARALLEL_BINNING_MIN_PRIMITIVES = 64u * 1024u;
+  const uint PARALLEL_BINNING_CHUNK_SIZE = 16u * 1024u;
+
+  // Subtrees smaller than this are never split up further between threads
+  const uint SUBTREE_TASK_MIN_PRIMITIVES = 1024u;
+
+  struct RangeBounds {
+    void Grow( const RangeBounds & someBounds ) {
+      myBounds.Grow( someBounds.myBounds );
+      myCentroidBounds.Grow( someBounds.myCentroidBounds );
+    }
+
+    CpuAabb myBounds;
+    CpuAabb myCentroidBounds;
+  };
+
+  struct SahBins {
+    void Grow( const SahBins & someBins ) {
+      for ( uint axis = 0u; axis < 3u; ++axis ) {
+        for ( uint i = 0u; i < CpuBvh::NUM_SAH_BINS; ++i ) {
+          myBounds[ axis ][ i ].Grow( someBins.myBounds[ axis ][ i ] );
+          myCounts[ axis ][ i ] += someBins.myCounts[ axis ][ i ];
+        }
+      }
+    }
+
+    CpuAabb myBounds[ 3 ][ CpuBvh::NUM_SAH_BINS ];
+    uint    myCounts[ 3 ][ CpuBvh::NUM_SAH_BINS ] = {};
+  };
+
+  struct SplitResult {
+    float myCost = FLT_MAX;
+    uint  myAxis = UINT_MAX;
+    uint  myBinIdx = 0u;  // Primitives in bins [0, myBinIdx) go to the left child
+  };
+
+  uint GetBinIdx( const glm::float3 & aCentroid, uint anAxis, const CpuAabb & someCentroidBounds ) {
+    const float extent = someCentroidBounds.myMax[ anAxis ] - someCentroidBounds.myMin[ anAxis ];
+    const float relPos = ( aCentroid[ anAxis ] - someCentroidBounds.myMin[ anAxis ] ) / extent;
+    return glm::min( ( uint ) ( relPos * ( float ) CpuBvh::NUM_SAH_BINS ), ( uint ) CpuBvh::NUM_SAH_BINS - 1u );
+  }
+
+  void ComputeRangeBounds( const CpuAabb * somePrimBounds, const glm::float3 * someCentroids,
+                           const uint * someIndices, uint aBegin, uint anEnd, RangeBounds & aResultOut ) {
+    for ( uint i = aBegin; i < anEnd; ++i ) {
+      const uint primIdx = someIndices[ i ];
+      aResultOut.myBounds.Grow( somePrimBounds[ primIdx ] );
+      aResultOut.myCentroidBounds.Grow( someCentroids[ primIdx ] );
+    }
+  }
+
+  void BinRange( const CpuAabb * somePrimBounds, const glm::float3 * someCentroids, const uint * someIndices,
+                 uint aBegin, uint anEnd, const CpuAabb & someCentroidBounds, SahBins & someBinsOut ) {
+    const glm::float3 extent = someCentroidBounds.GetExtent();
+    for ( uint i = aBegin; i < anEnd; ++i ) {
+      const uint primIdx = someIndices[ i ];
+      for ( uint axis = 0u; axis < 3u; ++axis ) {
+        if ( extent[ axis ] <= 0.0f )
+          continue;
+
+        const uint binIdx = GetBinIdx( someCentroids[ primIdx ], axis, someCentroidBounds );
+        someBinsOut.myBounds[ axis ][ binIdx ].Grow( somePrimBounds[ primIdx ] );
+        someBinsOut.myCounts[ axis ][ binIdx ]++;
+      }
+    }
+  }
+
+  // Sweeps the bin boundaries of all axes and returns the one with the lowest SA(L)*N(L) + SA(R)*N(R)
+  SplitResult FindBestSplit( const SahBins & someBins, const CpuAabb & someCentroidBounds ) {
+    const uint        numBins = CpuBvh::NUM_SAH_BINS;
+    const glm::float3 extent = someCentroidBounds.GetExtent();
+
+    SplitResult result;
+    for ( uint axis = 0u; axis < 3u; ++axis ) {
+      if ( extent[ axis ] <= 0.0f )
+        continue;
+
+      float   leftAreas[ numBins ];
+      uint    leftCounts[ numBins ];
+      CpuAabb leftBounds;
+      uint    leftCount = 0u;
+      for ( uint i = 0u; i < numBins; ++i ) {
+        leftBounds.Grow( someBins.myBounds[ axis ][ i ] );
+        leftCount += someBins.myCounts[ axis ][ i ];
+        leftAreas[ i ] = leftBounds.GetSurfaceArea();
+        leftCounts[ i ] = leftCount;
+      }
+
+      CpuAabb rightBounds;
+      uint    rightCount = 0u;
+      for ( uint i = numBins - 1u; i > 0u; --i ) {
+        rightBounds.Grow( someBins.myBounds[ axis ][ i ] );
+        rightCount += someBins.myCounts[ axis ][ i ];
+        if ( rightCount == 0u || leftCounts[ i - 1u ] == 0u )
+          continue;
+
+        const float cost =
+            leftAreas[ i - 1u ] * ( float ) leftCounts[ i - 1u ] + rightBounds.GetSurfaceArea() * ( float ) rightCount;
+        if ( cost < result.myCost ) {
+          result.myCost = cost;
+          result.myAxis = axis;
+          result.myBinIdx = i;
+        }
+      }
+    }
+
+    return result;
+  }
+}  // namespace Priv_CpuBvh
+
+struct CpuBvh::BuildContext {
+  explicit BuildContext( const LinearEastlAllocator & anAllocator ) : myCentroids( anAllocator ) {}
+
+  const CpuAabb *             myPrimBounds = nullptr;
+  LinearVector< glm::float3 > myCentroids;
+  std::atomic< uint >         myNumAllocatedNodes;
+};
+
+void CpuBvhBuildStats::Accumulate( const CpuBvhBuildStats & someStats ) {
+  myBuildTimeMs += someStats.myBuildTimeMs;
+  myMemorySize += someStats.myMemorySize;
+  myNumPrimitives += someStats.myNumPrimitives;
+  myNumNodes += someStats.myNumNodes;
+  myNumLeaves += someStats.myNumLeaves;
+  myMaxLeafSize = glm::max( myMaxLeafSize, someStats.myMaxLeafSize );
+  myMaxDepth = glm::max( myMaxDepth, someStats.myMaxDepth );
+  mySahCost += someStats.mySahCost;
+}
+
+void CpuBvh::Build( const CpuAabb * somePrimBounds, uint aNumPrimitives, CpuThreadPool * aThreadPool,
+                    LinearAllocator * aScratch ) {
+  using namespace Priv_CpuBvh;
+
+  const float64 startTime = SampleTimeMs();
+
+  myNodes.clear();
+  myPrimitiveIndices.clear();
+  myStats = CpuBvhBuildStats();
+
+  if ( aNumPrimitives == 0u )
+    return;
+
+  const LinearEastlAllocator scratchAllocator( aScratch );
+  BuildContext               context( scratchAllocator );
+  context.myPrimBounds = somePrimBounds;
+  context.myCentroids.resize( aNumPrimitives );
+  for ( uint i = 0u; i < aNumPrimitives; ++i )
+    context.myCentroids[ i ] = somePrimBounds[ i ].GetCenter();
+
+  myPrimitiveIndices.resize( aNumPrimitives );
+  for ( uint i = 0u; i < aNumPrimitives; ++i )
+    myPrimitiveIndices[ i ] = i;
+
+  // A binary tree with at least one primitive per leaf never has more than 2N-1 nodes
+  myNodes.resize( aNumPrimitives * 2u - 1u );
+  context.myNumAllocatedNodes = 1u;
+
+  const BuildTask rootTask = { 0u, 0u, aNumPrimitives, 0u };
+
+  // Top-down: split the upper levels on this thread with parallel binning until there are enough independent
+  // subtrees to keep all threads busy, then build these subtrees in parallel.
+  LinearVector< BuildTask > subtreeTasks( scratchAllocator );
+  if ( aThreadPool != nullptr && aThreadPool->GetNumThreads() > 1u ) {
+    const uint subtreeMaxPrimitives =
+        glm::max( SUBTREE_TASK_MIN_PRIMITIVES, aNumPrimitives / ( aThreadPool->GetNumThreads() * 4u ) );
+
+    LinearVector< BuildTask > pendingTasks( scratchAllocator );
+    pendingTasks.push_back( rootTask );
+    while ( !pendingTasks.empty() ) {
+      const BuildTask task = pendingTasks.back();
+      pendingTasks.pop_back();
+
+      if ( task.myEnd - task.myBegin <= subtreeMaxPrimitives ) {
+        subtreeTasks.push_back( task );
+        continue;
+      }
+
+      BuildTask leftTask;
+      BuildTask rightTask;
+      if ( SplitNode( context, task, aThreadPool, leftTask, rightTask ) ) {
+        pendingTasks.push_back( leftTask );
+        pendingTasks.push_back( rightTask );
+      }
+    }
+
+    aThreadPool->ParallelFor( ( uint ) subtreeTasks.size(), [ & ]( uint anItemIdx, uint /*aThreadIdx*/ ) {
+      BuildSubtree( context, subtreeTasks[ anItemIdx ] );
+    } );
+  } else {
+    BuildSubtree( context, rootTask );
+  }
+
+  myNodes.resize( context.myNumAllocatedNodes.load() );
+  GatherStats();
+  myStats.myMemorySize = GetMemorySize();
+  myStats.myBuildTimeMs = SampleTimeMs() - startTime;
+}
+
+void CpuBvh::Refit( const CpuAabb * somePrimBounds ) {
+  const float64 startTime = SampleTimeMs();
+
+  // The children of a node are always allocated after it, so walking the nodes backwards refits the children first
+  for ( uint i = ( uint ) myNodes.size(); i > 0u; --i ) {
+    CpuBvhNode & node = myNodes[ i - 1u ];
+    node.myBounds = CpuAabb();
+    if ( node.IsLeaf() ) {
+      const uint end = node.myLeftChildOrFirstPrimitive + node.myNumPrimitives;
+      for ( uint iPrim = node.myLeftChildOrFirstPrimitive; iPrim < end; ++iPrim )
+        node.myBounds.Grow( somePrimBounds[ myPrimitiveIndices[ iPrim ] ] );
+    } else {
+      node.myBounds.Grow( myNodes[ node.myLeftChildOrFirstPrimitive ].myBounds );
+      node.myBounds.Grow( myNodes[ node.myLeftChildOrFirstPrimitive + 1u ].myBounds );
+    }
+  }
+
+  myStats = CpuBvhBuildStats();
+  GatherStats();
+  myStats.myMemorySize = GetMemorySize();
+  myStats.myBuildTimeMs = SampleTimeMs() - startTime;
+}
+
+uint64 CpuBvh::GetMemorySize() const {
+  return myNodes.size() * sizeof( CpuBvhNode ) + myPrimitiveIndices.size() * sizeof( uint );
+}
+
+bool CpuBvh::SplitNode( BuildContext & aContext, const BuildTask & aTask, CpuThreadPool * aThreadPool,
+                        BuildTask & aLeftOut, BuildTask & aRightOut ) {
+  using namespace Priv_CpuBvh;
+
+  const uint          numPrims = aTask.myEnd - aTask.myBegin;
+  const CpuAabb *     primBounds = aContext.myPrimBounds;
+  const glm::float3 * centroids = aContext.myCentroids.data();
+  uint *              indices = myPrimitiveIndices.data();
+
+  const bool parallel = aThreadPool != nullptr && numPrims >= PARALLEL_BINNING_MIN_PRIMITIVES;
+  const uint numChunks = ( numPrims + PARALLEL_BINNING_CHUNK_SIZE - 1u ) / PARALLEL_BINNING_CHUNK_SIZE;
+
+  RangeBounds rangeBounds;
+  if ( parallel ) {
+    eastl::vector< RangeBounds > chunkBounds( numChunks );
+    aThreadPool->ParallelFor( numChunks, [ & ]( uint aChunkIdx, uint /*aThreadIdx*/ ) {
+      const uint begin = aTask.myBegin + aChunkIdx * PARALLEL_BINNING_CHUNK_SIZE;
+      const uint end = glm::min( begin + PARALLEL_BINNING_CHUNK_SIZE, aTask.myEnd );
+      ComputeRangeBounds( primBounds, centroids, indices, begin, end, chunkBounds[ aChunkIdx ] );
+    } );
+    for ( const RangeBounds & bounds : chunkBounds )
+      rangeBounds.Grow( bounds );
+  } else {
+    ComputeRangeBounds( primBounds, centroids, indices, aTask.myBegin, aTask.myEnd, rangeBounds );
+  }
+
+  CpuBvhNode & node = myNodes[ aTask.myNodeIdx ];
+  node.myBounds = rangeBounds.myBounds;
+  node.myLeftChildOrFirstPrimitive = aTask.myBegin;
+  node.myNumPrimitives = numPrims;
+
+  // Keep one slot of the traversal stack free for the sibling of the deepest node
+  if ( numPrims <= 1u || aTask.myDepth + 2u >= MAX_TRAVERSAL_DEPTH )
+    return false;
+
+  SahBins bins;
+  if ( parallel ) {
+    eastl::vector< SahBins > chunkBins( numChunks );
+    aThreadPool->ParallelFor( numChunks, [ & ]( uint aChunkIdx, uint /*aThreadIdx*/ ) {
+      const uint begin = aTask.myBegin + aChunkIdx * PARALLEL_BINNING_CHUNK_SIZE;
+      const uint end = glm::min( begin + PARALLEL_BINNING_CHUNK_SIZE, aTask.myEnd );
+      BinRange( primBounds, centroids, indices, begin, end, rangeBounds.myCentroidBounds, chunkBins[ aChunkIdx ] );
+    } );
+    for ( const SahBins & chunk : chunkBins )
+      bins.Grow( chunk );
+  } else {
+    BinRange( primBounds, centroids, indices, aTask.myBegin, aTask.myEnd, rangeBounds.myCentroidBounds, bins );
+  }
+
+  const SplitResult split = FindBestSplit( bins, rangeBounds.myCentroidBounds );
+
+  uint mid;
+  if ( split.myAxis == UINT_MAX ) {
+    // All centroids coincide, SAH can't separate them. Split by count if there are too many for one leaf.
+    if ( numPrims <= MAX_LEAF_SIZE )
+      return false;
+
+    mid = aTask.myBegin + numPrims / 2u;
+  } else {
+    const float nodeArea = rangeBounds.myBounds.GetSurfaceArea();
+    const float leafCost = ( float ) numPrims;
+    const float splitCost = nodeArea > 0.0f ? TRAVERSAL_COST + split.myCost / nodeArea : leafCost;
+    if ( splitCost >= leafCost && numPrims <= MAX_LEAF_SIZE )
+      return false;
+
+    const CpuAabb centroidBounds = rangeBounds.myCentroidBounds;
+    const uint *  midPtr = std::partition( indices + aTask.myBegin, indices + aTask.myEnd, [ & ]( uint aPrimIdx ) {
+      return GetBinIdx( centroids[ aPrimIdx ], split.myAxis, centroidBounds ) < split.myBinIdx;
+    } );
+    ASSERT( midPtr != indices + aTask.myBegin && midPtr != indices + aTask.myEnd );
+    mid = ( uint ) ( midPtr - indices );
+  }
+
+  const uint leftIdx = aContext.myNumAllocatedNodes.fetch_add( 2u );
+  ASSERT( leftIdx + 1u < ( uint ) myNodes.size() );
+
+  node.myLeftChildOrFirstPrimitive = leftIdx;
+  node.myNumPrimitives = 0u;
+
+  aLeftOut = { leftIdx, aTask.myBegin, mid, aTask.myDepth + 1u };
+  aRightOut = { leftIdx + 1u, mid, aTask.myEnd, aTask.myDepth + 1u };
+  return true;
+}
+
+void CpuBvh::BuildSubtree( BuildContext & aContext, const BuildTask & aTask ) {
+  eastl::fixed_vector< BuildTask, MAX_TRAVERSAL_DEPTH * 2 > stack;
+  stack.push_back( aTask );
+  while ( !stack.empty() ) {
+    const BuildTask task = stack.back();
+    stack.pop_back();
+
+    BuildTask leftTask;
+    BuildTask rightTask;
+    if ( SplitNode( aContext, task, nullptr, leftTask, rightTask ) ) {
+      stack.push_back( rightTask );
+      stack.push_back( leftTask );
+    }
+  }
+}
+
+void CpuBvh::GatherStats() {
+  using namespace Priv_CpuBvh;
+
+  myStats.myNumPrimitives = ( uint ) myPrimitiveIndices.size();
+  myStats.myNumNodes = ( uint ) myNodes.size();
+  if ( myNodes.empty() )
+    return;
+
+  const float rootArea = myNodes[ 0 ].myBounds.GetSurfaceArea();
+  const float invRootArea = rootArea > 0.0f ? 1.0f / rootArea : 0.0f;
+
+  eastl::fixed_vector< glm::uvec2, MAX_TRAVERSAL_DEPTH * 2 > stack;  // Node index, depth
+  stack.push_back( glm::uvec2( 0u, 1u ) );
+  while ( !stack.empty() ) {
+    const glm::uvec2 entry = stack.back();
+    stack.pop_back();
+
+    const CpuBvhNode & node = myNodes[ entry.x ];
+    const float        relArea = node.myBounds.GetSurfaceArea() * invRootArea;
+    myStats.myMaxDepth = glm::max( myStats.myMaxDepth, entry.y );
+
+    if ( node.IsLeaf() ) {
+      myStats.myNumLeaves++;
+      myStats.myMaxLeafSize = glm::max( myStats.myMaxLeafSize, node.myNumPrimitives );
+      myStats.mySahCost += relArea * ( float ) node.myNumPrimitives;
+    } else {
+      myStats.mySahCost += relArea * TRAVERSAL_COST;
+      stack.push_back( glm::uvec2( node.myLeftChildOrFirstPrimitive, entry.y + 1u ) );
+      stack.push_back( glm::uvec2( node.myLeftChildOrFirstPrimitive + 1u, entry.y + 1u ) );
+    }
+  }
+}
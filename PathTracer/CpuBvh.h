@@ -0,0 +1,185 @@
+#pragma once
+
+#include <float.h>
+#include <limits.h>
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+
+class CpuThreadPool;
+class LinearAllocator;
+
+struct CpuAabb {
+  void Grow( const glm::float3 & aPoint ) {
+    myMin = glm::min( myMin, aPoint );
+    myMax = glm::max( myMax, aPoint );
+  }
+  void Grow( const CpuAabb & anAabb ) {
+    myMin = glm::min( myMin, anAabb.myMin );
+    myMax = glm::max( myMax, anAabb.myMax );
+  }
+  bool IsValid() const {
+    return myMin.x <= myMax.x && myMin.y <= myMax.y && myMin.z <= myMax.z;
+  }
+  glm::float3 GetCenter() const {
+    return ( myMin + myMax ) * 0.5f;
+  }
+  glm::float3 GetExtent() const {
+    return myMax - myMin;
+  }
+  float GetSurfaceArea() const {
+    const glm::float3 e = glm::max( myMax - myMin, glm::float3( 0.0f ) );
+    return 2.0f * ( e.x * e.y + e.y * e.z + e.z * e.x );
+  }
+
+  glm::float3 myMin = glm::float3( FLT_MAX );
+  glm::float3 myMax = glm::float3( -FLT_MAX );
+};
+
+// Binary BVH node. Inner nodes store the index of their left child, the right child is always stored next to it.
+struct CpuBvhNode {
+  bool IsLeaf() const {
+    return myNumPrimitives != 0u;
+  }
+
+  CpuAabb myBounds;
+  uint    myLeftChildOrFirstPrimitive = 0u;
+  uint    myNumPrimitives = 0u;
+};
+
+struct CpuBvhBuildStats {
+  void Accumulate( const CpuBvhBuildStats & someStats );
+
+  float64 myBuildTimeMs = 0.0;
+  uint64  myMemorySize = 0u;
+  uint    myNumPrimitives = 0u;
+  uint    myNumNodes = 0u;
+  uint    myNumLeaves = 0u;
+  uint    myMaxLeafSize = 0u;
+  uint    myMaxDepth = 0u;
+  float   mySahCost = 0.0f;
+};
+
+// Binned SAH BVH over a set of primitive bounds. Used both as BLAS (over the triangles of one mesh) and as TLAS
+// (over the world bounds of all instances), following the BLAS-per-MeshData / TLAS-per-SceneMeshInstance split of
+// InitRtScene.
+class CpuBvh {
+public:
+  enum {
+    NUM_SAH_BINS = 16,
+    MAX_LEAF_SIZE = 8,
+    MAX_TRAVERSAL_DEPTH = 64,
+  };
+
+  // Builds the tree over somePrimBounds. If aThreadPool is set, the binning of large nodes and the construction of
+  // independent subtrees are spread over its threads. Must not be called from within a job of aThreadPool. The
+  // temporaries of the build come from aScratch if it is set, the caller resets it.
+  void Build( const CpuAabb * somePrimBounds, uint aNumPrimitives, CpuThreadPool * aThreadPool,
+              LinearAllocator * aScratch = nullptr );
+
+  // Recomputes the node bounds from the new bounds of the same primitives, keeping the topology of the last build.
+  // Much cheaper than a build, but the tree gets worse the further the primitives moved. Updates the stats, with the
+  // time of the refit as the build time.
+  void Refit( const CpuAabb * somePrimBounds );
+
+  // Visits all leaves whose bounds intersect the ray segment [aTMin, aTMaxInOut], nearest child first.
+  // aLeafFunc( aPrimitiveIdx, aTMaxInOut ) returns true if it found a hit and may shorten aTMaxInOut.
+  // With anAnyHit set the traversal stops at the first hit.
+  template < class LeafFuncT >
+  bool Traverse( const glm::float3 & anOrigin, const glm::float3 & anInvDir, float aTMin, float & aTMaxInOut,
+                 bool anAnyHit, LeafFuncT & aLeafFunc ) const;
+
+  const CpuBvhBuildStats & GetStats() const {
+    return myStats;
+  }
+
+  uint64 GetMemorySize() const;
+
+  eastl::vector< CpuBvhNode > myNodes;
+  eastl::vector< uint >       myPrimitiveIndices;  // Leaf primitive ranges index into this list
+
+private:
+  struct BuildContext;
+
+  struct BuildTask {
+    uint myNodeIdx;
+    uint myBegin;
+    uint myEnd;
+    uint myDepth;
+  };
+
+  bool SplitNode( BuildContext & aContext, const BuildTask & aTask, CpuThreadPool * aThreadPool,
+                  BuildTask & aLeftOut, BuildTask & aRightOut );
+  void BuildSubtree( BuildContext & aContext, const BuildTask & aTask );
+  void GatherStats();
+
+  CpuBvhBuildStats myStats;
+};
+
+inline float IntersectAabbDistance( const CpuAabb & anAabb, const glm::float3 & anOrigin, const glm::float3 & anInvDir,
+                                    float aTMin, float aTMax ) {
+  const glm::float3 t0 = ( anAabb.myMin - anOrigin ) * anInvDir;
+  const glm::float3 t1 = ( anAabb.myMax - anOrigin ) * anInvDir;
+  const glm::float3 tNear = glm::min( t0, t1 );
+  const glm::float3 tFar = glm::max( t0, t1 );
+  const float       tEnter = glm::max( glm::max( tNear.x, tNear.y ), glm::max( tNear.z, aTMin ) );
+  const float       tExit = glm::min( glm::min( tFar.x, tFar.y ), glm::min( tFar.z, aTMax ) );
+  return tEnter <= tExit ? tEnter : FLT_MAX;
+}
+
+template < class LeafFuncT >
+bool CpuBvh::Traverse( const glm::float3 & anOrigin, const glm::float3 & anInvDir, float aTMin, float & aTMaxInOut,
+                       bool anAnyHit, LeafFuncT & aLeafFunc ) const {
+  if ( myNodes.empty() )
+    return false;
+
+  if ( IntersectAabbDistance( myNodes[ 0 ].myBounds, anOrigin, anInvDir, aTMin, aTMaxInOut ) == FLT_MAX )
+    return false;
+
+  uint stack[ MAX_TRAVERSAL_DEPTH ];
+  uint stackSize = 0u;
+  uint nodeIdx = 0u;
+  bool hasHit = false;
+
+  while ( true ) {
+    const CpuBvhNode & node = myNodes[ nodeIdx ];
+    if ( node.IsLeaf() ) {
+      const uint primEnd = node.myLeftChildOrFirstPrimitive + node.myNumPrimitives;
+      for ( uint i = node.myLeftChildOrFirstPrimitive; i < primEnd; ++i ) {
+        if ( aLeafFunc( myPrimitiveIndices[ i ], aTMaxInOut ) ) {
+          hasHit = true;
+          if ( anAnyHit )
+            return true;
+        }
+      }
+    } else {
+      const uint  leftIdx = node.myLeftChildOrFirstPrimitive;
+      const float tLeft = IntersectAabbDistance( myNodes[ leftIdx ].myBounds, anOrigin, anInvDir, aTMin, aTMaxInOut );
+      const float tRight =
+          IntersectAabbDistance( myNodes[ leftIdx + 1u ].myBounds, anOrigin, anInvDir, aTMin, aTMaxInOut );
+
+      if ( tLeft != FLT_MAX && tRight != FLT_MAX ) {
+        ASSERT( stackSize < MAX_TRAVERSAL_DEPTH );
+        const bool leftFirst = tLeft <= tRight;
+        stack[ stackSize++ ] = leftFirst ? leftIdx + 1u : leftIdx;
+        nodeIdx = leftFirst ? leftIdx : leftIdx + 1u;
+        continue;
+      }
+      if ( tLeft != FLT_MAX ) {
+        nodeIdx = leftIdx;
+        continue;
+      }
+      if ( tRight != FLT_MAX ) {
+        nodeIdx = leftIdx + 1u;
+        continue;
+      }
+    }
+
+    if ( stackSize == 0u )
+      break;
+    nodeIdx = stack[ --stackSize ];
+  }
+
+  return hasHit;
+}
@@ -0,0 +1,152 @@
+#include "CpuBvh4.h"
+
+#include <EASTL/fixed_vector.h>
+
+namespace Priv_CpuBvh4 {
+  struct CollapseTask {
+    uint myBinaryNodeIdx;
+    uint myWideNodeIdx;
+  };
+
+  uint8 QuantizeMin( float aValue, float anOrigin, float aScale, float anInvScale ) {
+    int q = glm::clamp( ( int ) floorf( ( aValue - anOrigin ) * anInvScale ), 0, 255 );
+    while ( q > 0 && anOrigin + ( float ) q * aScale > aValue )
+      --q;
+    return ( uint8 ) q;
+  }
+
+  uint8 QuantizeMax( float aValue, float anOrigin, float aScale, float anInvScale ) {
+    int q = glm::clamp( ( int ) ceilf( ( aValue - anOrigin ) * anInvScale ), 0, 255 );
+    while ( q < 255 && anOrigin + ( float ) q * aScale < aValue )
+      ++q;
+    return ( uint8 ) q;
+  }
+
+  void InitNode( CpuBvh4Node & aNode, const CpuAabb & someBounds ) {
+    // The small margin keeps origin + 255 * scale above the max bound despite float rounding
+    aNode.myOrigin = someBounds.myMin;
+    aNode.myScale = glm::max( someBounds.GetExtent(), glm::float3( 0.0f ) ) * ( 1.0001f / 255.0f );
+    for ( uint i = 0u; i < 4u; ++i ) {
+      aNode.myMinX[ i ] = aNode.myMinY[ i ] = aNode.myMinZ[ i ] = 0u;
+      aNode.myMaxX[ i ] = aNode.myMaxY[ i ] = aNode.myMaxZ[ i ] = 0u;
+      aNode.myChildren[ i ] = CpuBvh4Node::EMPTY_CHILD;
+    }
+  }
+}  // namespace Priv_CpuBvh4
+
+bool CpuBvh4::Build( const CpuBvh & aBinaryBvh ) {
+  using namespace Priv_CpuBvh4;
+
+  myNodes.clear();
+  myPrimitiveIndices.clear();
+  if ( aBinaryBvh.myPrimitiveIndices.size() > MAX_PRIMITIVES )
+    return false;
+
+  myPrimitiveIndices = aBinaryBvh.myPrimitiveIndices;
+  if ( aBinaryBvh.myNodes.empty() )
+    return true;
+
+  // Every wide node consumes at least one binary inner node, so this is an upper bound unless leaves are split
+  myNodes.reserve( aBinaryBvh.myNodes.size() / 2u + 1u );
+
+  const CpuBvhNode & binaryRoot = aBinaryBvh.myNodes[ 0 ];
+  InitNode( myNodes.push_back(), binaryRoot.myBounds );
+
+  if ( binaryRoot.IsLeaf() ) {
+    SetLeafChild( 0u, 0u, binaryRoot.myBounds, binaryRoot.myLeftChildOrFirstPrimitive, binaryRoot.myNumPrimitives,
+                  0u );
+    return true;
+  }
+
+  eastl::fixed_vector< CollapseTask, CpuBvh::MAX_TRAVERSAL_DEPTH * 3 > tasks;
+  tasks.push_back( { 0u, 0u } );
+  while ( !tasks.empty() ) {
+    const CollapseTask task = tasks.back();
+    tasks.pop_back();
+
+    // Open up the inner child with the largest surface area until there are four children. This pulls the
+    // grandchildren that are most likely to be hit up into the same cache line.
+    const CpuBvhNode & binaryNode = aBinaryBvh.myNodes[ task.myBinaryNodeIdx ];
+    uint               children[ 4 ] = { binaryNode.myLeftChildOrFirstPrimitive,
+                                         binaryNode.myLeftChildOrFirstPrimitive + 1u };
+    uint               numChildren = 2u;
+    while ( numChildren < 4u ) {
+      uint  bestChild = UINT_MAX;
+      float bestArea = -1.0f;
+      for ( uint i = 0u; i < numChildren; ++i ) {
+        const CpuBvhNode & child = aBinaryBvh.myNodes[ children[ i ] ];
+        const float        area = child.myBounds.GetSurfaceArea();
+        if ( !child.IsLeaf() && area > bestArea ) {
+          bestArea = area;
+          bestChild = i;
+        }
+      }
+
+      if ( bestChild == UINT_MAX )
+        break;
+
+      const uint openedNodeIdx = children[ bestChild ];
+      children[ bestChild ] = aBinaryBvh.myNodes[ openedNodeIdx ].myLeftChildOrFirstPrimitive;
+      children[ numChildren++ ] = aBinaryBvh.myNodes[ openedNodeIdx ].myLeftChildOrFirstPrimitive + 1u;
+    }
+
+    for ( uint i = 0u; i < numChildren; ++i ) {
+      const CpuBvhNode & child = aBinaryBvh.myNodes[ children[ i ] ];
+      if ( child.IsLeaf() ) {
+        SetLeafChild( task.myWideNodeIdx, i, child.myBounds, child.myLeftChildOrFirstPrimitive,
+                      child.myNumPrimitives, 0u );
+      } else {
+        const uint wideChildIdx = ( uint ) myNodes.size();
+        InitNode( myNodes.push_back(), child.myBounds );
+        SetChild( task.myWideNodeIdx, i, child.myBounds, wideChildIdx );
+        tasks.push_back( { children[ i ], wideChildIdx } );
+      }
+    }
+  }
+  return true;
+}
+
+uint64 CpuBvh4::GetMemorySize() const {
+  return myNodes.size() * sizeof( CpuBvh4Node ) + myPrimitiveIndices.size() * sizeof( uint );
+}
+
+void CpuBvh4::SetChild( uint aNodeIdx, uint aChildIdx, const CpuAabb & someBounds, uint aChildRef ) {
+  using namespace Priv_CpuBvh4;
+
+  CpuBvh4Node &     node = myNodes[ aNodeIdx ];
+  const glm::float3 invScale( node.myScale.x > 0.0f ? 1.0f / node.myScale.x : 0.0f,
+                              node.myScale.y > 0.0f ? 1.0f / node.myScale.y : 0.0f,
+                              node.myScale.z > 0.0f ? 1.0f / node.myScale.z : 0.0f );
+
+  node.myMinX[ aChildIdx ] = QuantizeMin( someBounds.myMin.x, node.myOrigin.x, node.myScale.x, invScale.x );
+  node.myMinY[ aChildIdx ] = QuantizeMin( someBounds.myMin.y, node.myOrigin.y, node.myScale.y, invScale.y );
+  node.myMinZ[ aChildIdx ] = QuantizeMin( someBounds.myMin.z, node.myOrigin.z, node.myScale.z, invScale.z );
+  node.myMaxX[ aChildIdx ] = QuantizeMax( someBounds.myMax.x, node.myOrigin.x, node.myScale.x, invScale.x );
+  node.myMaxY[ aChildIdx ] = QuantizeMax( someBounds.myMax.y, node.myOrigin.y, node.myScale.y, invScale.y );
+  node.myMaxZ[ aChildIdx ] = QuantizeMax( someBounds.myMax.z, node.myOrigin.z, node.myScale.z, invScale.z );
+  node.myChildren[ aChildIdx ] = aChildRef;
+}
+
+void CpuBvh4::SetLeafChild( uint aNodeIdx, uint aChildIdx, const CpuAabb & someBounds, uint aFirstPrimitive,
+                            uint aNumPrimitives, uint aSplitDepth ) {
+  using namespace Priv_CpuBvh4;
+
+  if ( aNumPrimitives <= CpuBvh4Node::LEAF_COUNT_MASK ) {
+    SetChild( aNodeIdx, aChildIdx, someBounds,
+              CpuBvh4Node::LEAF_FLAG | ( aNumPrimitives << CpuBvh4Node::LEAF_COUNT_SHIFT ) | aFirstPrimitive );
+    return;
+  }
+
+  // Only the leaves the binary build forces at its depth limit get this large. The primitive bounds are gone by now,
+  // so the four parts of the range all keep the bounds of the whole leaf.
+  ASSERT( aSplitDepth < MAX_LEAF_SPLIT_DEPTH );
+  const uint splitNodeIdx = ( uint ) myNodes.size();
+  InitNode( myNodes.push_back(), someBounds );
+  SetChild( aNodeIdx, aChildIdx, someBounds, splitNodeIdx );
+
+  const uint partSize = ( aNumPrimitives + 3u ) / 4u;
+  for ( uint i = 0u; i < 4u && i * partSize < aNumPrimitives; ++i ) {
+    SetLeafChild( splitNodeIdx, i, someBounds, aFirstPrimitive + i * partSize,
+                  glm::min( partSize, aNumPrimitives - i * partSize ), aSplitDepth + 1u );
+  }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "CpuBvh.h"
+
+// 4-wide BVH node that fills exactly one cache line. The child bounds are quantized to 8 bits relative to the node
+// bounds (myOrigin + q * myScale) and conservatively rounded outwards.
+struct alignas( 64 ) CpuBvh4Node {
+  enum : uint {
+    EMPTY_CHILD = 0xFFFFFFFFu,
+    LEAF_FLAG = 0x80000000u,
+    LEAF_COUNT_SHIFT = 24u,
+    LEAF_COUNT_MASK = 0x7Fu,
+    LEAF_FIRST_PRIMITIVE_MASK = 0x00FFFFFFu,
+  };
+
+  static bool IsLeaf( uint aChildRef ) {
+    return ( aChildRef & LEAF_FLAG ) != 0u;
+  }
+
+  static uint GetLeafFirstPrimitive( uint aChildRef ) {
+    return aChildRef & LEAF_FIRST_PRIMITIVE_MASK;
+  }
+
+  static uint GetLeafNumPrimitives( uint aChildRef ) {
+    return ( aChildRef >> LEAF_COUNT_SHIFT ) & LEAF_COUNT_MASK;
+  }
+
+  CpuAabb GetChildBounds( uint aChildIdx ) const {
+    CpuAabb bounds;
+    bounds.myMin = myOrigin + glm::float3( myMinX[ aChildIdx ], myMinY[ aChildIdx ], myMinZ[ aChildIdx ] ) * myScale;
+    bounds.myMax = myOrigin + glm::float3( myMaxX[ aChildIdx ], myMaxY[ aChildIdx ], myMaxZ[ aChildIdx ] ) * myScale;
+    return bounds;
+  }
+
+  glm::float3 myOrigin;
+  glm::float3 myScale;
+
+  // Stored per axis so all four children can later be tested with one SIMD instruction per plane
+  uint8 myMinX[ 4 ];
+  uint8 myMinY[ 4 ];
+  uint8 myMinZ[ 4 ];
+  uint8 myMaxX[ 4 ];
+  uint8 myMaxY[ 4 ];
+  uint8 myMaxZ[ 4 ];
+
+  // Index of the child node, a leaf primitive range (LEAF_FLAG | count << LEAF_COUNT_SHIFT | first) or EMPTY_CHILD
+  uint myChildren[ 4 ];
+};
+
+static_assert( sizeof( CpuBvh4Node ) == 64, "CpuBvh4Node is expected to fill exactly one cache line" );
+
+// Wide BVH for traversal, collapsed from a binary SAH CpuBvh. The leaves reference the same primitive ranges, binary
+// leaves with more primitives than a child reference holds are split into a subtree of leaves.
+class CpuBvh4 {
+public:
+  enum : uint {
+    MAX_PRIMITIVES = CpuBvh4Node::LEAF_FIRST_PRIMITIVE_MASK + 1u,
+    // Levels of four-way splits that bring MAX_PRIMITIVES down to leaves of LEAF_COUNT_MASK primitives
+    MAX_LEAF_SPLIT_DEPTH = 9u,
+    MAX_TRAVERSAL_STACK_SIZE = ( CpuBvh::MAX_TRAVERSAL_DEPTH + MAX_LEAF_SPLIT_DEPTH ) * 3u + 1u,
+  };
+
+  // Returns false and leaves the BVH empty if the binary BVH has more than MAX_PRIMITIVES primitives
+  bool   Build( const CpuBvh & aBinaryBvh );
+  uint64 GetMemorySize() const;
+
+  // Same semantics as CpuBvh::Traverse, but the leaf function is called once per leaf with the leaf's range in
+  // myPrimitiveIndices: bool( uint aFirstPrimitive, uint aNumPrimitives, float & aTMaxInOut ). This lets it test all
+  // primitives of a leaf at once.
+  template < class LeafFuncT >
+  bool Traverse( const glm::float3 & anOrigin, const glm::float3 & anInvDir, float aTMin, float & aTMaxInOut,
+                 bool anAnyHit, LeafFuncT & aLeafFunc ) const;
+
+  eastl::vector< CpuBvh4Node > myNodes;
+  eastl::vector< uint >        myPrimitiveIndices;
+
+private:
+  void SetChild( uint aNodeIdx, uint aChildIdx, const CpuAabb & someBounds, uint aChildRef );
+  void SetLeafChild( uint aNodeIdx, uint aChildIdx, const CpuAabb & someBounds, uint aFirstPrimitive,
+                     uint aNumPrimitives, uint aSplitDepth );
+};
+
+template < class LeafFuncT >
+bool CpuBvh4::Traverse( const glm::float3 & anOrigin, const glm::float3 & anInvDir, float aTMin, float & aTMaxInOut,
+                        bool anAnyHit, LeafFuncT & aLeafFunc ) const {
+  struct StackEntry {
+    uint  myChildRef;
+    float myTEnter;
+  };
+
+  if ( myNodes.empty() )
+    return false;
+
+  StackEntry stack[ MAX_TRAVERSAL_STACK_SIZE ];
+  uint       stackSize = 0u;
+  bool       hasHit = false;
+
+  stack[ stackSize++ ] = { 0u, aTMin };
+  while ( stackSize > 0u ) {
+    const StackEntry entry = stack[ --stackSize ];
+    if ( entry.myTEnter > aTMaxInOut )
+      continue;
+
+    if ( CpuBvh4Node::IsLeaf( entry.myChildRef ) ) {
+      if ( aLeafFunc( CpuBvh4Node::GetLeafFirstPrimitive( entry.myChildRef ),
+                      CpuBvh4Node::GetLeafNumPrimitives( entry.myChildRef ), aTMaxInOut ) ) {
+        hasHit = true;
+        if ( anAnyHit )
+          return true;
+      }
+      continue;
+    }
+
+    const CpuBvh4Node & node = myNodes[ entry.myChildRef ];
+
+    // Push the intersected children sorted far to near so the nearest one is popped first
+    StackEntry hits[ 4 ];
+    uint       numHits = 0u;
+    for ( uint i = 0u; i < 4u; ++i ) {
+      if ( node.myChildren[ i ] == CpuBvh4Node::EMPTY_CHILD )
+        continue;
+
+      const float tEnter = IntersectAabbDistance( node.GetChildBounds( i ), anOrigin, anInvDir, aTMin, aTMaxInOut );
+      if ( tEnter == FLT_MAX )
+        continue;
+
+      uint insertIdx = numHits++;
+      for ( ; insertIdx > 0u && hits[ insertIdx - 1u ].myTEnter < tEnter; --insertIdx )
+        hits[ insertIdx ] = hits[ insertIdx - 1u ];
+      hits[ insertIdx ] = { node.myChildren[ i ], tEnter };
+    }
+
+    ASSERT( stackSize + numHits <= MAX_TRAVERSAL_STACK_SIZE );
+    for ( uint i = 0u; i < numHits; ++i )
+      stack[ stackSize++ ] = hits[ i ];
+  }
+
+  return hasHit;
+}
@@ -0,0 +1,1175 @@
+#include "CpuPathTracer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+
+#include "CpuTextureCache.h"
+#include "CpuThreadPool.h"
+#include "IO/Scene.h"
+#include "Timing.h"
+
+using namespace CpuRt;
+
+namespace Priv_CpuPathTracer {
+  const uint TILE_SIZE = CPU_RT_TILE_SIZE;
+
+  // Pixel block whose primary rays are traced as one packet, for the lanes of the packet kernel the CPU supports
+  glm::uvec2 GetPacketBlockSize() {
+    const uint packetWidth = CpuRtScene::GetPacketWidth();
+    const uint blockWidth = packetWidth >= 8u ? 4u : ( packetWidth >= 4u ? 2u : 1u );
+    return glm::uvec2( blockWidth, packetWidth / blockWidth );
+  }
+
+  const uint NUM_AO_RAYS = 16u;
+
+  // Same as in RayGen
+  const float SPECULAR_STRENGTH = 0.9f;
+  const float SHADOW_RAY_TMIN = 0.001f;
+
+  const uint NUM_INTEGRATOR_REFERENCE_FRAMES = 256u;
+  const uint NUM_INTEGRATOR_BRDF_FRAMES = 32u;
+  const uint MAX_INTEGRATOR_NEE_FRAMES = 256u;
+
+  // Added to the squared mean luminance of a pixel when estimating its relative error, like in ComputeRelativeRmse()
+  const float RELATIVE_ERROR_EPSILON = 0.01f;
+
+  const uint NUM_ROULETTE_REFERENCE_FRAMES = 256u;
+  const uint NUM_ROULETTE_FIXED_FRAMES = 32u;
+  const uint MAX_ROULETTE_FRAMES = 256u;
+
+  // The sampler benchmark measures up to 2^( NUM_STEPS - 1 ) spp, the reference has far less noise than that. A few
+  // fireflies make up much of the error of a single run, so the squared errors are averaged over several seeds.
+  const uint NUM_SAMPLER_REFERENCE_FRAMES = 1024u;
+  const uint MAX_SAMPLER_FRAMES = 1u << ( CpuSamplerBenchmarkResults::NUM_STEPS - 1u );
+  const uint NUM_SAMPLER_RUNS = 4u;
+
+  const uint NUM_SCHEDULER_FRAMES = 4u;
+
+  const uint NUM_VERTEX_FORMAT_FRAMES = 16u;
+
+  // The compact vertex format must not change the image by more than this share of the noise of the render
+  const float VERTEX_FORMAT_MAX_NOISE_RATIO = 0.25f;
+
+  const uint    NUM_BENCHMARK_RUNS = 3u;
+  const uint    BENCHMARK_PACKETS_PER_JOB = 64u;
+  const uint    MAX_BENCHMARK_AO_RAYS = 1024u * 1024u;
+  const float64 MS_TO_MRAYS = 1.0 / 1000.0;
+
+  // Inserts a zero bit in front of each of the lower 16 bits
+  uint SpreadBits2( uint aValue ) {
+    aValue = ( aValue | ( aValue << 8u ) ) & 0x00FF00FFu;
+    aValue = ( aValue | ( aValue << 4u ) ) & 0x0F0F0F0Fu;
+    aValue = ( aValue | ( aValue << 2u ) ) & 0x33333333u;
+    aValue = ( aValue | ( aValue << 1u ) ) & 0x55555555u;
+    return aValue;
+  }
+
+  uint CountSetBits( uint someBits ) {
+    uint count = 0u;
+    for ( ; someBits != 0u; someBits &= someBits - 1u )
+      ++count;
+    return count;
+  }
+
+  template < class FuncT >
+  float64 GetBestTimeMs( const FuncT & aFunc ) {
+    float64 bestTime = DBL_MAX;
+    for ( uint i = 0u; i < NUM_BENCHMARK_RUNS; ++i ) {
+      const float64 startTime = SampleTimeMs();
+      aFunc();
+      bestTime = glm::min( bestTime, SampleTimeMs() - startTime );
+    }
+    return glm::max( bestTime, 0.001 );
+  }
+
+  // Squared standard error of the mean luminance of a pixel, relative to the squared mean like ComputeRelativeRmse().
+  // Same as GetRelativeErrorSq() in compute_tile_error.hlsl.
+  float GetRelativeErrorSq( const glm::float4 & anAccumulation, float aMoment ) {
+    const float numSamples = anAccumulation.w;
+    if ( numSamples < 2.0f )
+      return FLT_MAX;
+
+    const float mean = GetLuminance( glm::float3( anAccumulation ) );
+    const float meanVariance = glm::max( aMoment - mean * mean, 0.0f ) / ( numSamples - 1.0f );
+    return meanVariance / ( mean * mean + RELATIVE_ERROR_EPSILON );
+  }
+}  // namespace Priv_CpuPathTracer
+
+float ComputeRelativeRmse( const glm::float4 * someValues, const glm::float4 * someReferences, uint aCount ) {
+  // The squared error of each pixel is relative to its own reference, so the edges of directly visible emitters don't
+  // dominate the error of the rest of the image. The epsilon keeps black pixels from blowing it up.
+  const float64 EPSILON = 0.01;
+
+  float64 errorSum = 0.0;
+  for ( uint i = 0u; i < aCount; ++i ) {
+    const glm::float3 reference( someReferences[ i ] );
+    const glm::float3 diff = glm::float3( someValues[ i ] ) - reference;
+    errorSum += glm::dot( diff, diff ) / ( glm::dot( reference, reference ) + EPSILON );
+  }
+  return aCount > 0u ? ( float ) sqrt( errorSum / aCount ) : 0.0f;
+}
+
+CpuPathTracer::CpuPathTracer()
+  : myThreadPool( new CpuThreadPool() ), myTextureCache( new CpuTextureCache() ), mySky( myThreadPool.get() ) {}
+
+CpuPathTracer::~CpuPathTracer() {}
+
+void CpuPathTracer::InitScene( const SceneData & aScene, SceneCache * aCache, RtVertexFormat aVertexFormat,
+                               uint64 aBlasStreamingBudget ) {
+  myScene.Init( aScene, myThreadPool.get(), aCache, aVertexFormat, aBlasStreamingBudget );
+  myLights = CpuRtLights();
+
+  myTextureCache->Clear();
+  for ( uint i = 0u; i < ( uint ) myScene.myMaterials.size(); ++i ) {
+    const eastl::string & path = aScene.myMaterials[ i ].myTextures[ ( uint ) MaterialTextureType::BASE_COLOR ];
+    if ( !path.empty() )
+      myScene.myMaterials[ i ].myBaseColorTexture = myTextureCache->AddTexture( path.c_str() );
+  }
+  RestartAccumulation();
+}
+
+CpuTlasUpdate CpuPathTracer::UpdateInstanceTransforms( const uint * someInstanceIndices,
+                                                       const glm::float4x4 * someTransforms, uint aNumInstances ) {
+  const CpuTlasUpdate update =
+      myScene.UpdateInstanceTransforms( someInstanceIndices, someTransforms, aNumInstances, myThreadPool.get() );
+
+  // The light triangles are in world space
+  if ( myLights.ContainsAnyInstance( someInstanceIndices, aNumInstances ) )
+    myLights = CpuRtLights();
+
+  RestartAccumulation();
+  return update;
+}
+
+CpuTlasUpdateBenchmarkResults CpuPathTracer::RunTlasUpdateBenchmark( uint aNumInstances ) {
+  return myScene.RunTlasUpdateBenchmark( aNumInstances, myThreadPool.get() );
+}
+
+void CpuPathTracer::SetResolution( uint aWidth, uint aHeight ) {
+  using namespace Priv_CpuPathTracer;
+
+  if ( myResolution.x == aWidth && myResolution.y == aHeight )
+    return;
+
+  myResolution = glm::uvec2( aWidth, aHeight );
+  myAccumulationBuffer.clear();
+  myAccumulationBuffer.resize( aWidth * aHeight, glm::float4( 0.0f ) );
+  myMomentBuffer.clear();
+  myMomentBuffer.resize( aWidth * aHeight, 0.0f );
+  myTileErrors.clear();
+  myTileErrors.resize( GetNumTiles(), FLT_MAX );
+
+  // The Morton curve covers the next power-of-two square, sorting skips the parts outside the tile grid
+  const uint              numTilesX = ( aWidth + TILE_SIZE - 1u ) / TILE_SIZE;
+  eastl::vector< uint64 > sortEntries;  // Morton code in the upper and tile index in the lower 32 bits
+  sortEntries.resize( GetNumTiles() );
+  for ( uint i = 0u; i < ( uint ) sortEntries.size(); ++i ) {
+    const uint64 morton = SpreadBits2( i % numTilesX ) | ( SpreadBits2( i / numTilesX ) << 1u );
+    sortEntries[ i ] = ( morton << 32u ) | i;
+  }
+  std::sort( sortEntries.begin(), sortEntries.end() );
+
+  myTileOrder.resize( sortEntries.size() );
+  for ( uint i = 0u; i < ( uint ) sortEntries.size(); ++i )
+    myTileOrder[ i ] = ( uint ) sortEntries[ i ];
+  RestartAccumulation();
+}
+
+void CpuPathTracer::RestartAccumulation() {
+  myNumAccumulationFrames = 0u;
+  myNumAccumulatedSamples = 0u;
+  myTextureCache->ResetStats();
+  if ( myScene.GetBlasCache() )
+    myScene.GetBlasCache()->ResetStats();
+
+  myActiveTiles = myTileOrder;
+}
+
+const glm::float4 * CpuPathTracer::GetAccumulationBuffer() const {
+  return myAccumulationBuffer.data();
+}
+
+glm::uvec2 CpuPathTracer::GetResolution() const {
+  return myResolution;
+}
+
+uint CpuPathTracer::GetNumAccumulationFrames() const {
+  return myNumAccumulationFrames;
+}
+
+const CpuRtScene & CpuPathTracer::GetScene() const {
+  return myScene;
+}
+
+CpuThreadPool * CpuPathTracer::GetThreadPool() const {
+  return myThreadPool.get();
+}
+
+CpuTextureCache & CpuPathTracer::GetTextureCache() const {
+  return *myTextureCache;
+}
+
+const SkyLutStats & CpuPathTracer::GetSkyStats() const {
+  return mySky.GetFrameStats();
+}
+
+float CpuPathTracer::GetAveragePathLength() const {
+  return myAveragePathLength;
+}
+
+uint64 CpuPathTracer::GetNumAccumulatedSamples() const {
+  return myNumAccumulatedSamples;
+}
+
+uint CpuPathTracer::GetNumActiveTiles() const {
+  return ( uint ) myActiveTiles.size();
+}
+
+uint CpuPathTracer::GetNumTiles() const {
+  using namespace Priv_CpuPathTracer;
+  return ( ( myResolution.x + TILE_SIZE - 1u ) / TILE_SIZE ) * ( ( myResolution.y + TILE_SIZE - 1u ) / TILE_SIZE );
+}
+
+bool CpuPathTracer::IsConverged() const {
+  return myActiveTiles.empty();
+}
+
+void CpuPathTracer::GetTileBounds( uint aTileIdx, glm::uvec2 & aStartOut, glm::uvec2 & anEndOut ) const {
+  using namespace Priv_CpuPathTracer;
+  const uint numTilesX = ( myResolution.x + TILE_SIZE - 1u ) / TILE_SIZE;
+  aStartOut = glm::uvec2( ( aTileIdx % numTilesX ) * TILE_SIZE, ( aTileIdx / numTilesX ) * TILE_SIZE );
+  anEndOut = glm::min( aStartOut + glm::uvec2( TILE_SIZE ), myResolution );
+}
+
+void CpuPathTracer::RenderFrame( const CpuRtConsts & someConsts ) {
+  if ( someConsts.myAdaptiveSampling && IsConverged() )
+    return;
+
+  UpdateSky( someConsts );
+  UpdateLights( someConsts );
+
+  // AO only traces a single bounce, so there is nothing to gain from the wavefront mode
+  if ( someConsts.myWavefront && !someConsts.myRenderAo )
+    RenderFrameWavefront( someConsts, false );
+  else
+    RenderFrameDepthFirst( someConsts, *myThreadPool );
+
+  ++myNumAccumulationFrames;
+  myNumAccumulatedSamples += myFrameNumSamples;
+
+  // Before myAdaptiveMinSamples, the variance estimates of the pixels are too unreliable to stop sampling any tile
+  if ( someConsts.myAdaptiveSampling && myNumAccumulationFrames >= someConsts.myAdaptiveMinSamples )
+    UpdateTileErrors( someConsts );
+}
+
+void CpuPathTracer::UpdateTileErrors( const CpuRtConsts & someConsts ) {
+  using namespace Priv_CpuPathTracer;
+
+  // The error of a tile is the root of the mean squared relative error of its pixels, an estimate of its contribution
+  // to the relative RMSE of the image. Tiles that are below the threshold don't get samples anymore, so their error
+  // doesn't change.
+  myThreadPool->ParallelFor( ( uint ) myActiveTiles.size(), [ & ]( uint anActiveTileIdx, uint /*aThreadIdx*/ ) {
+    const uint tileIdx = myActiveTiles[ anActiveTileIdx ];
+    glm::uvec2 tileStart, tileEnd;
+    GetTileBounds( tileIdx, tileStart, tileEnd );
+
+    float64 errorSqSum = 0.0;
+    for ( uint y = tileStart.y; y < tileEnd.y; ++y ) {
+      for ( uint x = tileStart.x; x < tileEnd.x; ++x ) {
+        const uint pixelIdx = y * myResolution.x + x;
+        errorSqSum += GetRelativeErrorSq( myAccumulationBuffer[ pixelIdx ], myMomentBuffer[ pixelIdx ] );
+      }
+    }
+    const uint numTilePixels = ( tileEnd.x - tileStart.x ) * ( tileEnd.y - tileStart.y );
+    myTileErrors[ tileIdx ] = ( float ) sqrt( errorSqSum / numTilePixels );
+  } );
+
+  uint numActiveTiles = 0u;
+  for ( uint tileIdx : myActiveTiles ) {
+    if ( myTileErrors[ tileIdx ] > someConsts.myAdaptiveErrorThreshold )
+      myActiveTiles[ numActiveTiles++ ] = tileIdx;
+  }
+  myActiveTiles.resize( numActiveTiles );
+}
+
+void CpuPathTracer::UpdateSky( const CpuRtConsts & someConsts ) {
+  mySky.ResetFrameStats();
+  if ( someConsts.mySampleSky )
+    mySky.Update( someConsts.mySkyParams, someConsts.myCameraPos.y, someConsts.mySkyLookup );
+}
+
+void CpuPathTracer::UpdateLights( const CpuRtConsts & someConsts ) {
+  if ( someConsts.myNextEventEstimation &&
+       !myLights.IsBuiltFor( someConsts.myLightInstanceId, someConsts.myLightEmission ) )
+    myLights.Build( myScene, someConsts.myLightInstanceId, someConsts.myLightEmission );
+}
+
+void CpuPathTracer::RenderFrameDepthFirst( const CpuRtConsts & someConsts, CpuThreadPool & aThreadPool ) {
+  using namespace Priv_CpuPathTracer;
+
+  // Adaptive sampling only renders the tiles that haven't converged yet
+  const eastl::vector< uint > & tiles = someConsts.myAdaptiveSampling ? myActiveTiles : myTileOrder;
+  const uint                    numTiles = ( uint ) tiles.size();
+  myTileTimesMs.resize( numTiles );
+
+  const uint       packetWidth = CpuRtScene::GetPacketWidth();
+  const glm::uvec2 packetSize = GetPacketBlockSize();
+
+  // The random numbers of a pixel only depend on the pixel and the frame, so the image doesn't depend on the number of
+  // threads or on which thread renders a tile
+  std::atomic< uint64 > numRays( 0u );
+  std::atomic< uint >   numSamples( 0u );
+  aThreadPool.ParallelFor( numTiles, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+    const float64 tileStartTime = SampleTimeMs();
+    glm::uvec2    tileStart, tileEnd;
+    GetTileBounds( tiles[ aJobIdx ], tileStart, tileEnd );
+    uint64 numTileRays = 0u;
+
+    for ( uint packetY = tileStart.y; packetY < tileEnd.y; packetY += packetSize.y ) {
+      for ( uint packetX = tileStart.x; packetX < tileEnd.x; packetX += packetSize.x ) {
+        // The primary rays of neighboring pixels are coherent, so they are traced as one packet. The bounces and AO
+        // rays of each pixel continue from its primary hit.
+        CpuRayPacket packet;
+        CpuRay       rays[ CPU_MAX_PACKET_WIDTH ];
+        SamplerState samplerStates[ CPU_MAX_PACKET_WIDTH ];
+        uint         laneMask = 0u;
+        for ( uint lane = 0u; lane < packetWidth; ++lane ) {
+          const glm::uvec2 pixel( packetX + lane % packetSize.x, packetY + lane / packetSize.x );
+          if ( pixel.x >= tileEnd.x || pixel.y >= tileEnd.y )
+            continue;
+
+          GenerateCameraRay( pixel, someConsts, samplerStates[ lane ], rays[ lane ] );
+          packet.SetRay( lane, rays[ lane ] );
+          laneMask |= 1u << lane;
+        }
+
+        CpuHitPacket hits;
+        const uint   hitMask = myScene.TraceClosestPacket( packet, laneMask, hits );
+
+        for ( uint lane = 0u; lane < packetWidth; ++lane ) {
+          if ( ( laneMask & ( 1u << lane ) ) == 0u )
+            continue;
+
+          const bool   hasHit = ( hitMask & ( 1u << lane ) ) != 0u;
+          const CpuHit hit = hits.GetHit( lane );
+          uint         numPathRays = 1u;
+          const glm::float3 luminance =
+              someConsts.myRenderAo
+                  ? ShadeAo( rays[ lane ], hit, hasHit, samplerStates[ lane ], someConsts )
+                  : ShadePath( rays[ lane ], hit, hasHit, samplerStates[ lane ], someConsts, numPathRays );
+          numTileRays += numPathRays;
+
+          const uint x = packetX + lane % packetSize.x;
+          const uint y = packetY + lane / packetSize.x;
+          AccumulateSample( y * myResolution.x + x, luminance );
+        }
+      }
+    }
+    numRays += numTileRays;
+    numSamples += ( tileEnd.x - tileStart.x ) * ( tileEnd.y - tileStart.y );
+    myTileTimesMs[ aJobIdx ] = ( float ) ( SampleTimeMs() - tileStartTime );
+  } );
+
+  myFrameNumSamples = numSamples.load();
+  myAveragePathLength = myFrameNumSamples > 0u ? ( float ) ( ( float64 ) numRays.load() / myFrameNumSamples ) : 0.0f;
+}
+
+void CpuPathTracer::AccumulateSample( uint aPixelIdx, glm::float3 aLuminance ) {
+  if ( std::isnan( aLuminance.x ) || std::isnan( aLuminance.y ) || std::isnan( aLuminance.z ) ||
+       std::isinf( aLuminance.x ) || std::isinf( aLuminance.y ) || std::isinf( aLuminance.z ) )
+    aLuminance = glm::float3( 0.0f );
+
+  // Pixels count their own samples, adaptive sampling skips some of them in a frame. The second moment of the
+  // luminance gives the variance estimate of UpdateTileErrors(). Same as AccumulateSample() in raytracing/Common.hlsl.
+  glm::float4 & accumLight = myAccumulationBuffer[ aPixelIdx ];
+  float &       moment = myMomentBuffer[ aPixelIdx ];
+  const float   numSamples = myNumAccumulationFrames > 0u ? accumLight.w : 0.0f;
+  const float   luminance = GetLuminance( aLuminance );
+  accumLight = glm::float4( ( glm::float3( accumLight ) * numSamples + aLuminance ) / ( numSamples + 1.0f ),
+                            numSamples + 1.0f );
+  moment = ( moment * numSamples + luminance * luminance ) / ( numSamples + 1.0f );
+}
+
+CpuTraversalBenchmarkResults CpuPathTracer::RunTraversalBenchmark( const CpuRtConsts & someConsts ) {
+  using namespace Priv_CpuPathTracer;
+
+  CpuTraversalBenchmarkResults results;
+  results.mySimdName = CpuRtScene::GetPacketIsaName();
+  results.mySimdWidth = CpuRtScene::GetPacketWidth();
+
+  const uint       packetWidth = results.mySimdWidth;
+  const glm::uvec2 packetSize = GetPacketBlockSize();
+
+  const uint numPacketsX = ( myResolution.x + packetSize.x - 1u ) / packetSize.x;
+  const uint numPacketsY = ( myResolution.y + packetSize.y - 1u ) / packetSize.y;
+  const uint numPrimaryPackets = numPacketsX * numPacketsY;
+  if ( numPrimaryPackets == 0u )
+    return results;
+
+  eastl::vector< CpuRayPacket > primaryPackets( numPrimaryPackets );
+  eastl::vector< uint >         primaryLaneMasks( numPrimaryPackets, 0u );
+  for ( uint i = 0u; i < numPrimaryPackets; ++i ) {
+    const glm::uvec2 packetStart( ( i % numPacketsX ) * packetSize.x, ( i / numPacketsX ) * packetSize.y );
+    for ( uint lane = 0u; lane < packetWidth; ++lane ) {
+      const glm::uvec2 pixel = packetStart + glm::uvec2( lane % packetSize.x, lane / packetSize.x );
+      if ( pixel.x >= myResolution.x || pixel.y >= myResolution.y )
+        continue;
+
+      CpuRay ray;
+      GetPrimaryRay( glm::float2( pixel ), someConsts, ray.myOrigin, ray.myDirection );
+      ray.myTMin = 0.0f;
+      ray.myTMax = 10000.0f;
+      primaryPackets[ i ].SetRay( lane, ray );
+      primaryLaneMasks[ i ] |= 1u << lane;
+    }
+    results.myNumPrimaryRays += CountSetBits( primaryLaneMasks[ i ] );
+  }
+
+  eastl::vector< CpuHitPacket > primaryHits( numPrimaryPackets );
+  eastl::vector< uint >         primaryHitMasks( numPrimaryPackets, 0u );
+  const uint                    numPrimaryJobs = ( numPrimaryPackets + BENCHMARK_PACKETS_PER_JOB - 1u ) /
+                                                 BENCHMARK_PACKETS_PER_JOB;
+
+  const float64 primaryScalarMs = GetBestTimeMs( [ & ]() {
+    myThreadPool->ParallelFor( numPrimaryJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+      const uint end = glm::min( ( aJobIdx + 1u ) * BENCHMARK_PACKETS_PER_JOB, numPrimaryPackets );
+      for ( uint i = aJobIdx * BENCHMARK_PACKETS_PER_JOB; i < end; ++i ) {
+        uint hitMask = 0u;
+        for ( uint lane = 0u; lane < packetWidth; ++lane ) {
+          CpuHit hit;
+          if ( ( primaryLaneMasks[ i ] & ( 1u << lane ) ) && myScene.TraceClosest( primaryPackets[ i ].GetRay( lane ),
+                                                                                  hit ) )
+            hitMask |= 1u << lane;
+        }
+        primaryHitMasks[ i ] = hitMask;
+      }
+    } );
+  } );
+
+  const float64 primaryPacketMs = GetBestTimeMs( [ & ]() {
+    myThreadPool->ParallelFor( numPrimaryJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+      const uint end = glm::min( ( aJobIdx + 1u ) * BENCHMARK_PACKETS_PER_JOB, numPrimaryPackets );
+      for ( uint i = aJobIdx * BENCHMARK_PACKETS_PER_JOB; i < end; ++i )
+        primaryHitMasks[ i ] =
+            myScene.TraceClosestPacket( primaryPackets[ i ], primaryLaneMasks[ i ], primaryHits[ i ] );
+    } );
+  } );
+
+  // Same AO rays as ShadeAo, limited to myAoDistance. Each packet holds rays of a single pixel.
+  eastl::vector< CpuRayPacket > aoPackets;
+  eastl::vector< uint >         aoLaneMasks;
+  for ( uint i = 0u; i < numPrimaryPackets && results.myNumAoRays < MAX_BENCHMARK_AO_RAYS; ++i ) {
+    const glm::uvec2 packetStart( ( i % numPacketsX ) * packetSize.x, ( i / numPacketsX ) * packetSize.y );
+    for ( uint lane = 0u; lane < packetWidth; ++lane ) {
+      if ( ( primaryHitMasks[ i ] & ( 1u << lane ) ) == 0u )
+        continue;
+
+      const CpuRay      primaryRay = primaryPackets[ i ].GetRay( lane );
+      const CpuHit      hit = primaryHits[ i ].GetHit( lane );
+      const glm::float3 hitPos = primaryRay.myOrigin + primaryRay.myDirection * hit.myT;
+      const glm::float3 hitNormal = myScene.GetInterpolatedVertexData( hit ).myNormal;
+      const glm::uvec2  pixel = packetStart + glm::uvec2( lane % packetSize.x, lane / packetSize.x );
+      RngStateType      rngState = InitRNG( pixel, myResolution, someConsts.myFrameRandomSeed );
+
+      for ( uint iRay = 0u; iRay < NUM_AO_RAYS; ++iRay ) {
+        const uint aoLane = iRay % packetWidth;
+        if ( aoLane == 0u ) {
+          aoPackets.push_back();
+          aoLaneMasks.push_back( 0u );
+        }
+
+        const float rand0 = GetRand01( rngState );
+        const float rand1 = GetRand01( rngState );
+
+        CpuRay aoRay;
+        aoRay.myOrigin = hitPos;
+        aoRay.myTMin = 0.01f;
+        aoRay.myDirection = GetHemisphereDirection( glm::float2( rand0, rand1 ) * 2.0f - 1.0f, hitNormal );
+        aoRay.myTMax = someConsts.myAoDistance;
+        aoPackets.back().SetRay( aoLane, aoRay );
+        aoLaneMasks.back() |= 1u << aoLane;
+      }
+      results.myNumAoRays += NUM_AO_RAYS;
+    }
+  }
+
+  const uint            numAoPackets = ( uint ) aoPackets.size();
+  const uint            numAoJobs = ( numAoPackets + BENCHMARK_PACKETS_PER_JOB - 1u ) / BENCHMARK_PACKETS_PER_JOB;
+  eastl::vector< uint > aoHitMasks( numAoPackets, 0u );
+
+  const float64 aoScalarMs = GetBestTimeMs( [ & ]() {
+    myThreadPool->ParallelFor( numAoJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+      const uint end = glm::min( ( aJobIdx + 1u ) * BENCHMARK_PACKETS_PER_JOB, numAoPackets );
+      for ( uint i = aJobIdx * BENCHMARK_PACKETS_PER_JOB; i < end; ++i ) {
+        uint hitMask = 0u;
+        for ( uint lane = 0u; lane < packetWidth; ++lane ) {
+          if ( ( aoLaneMasks[ i ] & ( 1u << lane ) ) && myScene.TraceAny( aoPackets[ i ].GetRay( lane ) ) )
+            hitMask |= 1u << lane;
+        }
+        aoHitMasks[ i ] = hitMask;
+      }
+    } );
+  } );
+
+  const float64 aoPacketMs = GetBestTimeMs( [ & ]() {
+    myThreadPool->ParallelFor( numAoJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+      const uint end = glm::min( ( aJobIdx + 1u ) * BENCHMARK_PACKETS_PER_JOB, numAoPackets );
+      for ( uint i = aJobIdx * BENCHMARK_PACKETS_PER_JOB; i < end; ++i )
+        aoHitMasks[ i ] = myScene.TraceAnyPacket( aoPackets[ i ], aoLaneMasks[ i ] );
+    } );
+  } );
+
+  results.myPrimaryScalarMrays = ( float ) ( results.myNumPrimaryRays / primaryScalarMs * MS_TO_MRAYS );
+  results.myPrimaryPacketMrays = ( float ) ( results.myNumPrimaryRays / primaryPacketMs * MS_TO_MRAYS );
+  results.myAoScalarMrays = ( float ) ( results.myNumAoRays / aoScalarMs * MS_TO_MRAYS );
+  results.myAoPacketMrays = ( float ) ( results.myNumAoRays / aoPacketMs * MS_TO_MRAYS );
+
+  Log( "CPU traversal benchmark (%s, %d lanes, %d threads): primary %.2f / %.2f Mrays/s, AO %.2f / %.2f Mrays/s "
+       "(scalar / packet)",
+       results.mySimdName, results.mySimdWidth, myThreadPool->GetNumThreads(), results.myPrimaryScalarMrays,
+       results.myPrimaryPacketMrays, results.myAoScalarMrays, results.myAoPacketMrays );
+
+  return results;
+}
+
+CpuIntegratorBenchmarkResults CpuPathTracer::RunIntegratorBenchmark( const CpuRtConsts & someConsts ) {
+  using namespace Priv_CpuPathTracer;
+
+  CpuIntegratorBenchmarkResults results;
+  const uint                    numPixels = myResolution.x * myResolution.y;
+  if ( numPixels == 0u )
+    return results;
+
+  CpuRtConsts consts = someConsts;
+  consts.myRenderAo = false;
+
+  // The reference uses other seeds than the measured runs, so its remaining noise isn't correlated with theirs
+  consts.myNextEventEstimation = true;
+  consts.mySamplerSeed = someConsts.mySamplerSeed + 1u;
+  RestartAccumulation();
+  for ( uint i = 0u; i < NUM_INTEGRATOR_REFERENCE_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + MAX_INTEGRATOR_NEE_FRAMES + i;
+    RenderFrame( consts );
+  }
+  const eastl::vector< glm::float4 > reference = myAccumulationBuffer;
+  results.myReferenceSpp = NUM_INTEGRATOR_REFERENCE_FRAMES;
+  consts.mySamplerSeed = someConsts.mySamplerSeed;
+
+  // Only the frames are timed, not the error computations in between
+  consts.myNextEventEstimation = false;
+  RestartAccumulation();
+  float64 brdfTimeMs = 0.0;
+  for ( uint i = 0u; i < NUM_INTEGRATOR_BRDF_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + i;
+    const float64 startTime = SampleTimeMs();
+    RenderFrame( consts );
+    brdfTimeMs += SampleTimeMs() - startTime;
+  }
+  results.myBrdfSpp = NUM_INTEGRATOR_BRDF_FRAMES;
+  results.myBrdfTimeMs = ( float ) brdfTimeMs;
+  results.myTargetRmse = ComputeRelativeRmse( myAccumulationBuffer.data(), reference.data(), numPixels );
+
+  consts.myNextEventEstimation = true;
+  RestartAccumulation();
+  float64 neeTimeMs = 0.0;
+  for ( uint i = 0u; i < MAX_INTEGRATOR_NEE_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + i;
+    const float64 startTime = SampleTimeMs();
+    RenderFrame( consts );
+    neeTimeMs += SampleTimeMs() - startTime;
+
+    results.myNeeSpp = i + 1u;
+    results.myNeeRmse = ComputeRelativeRmse( myAccumulationBuffer.data(), reference.data(), numPixels );
+    if ( results.myNeeRmse <= results.myTargetRmse )
+      break;
+  }
+  results.myNeeTimeMs = ( float ) neeTimeMs;
+
+  RestartAccumulation();
+
+  Log( "CPU integrator benchmark (%d spp reference): BRDF sampling %d spp in %.1f ms for RMSE %.4f, next-event "
+       "estimation %d spp in %.1f ms for RMSE %.4f",
+       results.myReferenceSpp, results.myBrdfSpp, results.myBrdfTimeMs, results.myTargetRmse, results.myNeeSpp,
+       results.myNeeTimeMs, results.myNeeRmse );
+
+  return results;
+}
+
+CpuRussianRouletteBenchmarkResults CpuPathTracer::RunRussianRouletteBenchmark( const CpuRtConsts & someConsts ) {
+  using namespace Priv_CpuPathTracer;
+
+  CpuRussianRouletteBenchmarkResults results;
+  const uint                         numPixels = myResolution.x * myResolution.y;
+  if ( numPixels == 0u )
+    return results;
+
+  CpuRtConsts consts = someConsts;
+  consts.myRenderAo = false;
+
+  // The reference uses other seeds than the measured runs, so its remaining noise isn't correlated with theirs
+  consts.myRussianRoulette = false;
+  consts.mySamplerSeed = someConsts.mySamplerSeed + 1u;
+  RestartAccumulation();
+  for ( uint i = 0u; i < NUM_ROULETTE_REFERENCE_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + MAX_ROULETTE_FRAMES + i;
+    RenderFrame( consts );
+  }
+  const eastl::vector< glm::float4 > reference = myAccumulationBuffer;
+  results.myReferenceSpp = NUM_ROULETTE_REFERENCE_FRAMES;
+  consts.mySamplerSeed = someConsts.mySamplerSeed;
+
+  // Only the frames are timed, not the error computations in between
+  RestartAccumulation();
+  float64 fixedTimeMs = 0.0;
+  float64 fixedPathLengthSum = 0.0;
+  for ( uint i = 0u; i < NUM_ROULETTE_FIXED_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + i;
+    const float64 startTime = SampleTimeMs();
+    RenderFrame( consts );
+    fixedTimeMs += SampleTimeMs() - startTime;
+    fixedPathLengthSum += myAveragePathLength;
+  }
+  results.myFixedSpp = NUM_ROULETTE_FIXED_FRAMES;
+  results.myFixedTimeMs = ( float ) fixedTimeMs;
+  results.myFixedPathLength = ( float ) ( fixedPathLengthSum / NUM_ROULETTE_FIXED_FRAMES );
+  results.myTargetRmse = ComputeRelativeRmse( myAccumulationBuffer.data(), reference.data(), numPixels );
+
+  consts.myRussianRoulette = true;
+  RestartAccumulation();
+  float64 rouletteTimeMs = 0.0;
+  float64 roulettePathLengthSum = 0.0;
+  for ( uint i = 0u; i < MAX_ROULETTE_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + i;
+    const float64 startTime = SampleTimeMs();
+    RenderFrame( consts );
+    rouletteTimeMs += SampleTimeMs() - startTime;
+    roulettePathLengthSum += myAveragePathLength;
+
+    results.myRouletteSpp = i + 1u;
+    results.myRouletteRmse = ComputeRelativeRmse( myAccumulationBuffer.data(), reference.data(), numPixels );
+    if ( results.myRouletteRmse <= results.myTargetRmse )
+      break;
+  }
+  results.myRouletteTimeMs = ( float ) rouletteTimeMs;
+  results.myRoulettePathLength = ( float ) ( roulettePathLengthSum / results.myRouletteSpp );
+  results.mySpeedup = results.myFixedTimeMs / glm::max( results.myRouletteTimeMs, 0.001f );
+
+  RestartAccumulation();
+
+  Log( "CPU Russian roulette benchmark (%d spp reference): fixed length %d spp in %.1f ms for RMSE %.4f, %.2f rays "
+       "per path, Russian roulette %d spp in %.1f ms for RMSE %.4f, %.2f rays per path, %.2fx samples/s at equal "
+       "noise",
+       results.myReferenceSpp, results.myFixedSpp, results.myFixedTimeMs, results.myTargetRmse,
+       results.myFixedPathLength, results.myRouletteSpp, results.myRouletteTimeMs, results.myRouletteRmse,
+       results.myRoulettePathLength, results.mySpeedup );
+
+  return results;
+}
+
+CpuSamplerBenchmarkResults CpuPathTracer::RunSamplerBenchmark( const CpuRtConsts & someConsts ) {
+  using namespace Priv_CpuPathTracer;
+
+  CpuSamplerBenchmarkResults results;
+  const uint                 numPixels = myResolution.x * myResolution.y;
+  if ( numPixels == 0u )
+    return results;
+
+  CpuRtConsts consts = someConsts;
+  consts.myRenderAo = false;
+  consts.myAdaptiveSampling = false;
+
+  // The reference uses other seeds than the measured runs, so its remaining noise isn't correlated with theirs
+  consts.mySampler = SamplerType::SOBOL;
+  consts.mySamplerSeed = someConsts.mySamplerSeed + NUM_SAMPLER_RUNS;
+  RestartAccumulation();
+  for ( uint i = 0u; i < NUM_SAMPLER_REFERENCE_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + NUM_SAMPLER_RUNS * MAX_SAMPLER_FRAMES + i;
+    RenderFrame( consts );
+  }
+  const eastl::vector< glm::float4 > reference = myAccumulationBuffer;
+  results.myReferenceSpp = NUM_SAMPLER_REFERENCE_FRAMES;
+
+  // Only the frames are timed, not the error computations in between
+  for ( uint sampler = 0u; sampler < ( uint ) SamplerType::NUM; ++sampler ) {
+    consts.mySampler = ( SamplerType ) sampler;
+    float64 timeMs = 0.0;
+    float64 errorSqSums[ CpuSamplerBenchmarkResults::NUM_STEPS ] = {};
+    for ( uint run = 0u; run < NUM_SAMPLER_RUNS; ++run ) {
+      consts.mySamplerSeed = someConsts.mySamplerSeed + run;
+      RestartAccumulation();
+      uint step = 0u;
+      for ( uint i = 0u; i < MAX_SAMPLER_FRAMES; ++i ) {
+        consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + run * MAX_SAMPLER_FRAMES + i;
+        const float64 startTime = SampleTimeMs();
+        RenderFrame( consts );
+        timeMs += SampleTimeMs() - startTime;
+
+        if ( i + 1u == 1u << step ) {
+          const float rmse = ComputeRelativeRmse( myAccumulationBuffer.data(), reference.data(), numPixels );
+          errorSqSums[ step ] += rmse * rmse;
+          results.mySpp[ step++ ] = i + 1u;
+        }
+      }
+    }
+
+    for ( uint step = 0u; step < CpuSamplerBenchmarkResults::NUM_STEPS; ++step )
+      results.myRmse[ sampler ][ step ] = ( float ) sqrt( errorSqSums[ step ] / NUM_SAMPLER_RUNS );
+    results.myTimeMs[ sampler ] = ( float ) ( timeMs / NUM_SAMPLER_RUNS );
+  }
+
+  RestartAccumulation();
+
+  for ( uint sampler = 0u; sampler < ( uint ) SamplerType::NUM; ++sampler ) {
+    char rmseText[ 256 ] = "";
+    int  length = 0;
+    for ( uint step = 0u; step < CpuSamplerBenchmarkResults::NUM_STEPS; ++step )
+      length += snprintf( rmseText + length, sizeof( rmseText ) - length, "%s%d spp %.4f", step > 0u ? ", " : "",
+                          results.mySpp[ step ], results.myRmse[ sampler ][ step ] );
+
+    Log( "CPU sampler benchmark (%d spp reference): %s RMSE %s, %.1f ms", results.myReferenceSpp,
+         GetSamplerName( ( SamplerType ) sampler ), rmseText, results.myTimeMs[ sampler ] );
+  }
+
+  return results;
+}
+
+eastl::vector< CpuSchedulerBenchmarkResults > CpuPathTracer::RunSchedulerBenchmark( const CpuRtConsts & someConsts ) {
+  using namespace Priv_CpuPathTracer;
+
+  eastl::vector< CpuSchedulerBenchmarkResults > results;
+  if ( myResolution.x * myResolution.y == 0u )
+    return results;
+
+  CpuRtConsts consts = someConsts;
+  consts.myAdaptiveSampling = false;
+  UpdateSky( consts );
+  UpdateLights( consts );
+
+  // Builds the sampler table and warms up the caches, so the first tile doesn't pay for it
+  RestartAccumulation();
+  RenderFrameDepthFirst( consts, *myThreadPool );
+
+  eastl::vector< uint > threadCounts;
+  const uint            maxThreads = glm::max( 1u, std::thread::hardware_concurrency() );
+  for ( uint numThreads = 1u; numThreads < maxThreads; numThreads *= 2u )
+    threadCounts.push_back( numThreads );
+  threadCounts.push_back( maxThreads );
+
+  eastl::vector< glm::float4 > singleThreadAccumulation;
+  eastl::vector< float >       tileTimesMs;
+  for ( uint numThreads : threadCounts ) {
+    CpuThreadPool                  threadPool( numThreads );
+    CpuSchedulerBenchmarkResults & result = results.push_back();
+    result.myNumThreads = threadPool.GetNumThreads();
+
+    // Same frames for every thread count
+    RestartAccumulation();
+    float64 bestFrameTimeMs = DBL_MAX;
+    tileTimesMs.clear();
+    for ( uint i = 0u; i < NUM_SCHEDULER_FRAMES; ++i ) {
+      consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + i;
+      const float64 startTime = SampleTimeMs();
+      RenderFrameDepthFirst( consts, threadPool );
+      bestFrameTimeMs = glm::min( bestFrameTimeMs, SampleTimeMs() - startTime );
+      ++myNumAccumulationFrames;
+      tileTimesMs.insert( tileTimesMs.end(), myTileTimesMs.begin(), myTileTimesMs.end() );
+    }
+
+    std::sort( tileTimesMs.begin(), tileTimesMs.end() );
+    const uint numTileTimes = ( uint ) tileTimesMs.size();
+    result.myFrameTimeMs = ( float ) glm::max( bestFrameTimeMs, 0.001 );
+    result.mySpeedup = results.front().myFrameTimeMs / result.myFrameTimeMs;
+    result.myTileMedianMs = tileTimesMs[ numTileTimes / 2u ];
+    result.myTileP99Ms = tileTimesMs[ glm::min( numTileTimes * 99u / 100u, numTileTimes - 1u ) ];
+    result.myTileMaxMs = tileTimesMs.back();
+
+    if ( singleThreadAccumulation.empty() )
+      singleThreadAccumulation = myAccumulationBuffer;
+    result.myMatchesSingleThread = memcmp( myAccumulationBuffer.data(), singleThreadAccumulation.data(),
+                                           myAccumulationBuffer.size() * sizeof( glm::float4 ) ) == 0;
+
+    Log( "CPU scheduler benchmark (%d threads): %.2f ms per frame, %.2fx speedup, tiles %.3f ms median, %.3f ms p99, "
+         "%.3f ms max%s",
+         result.myNumThreads, result.myFrameTimeMs, result.mySpeedup, result.myTileMedianMs, result.myTileP99Ms,
+         result.myTileMaxMs, result.myMatchesSingleThread ? "" : ", differs from one thread" );
+  }
+
+  RestartAccumulation();
+  return results;
+}
+
+CpuVertexFormatBenchmarkResults CpuPathTracer::RunVertexFormatBenchmark( const SceneData & aScene,
+                                                                         const CpuRtConsts & someConsts ) {
+  using namespace Priv_CpuPathTracer;
+
+  CpuVertexFormatBenchmarkResults results;
+  const uint                      numPixels = myResolution.x * myResolution.y;
+  if ( numPixels == 0u )
+    return results;
+
+  CpuRtConsts consts = someConsts;
+  consts.myRenderAo = false;
+  consts.myAdaptiveSampling = false;
+
+  const RtVertexFormat         sceneVertexFormat = myScene.myVertexFormat;
+  eastl::vector< glm::float4 > fullImage;
+  for ( uint format = 0u; format < ( uint ) RtVertexFormat::NUM; ++format ) {
+    InitScene( aScene, nullptr, ( RtVertexFormat ) format );
+
+    // A closest hit loads the indices of its triangle and the attributes of the three vertices
+    uint64 numTriangles = 0u;
+    uint64 numHitBytes = 0u;
+    for ( const CpuRtMesh & mesh : myScene.myMeshes ) {
+      const uint   vertexFlags = mesh.GetVertexFlags();
+      const uint64 indexSize = ( vertexFlags & RT_VERTEX_FLAG_INDEX16 ) ? 3u * sizeof( uint16 ) : sizeof( glm::uvec3 );
+      const uint64 vertexSize =
+          ( vertexFlags & RT_VERTEX_FLAG_COMPACT ) ? sizeof( CpuRtCompactVertexData ) : sizeof( CpuRtVertexData );
+      numTriangles += mesh.myTriangles.mySize;
+      numHitBytes += mesh.myTriangles.mySize * ( indexSize + 3u * vertexSize );
+      results.myShadingMemorySize[ format ] += mesh.GetShadingVertexSize() + mesh.GetShadingIndexSize();
+    }
+    results.myBytesPerHit[ format ] = numTriangles > 0u ? ( float ) numHitBytes / ( float ) numTriangles : 0.0f;
+
+    float64 timeMs = 0.0;
+    for ( uint i = 0u; i < NUM_VERTEX_FORMAT_FRAMES; ++i ) {
+      consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + i;
+      const float64 startTime = SampleTimeMs();
+      RenderFrame( consts );
+      timeMs += SampleTimeMs() - startTime;
+    }
+    results.myTimeMs[ format ] = ( float ) ( timeMs / NUM_VERTEX_FORMAT_FRAMES );
+
+    if ( ( RtVertexFormat ) format == RtVertexFormat::FULL )
+      fullImage = myAccumulationBuffer;
+    else
+      results.myFormatRmse = ComputeRelativeRmse( myAccumulationBuffer.data(), fullImage.data(), numPixels );
+  }
+
+  // The difference between the formats is only visible if it comes close to the noise of the renders. The quasi-random
+  // samplers take the sample index rather than the frame seed, so the second render needs another scramble seed.
+  InitScene( aScene, nullptr, RtVertexFormat::FULL );
+  consts.mySamplerSeed = someConsts.mySamplerSeed + 1u;
+  for ( uint i = 0u; i < NUM_VERTEX_FORMAT_FRAMES; ++i ) {
+    consts.myFrameRandomSeed = someConsts.myFrameRandomSeed + NUM_VERTEX_FORMAT_FRAMES + i;
+    RenderFrame( consts );
+  }
+  results.myNoiseRmse = ComputeRelativeRmse( myAccumulationBuffer.data(), fullImage.data(), numPixels );
+  results.myMaxFormatRmse = results.myNoiseRmse * VERTEX_FORMAT_MAX_NOISE_RATIO;
+  results.myNumFrames = NUM_VERTEX_FORMAT_FRAMES;
+
+  InitScene( aScene, nullptr, sceneVertexFormat );
+
+  for ( uint format = 0u; format < ( uint ) RtVertexFormat::NUM; ++format ) {
+    Log( "CPU vertex format benchmark (%u spp): %s %.1f KiB of shading data, %.1f bytes per hit, %.2f ms per frame",
+         results.myNumFrames, GetVertexFormatName( ( RtVertexFormat ) format ),
+         ( float ) results.myShadingMemorySize[ format ] / 1024.0f, results.myBytesPerHit[ format ],
+         results.myTimeMs[ format ] );
+  }
+  Log( "CPU vertex format benchmark: relative RMSE of compact against full %.5f (limit %.5f), noise %.5f",
+       results.myFormatRmse, results.myMaxFormatRmse, results.myNoiseRmse );
+  return results;
+}
+
+void CpuPathTracer::GetPrimaryRay( const glm::float2 & aPixel, const CpuRtConsts & someConsts,
+                                   glm::float3 & anOriginOut, glm::float3 & aDirOut ) const {
+  glm::float2 vpLerp = aPixel / glm::float2( myResolution );
+  vpLerp.y = 1.0f - vpLerp.y;
+  anOriginOut = someConsts.myNearPlaneCorner + someConsts.myXAxis * vpLerp.x + someConsts.myYAxis * vpLerp.y;
+  aDirOut = glm::normalize( anOriginOut - someConsts.myCameraPos );
+}
+
+void CpuPathTracer::GetPixelSteps( const glm::float3 & aPos, const CpuRtConsts & someConsts,
+                                   glm::float3 & aStepXOut, glm::float3 & aStepYOut ) const {
+  // The steps on the near plane, scaled by the distance of aPos along the view axis relative to the near plane
+  const glm::float3 viewAxis = glm::cross( someConsts.myXAxis, someConsts.myYAxis );
+  const float       nearDist = glm::dot( someConsts.myNearPlaneCorner - someConsts.myCameraPos, viewAxis );
+  const float       scale = glm::dot( aPos - someConsts.myCameraPos, viewAxis ) / nearDist;
+  aStepXOut = someConsts.myXAxis * ( scale / ( float ) myResolution.x );
+  aStepYOut = someConsts.myYAxis * ( scale / ( float ) myResolution.y );
+}
+
+glm::float3 CpuPathTracer::SampleBaseColorTexture( uint aTexture, const CpuHit & aHit, const glm::float3 & aHitPos,
+                                                   const glm::float2 & aUv, const CpuRtConsts & someConsts ) const {
+  glm::float3 positions[ 3 ];
+  glm::float2 uvs[ 3 ];
+  myScene.GetHitTriangle( aHit, positions, uvs );
+
+  glm::float3 pixelStepX;
+  glm::float3 pixelStepY;
+  GetPixelSteps( aHitPos, someConsts, pixelStepX, pixelStepY );
+
+  const CpuTextureFile & texture = myTextureCache->GetTexture( aTexture );
+  const glm::float2      textureSize( ( float ) texture.GetWidth( 0u ), ( float ) texture.GetHeight( 0u ) );
+  const float lod = GetTextureLod( aHitPos, someConsts.myCameraPos, pixelStepX, pixelStepY, positions, uvs,
+                                   textureSize );
+  return myTextureCache->Sample( aTexture, aUv, lod );
+}
+
+glm::float3 CpuPathTracer::SampleSkyLuminance( const glm::float3 & aViewPos, const glm::float3 & aViewDir,
+                                               const CpuRtConsts & someConsts ) const {
+  // The LUT lookups are only approximations of the per-ray integration in SampleSky.hlsl, but much cheaper. The LUTs
+  // are only recomputed when the sky parameters or the camera height bucket change.
+  if ( !someConsts.mySampleSky )
+    return someConsts.mySkyFallbackEmission;
+
+  return mySky.SampleSkyLuminance( aViewPos, aViewDir );
+}
+
+void CpuPathTracer::GenerateCameraRay( const glm::uvec2 & aPixel, const CpuRtConsts & someConsts,
+                                       SamplerState & aSamplerState, CpuRay & aRayOut ) const {
+  aSamplerState = InitSampler( aPixel, myResolution, someConsts.myFrameRandomSeed, myNumAccumulationFrames,
+                               someConsts.mySamplerSeed, someConsts.mySampler );
+
+  glm::float2 pixel( aPixel );
+
+  const float jitterX = GetSample01( aSamplerState );
+  const float jitterY = GetSample01( aSamplerState );
+  pixel += glm::float2( glm::mix( -0.5f, 0.5f, jitterX ), glm::mix( -0.5f, 0.5f, jitterY ) );
+  pixel = glm::clamp( pixel, glm::float2( 0.0f ), glm::float2( myResolution ) );
+
+  GetPrimaryRay( pixel, someConsts, aRayOut.myOrigin, aRayOut.myDirection );
+  aRayOut.myTMin = 0.0f;
+  aRayOut.myTMax = 10000.0f;
+}
+
+glm::float3 CpuPathTracer::ShadePath( const CpuRay & aRay, const CpuHit & aPrimaryHit, bool aHasPrimaryHit,
+                                      SamplerState & aSamplerState, const CpuRtConsts & someConsts,
+                                      uint & aNumRaysOut ) const {
+  CpuRay ray = aRay;
+
+  glm::float3 luminance( 0.0f );
+  glm::float3 transmission( 1.0f );
+  float       lastBrdfPdf = 0.0f;
+  glm::float3 lastNormal( 0.0f );
+
+  aNumRaysOut = 1u;
+  for ( uint bounceIdx = 0u; bounceIdx <= someConsts.myMaxRecursionDepth; ++bounceIdx ) {
+    CpuHit hit = aPrimaryHit;
+    bool   hasHit = aHasPrimaryHit;
+    if ( bounceIdx > 0u ) {
+      hasHit = myScene.TraceClosest( ray, hit );
+      ++aNumRaysOut;
+    }
+
+    if ( !ShadeBounce( hit, hasHit, bounceIdx, ray, aSamplerState, luminance, transmission, lastBrdfPdf, lastNormal,
+                       someConsts ) )
+      break;
+  }
+
+  return luminance;
+}
+
+bool CpuPathTracer::ShadeBounce( const CpuHit & aHit, bool aHasHit, uint aBounceIdx, CpuRay & aRayInOut,
+                                 SamplerState & aSamplerState, glm::float3 & aLuminanceInOut,
+                                 glm::float3 & aTransmissionInOut, float & aLastBrdfPdfInOut,
+                                 glm::float3 & aLastNormalInOut, const CpuRtConsts & someConsts ) const {
+  using namespace Priv_CpuPathTracer;
+
+  if ( !aHasHit ) {
+    const glm::float3 skyLuminance = SampleSkyLuminance( aRayInOut.myOrigin, aRayInOut.myDirection, someConsts );
+    const glm::float3 sunLuminance = GetSunDiscLuminance( aRayInOut, aLastBrdfPdfInOut, someConsts );
+    aLuminanceInOut += aTransmissionInOut * ( skyLuminance + sunLuminance );
+    return false;
+  }
+
+  // ClosestHit
+  const CpuRtInstance & instance = myScene.myInstances[ aHit.myInstanceIdx ];
+  const CpuRtMaterial & material = myScene.myMaterials[ instance.myMaterialIndex ];
+  const CpuRtVertexData vertexData = myScene.GetInterpolatedVertexData( aHit );
+  const glm::float3     hitPos = aRayInOut.myOrigin + aRayInOut.myDirection * aHit.myT;
+  glm::float3           hitColor = material.myColor;
+  glm::float3           hitNormal = vertexData.myNormal;
+  glm::float3           hitEmission = material.myEmission;
+
+  if ( material.myBaseColorTexture != CPU_TEXTURE_NONE )
+    hitColor *= SampleBaseColorTexture( material.myBaseColorTexture, aHit, hitPos, vertexData.myUv, someConsts );
+
+  if ( glm::dot( hitNormal, -aRayInOut.myDirection ) < 0.0f )
+    hitNormal = -hitNormal;
+
+  if ( aHit.myInstanceIdx == someConsts.myLightInstanceId )
+    hitEmission = someConsts.myLightEmission;
+
+  // RayGen
+  // Emission that next-event estimation could also have sampled from the previous hit is weighted against it
+  float emissionWeight = 1.0f;
+  if ( someConsts.myNextEventEstimation && aLastBrdfPdfInOut > 0.0f ) {
+    const float lightPdf = myLights.GetPdf( someConsts.myLightSampling, aRayInOut.myOrigin, aLastNormalInOut,
+                                            aHit.myInstanceIdx, aHit.myPrimitiveIdx, aRayInOut.myDirection, aHit.myT );
+    emissionWeight = GetPowerHeuristic( aLastBrdfPdfInOut, lightPdf );
+  }
+  aLuminanceInOut += aTransmissionInOut * hitEmission * emissionWeight;
+
+  const bool  isLastBounce = aBounceIdx >= someConsts.myMaxRecursionDepth;
+  const float specularPower = someConsts.myPhongSpecularPower;
+
+  const float fresnel = GetFresnelSchlick( hitNormal, -aRayInOut.myDirection );
+  const float specRayProbability = EstimateSpecularRayProbability( SPECULAR_STRENGTH, hitColor, fresnel );
+
+  // The BRDF sample of the last bounce is never traced, so light sampled from here would have no MIS counterpart and
+  // the paths would be one bounce longer than without next-event estimation
+  if ( someConsts.myNextEventEstimation && !isLastBounce )
+    aLuminanceInOut += aTransmissionInOut * SampleDirectLight( hitPos, hitNormal, -aRayInOut.myDirection, hitColor,
+                                                               fresnel, specRayProbability, aBounceIdx,
+                                                               aSamplerState, someConsts );
+
+  SetSamplerDimension( aSamplerState, aBounceIdx, SAMPLER_BRDF_DIMENSION );
+  if ( GetSample01( aSamplerState ) < specRayProbability ) {
+    const float rand0 = GetSample01( aSamplerState );
+    const float rand1 = GetSample01( aSamplerState );
+
+    float             pdf;
+    const glm::float3 nextSampleDir =
+        SampleModifiedPhong( glm::float2( rand0, rand1 ), hitNormal, specularPower, pdf );
+    const glm::float3 brdf = glm::float3(
+        fresnel * EvaluateModifiedPhong( hitNormal, nextSampleDir, -aRayInOut.myDirection, SPECULAR_STRENGTH,
+                                         specularPower ) );
+
+    aTransmissionInOut *= brdf / glm::max( 0.01f, pdf );
+    aTransmissionInOut /= specRayProbability;
+    aRayInOut.myDirection = nextSampleDir;
+  } else {
+    const glm::float3 brdf = ( 1.0f - fresnel ) * GetLambertianBRDF( hitColor, hitNormal, -aRayInOut.myDirection );
+    const float       pdf = GetLambertianPDF( hitNormal, -aRayInOut.myDirection );
+    aTransmissionInOut *= brdf / pdf;
+    aTransmissionInOut /= ( 1.0f - specRayProbability );
+
+    const float rand0 = GetSample01( aSamplerState );
+    const float rand1 = GetSample01( aSamplerState );
+    aRayInOut.myDirection = GetCosineWeightedHemisphereDirection( glm::float2( rand0, rand1 ), hitNormal );
+  }
+
+  aLastBrdfPdfInOut = GetBrdfPDF( hitNormal, aRayInOut.myDirection, specRayProbability, specularPower );
+  aLastNormalInOut = hitNormal;
+
+  // Russian roulette. Paths that carry little light are likely to end, the others are reweighted so the estimate stays
+  // the same. The largest channel of the throughput keeps saturated paths alive more often than their luminance would.
+  // The BRDF sample of the last bounce isn't traced anyway.
+  if ( someConsts.myRussianRoulette && aBounceIdx >= someConsts.myRussianRouletteMinBounces && !isLastBounce ) {
+    const float survivalProbability = glm::clamp( glm::compMax( aTransmissionInOut ),
+                                                  someConsts.myRussianRouletteMinSurvival,
+                                                  someConsts.myRussianRouletteMaxSurvival );
+    SetSamplerDimension( aSamplerState, aBounceIdx, SAMPLER_ROULETTE_DIMENSION );
+    if ( GetSample01( aSamplerState ) >= survivalProbability )
+      return false;
+    aTransmissionInOut /= survivalProbability;
+  }
+
+  aRayInOut.myOrigin = hitPos;
+  aRayInOut.myTMin = 0.001f;
+
+  return true;
+}
+
+glm::float3 CpuPathTracer::GetSunDiscLuminance( const CpuRay & aRay, float aLastBrdfPdf,
+                                            const CpuRtConsts & someConsts ) const {
+  if ( !someConsts.mySampleSky )
+    return glm::float3( 0.0f );
+
+  const glm::float3 sunLuminance = mySky.GetSunDiscLuminance( aRay.myOrigin, aRay.myDirection );
+  if ( !someConsts.myNextEventEstimation || aLastBrdfPdf <= 0.0f || sunLuminance == glm::float3( 0.0f ) )
+    return sunLuminance;
+
+  return sunLuminance * GetPowerHeuristic( aLastBrdfPdf, 1.0f / GetSunSolidAngle() );
+}
+
+glm::float3 CpuPathTracer::SampleDirectLight( const glm::float3 & aPos, const glm::float3 & aNormal,
+                                              const glm::float3 & aView, const glm::float3 & aBaseColor,
+                                              float aFresnel, float aSpecRayProbability, uint aBounceIdx,
+                                              SamplerState & aSamplerState, const CpuRtConsts & someConsts ) const {
+  using namespace Priv_CpuPathTracer;
+
+  const float specularPower = someConsts.myPhongSpecularPower;
+  glm::float3 luminance( 0.0f );
+
+  if ( someConsts.mySampleSky ) {
+    SetSamplerDimension( aSamplerState, aBounceIdx, SAMPLER_SUN_DIMENSION );
+    const float       rand0 = GetSample01( aSamplerState );
+    const float       rand1 = GetSample01( aSamplerState );
+    const glm::float3 sunDir = SampleSunDisc( glm::float2( rand0, rand1 ), someConsts.mySkyParams.mySunDirection );
+    const glm::float3 brdf =
+        EvaluateBrdf( aNormal, sunDir, aView, aBaseColor, aFresnel, SPECULAR_STRENGTH, specularPower );
+    if ( brdf != glm::float3( 0.0f ) ) {
+      CpuRay shadowRay;
+      shadowRay.myOrigin = aPos;
+      shadowRay.myDirection = sunDir;
+      shadowRay.myTMin = SHADOW_RAY_TMIN;
+      shadowRay.myTMax = 10000.0f;
+      if ( !myScene.TraceAny( shadowRay ) ) {
+        // The sun luminance over the pdf of the disc samples is its illuminance
+        const float sunPdf = 1.0f / GetSunSolidAngle();
+        const float brdfPdf = GetBrdfPDF( aNormal, sunDir, aSpecRayProbability, specularPower );
+        luminance += brdf * mySky.GetSunIlluminance( aPos ) * GetPowerHeuristic( sunPdf, brdfPdf );
+      }
+    }
+  }
+
+  if ( myLights.IsEmpty() )
+    return luminance;
+
+  SetSamplerDimension( aSamplerState, aBounceIdx, SAMPLER_LIGHT_DIMENSION );
+  const float rand0 = GetSample01( aSamplerState );
+  const float rand1 = GetSample01( aSamplerState );
+  const float rand2 = GetSample01( aSamplerState );
+
+  CpuRtLightSample lightSample;
+  if ( !myLights.Sample( someConsts.myLightSampling, aPos, aNormal, glm::float3( rand0, rand1, rand2 ),
+                         lightSample ) )
+    return luminance;
+
+  const glm::float3 brdf = EvaluateBrdf( aNormal, lightSample.myDirection, aView, aBaseColor, aFresnel,
+                                         SPECULAR_STRENGTH, specularPower );
+  if ( brdf == glm::float3( 0.0f ) )
+    return luminance;
+
+  CpuRay shadowRay;
+  shadowRay.myOrigin = aPos;
+  shadowRay.myDirection = lightSample.myDirection;
+  shadowRay.myTMin = SHADOW_RAY_TMIN;
+  shadowRay.myTMax = lightSample.myDistance * ( 1.0f - 1e-3f );
+  if ( myScene.TraceAny( shadowRay ) )
+    return luminance;
+
+  const float brdfPdf = GetBrdfPDF( aNormal, lightSample.myDirection, aSpecRayProbability, specularPower );
+  const float weight = GetPowerHeuristic( lightSample.myPdf, brdfPdf );
+  return luminance + brdf * lightSample.myEmission * ( weight / lightSample.myPdf );
+}
+
+glm::float3 CpuPathTracer::ShadeAo( const CpuRay & aRay, const CpuHit & aPrimaryHit, bool aHasPrimaryHit,
+                                    SamplerState & aSamplerState, const CpuRtConsts & someConsts ) const {
+  using namespace Priv_CpuPathTracer;
+
+  if ( !aHasPrimaryHit )
+    return SampleSkyLuminance( aRay.myOrigin, aRay.myDirection, someConsts );
+
+  const glm::float3 hitPos = aRay.myOrigin + aRay.myDirection * aPrimaryHit.myT;
+  const glm::float3 hitNormal = myScene.GetInterpolatedVertexData( aPrimaryHit ).myNormal;
+
+  // All AO rays start at the same point, so they are traced as packets
+  const uint packetWidth = CpuRtScene::GetPacketWidth();
+  uint       numAoHits = 0u;
+  for ( uint firstRay = 0u; firstRay < NUM_AO_RAYS; firstRay += packetWidth ) {
+    CpuRayPacket packet;
+    uint         laneMask = 0u;
+    for ( uint lane = 0u; lane < packetWidth && firstRay + lane < NUM_AO_RAYS; ++lane ) {
+      const float       rand0 = GetSample01( aSamplerState );
+      const float       rand1 = GetSample01( aSamplerState );
+      const glm::float2 rand11 = glm::float2( rand0, rand1 ) * 2.0f - 1.0f;
+
+      CpuRay aoRay;
+      aoRay.myOrigin = hitPos;
+      aoRay.myTMin = 0.01f;
+      aoRay.myDirection = GetHemisphereDirection( rand11, hitNormal );
+      aoRay.myTMax = someConsts.myAoDistance;
+      packet.SetRay( lane, aoRay );
+      laneMask |= 1u << lane;
+    }
+
+    numAoHits += CountSetBits( myScene.TraceAnyPacket( packet, laneMask ) );
+  }
+
+  const float ao = 1.0f - float( numAoHits ) / float( NUM_AO_RAYS );
+  return glm::float3( ao );
+}
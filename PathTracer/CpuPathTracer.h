@@ -0,0 +1,331 @@
+#pragma once
+
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+#include "Common/Ptr.h"
+#include "CpuRtLights.h"
+#include "CpuRtSampler.h"
+#include "CpuRtScene.h"
+#include "CpuRtShading.h"
+#include "CpuSky.h"
+
+class CpuTextureCache;
+class CpuThreadPool;
+
+namespace Fancy {
+  struct SceneData;
+}
+
+using namespace Fancy;
+
+// Pixel tiles of the CPU scheduler and of the error estimate of adaptive sampling, on the CPU and the GPU. Same as
+// TILE_SIZE in compute_tile_error.hlsl and RT_TILE_SIZE in raytracing/Common.hlsl.
+const uint CPU_RT_TILE_SIZE = 16u;
+
+// Mirrors the parts of the RtConsts cbuffer in PathTracing.hlsl/Ao.hlsl that the integrator reads
+struct CpuRtConsts {
+  glm::float3 myNearPlaneCorner;
+  float       myAoDistance = 1.0f;
+  glm::float3 myXAxis;
+  glm::float3 myYAxis;
+  glm::float3 myCameraPos;
+
+  uint myFrameRandomSeed = 0u;
+  uint myMaxRecursionDepth = 4u;
+  uint myLightInstanceId = UINT_MAX;
+
+  // Where the paths take their random numbers from. The sequences of the quasi-random samplers are indexed by the
+  // accumulated frames and scrambled with mySamplerSeed, which has to stay the same until the accumulation restarts.
+  SamplerType mySampler = SamplerType::SOBOL;
+  uint        mySamplerSeed = 0u;
+
+  glm::float3      myLightEmission = glm::float3( 0.0f );
+  bool             mySampleSky = true;
+  SkyLutParameters mySkyParams;  // Only used with mySampleSky
+  SkyLookup        mySkyLookup = SkyLookup::SKY_VIEW_LUT;
+
+  glm::float3 mySkyFallbackEmission = glm::float3( 0.0f );
+  float       myPhongSpecularPower = 10.0f;
+
+  // Samples the sun and the emissive instances at every bounce and weights the samples against the BRDF samples with
+  // multiple importance sampling
+  bool          myNextEventEstimation = true;
+  LightSampling myLightSampling = LightSampling::LIGHT_BVH;
+
+  // Russian roulette. From bounce myRussianRouletteMinBounces on, paths continue with the largest channel of their
+  // throughput as probability, clamped to [ myRussianRouletteMinSurvival, myRussianRouletteMaxSurvival ], and the
+  // survivors are reweighted by it. The lower bound limits the weight of the survivors, the upper one lets bright
+  // paths end too.
+  bool  myRussianRoulette = true;
+  uint  myRussianRouletteMinBounces = 2u;
+  float myRussianRouletteMinSurvival = 0.05f;
+  float myRussianRouletteMaxSurvival = 0.95f;
+
+  // Adaptive sampling. Once every pixel has myAdaptiveMinSamples samples, only the tiles whose estimated relative RMSE
+  // is above myAdaptiveErrorThreshold get more, see CpuPathTracer::UpdateTileErrors(). Once no tile is left, the image
+  // has converged and RenderFrame() does nothing.
+  bool  myAdaptiveSampling = false;
+  float myAdaptiveErrorThreshold = 0.02f;
+  uint  myAdaptiveMinSamples = 16u;
+
+  bool myRenderAo = false;
+  bool myWavefront = false;  // Trace all paths one bounce at a time instead of depth-first, see RenderFrameWavefront()
+};
+
+// Throughput of the scalar and the packet traversal for primary and AO rays, in million rays per second
+struct CpuTraversalBenchmarkResults {
+  const char * mySimdName = "";
+  uint         mySimdWidth = 0u;
+  uint         myNumPrimaryRays = 0u;
+  uint         myNumAoRays = 0u;
+  float        myPrimaryScalarMrays = 0.0f;
+  float        myPrimaryPacketMrays = 0.0f;
+  float        myAoScalarMrays = 0.0f;
+  float        myAoPacketMrays = 0.0f;
+};
+
+// Per-bounce timings of the wavefront mode. The depth-first and unsorted numbers are only filled by
+// RunWavefrontBenchmark().
+struct CpuWavefrontBounceStats {
+  uint  myNumRays = 0u;
+  float mySortTimeMs = 0.0f;
+  float myTraceTimeMs = 0.0f;
+  float myDepthFirstMrays = 0.0f;      // Scalar traversal in pixel order, like ShadePath() does
+  float myUnsortedPacketMrays = 0.0f;  // Packets in pixel order
+  float mySortedPacketMrays = 0.0f;    // Packets in sort order, including the sort
+};
+
+// Cost of the BRDF-only integrator and of next-event estimation for the same noise level, see
+// RunIntegratorBenchmark(). The RMSE is relative to a high sample count reference.
+struct CpuIntegratorBenchmarkResults {
+  uint  myReferenceSpp = 0u;
+  uint  myBrdfSpp = 0u;
+  float myTargetRmse = 0.0f;  // Of the BRDF-only integrator after myBrdfSpp
+  float myBrdfTimeMs = 0.0f;
+  uint  myNeeSpp = 0u;  // Samples next-event estimation needed to get below myTargetRmse
+  float myNeeRmse = 0.0f;
+  float myNeeTimeMs = 0.0f;
+};
+
+// Cost of paths of fixed length and of Russian roulette for the same noise level, see RunRussianRouletteBenchmark().
+// The RMSE is relative to a high sample count reference without Russian roulette.
+struct CpuRussianRouletteBenchmarkResults {
+  uint  myReferenceSpp = 0u;
+  uint  myFixedSpp = 0u;
+  float myTargetRmse = 0.0f;  // Without Russian roulette after myFixedSpp
+  float myFixedTimeMs = 0.0f;
+  float myFixedPathLength = 0.0f;  // Rays per path, without shadow rays
+  uint  myRouletteSpp = 0u;        // Samples Russian roulette needed to get below myTargetRmse
+  float myRouletteRmse = 0.0f;
+  float myRouletteTimeMs = 0.0f;
+  float myRoulettePathLength = 0.0f;
+  float mySpeedup = 0.0f;  // myFixedTimeMs over myRouletteTimeMs, the gain in samples/s at equal noise
+};
+
+// Convergence of each sampler, see RunSamplerBenchmark(). The RMSE is relative to a high sample count reference.
+struct CpuSamplerBenchmarkResults {
+  enum : uint { NUM_STEPS = 7u };  // 1, 2, 4, ... 64 spp
+
+  uint  myReferenceSpp = 0u;
+  uint  mySpp[ NUM_STEPS ] = {};
+  float myRmse[ ( uint ) SamplerType::NUM ][ NUM_STEPS ] = {};
+  float myTimeMs[ ( uint ) SamplerType::NUM ] = {};  // For all NUM_STEPS steps of one run
+};
+
+// Frame time and per-tile latency of the depth-first renderer with a given number of threads, see
+// RunSchedulerBenchmark()
+struct CpuSchedulerBenchmarkResults {
+  uint  myNumThreads = 0u;
+  float myFrameTimeMs = 0.0f;  // Best of a few frames
+  float mySpeedup = 0.0f;      // Frame time of one thread over myFrameTimeMs
+  float myTileMedianMs = 0.0f;
+  float myTileP99Ms = 0.0f;
+  float myTileMaxMs = 0.0f;
+  bool  myMatchesSingleThread = false;  // The accumulation buffer is bit-identical to the one of a single thread
+};
+
+// Shading data of each RtVertexFormat and its effect on the image, see RunVertexFormatBenchmark()
+struct CpuVertexFormatBenchmarkResults {
+  uint   myNumFrames = 0u;
+  uint64 myShadingMemorySize[ ( uint ) RtVertexFormat::NUM ] = {};  // Vertex attributes and indices of all meshes
+  float  myBytesPerHit[ ( uint ) RtVertexFormat::NUM ] = {};  // That a closest hit loads, averaged over the triangles
+  float  myTimeMs[ ( uint ) RtVertexFormat::NUM ] = {};       // Per frame
+  float  myFormatRmse = 0.0f;     // Relative, of the compact render against the full one with the same seeds
+  float  myNoiseRmse = 0.0f;      // Relative, of two full renders with different seeds
+  float  myMaxFormatRmse = 0.0f;  // A fixed share of myNoiseRmse
+
+  bool IsFormatWithinNoise() const {
+    return myFormatRmse <= myMaxFormatRmse;
+  }
+};
+
+// Root of the mean squared error of the rgb channels of someValues, each relative to the squared value of its reference
+float ComputeRelativeRmse( const glm::float4 * someValues, const glm::float4 * someReferences, uint aCount );
+
+// Multithreaded CPU implementation of the RayGen/ClosestHit shaders in PathTracing.hlsl and Ao.hlsl.
+// The accumulation buffer has the same semantics as myHdrLightTex: the running average of the radiance in rgb and the
+// number of samples of the pixel in w.
+class CpuPathTracer {
+public:
+  CpuPathTracer();
+  ~CpuPathTracer();
+
+  // aCache is optional, as is streaming the BLAS from it, see CpuRtScene::Init(). The base-color textures of the
+  // materials are added to the texture cache, which drops those of the last scene.
+  void InitScene( const SceneData & aScene, SceneCache * aCache = nullptr,
+                  RtVertexFormat aVertexFormat = RtVertexFormat::FULL, uint64 aBlasStreamingBudget = 0u );
+
+  // Moves scene instances, see CpuRtScene::UpdateInstanceTransforms(). Restarts the accumulation.
+  CpuTlasUpdate UpdateInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                                          uint aNumInstances );
+
+  // See CpuRtScene::RunTlasUpdateBenchmark()
+  CpuTlasUpdateBenchmarkResults RunTlasUpdateBenchmark( uint aNumInstances );
+  void SetResolution( uint aWidth, uint aHeight );
+  void RestartAccumulation();
+
+  // Traces one sample per pixel and accumulates it. With adaptive sampling, only the pixels of the tiles that haven't
+  // converged yet get one.
+  void RenderFrame( const CpuRtConsts & someConsts );
+
+  // Traces one unjittered primary ray per pixel and 16 AO rays for a subset of the primary hits, once with the scalar
+  // and once with the packet traversal. Doesn't touch the accumulation buffer.
+  CpuTraversalBenchmarkResults RunTraversalBenchmark( const CpuRtConsts & someConsts );
+
+  // Traces one wavefront frame and times each bounce with the depth-first, unsorted and sorted traversal. Doesn't
+  // touch the accumulation buffer.
+  const eastl::vector< CpuWavefrontBounceStats > & RunWavefrontBenchmark( const CpuRtConsts & someConsts );
+
+  // Renders a reference with next-event estimation, then measures how long the BRDF-only integrator and next-event
+  // estimation take to reach the same RMSE. Restarts the accumulation.
+  CpuIntegratorBenchmarkResults RunIntegratorBenchmark( const CpuRtConsts & someConsts );
+
+  // Renders a reference without Russian roulette, then measures how long the paths of fixed length and Russian roulette
+  // take to reach the same RMSE. Restarts the accumulation.
+  CpuRussianRouletteBenchmarkResults RunRussianRouletteBenchmark( const CpuRtConsts & someConsts );
+
+  // Renders a reference with another scramble seed, then measures the RMSE of each sampler after 1, 2, 4, ... samples
+  // per pixel, averaged over a few scramble seeds. Restarts the accumulation.
+  CpuSamplerBenchmarkResults RunSamplerBenchmark( const CpuRtConsts & someConsts );
+
+  // Renders a few frames with 1, 2, 4, ... threads, up to the number of hardware threads, and times the frames and
+  // each tile. Restarts the accumulation.
+  eastl::vector< CpuSchedulerBenchmarkResults > RunSchedulerBenchmark( const CpuRtConsts & someConsts );
+
+  // Rebuilds the scene from aScene with each RtVertexFormat and renders a few frames with the same seeds, then once
+  // more with the full format and other seeds for the noise level. The scene is rebuilt with its vertex format
+  // afterwards. Restarts the accumulation.
+  CpuVertexFormatBenchmarkResults RunVertexFormatBenchmark( const SceneData & aScene, const CpuRtConsts & someConsts );
+
+  const glm::float4 * GetAccumulationBuffer() const;
+  glm::uvec2          GetResolution() const;
+  uint                GetNumAccumulationFrames() const;
+  const CpuRtScene &  GetScene() const;
+  CpuThreadPool *     GetThreadPool() const;
+
+  // Base-color textures of the scene. Its budget can be changed at any time, its stats are reset with the accumulation.
+  CpuTextureCache & GetTextureCache() const;
+
+  // LUT computations of the sky, of the last frame or benchmark
+  const SkyLutStats & GetSkyStats() const;
+
+  // Of the last wavefront frame or benchmark
+  const eastl::vector< CpuWavefrontBounceStats > & GetWavefrontStats() const;
+
+  // Rays per path of the last frame, without shadow and AO rays
+  float GetAveragePathLength() const;
+
+  // Camera samples since the accumulation was restarted, over all pixels
+  uint64 GetNumAccumulatedSamples() const;
+
+  // Adaptive sampling: tiles that still get samples, out of all tiles. The image has converged if none are left.
+  uint GetNumActiveTiles() const;
+  uint GetNumTiles() const;
+  bool IsConverged() const;
+
+private:
+  // State of one path between two wavefront bounces
+  struct WavefrontPath {
+    CpuRay              myRay;
+    CpuRt::SamplerState mySamplerState;
+    glm::float3         myLuminance;
+    glm::float3         myTransmission;
+    float               myLastBrdfPdf;  // Of the direction of myRay, 0 for camera rays
+    glm::float3         myLastNormal;   // At the origin of myRay, for the light BVH
+    uint                myPixelIdx;
+  };
+
+  void UpdateSky( const CpuRtConsts & someConsts );
+  void UpdateLights( const CpuRtConsts & someConsts );
+  void RenderFrameDepthFirst( const CpuRtConsts & someConsts, CpuThreadPool & aThreadPool );
+  void RenderFrameWavefront( const CpuRtConsts & someConsts, bool aBenchmark );
+  void SortWavefrontQueue();
+  void TraceWavefrontQueue();
+  void AccumulateSample( uint aPixelIdx, glm::float3 aLuminance );
+  void UpdateTileErrors( const CpuRtConsts & someConsts );
+  void GetTileBounds( uint aTileIdx, glm::uvec2 & aStartOut, glm::uvec2 & anEndOut ) const;
+
+  void        GenerateCameraRay( const glm::uvec2 & aPixel, const CpuRtConsts & someConsts,
+                                 CpuRt::SamplerState & aSamplerState, CpuRay & aRayOut ) const;
+  glm::float3 ShadePath( const CpuRay & aRay, const CpuHit & aPrimaryHit, bool aHasPrimaryHit,
+                         CpuRt::SamplerState & aSamplerState, const CpuRtConsts & someConsts,
+                         uint & aNumRaysOut ) const;
+  bool        ShadeBounce( const CpuHit & aHit, bool aHasHit, uint aBounceIdx, CpuRay & aRayInOut,
+                           CpuRt::SamplerState & aSamplerState, glm::float3 & aLuminanceInOut,
+                           glm::float3 & aTransmissionInOut, float & aLastBrdfPdfInOut,
+                           glm::float3 & aLastNormalInOut, const CpuRtConsts & someConsts ) const;
+  // The sun disc along a ray that left the scene, weighted against the sun samples of SampleDirectLight()
+  glm::float3 GetSunDiscLuminance( const CpuRay & aRay, float aLastBrdfPdf, const CpuRtConsts & someConsts ) const;
+  glm::float3 SampleDirectLight( const glm::float3 & aPos, const glm::float3 & aNormal, const glm::float3 & aView,
+                                 const glm::float3 & aBaseColor, float aFresnel, float aSpecRayProbability,
+                                 uint aBounceIdx, CpuRt::SamplerState & aSamplerState,
+                                 const CpuRtConsts & someConsts ) const;
+  glm::float3 ShadeAo( const CpuRay & aRay, const CpuHit & aPrimaryHit, bool aHasPrimaryHit,
+                       CpuRt::SamplerState & aSamplerState, const CpuRtConsts & someConsts ) const;
+  glm::float3 SampleSkyLuminance( const glm::float3 & aViewPos, const glm::float3 & aViewDir,
+                                  const CpuRtConsts & someConsts ) const;
+  void        GetPrimaryRay( const glm::float2 & aPixel, const CpuRtConsts & someConsts, glm::float3 & anOriginOut,
+                             glm::float3 & aDirOut ) const;
+  // Offsets of one pixel along the x- and y-axis of the image, in the plane parallel to the near plane through aPos
+  void        GetPixelSteps( const glm::float3 & aPos, const CpuRtConsts & someConsts, glm::float3 & aStepXOut,
+                             glm::float3 & aStepYOut ) const;
+  // Trilinear lookup with the mip of the pixel footprint at the hit. Hits of later bounces use the footprint the
+  // camera would see, which is too sharp after rough bounces but cheap.
+  glm::float3 SampleBaseColorTexture( uint aTexture, const CpuHit & aHit, const glm::float3 & aHitPos,
+                                      const glm::float2 & aUv, const CpuRtConsts & someConsts ) const;
+
+  UniquePtr< CpuThreadPool >   myThreadPool;
+  UniquePtr< CpuTextureCache > myTextureCache;
+  CpuRtScene                   myScene;
+  CpuRtLights                  myLights;
+  eastl::vector< glm::float4 > myAccumulationBuffer;
+  eastl::vector< float >       myMomentBuffer;  // Running average of the squared luminance per pixel
+  glm::uvec2                   myResolution = glm::uvec2( 0u );
+  uint                         myNumAccumulationFrames = 0u;
+  uint64                       myNumAccumulatedSamples = 0u;
+  uint                         myFrameNumSamples = 0u;
+  float                        myAveragePathLength = 0.0f;
+
+  // The tiles along a Morton curve over the tile grid. The thread pool hands out contiguous ranges of them, so the
+  // tiles of a thread are close to each other on screen and their rays touch the same parts of the BVH.
+  eastl::vector< uint >  myTileOrder;
+  eastl::vector< float > myTileTimesMs;  // Of each tile of the last depth-first frame, in rendering order
+
+  // Adaptive sampling. myTileErrors holds the estimated relative RMSE of each tile, myActiveTiles the tiles that are
+  // still above the threshold in the order of myTileOrder.
+  eastl::vector< float > myTileErrors;
+  eastl::vector< uint >  myActiveTiles;
+  CpuSky                       mySky;
+
+  // Wavefront mode. myWavefrontQueue holds the indices of the paths that are still alive in tracing order, the sort
+  // entries hold the sort key in the upper and the path index in the lower 32 bits.
+  eastl::vector< WavefrontPath >           myWavefrontPaths;
+  eastl::vector< uint >                    myWavefrontPixels;  // Of the active tiles, if not all are active
+  eastl::vector< CpuHit >                  myWavefrontHits;
+  eastl::vector< uint >                    myWavefrontQueue;
+  eastl::vector< uint64 >                  myWavefrontSortEntries;
+  eastl::vector< uint64 >                  myWavefrontSortTemp;
+  eastl::vector< CpuWavefrontBounceStats > myWavefrontStats;
+};
@@ -0,0 +1,291 @@
+#include "CpuPathTracer.h"
+
+#include "CpuThreadPool.h"
+#include "Timing.h"
+
+using namespace CpuRt;
+
+namespace Priv_CpuPathTracerWavefront {
+  // Rays are sorted by their direction octant first and then by the Morton code of their origin cell on a grid over
+  // the scene bounds. Rays that end up next to each other in the queue are traced as one packet.
+  const uint SORT_GRID_BITS = 7u;
+  const uint SORT_GRID_RESOLUTION = 1u << SORT_GRID_BITS;
+  const uint SORT_KEY_BITS = 3u + 3u * SORT_GRID_BITS;
+  const uint RADIX_BITS = 8u;
+  const uint NUM_RADIX_BUCKETS = 1u << RADIX_BITS;
+
+  const uint    PATHS_PER_JOB = 1024u;
+  const uint    PACKETS_PER_JOB = 64u;
+  const float64 MS_TO_MRAYS = 1.0 / 1000.0;
+
+  // Inserts two zero bits in front of each of the lower 10 bits
+  uint SpreadBits3( uint aValue ) {
+    aValue = ( aValue | ( aValue << 16u ) ) & 0x030000FFu;
+    aValue = ( aValue | ( aValue << 8u ) ) & 0x0300F00Fu;
+    aValue = ( aValue | ( aValue << 4u ) ) & 0x030C30C3u;
+    aValue = ( aValue | ( aValue << 2u ) ) & 0x09249249u;
+    return aValue;
+  }
+
+  uint GetSortKey( const CpuRay & aRay, const glm::float3 & aGridOrigin, const glm::float3 & aGridScale ) {
+    const uint octant = ( aRay.myDirection.x < 0.0f ? 1u : 0u ) | ( aRay.myDirection.y < 0.0f ? 2u : 0u ) |
+                        ( aRay.myDirection.z < 0.0f ? 4u : 0u );
+
+    const glm::float3 gridPos = glm::clamp( ( aRay.myOrigin - aGridOrigin ) * aGridScale, glm::float3( 0.0f ),
+                                            glm::float3( ( float ) ( SORT_GRID_RESOLUTION - 1u ) ) );
+    const glm::uvec3  cell( gridPos );
+    const uint        morton =
+        SpreadBits3( cell.x ) | ( SpreadBits3( cell.y ) << 1u ) | ( SpreadBits3( cell.z ) << 2u );
+    return ( octant << ( 3u * SORT_GRID_BITS ) ) | morton;
+  }
+
+  float GetMrays( uint aNumRays, float64 aTimeMs ) {
+    return ( float ) ( aNumRays / glm::max( aTimeMs, 0.001 ) * MS_TO_MRAYS );
+  }
+}  // namespace Priv_CpuPathTracerWavefront
+
+const eastl::vector< CpuWavefrontBounceStats > & CpuPathTracer::RunWavefrontBenchmark(
+    const CpuRtConsts & someConsts ) {
+  UpdateSky( someConsts );
+  UpdateLights( someConsts );
+  RenderFrameWavefront( someConsts, true );
+
+  for ( uint i = 0u; i < ( uint ) myWavefrontStats.size(); ++i ) {
+    const CpuWavefrontBounceStats & stats = myWavefrontStats[ i ];
+    Log( "CPU wavefront benchmark bounce %d: %d rays, depth-first %.2f Mrays/s, unsorted packets %.2f Mrays/s, "
+         "sorted packets %.2f Mrays/s (sort %.2f ms)",
+         i, stats.myNumRays, stats.myDepthFirstMrays, stats.myUnsortedPacketMrays, stats.mySortedPacketMrays,
+         stats.mySortTimeMs );
+  }
+
+  return myWavefrontStats;
+}
+
+const eastl::vector< CpuWavefrontBounceStats > & CpuPathTracer::GetWavefrontStats() const {
+  return myWavefrontStats;
+}
+
+void CpuPathTracer::RenderFrameWavefront( const CpuRtConsts & someConsts, bool aBenchmark ) {
+  using namespace Priv_CpuPathTracerWavefront;
+
+  myWavefrontStats.clear();
+
+  // Adaptive sampling only traces the pixels of the tiles that haven't converged yet, in tile order
+  const bool allPixels = !someConsts.myAdaptiveSampling || myActiveTiles.size() == GetNumTiles();
+  if ( !allPixels ) {
+    myWavefrontPixels.clear();
+    for ( uint tileIdx : myActiveTiles ) {
+      glm::uvec2 tileStart, tileEnd;
+      GetTileBounds( tileIdx, tileStart, tileEnd );
+      for ( uint y = tileStart.y; y < tileEnd.y; ++y ) {
+        for ( uint x = tileStart.x; x < tileEnd.x; ++x )
+          myWavefrontPixels.push_back( y * myResolution.x + x );
+      }
+    }
+  }
+
+  const uint numPaths = allPixels ? myResolution.x * myResolution.y : ( uint ) myWavefrontPixels.size();
+  myFrameNumSamples = numPaths;
+  if ( numPaths == 0u )
+    return;
+
+  myWavefrontPaths.resize( numPaths );
+  myWavefrontHits.resize( numPaths );
+  myWavefrontQueue.resize( numPaths );
+  // The queue that gets sorted varies from frame to frame, reserving for its maximum keeps later frames from allocating
+  myWavefrontSortEntries.reserve( numPaths );
+  myWavefrontSortTemp.reserve( numPaths );
+
+  const uint numPathJobs = ( numPaths + PATHS_PER_JOB - 1u ) / PATHS_PER_JOB;
+  myThreadPool->ParallelFor( numPathJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+    const uint end = glm::min( ( aJobIdx + 1u ) * PATHS_PER_JOB, numPaths );
+    for ( uint i = aJobIdx * PATHS_PER_JOB; i < end; ++i ) {
+      WavefrontPath & path = myWavefrontPaths[ i ];
+      const uint      pixelIdx = allPixels ? i : myWavefrontPixels[ i ];
+      GenerateCameraRay( glm::uvec2( pixelIdx % myResolution.x, pixelIdx / myResolution.x ), someConsts,
+                         path.mySamplerState, path.myRay );
+      path.myLuminance = glm::float3( 0.0f );
+      path.myTransmission = glm::float3( 1.0f );
+      path.myLastBrdfPdf = 0.0f;
+      path.myLastNormal = glm::float3( 0.0f );
+      path.myPixelIdx = pixelIdx;
+      myWavefrontQueue[ i ] = i;
+    }
+  } );
+
+  for ( uint bounceIdx = 0u; bounceIdx <= someConsts.myMaxRecursionDepth && !myWavefrontQueue.empty(); ++bounceIdx ) {
+    const uint                queueSize = ( uint ) myWavefrontQueue.size();
+    CpuWavefrontBounceStats & stats = myWavefrontStats.push_back();
+    stats.myNumRays = queueSize;
+
+    if ( aBenchmark ) {
+      // Each path's ray traced on its own in pixel order, like the bounce loop of ShadePath() does
+      const uint    numJobs = ( queueSize + PATHS_PER_JOB - 1u ) / PATHS_PER_JOB;
+      const float64 depthFirstStartTime = SampleTimeMs();
+      myThreadPool->ParallelFor( numJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+        const uint end = glm::min( ( aJobIdx + 1u ) * PATHS_PER_JOB, queueSize );
+        for ( uint i = aJobIdx * PATHS_PER_JOB; i < end; ++i ) {
+          CpuHit hit;
+          myScene.TraceClosest( myWavefrontPaths[ myWavefrontQueue[ i ] ].myRay, hit );
+        }
+      } );
+      stats.myDepthFirstMrays = GetMrays( queueSize, SampleTimeMs() - depthFirstStartTime );
+
+      const float64 unsortedStartTime = SampleTimeMs();
+      TraceWavefrontQueue();
+      stats.myUnsortedPacketMrays = GetMrays( queueSize, SampleTimeMs() - unsortedStartTime );
+    }
+
+    // The primary rays are already coherent in pixel order
+    const float64 sortStartTime = SampleTimeMs();
+    if ( bounceIdx > 0u )
+      SortWavefrontQueue();
+    const float64 traceStartTime = SampleTimeMs();
+    TraceWavefrontQueue();
+    const float64 traceEndTime = SampleTimeMs();
+
+    stats.mySortTimeMs = ( float ) ( traceStartTime - sortStartTime );
+    stats.myTraceTimeMs = ( float ) ( traceEndTime - traceStartTime );
+    stats.mySortedPacketMrays = GetMrays( queueSize, traceEndTime - sortStartTime );
+
+    // Paths that missed or reached the last bounce are dropped from the queue. The survivors are compacted so the
+    // packets of the next bounce stay full.
+    // Misses of a job are gathered and evaluated as one batch if the sky is integrated per ray, see
+    // CpuSky::SampleSkyLuminanceBatch()
+    const bool lastBounce = bounceIdx == someConsts.myMaxRecursionDepth;
+    const bool batchSkyMisses = someConsts.mySampleSky && someConsts.mySkyLookup == SkyLookup::INTEGRATE;
+    const uint numJobs = ( queueSize + PATHS_PER_JOB - 1u ) / PATHS_PER_JOB;
+    myThreadPool->ParallelFor( numJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+      uint        missPathIndices[ PATHS_PER_JOB ];
+      glm::float3 missPositions[ PATHS_PER_JOB ];
+      glm::float3 missDirs[ PATHS_PER_JOB ];
+      uint        numMisses = 0u;
+
+      const uint end = glm::min( ( aJobIdx + 1u ) * PATHS_PER_JOB, queueSize );
+      for ( uint i = aJobIdx * PATHS_PER_JOB; i < end; ++i ) {
+        const uint      pathIdx = myWavefrontQueue[ i ];
+        WavefrontPath & path = myWavefrontPaths[ pathIdx ];
+        const CpuHit &  hit = myWavefrontHits[ pathIdx ];
+        if ( batchSkyMisses && hit.myInstanceIdx == UINT_MAX ) {
+          missPathIndices[ numMisses ] = pathIdx;
+          missPositions[ numMisses ] = path.myRay.myOrigin;
+          missDirs[ numMisses ] = path.myRay.myDirection;
+          ++numMisses;
+          myWavefrontQueue[ i ] = UINT_MAX;
+          continue;
+        }
+
+        const bool alive = ShadeBounce( hit, hit.myInstanceIdx != UINT_MAX, bounceIdx, path.myRay, path.mySamplerState,
+                                        path.myLuminance, path.myTransmission, path.myLastBrdfPdf,
+                                        path.myLastNormal, someConsts );
+        if ( !alive || lastBounce )
+          myWavefrontQueue[ i ] = UINT_MAX;
+      }
+
+      if ( numMisses == 0u )
+        return;
+
+      glm::float3 missLuminances[ PATHS_PER_JOB ];
+      mySky.SampleSkyLuminanceBatch( missPositions, missDirs, numMisses, missLuminances );
+      for ( uint i = 0u; i < numMisses; ++i ) {
+        WavefrontPath & path = myWavefrontPaths[ missPathIndices[ i ] ];
+        path.myLuminance += path.myTransmission * ( missLuminances[ i ] +
+                                                    GetSunDiscLuminance( path.myRay, path.myLastBrdfPdf, someConsts ) );
+      }
+    } );
+
+    uint numAlive = 0u;
+    for ( uint i = 0u; i < queueSize; ++i ) {
+      if ( myWavefrontQueue[ i ] != UINT_MAX )
+        myWavefrontQueue[ numAlive++ ] = myWavefrontQueue[ i ];
+    }
+    myWavefrontQueue.resize( numAlive );
+  }
+
+  uint64 numRays = 0u;
+  for ( const CpuWavefrontBounceStats & stats : myWavefrontStats )
+    numRays += stats.myNumRays;
+  myAveragePathLength = ( float ) ( ( float64 ) numRays / numPaths );
+
+  if ( aBenchmark )
+    return;
+
+  myThreadPool->ParallelFor( numPathJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+    const uint end = glm::min( ( aJobIdx + 1u ) * PATHS_PER_JOB, numPaths );
+    for ( uint i = aJobIdx * PATHS_PER_JOB; i < end; ++i )
+      AccumulateSample( myWavefrontPaths[ i ].myPixelIdx, myWavefrontPaths[ i ].myLuminance );
+  } );
+}
+
+void CpuPathTracer::SortWavefrontQueue() {
+  using namespace Priv_CpuPathTracerWavefront;
+
+  const uint queueSize = ( uint ) myWavefrontQueue.size();
+  myWavefrontSortEntries.resize( queueSize );
+  myWavefrontSortTemp.resize( queueSize );
+
+  const glm::float3 gridOrigin = myScene.myBounds.myMin;
+  const glm::float3 gridScale =
+      ( float ) SORT_GRID_RESOLUTION / glm::max( myScene.myBounds.GetExtent(), glm::float3( FLT_MIN ) );
+
+  const uint numJobs = ( queueSize + PATHS_PER_JOB - 1u ) / PATHS_PER_JOB;
+  myThreadPool->ParallelFor( numJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+    const uint end = glm::min( ( aJobIdx + 1u ) * PATHS_PER_JOB, queueSize );
+    for ( uint i = aJobIdx * PATHS_PER_JOB; i < end; ++i ) {
+      const uint key = GetSortKey( myWavefrontPaths[ myWavefrontQueue[ i ] ].myRay, gridOrigin, gridScale );
+      myWavefrontSortEntries[ i ] = ( ( uint64 ) key << 32u ) | myWavefrontQueue[ i ];
+    }
+  } );
+
+  // LSD radix sort over the key bits. Stable, so paths of the same cell keep their pixel order.
+  for ( uint shift = 32u; shift < 32u + SORT_KEY_BITS; shift += RADIX_BITS ) {
+    uint bucketOffsets[ NUM_RADIX_BUCKETS ] = {};
+    for ( uint i = 0u; i < queueSize; ++i )
+      ++bucketOffsets[ ( myWavefrontSortEntries[ i ] >> shift ) & ( NUM_RADIX_BUCKETS - 1u ) ];
+
+    uint offset = 0u;
+    for ( uint bucket = 0u; bucket < NUM_RADIX_BUCKETS; ++bucket ) {
+      const uint count = bucketOffsets[ bucket ];
+      bucketOffsets[ bucket ] = offset;
+      offset += count;
+    }
+
+    for ( uint i = 0u; i < queueSize; ++i ) {
+      const uint64 entry = myWavefrontSortEntries[ i ];
+      myWavefrontSortTemp[ bucketOffsets[ ( entry >> shift ) & ( NUM_RADIX_BUCKETS - 1u ) ]++ ] = entry;
+    }
+    myWavefrontSortEntries.swap( myWavefrontSortTemp );
+  }
+
+  for ( uint i = 0u; i < queueSize; ++i )
+    myWavefrontQueue[ i ] = ( uint ) myWavefrontSortEntries[ i ];
+}
+
+void CpuPathTracer::TraceWavefrontQueue() {
+  using namespace Priv_CpuPathTracerWavefront;
+
+  const uint queueSize = ( uint ) myWavefrontQueue.size();
+  const uint packetWidth = CpuRtScene::GetPacketWidth();
+  const uint numPackets = ( queueSize + packetWidth - 1u ) / packetWidth;
+  const uint numJobs = ( numPackets + PACKETS_PER_JOB - 1u ) / PACKETS_PER_JOB;
+
+  myThreadPool->ParallelFor( numJobs, [ & ]( uint aJobIdx, uint /*aThreadIdx*/ ) {
+    const uint end = glm::min( ( aJobIdx + 1u ) * PACKETS_PER_JOB, numPackets );
+    for ( uint packetIdx = aJobIdx * PACKETS_PER_JOB; packetIdx < end; ++packetIdx ) {
+      const uint firstRay = packetIdx * packetWidth;
+      const uint numLanes = glm::min( queueSize - firstRay, packetWidth );
+
+      CpuRayPacket packet;
+      for ( uint lane = 0u; lane < numLanes; ++lane )
+        packet.SetRay( lane, myWavefrontPaths[ myWavefrontQueue[ firstRay + lane ] ].myRay );
+
+      CpuHitPacket hits;
+      const uint   laneMask = ( uint ) ( ( 1ull << numLanes ) - 1ull );
+      const uint   hitMask = myScene.TraceClosestPacket( packet, laneMask, hits );
+      for ( uint lane = 0u; lane < numLanes; ++lane ) {
+        CpuHit & hit = myWavefrontHits[ myWavefrontQueue[ firstRay + lane ] ];
+        hit = ( hitMask & ( 1u << lane ) ) != 0u ? hits.GetHit( lane ) : CpuHit();
+      }
+    }
+  } );
+}
@@ -0,0 +1,496 @@
+#include "CpuRtLights.h"
+
+#include <algorithm>
+
+#include "CpuRtScene.h"
+#include "CpuRtShading.h"
+#include "Timing.h"
+
+namespace Priv_CpuRtLights {
+  const uint  NUM_BENCHMARK_RECEIVERS = 1024u;
+  const uint  NUM_BENCHMARK_SAMPLES = 64u;   // Per receiver
+  const float BENCHMARK_LIGHT_SIZE = 0.01f;  // Of the scene diagonal
+  const float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+  glm::float3 TransformPoint( const glm::float4x4 & aMatrix, const glm::float3 & aPoint ) {
+    return glm::float3( aMatrix * glm::float4( aPoint, 1.0f ) );
+  }
+
+  float GetTrianglePower( const CpuRtLightTriangle & aTriangle ) {
+    return CpuRt::GetLuminance( aTriangle.myEmission ) * aTriangle.myArea;
+  }
+
+  glm::float3 GetTriangleCentroid( const CpuRtLightTriangle & aTriangle ) {
+    return aTriangle.myV0 + ( aTriangle.myEdge1 + aTriangle.myEdge2 ) * ( 1.0f / 3.0f );
+  }
+
+  // Power over the squared distance, times the largest cosine between aNormal and a direction into the bounding sphere
+  // of the node. Inside or close to the bounds, the distance to their center says little about the distance to the
+  // triangles, so it is clamped to the radius. Same as GetLightBvhNodeImportance() in Lights.hlsl.
+  float GetBvhNodeImportance( const CpuRtLightBvhNode & aNode, const glm::float3 & aPos, const glm::float3 & aNormal ) {
+    const glm::float3 diagonal = aNode.myBoundsMax - aNode.myBoundsMin;
+    const glm::float3 toCenter = ( aNode.myBoundsMin + aNode.myBoundsMax ) * 0.5f - aPos;
+    const float       distanceSq = glm::dot( toCenter, toCenter );
+    const float       radiusSq = 0.25f * glm::dot( diagonal, diagonal );
+
+    float cosIncidence = 1.0f;
+    if ( distanceSq > radiusSq ) {
+      const float cosCenter = glm::dot( aNormal, toCenter ) / sqrtf( distanceSq );
+      const float sinCenter = sqrtf( glm::max( 1.0f - cosCenter * cosCenter, 0.0f ) );
+      const float sinBounds = sqrtf( radiusSq / distanceSq );
+      const float cosBounds = sqrtf( 1.0f - sinBounds * sinBounds );
+      if ( cosCenter < cosBounds )
+        cosIncidence = glm::max( cosCenter * cosBounds + sinCenter * sinBounds, 0.0f );
+    }
+
+    return aNode.myPower * cosIncidence / glm::max( glm::max( distanceSq, radiusSq ), FLT_MIN );
+  }
+
+  struct SurfaceTriangle {
+    glm::float3 myV0;
+    glm::float3 myEdge1;
+    glm::float3 myEdge2;
+    glm::float3 myNormal;
+  };
+
+  // World-space triangles of all instances with an area CDF, to place emitters and receivers on for the benchmark
+  struct SceneSurface {
+    void Init( const CpuRtScene & aScene ) {
+      float area = 0.0f;
+      for ( const CpuRtInstance & instance : aScene.myInstances ) {
+        const CpuRtMesh & mesh = aScene.myMeshes[ instance.myMeshIndex ];
+        for ( uint iTri = 0u; iTri < mesh.myTriangles.mySize; ++iTri ) {
+          const glm::uvec3 & indices = mesh.myTriangles[ iTri ];
+          const glm::float3  v0 = TransformPoint( instance.myObjectToWorld, mesh.myPositions[ indices.x ] );
+          const glm::float3  v1 = TransformPoint( instance.myObjectToWorld, mesh.myPositions[ indices.y ] );
+          const glm::float3  v2 = TransformPoint( instance.myObjectToWorld, mesh.myPositions[ indices.z ] );
+          const glm::float3  normal = glm::cross( v1 - v0, v2 - v0 );
+          const float        triangleArea = 0.5f * glm::length( normal );
+          if ( triangleArea <= 0.0f )
+            continue;
+
+          area += triangleArea;
+          myTriangles.push_back( { v0, v1 - v0, v2 - v0, normal / ( 2.0f * triangleArea ) } );
+          myCdf.push_back( area );
+        }
+      }
+    }
+
+    // Uniform over the area of all triangles
+    void Sample( CpuRt::RngStateType & aRngState, glm::float3 & aPosOut, glm::float3 & aNormalOut ) const {
+      const float target = CpuRt::GetRand01( aRngState ) * myCdf.back();
+      const uint  triangleIdx = glm::min( ( uint ) ( std::upper_bound( myCdf.begin(), myCdf.end(), target ) -
+                                                    myCdf.begin() ),
+                                          ( uint ) myCdf.size() - 1u );
+      const SurfaceTriangle & triangle = myTriangles[ triangleIdx ];
+
+      const float sqrtRand = sqrtf( CpuRt::GetRand01( aRngState ) );
+      const float rand1 = CpuRt::GetRand01( aRngState );
+      aPosOut = triangle.myV0 + triangle.myEdge1 * ( sqrtRand * ( 1.0f - rand1 ) ) +
+                triangle.myEdge2 * ( sqrtRand * rand1 );
+      aNormalOut = triangle.myNormal;
+    }
+
+    eastl::vector< SurfaceTriangle > myTriangles;
+    eastl::vector< float >           myCdf;
+  };
+
+  // Mean relative variance per sample of the unoccluded direct light at the receivers, with the time per sample
+  void MeasureLightSampling( const CpuRtLights & someLights, LightSampling aSampling,
+                             const eastl::vector< glm::float3 > & someReceiverPositions,
+                             const eastl::vector< glm::float3 > & someReceiverNormals, float & aVarianceOut,
+                             float & aTimeNsOut ) {
+    CpuRt::RngStateType rngState = CpuRt::InitRNG( glm::uvec2( 1u, 0u ), glm::uvec2( 0u ), 0u );
+
+    float64 varianceSum = 0.0;
+    uint    numLitReceivers = 0u;
+
+    const float64 startTime = SampleTimeMs();
+    for ( uint iReceiver = 0u; iReceiver < ( uint ) someReceiverPositions.size(); ++iReceiver ) {
+      float64 sum = 0.0;
+      float64 sumSq = 0.0;
+      for ( uint iSample = 0u; iSample < NUM_BENCHMARK_SAMPLES; ++iSample ) {
+        const float rand0 = CpuRt::GetRand01( rngState );
+        const float rand1 = CpuRt::GetRand01( rngState );
+        const float rand2 = CpuRt::GetRand01( rngState );
+
+        CpuRtLightSample lightSample;
+        if ( !someLights.Sample( aSampling, someReceiverPositions[ iReceiver ], someReceiverNormals[ iReceiver ],
+                                 glm::float3( rand0, rand1, rand2 ), lightSample ) )
+          continue;
+
+        const float cosReceiver = glm::dot( someReceiverNormals[ iReceiver ], lightSample.myDirection );
+        const float value = CpuRt::GetLuminance( lightSample.myEmission ) * glm::max( cosReceiver, 0.0f ) /
+                            lightSample.myPdf;
+        sum += value;
+        sumSq += ( float64 ) value * value;
+      }
+
+      const float64 mean = sum / NUM_BENCHMARK_SAMPLES;
+      if ( mean <= 0.0 )
+        continue;
+
+      varianceSum += glm::max( sumSq / NUM_BENCHMARK_SAMPLES - mean * mean, 0.0 ) / ( mean * mean );
+      ++numLitReceivers;
+    }
+    const float64 timeMs = SampleTimeMs() - startTime;
+
+    aVarianceOut = numLitReceivers > 0u ? ( float ) ( varianceSum / numLitReceivers ) : 0.0f;
+    aTimeNsOut =
+        ( float ) ( timeMs * 1000000.0 / ( ( float64 ) someReceiverPositions.size() * NUM_BENCHMARK_SAMPLES ) );
+  }
+}  // namespace Priv_CpuRtLights
+
+static_assert( sizeof( CpuRtLightTriangle ) == 64u, "Has to match LightTriangle in Lights.hlsl" );
+static_assert( sizeof( CpuRtLightBvhNode ) == 32u, "Has to match LightBvhNode in Lights.hlsl" );
+
+void CpuRtLights::Build( const CpuRtScene & aScene, uint aLightInstanceId, const glm::float3 & aLightEmission ) {
+  using namespace Priv_CpuRtLights;
+
+  myTriangles.clear();
+  myInstanceFirstTriangles.assign( aScene.myInstances.size(), UINT_MAX );
+  myLightInstanceId = aLightInstanceId;
+  myLightEmission = aLightEmission;
+  myIsBuilt = true;
+
+  for ( uint iInstance = 0u; iInstance < ( uint ) aScene.myInstances.size(); ++iInstance ) {
+    const CpuRtInstance & instance = aScene.myInstances[ iInstance ];
+    const glm::float3     emission =
+        iInstance == aLightInstanceId ? aLightEmission : aScene.myMaterials[ instance.myMaterialIndex ].myEmission;
+    if ( CpuRt::GetLuminance( emission ) <= 0.0f )
+      continue;
+
+    // All triangles of the instance are added, so the light triangle of a hit is the first one plus its primitive
+    // index
+    const CpuRtMesh & mesh = aScene.myMeshes[ instance.myMeshIndex ];
+    myInstanceFirstTriangles[ iInstance ] = ( uint ) myTriangles.size();
+    for ( uint iTri = 0u; iTri < mesh.myTriangles.mySize; ++iTri ) {
+      const glm::uvec3 & indices = mesh.myTriangles[ iTri ];
+      const glm::float3  v0 = TransformPoint( instance.myObjectToWorld, mesh.myPositions[ indices.x ] );
+      const glm::float3  v1 = TransformPoint( instance.myObjectToWorld, mesh.myPositions[ indices.y ] );
+      const glm::float3  v2 = TransformPoint( instance.myObjectToWorld, mesh.myPositions[ indices.z ] );
+
+      CpuRtLightTriangle & triangle = myTriangles.push_back();
+      triangle.myV0 = v0;
+      triangle.myEdge1 = v1 - v0;
+      triangle.myEdge2 = v2 - v0;
+      triangle.myArea = 0.5f * glm::length( glm::cross( triangle.myEdge1, triangle.myEdge2 ) );
+      triangle.myEmission = emission;
+    }
+  }
+
+  BuildSamplingStructures();
+}
+
+void CpuRtLights::BuildFromTriangles( const eastl::vector< CpuRtLightTriangle > & someTriangles ) {
+  myTriangles = someTriangles;
+  myInstanceFirstTriangles.clear();
+  myLightInstanceId = UINT_MAX;
+  myLightEmission = glm::float3( 0.0f );
+  myIsBuilt = false;
+
+  BuildSamplingStructures();
+}
+
+void CpuRtLights::BuildSamplingStructures() {
+  using namespace Priv_CpuRtLights;
+
+  myBvhNodes.clear();
+  myTotalPower = 0.0f;
+  for ( const CpuRtLightTriangle & triangle : myTriangles )
+    myTotalPower += GetTrianglePower( triangle );
+
+  if ( myTotalPower <= 0.0f ) {
+    myTriangles.clear();
+    myInstanceFirstTriangles.assign( myInstanceFirstTriangles.size(), UINT_MAX );
+    return;
+  }
+
+  BuildAliasTable();
+
+  eastl::vector< uint > triangleIndices( myTriangles.size() );
+  for ( uint i = 0u; i < ( uint ) triangleIndices.size(); ++i )
+    triangleIndices[ i ] = i;
+
+  myBvhNodes.reserve( myTriangles.size() * 2u - 1u );
+  BuildBvhNode( triangleIndices.data(), ( uint ) triangleIndices.size(), 0u, 0u );
+}
+
+void CpuRtLights::BuildAliasTable() {
+  using namespace Priv_CpuRtLights;
+
+  // Vose's method: every entry below the average power is topped up by one above it, which becomes its alias
+  const uint             numTriangles = ( uint ) myTriangles.size();
+  eastl::vector< float > scaledPowers( numTriangles );
+  eastl::vector< uint >  belowAverage;
+  eastl::vector< uint >  aboveAverage;
+  for ( uint i = 0u; i < numTriangles; ++i ) {
+    scaledPowers[ i ] = GetTrianglePower( myTriangles[ i ] ) * numTriangles / myTotalPower;
+    if ( scaledPowers[ i ] < 1.0f )
+      belowAverage.push_back( i );
+    else
+      aboveAverage.push_back( i );
+  }
+
+  while ( !belowAverage.empty() && !aboveAverage.empty() ) {
+    const uint below = belowAverage.back();
+    const uint above = aboveAverage.back();
+    belowAverage.pop_back();
+
+    myTriangles[ below ].myAliasProbability = scaledPowers[ below ];
+    myTriangles[ below ].myAlias = above;
+
+    scaledPowers[ above ] -= 1.0f - scaledPowers[ below ];
+    if ( scaledPowers[ above ] < 1.0f ) {
+      aboveAverage.pop_back();
+      belowAverage.push_back( above );
+    }
+  }
+
+  // Whatever is left is at the average up to rounding errors
+  for ( uint i : belowAverage ) {
+    myTriangles[ i ].myAliasProbability = 1.0f;
+    myTriangles[ i ].myAlias = i;
+  }
+  for ( uint i : aboveAverage ) {
+    myTriangles[ i ].myAliasProbability = 1.0f;
+    myTriangles[ i ].myAlias = i;
+  }
+}
+
+uint CpuRtLights::BuildBvhNode( uint * someTriangleIndices, uint aCount, uint aDepth, uint aBitTrail ) {
+  using namespace Priv_CpuRtLights;
+
+  const uint nodeIdx = ( uint ) myBvhNodes.size();
+  myBvhNodes.push_back();
+
+  CpuAabb bounds;
+  CpuAabb centroidBounds;
+  float   power = 0.0f;
+  for ( uint i = 0u; i < aCount; ++i ) {
+    const CpuRtLightTriangle & triangle = myTriangles[ someTriangleIndices[ i ] ];
+    bounds.Grow( triangle.myV0 );
+    bounds.Grow( triangle.myV0 + triangle.myEdge1 );
+    bounds.Grow( triangle.myV0 + triangle.myEdge2 );
+    centroidBounds.Grow( GetTriangleCentroid( triangle ) );
+    power += GetTrianglePower( triangle );
+  }
+
+  myBvhNodes[ nodeIdx ].myBoundsMin = bounds.myMin;
+  myBvhNodes[ nodeIdx ].myBoundsMax = bounds.myMax;
+  myBvhNodes[ nodeIdx ].myPower = power;
+
+  if ( aCount == 1u ) {
+    myBvhNodes[ nodeIdx ].myChildOrTriangle = someTriangleIndices[ 0 ] | CpuRtLightBvhNode::LEAF_FLAG;
+    myTriangles[ someTriangleIndices[ 0 ] ].myBvhBitTrail = aBitTrail;
+    return nodeIdx;
+  }
+
+  // Splits at the median of the largest centroid extent. That keeps the tree balanced, so the bit trails of up to 2^32
+  // triangles fit into 32 bits.
+  const glm::float3 extent = centroidBounds.GetExtent();
+  const uint        axis = extent.x > extent.y ? ( extent.x > extent.z ? 0u : 2u ) : ( extent.y > extent.z ? 1u : 2u );
+  const uint        numLeft = aCount / 2u;
+  std::nth_element( someTriangleIndices, someTriangleIndices + numLeft, someTriangleIndices + aCount,
+                    [ & ]( uint aLeft, uint aRight ) {
+                      return GetTriangleCentroid( myTriangles[ aLeft ] )[ axis ] <
+                             GetTriangleCentroid( myTriangles[ aRight ] )[ axis ];
+                    } );
+
+  BuildBvhNode( someTriangleIndices, numLeft, aDepth + 1u, aBitTrail );
+  const uint secondChild =
+      BuildBvhNode( someTriangleIndices + numLeft, aCount - numLeft, aDepth + 1u, aBitTrail | ( 1u << aDepth ) );
+  myBvhNodes[ nodeIdx ].myChildOrTriangle = secondChild;
+  return nodeIdx;
+}
+
+bool CpuRtLights::IsBuiltFor( uint aLightInstanceId, const glm::float3 & aLightEmission ) const {
+  return myIsBuilt && myLightInstanceId == aLightInstanceId && myLightEmission == aLightEmission;
+}
+
+bool CpuRtLights::IsEmpty() const {
+  return myTriangles.empty();
+}
+
+bool CpuRtLights::ContainsAnyInstance( const uint * someInstanceIndices, uint aNumInstances ) const {
+  for ( uint i = 0u; i < aNumInstances; ++i ) {
+    const uint instanceIdx = someInstanceIndices[ i ];
+    if ( instanceIdx < ( uint ) myInstanceFirstTriangles.size() && myInstanceFirstTriangles[ instanceIdx ] != UINT_MAX )
+      return true;
+  }
+  return false;
+}
+
+float CpuRtLights::GetTotalPower() const {
+  return myTotalPower;
+}
+
+bool CpuRtLights::Sample( LightSampling aSampling, const glm::float3 & aPos, const glm::float3 & aNormal,
+                          const glm::float3 & aRand01, CpuRtLightSample & aSampleOut ) const {
+  using namespace Priv_CpuRtLights;
+
+  // Same selection as PickLightTriangle() in Lights.hlsl
+  uint  triangleIdx;
+  float trianglePmf;
+  if ( aSampling == LightSampling::ALIAS_TABLE ) {
+    const uint  numTriangles = ( uint ) myTriangles.size();
+    const float scaledRand = aRand01.x * numTriangles;
+    const uint  entry = glm::min( ( uint ) scaledRand, numTriangles - 1u );
+    triangleIdx = scaledRand - entry < myTriangles[ entry ].myAliasProbability ? entry : myTriangles[ entry ].myAlias;
+    trianglePmf = GetTrianglePower( myTriangles[ triangleIdx ] ) / myTotalPower;
+  } else {
+    // Descends into either child with the probability of its importance and rescales the random number to reuse it
+    uint  nodeIdx = 0u;
+    float rand = aRand01.x;
+    trianglePmf = 1.0f;
+    while ( ( myBvhNodes[ nodeIdx ].myChildOrTriangle & CpuRtLightBvhNode::LEAF_FLAG ) == 0u ) {
+      const uint  secondChild = myBvhNodes[ nodeIdx ].myChildOrTriangle;
+      const float importance0 = GetBvhNodeImportance( myBvhNodes[ nodeIdx + 1u ], aPos, aNormal );
+      const float importance1 = GetBvhNodeImportance( myBvhNodes[ secondChild ], aPos, aNormal );
+      if ( importance0 + importance1 <= 0.0f )
+        return false;
+
+      const float probability0 = importance0 / ( importance0 + importance1 );
+      if ( rand < probability0 ) {
+        nodeIdx = nodeIdx + 1u;
+        rand = rand / probability0;
+        trianglePmf *= probability0;
+      } else {
+        nodeIdx = secondChild;
+        rand = ( rand - probability0 ) / ( 1.0f - probability0 );
+        trianglePmf *= 1.0f - probability0;
+      }
+      rand = glm::min( rand, ONE_MINUS_EPSILON );
+    }
+    triangleIdx = myBvhNodes[ nodeIdx ].myChildOrTriangle & ~CpuRtLightBvhNode::LEAF_FLAG;
+  }
+
+  const CpuRtLightTriangle & triangle = myTriangles[ triangleIdx ];
+
+  const float       sqrtRand = sqrtf( aRand01.y );
+  const glm::float3 lightPos = triangle.myV0 + triangle.myEdge1 * ( sqrtRand * ( 1.0f - aRand01.z ) ) +
+                               triangle.myEdge2 * ( sqrtRand * aRand01.z );
+  const glm::float3 toLight = lightPos - aPos;
+  const float       distanceSq = glm::dot( toLight, toLight );
+  if ( distanceSq <= 0.0f )
+    return false;
+
+  aSampleOut.myDistance = sqrtf( distanceSq );
+  aSampleOut.myDirection = toLight / aSampleOut.myDistance;
+  aSampleOut.myEmission = triangle.myEmission;
+  aSampleOut.myPdf = GetPdf( trianglePmf, triangle, aSampleOut.myDirection, distanceSq );
+  return aSampleOut.myPdf > 0.0f;
+}
+
+float CpuRtLights::GetPdf( LightSampling aSampling, const glm::float3 & aPos, const glm::float3 & aNormal,
+                           uint anInstanceIdx, uint aPrimitiveIdx, const glm::float3 & aDirection,
+                           float aDistance ) const {
+  if ( myTriangles.empty() || myInstanceFirstTriangles[ anInstanceIdx ] == UINT_MAX )
+    return 0.0f;
+
+  const uint triangleIdx = myInstanceFirstTriangles[ anInstanceIdx ] + aPrimitiveIdx;
+  return GetPdf( GetTrianglePmf( aSampling, aPos, aNormal, triangleIdx ), myTriangles[ triangleIdx ], aDirection,
+                 aDistance * aDistance );
+}
+
+float CpuRtLights::GetTrianglePmf( LightSampling aSampling, const glm::float3 & aPos, const glm::float3 & aNormal,
+                                   uint aTriangleIdx ) const {
+  using namespace Priv_CpuRtLights;
+
+  if ( aSampling == LightSampling::ALIAS_TABLE )
+    return GetTrianglePower( myTriangles[ aTriangleIdx ] ) / myTotalPower;
+
+  // Follows the bit trail of the triangle down from the root, with the same probabilities as Sample()
+  uint  bitTrail = myTriangles[ aTriangleIdx ].myBvhBitTrail;
+  uint  nodeIdx = 0u;
+  float pmf = 1.0f;
+  while ( ( myBvhNodes[ nodeIdx ].myChildOrTriangle & CpuRtLightBvhNode::LEAF_FLAG ) == 0u ) {
+    const uint  secondChild = myBvhNodes[ nodeIdx ].myChildOrTriangle;
+    const float importance0 = GetBvhNodeImportance( myBvhNodes[ nodeIdx + 1u ], aPos, aNormal );
+    const float importance1 = GetBvhNodeImportance( myBvhNodes[ secondChild ], aPos, aNormal );
+    if ( importance0 + importance1 <= 0.0f )
+      return 0.0f;
+
+    if ( bitTrail & 1u ) {
+      pmf *= importance1 / ( importance0 + importance1 );
+      nodeIdx = secondChild;
+    } else {
+      pmf *= importance0 / ( importance0 + importance1 );
+      nodeIdx = nodeIdx + 1u;
+    }
+    bitTrail >>= 1u;
+  }
+  return pmf;
+}
+
+float CpuRtLights::GetPdf( float aTrianglePmf, const CpuRtLightTriangle & aTriangle, const glm::float3 & aDirection,
+                           float aDistanceSq ) const {
+  // Points are uniform over the area of the triangle. Emitters are two-sided, like in ClosestHit.
+  if ( aTriangle.myArea <= 0.0f )
+    return 0.0f;
+
+  const glm::float3 normal = glm::cross( aTriangle.myEdge1, aTriangle.myEdge2 ) / ( 2.0f * aTriangle.myArea );
+  const float       cosLight = glm::abs( glm::dot( normal, aDirection ) );
+  if ( cosLight < 1e-6f )
+    return 0.0f;
+
+  return aTrianglePmf / aTriangle.myArea * aDistanceSq / cosLight;
+}
+
+CpuLightSamplingBenchmarkResults RunLightSamplingBenchmark( const CpuRtScene & aScene, uint aNumLights ) {
+  using namespace Priv_CpuRtLights;
+
+  CpuLightSamplingBenchmarkResults results;
+
+  SceneSurface surface;
+  surface.Init( aScene );
+  if ( surface.myTriangles.empty() || aNumLights == 0u )
+    return results;
+
+  // Small triangles slightly in front of the surfaces, with powers over two orders of magnitude
+  CpuRt::RngStateType rngState = CpuRt::InitRNG( glm::uvec2( 0u ), glm::uvec2( 0u ), 0u );
+  const float         sceneSize = glm::length( aScene.myBounds.GetExtent() );
+  const float         lightSize = sceneSize * BENCHMARK_LIGHT_SIZE;
+
+  eastl::vector< CpuRtLightTriangle > triangles( aNumLights );
+  for ( CpuRtLightTriangle & triangle : triangles ) {
+    glm::float3 pos, normal, tangent, bitangent;
+    surface.Sample( rngState, pos, normal );
+    CpuRt::GetCoordinateFrame( normal, tangent, bitangent );
+    pos += normal * ( lightSize * 0.1f );
+
+    triangle = CpuRtLightTriangle();
+    triangle.myV0 = pos + tangent * lightSize;
+    triangle.myEdge1 = ( tangent * -0.5f + bitangent * 0.866f ) * lightSize + pos - triangle.myV0;
+    triangle.myEdge2 = ( tangent * -0.5f - bitangent * 0.866f ) * lightSize + pos - triangle.myV0;
+    triangle.myArea = 0.5f * glm::length( glm::cross( triangle.myEdge1, triangle.myEdge2 ) );
+    triangle.myEmission = glm::float3( powf( 10.0f, 2.0f * CpuRt::GetRand01( rngState ) ) );
+  }
+
+  eastl::vector< glm::float3 > receiverPositions( NUM_BENCHMARK_RECEIVERS );
+  eastl::vector< glm::float3 > receiverNormals( NUM_BENCHMARK_RECEIVERS );
+  for ( uint i = 0u; i < NUM_BENCHMARK_RECEIVERS; ++i ) {
+    surface.Sample( rngState, receiverPositions[ i ], receiverNormals[ i ] );
+    receiverPositions[ i ] += receiverNormals[ i ] * ( sceneSize * 1e-4f );
+  }
+
+  CpuRtLights   lights;
+  const float64 buildStartMs = SampleTimeMs();
+  lights.BuildFromTriangles( triangles );
+  results.myBuildMs = ( float ) ( SampleTimeMs() - buildStartMs );
+
+  results.myNumLights = aNumLights;
+  results.myNumReceivers = NUM_BENCHMARK_RECEIVERS;
+  results.mySamplesPerReceiver = NUM_BENCHMARK_SAMPLES;
+  MeasureLightSampling( lights, LightSampling::ALIAS_TABLE, receiverPositions, receiverNormals,
+                        results.myAliasTableVariance, results.myAliasTableNs );
+  MeasureLightSampling( lights, LightSampling::LIGHT_BVH, receiverPositions, receiverNormals,
+                        results.myLightBvhVariance, results.myLightBvhNs );
+
+  Log( "Light sampling benchmark (%d lights, %d receivers, %d samples each, built in %.2f ms): alias table variance "
+       "%.3f at %.1f ns/sample, light BVH variance %.3f at %.1f ns/sample",
+       results.myNumLights, results.myNumReceivers, results.mySamplesPerReceiver, results.myBuildMs,
+       results.myAliasTableVariance, results.myAliasTableNs, results.myLightBvhVariance, results.myLightBvhNs );
+
+  return results;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <limits.h>
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+
+class CpuRtScene;
+
+using namespace Fancy;
+
+// How next-event estimation picks the light triangle to sample
+enum class LightSampling {
+  ALIAS_TABLE,  // Proportional to the power of the triangles, in constant time
+  LIGHT_BVH,    // By the power, distance and direction of the BVH nodes from the receiver, down to one triangle
+};
+
+// World-space triangle of an emissive instance. Same layout as LightTriangle in Lights.hlsl, the GPU reads these
+// from a buffer.
+struct CpuRtLightTriangle {
+  glm::float3 myV0;
+  float       myAliasProbability;  // Of keeping this triangle when the alias table picks its entry
+  glm::float3 myEdge1;
+  float       myArea;
+  glm::float3 myEdge2;
+  uint        myAlias;  // Triangle picked instead, with 1 - myAliasProbability
+  glm::float3 myEmission;
+  uint        myBvhBitTrail;  // Bit i selects the second child at depth i on the way from the root to the leaf
+};
+
+// Node of the light BVH, in depth-first order. Same layout as LightBvhNode in Lights.hlsl.
+struct CpuRtLightBvhNode {
+  enum : uint { LEAF_FLAG = 0x80000000u };
+
+  glm::float3 myBoundsMin;
+  float       myPower;  // Of all triangles below the node
+  glm::float3 myBoundsMax;
+  uint        myChildOrTriangle;  // Second child of inner nodes, the first one follows the node. Triangle | LEAF_FLAG.
+};
+
+struct CpuRtLightSample {
+  glm::float3 myDirection;
+  float       myDistance;
+  glm::float3 myEmission;
+  float       myPdf;  // Over solid angle
+};
+
+// Variance and cost of the light sampling strategies, see RunLightSamplingBenchmark()
+struct CpuLightSamplingBenchmarkResults {
+  uint  myNumLights = 0u;
+  uint  myNumReceivers = 0u;
+  uint  mySamplesPerReceiver = 0u;
+  float myBuildMs = 0.0f;             // Alias table and light BVH
+  float myAliasTableVariance = 0.0f;  // Relative variance per sample of the direct light, averaged over the receivers
+  float myLightBvhVariance = 0.0f;
+  float myAliasTableNs = 0.0f;  // Per sample
+  float myLightBvhNs = 0.0f;
+};
+
+// The triangles of all emissive instances, for next-event estimation. A triangle is picked with the alias table or
+// the light BVH and then sampled uniformly over its area, like SampleLightTriangle() in Lights.hlsl. The instance with
+// aLightInstanceId emits aLightEmission instead of its material emission, like ClosestHit does.
+class CpuRtLights {
+public:
+  void Build( const CpuRtScene & aScene, uint aLightInstanceId, const glm::float3 & aLightEmission );
+  bool IsBuiltFor( uint aLightInstanceId, const glm::float3 & aLightEmission ) const;
+  bool IsEmpty() const;
+
+  // True if any of the given scene instances emits, so the lights have to be rebuilt when they move
+  bool ContainsAnyInstance( const uint * someInstanceIndices, uint aNumInstances ) const;
+
+  // Lights that don't belong to any scene instance, see RunLightSamplingBenchmark(). Only the geometry and the
+  // emission of the triangles are used.
+  void BuildFromTriangles( const eastl::vector< CpuRtLightTriangle > & someTriangles );
+
+  // Returns false if the sampled point can't light aPos. The light BVH prefers lights above aNormal.
+  bool Sample( LightSampling aSampling, const glm::float3 & aPos, const glm::float3 & aNormal,
+               const glm::float3 & aRand01, CpuRtLightSample & aSampleOut ) const;
+
+  // Solid angle density with which Sample() from aPos and aNormal picks the point at aDistance along aDirection on the
+  // triangle of the hit. 0 if the instance doesn't emit.
+  float GetPdf( LightSampling aSampling, const glm::float3 & aPos, const glm::float3 & aNormal, uint anInstanceIdx,
+                uint aPrimitiveIdx, const glm::float3 & aDirection, float aDistance ) const;
+
+  float GetTotalPower() const;
+
+  eastl::vector< CpuRtLightTriangle > myTriangles;
+  eastl::vector< CpuRtLightBvhNode >  myBvhNodes;
+  eastl::vector< uint >               myInstanceFirstTriangles;  // Per scene instance, UINT_MAX if it doesn't emit
+
+private:
+  void  BuildSamplingStructures();
+  void  BuildAliasTable();
+  uint  BuildBvhNode( uint * someTriangleIndices, uint aCount, uint aDepth, uint aBitTrail );
+  float GetTrianglePmf( LightSampling aSampling, const glm::float3 & aPos, const glm::float3 & aNormal,
+                        uint aTriangleIdx ) const;
+  float GetPdf( float aTrianglePmf, const CpuRtLightTriangle & aTriangle, const glm::float3 & aDirection,
+                float aDistanceSq ) const;
+
+  float       myTotalPower = 0.0f;
+  uint        myLightInstanceId = UINT_MAX;
+  glm::float3 myLightEmission = glm::float3( 0.0f );
+  bool        myIsBuilt = false;
+};
+
+// Scatters aNumLights small emitters of random power over the surfaces of the scene and estimates the unoccluded
+// direct light at random surface points with both LightSampling strategies
+CpuLightSamplingBenchmarkResults RunLightSamplingBenchmark( const CpuRtScene & aScene, uint aNumLights );
@@ -0,0 +1,326 @@
+#include "CpuRtSampler.h"
+
+#include <float.h>
+#include <EASTL/vector.h>
+
+using namespace CpuRt;
+
+namespace Priv_CpuRtSampler {
+  // Degrees, coefficients and initial direction numbers of the primitive polynomials of Sobol dimensions 1 to 3, from
+  // Joe and Kuo's new-joe-kuo-6.21201. Dimension 0 is the van der Corput sequence.
+  const uint SOBOL_DEGREES[ SAMPLER_SET_DIMENSIONS - 1u ] = { 1u, 2u, 3u };
+  const uint SOBOL_COEFFICIENTS[ SAMPLER_SET_DIMENSIONS - 1u ] = { 0u, 1u, 1u };
+  const uint SOBOL_INITIAL_NUMBERS[ SAMPLER_SET_DIMENSIONS - 1u ][ 3 ] = { { 1u }, { 1u, 3u }, { 1u, 3u, 1u } };
+
+  const uint HALTON_BASES[ SAMPLER_SET_DIMENSIONS ] = { 2u, 3u, 5u, 7u };
+
+  // Void-and-cluster: width of the Gaussian that measures how clustered the points are, and the share of the pixels
+  // in the initial pattern
+  const float BLUE_NOISE_SIGMA = 1.5f;
+  const float BLUE_NOISE_INITIAL_DENSITY = 0.1f;
+
+  // A rank rotates the samples by ( rank + 0.5 ) / number of pixels in 0.32 fixed point
+  const uint BLUE_NOISE_RANK_SHIFT = 20u;
+  static_assert( SAMPLER_BLUE_NOISE_SIZE * SAMPLER_BLUE_NOISE_SIZE == 1u << ( 32u - BLUE_NOISE_RANK_SHIFT ),
+                 "The rank shift doesn't match the size of the blue-noise tile" );
+
+  // The Halton sequence of a set of dimensions starts at a random index below this, so the sets of a path aren't
+  // correlated
+  const uint HALTON_MAX_INDEX_OFFSET = 1u << 16u;
+
+  uint ReverseBits( uint x ) {
+    x = ( x << 16u ) | ( x >> 16u );
+    x = ( ( x & 0x00ff00ffu ) << 8u ) | ( ( x & 0xff00ff00u ) >> 8u );
+    x = ( ( x & 0x0f0f0f0fu ) << 4u ) | ( ( x & 0xf0f0f0f0u ) >> 4u );
+    x = ( ( x & 0x33333333u ) << 2u ) | ( ( x & 0xccccccccu ) >> 2u );
+    x = ( ( x & 0x55555555u ) << 1u ) | ( ( x & 0xaaaaaaaau ) >> 1u );
+    return x;
+  }
+
+  uint Hash( uint x ) {
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+  }
+
+  uint HashCombine( uint aSeed, uint aValue ) {
+    return aSeed ^ ( Hash( aValue ) + 0x9e3779b9u + ( aSeed << 6u ) + ( aSeed >> 2u ) );
+  }
+
+  // Burley, "Practical Hash-based Owen Scrambling": the Laine-Karras permutation flips each bit depending on the
+  // lower ones, so on the reversed bits it is an Owen scramble
+  uint LaineKarrasPermutation( uint x, uint aSeed ) {
+    x += aSeed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+  }
+
+  uint NestedUniformScramble( uint x, uint aSeed ) {
+    return ReverseBits( LaineKarrasPermutation( ReverseBits( x ), aSeed ) );
+  }
+
+  // Sobol points of a dimension as the XOR of the matrix columns of each set bit of the index
+  uint GetSobol( uint anIndex, uint aSobolDimension, const uint * someMatrices ) {
+    const uint * matrix = someMatrices + aSobolDimension * SAMPLER_SOBOL_BITS;
+    uint         result = 0u;
+    for ( uint bit = 0u; anIndex != 0u; anIndex >>= 1u, ++bit ) {
+      if ( anIndex & 1u )
+        result ^= matrix[ bit ];
+    }
+    return result;
+  }
+
+  struct SamplerTable {
+    SamplerTable();
+
+    uint myData[ SAMPLER_TABLE_SIZE ];
+
+    // The scrambled indices use all 32 bits, so the CPU looks up the XOR of the columns of each byte of the index
+    // instead of going over its bits like the GPU does
+    uint mySobolByteColumns[ SAMPLER_SET_DIMENSIONS ][ 4 ][ 256 ];
+  };
+
+  uint GetSobol( uint anIndex, uint aSobolDimension, const SamplerTable & aTable ) {
+    const uint( *byteColumns )[ 256 ] = aTable.mySobolByteColumns[ aSobolDimension ];
+    return byteColumns[ 0 ][ anIndex & 0xffu ] ^ byteColumns[ 1 ][ ( anIndex >> 8u ) & 0xffu ] ^
+           byteColumns[ 2 ][ ( anIndex >> 16u ) & 0xffu ] ^ byteColumns[ 3 ][ anIndex >> 24u ];
+  }
+
+  // Each set of dimensions shuffles the sample order and scrambles the values with its own seed
+  uint GetOwenScrambledSobol( uint aSampleIdx, uint aDimension, uint aSeed, const SamplerTable & aTable ) {
+    const uint setSeed = HashCombine( aSeed, aDimension / SAMPLER_SET_DIMENSIONS );
+    const uint sobolDimension = aDimension % SAMPLER_SET_DIMENSIONS;
+    const uint index = NestedUniformScramble( aSampleIdx, setSeed );
+    return NestedUniformScramble( GetSobol( index, sobolDimension, aTable ),
+                                  HashCombine( setSeed, sobolDimension + 1u ) );
+  }
+
+  // In 0.32 fixed point
+  uint GetRadicalInverse( uint anIndex, uint aBase ) {
+    if ( aBase == 2u )
+      return ReverseBits( anIndex );
+
+    const float invBase = 1.0f / ( float ) aBase;
+    float       result = 0.0f;
+    float       digitWeight = invBase;
+    for ( ; anIndex != 0u; anIndex /= aBase, digitWeight *= invBase )
+      result += ( float ) ( anIndex % aBase ) * digitWeight;
+    return ( uint ) ( result * 4294967296.0f );
+  }
+
+  uint GetPixelSeed( const glm::uvec2 & aPixelCoords, uint aScrambleSeed ) {
+    return HashCombine( HashCombine( Hash( aScrambleSeed ), aPixelCoords.x ), aPixelCoords.y );
+  }
+
+  void BuildSobolMatrices( uint * someMatricesOut ) {
+    for ( uint bit = 0u; bit < SAMPLER_SOBOL_BITS; ++bit )
+      someMatricesOut[ bit ] = 1u << ( 31u - bit );
+
+    for ( uint dim = 1u; dim < SAMPLER_SET_DIMENSIONS; ++dim ) {
+      uint *     matrix = someMatricesOut + dim * SAMPLER_SOBOL_BITS;
+      const uint degree = SOBOL_DEGREES[ dim - 1u ];
+      const uint coefficients = SOBOL_COEFFICIENTS[ dim - 1u ];
+      for ( uint bit = 0u; bit < degree; ++bit )
+        matrix[ bit ] = SOBOL_INITIAL_NUMBERS[ dim - 1u ][ bit ] << ( 31u - bit );
+
+      for ( uint bit = degree; bit < SAMPLER_SOBOL_BITS; ++bit ) {
+        matrix[ bit ] = matrix[ bit - degree ] ^ ( matrix[ bit - degree ] >> degree );
+        for ( uint k = 1u; k < degree; ++k ) {
+          if ( ( coefficients >> ( degree - 1u - k ) ) & 1u )
+            matrix[ bit ] ^= matrix[ bit - k ];
+        }
+      }
+    }
+  }
+
+  // Adds or removes a point of the void-and-cluster pattern, along with its Gaussian in the energies of all pixels
+  void SetBlueNoisePoint( uint aPixel, bool aSet, const eastl::vector< float > & aKernel,
+                          eastl::vector< uint8 > & aPatternInOut, eastl::vector< float > & someEnergiesInOut ) {
+    const uint size = SAMPLER_BLUE_NOISE_SIZE;
+
+    aPatternInOut[ aPixel ] = aSet ? 1u : 0u;
+    const uint  px = aPixel % size;
+    const uint  py = aPixel / size;
+    const float sign = aSet ? 1.0f : -1.0f;
+    for ( uint y = 0u; y < size; ++y ) {
+      const float * kernelRow = aKernel.data() + ( ( y - py ) & ( size - 1u ) ) * size;
+      for ( uint x = 0u; x < size; ++x )
+        someEnergiesInOut[ y * size + x ] += sign * kernelRow[ ( x - px ) & ( size - 1u ) ];
+    }
+  }
+
+  // The point with the highest energy
+  uint FindTightestCluster( const eastl::vector< uint8 > & aPattern, const eastl::vector< float > & someEnergies ) {
+    uint  best = 0u;
+    float bestEnergy = -FLT_MAX;
+    for ( uint i = 0u; i < ( uint ) aPattern.size(); ++i ) {
+      if ( aPattern[ i ] && someEnergies[ i ] > bestEnergy ) {
+        best = i;
+        bestEnergy = someEnergies[ i ];
+      }
+    }
+    return best;
+  }
+
+  // The empty pixel with the lowest energy
+  uint FindLargestVoid( const eastl::vector< uint8 > & aPattern, const eastl::vector< float > & someEnergies ) {
+    uint  best = 0u;
+    float bestEnergy = FLT_MAX;
+    for ( uint i = 0u; i < ( uint ) aPattern.size(); ++i ) {
+      if ( !aPattern[ i ] && someEnergies[ i ] < bestEnergy ) {
+        best = i;
+        bestEnergy = someEnergies[ i ];
+      }
+    }
+    return best;
+  }
+
+  // Ulichney, "The void-and-cluster method for dither array generation". The energy of a pixel is the sum of a
+  // toroidal Gaussian over all points, the tightest cluster is the point with the most and the largest void the empty
+  // pixel with the least of it. Removing the points of the relaxed initial pattern from the tightest cluster on ranks
+  // them below the initial count, filling the largest voids from there on ranks all other pixels.
+  void BuildBlueNoiseRanks( uint * someRanksOut ) {
+    const uint size = SAMPLER_BLUE_NOISE_SIZE;
+    const uint numPixels = size * size;
+
+    eastl::vector< float > kernel( numPixels );
+    for ( uint y = 0u; y < size; ++y ) {
+      for ( uint x = 0u; x < size; ++x ) {
+        const float dx = ( float ) glm::min( x, size - x );
+        const float dy = ( float ) glm::min( y, size - y );
+        kernel[ y * size + x ] = expf( -( dx * dx + dy * dy ) / ( 2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA ) );
+      }
+    }
+
+    eastl::vector< uint8 > pattern( numPixels, 0u );
+    eastl::vector< float > energies( numPixels, 0.0f );
+
+    const uint   numInitialPoints = ( uint ) ( numPixels * BLUE_NOISE_INITIAL_DENSITY );
+    RngStateType rngState = InitRNG( glm::uvec2( 0u ), glm::uvec2( 0u ), 0u );
+    for ( uint numPoints = 0u; numPoints < numInitialPoints; ) {
+      const uint pixel = glm::min( ( uint ) ( GetRand01( rngState ) * numPixels ), numPixels - 1u );
+      if ( !pattern[ pixel ] ) {
+        SetBlueNoisePoint( pixel, true, kernel, pattern, energies );
+        ++numPoints;
+      }
+    }
+
+    // Moves the point of the tightest cluster into the largest void until it would end up where it was
+    for ( uint i = 0u; i < numPixels; ++i ) {
+      const uint cluster = FindTightestCluster( pattern, energies );
+      SetBlueNoisePoint( cluster, false, kernel, pattern, energies );
+      const uint largestVoid = FindLargestVoid( pattern, energies );
+      SetBlueNoisePoint( largestVoid, true, kernel, pattern, energies );
+      if ( largestVoid == cluster )
+        break;
+    }
+
+    const eastl::vector< uint8 > initialPattern = pattern;
+    const eastl::vector< float > initialEnergies = energies;
+    for ( uint rank = numInitialPoints; rank > 0u; --rank ) {
+      const uint cluster = FindTightestCluster( pattern, energies );
+      SetBlueNoisePoint( cluster, false, kernel, pattern, energies );
+      someRanksOut[ cluster ] = rank - 1u;
+    }
+
+    pattern = initialPattern;
+    energies = initialEnergies;
+    for ( uint rank = numInitialPoints; rank < numPixels; ++rank ) {
+      const uint largestVoid = FindLargestVoid( pattern, energies );
+      SetBlueNoisePoint( largestVoid, true, kernel, pattern, energies );
+      someRanksOut[ largestVoid ] = rank;
+    }
+  }
+
+  SamplerTable::SamplerTable() {
+    BuildSobolMatrices( myData );
+    BuildBlueNoiseRanks( myData + SAMPLER_TABLE_BLUE_NOISE_OFFSET );
+
+    for ( uint dim = 0u; dim < SAMPLER_SET_DIMENSIONS; ++dim ) {
+      for ( uint byteIdx = 0u; byteIdx < 4u; ++byteIdx ) {
+        for ( uint value = 0u; value < 256u; ++value )
+          mySobolByteColumns[ dim ][ byteIdx ][ value ] = GetSobol( value << ( byteIdx * 8u ), dim, myData );
+      }
+    }
+  }
+
+  const SamplerTable & GetTable() {
+    static const SamplerTable theTable;
+    return theTable;
+  }
+}  // namespace Priv_CpuRtSampler
+
+using namespace Priv_CpuRtSampler;
+
+const char * GetSamplerName( SamplerType aType ) {
+  switch ( aType ) {
+    case SamplerType::RANDOM:
+      return "Random (PCG)";
+    case SamplerType::HALTON:
+      return "Halton";
+    case SamplerType::SOBOL:
+      return "Sobol (Owen-scrambled)";
+    case SamplerType::BLUE_NOISE:
+      return "Blue-noise Sobol";
+    default:
+      return "";
+  }
+}
+
+const uint * GetSamplerTable() {
+  return GetTable().myData;
+}
+
+SamplerState CpuRt::InitSampler( const glm::uvec2 & aPixelCoords, const glm::uvec2 & aResolution,
+                                 uint aFrameRandomSeed, uint aSampleIdx, uint aScrambleSeed, SamplerType aType ) {
+  SamplerState state;
+  state.myRngState = InitRNG( aPixelCoords, aResolution, aFrameRandomSeed );
+  state.mySampleIdx = aSampleIdx;
+  state.myScrambleSeed = aScrambleSeed;
+  state.myType = aType;
+  return state;
+}
+
+float CpuRt::GetSample01( SamplerState & aState ) {
+  if ( aState.myType == SamplerType::RANDOM )
+    return GetRand01( aState.myRngState );
+
+  const glm::uvec2 pixel( aState.myRngState.x, aState.myRngState.y );
+  const uint       dimension = aState.myRngState.w++;
+
+  uint sample = 0u;
+  if ( aState.myType == SamplerType::HALTON ) {
+    // The Cranley-Patterson rotation keeps the points of the pixel stratified and makes the estimate unbiased
+    const uint pixelSeed = GetPixelSeed( pixel, aState.myScrambleSeed );
+    const uint setSeed = HashCombine( pixelSeed, dimension / SAMPLER_SET_DIMENSIONS );
+    const uint index = aState.mySampleIdx + Hash( setSeed ) % HALTON_MAX_INDEX_OFFSET;
+    const uint haltonDimension = dimension % SAMPLER_SET_DIMENSIONS;
+    sample = GetRadicalInverse( index, HALTON_BASES[ haltonDimension ] ) + HashCombine( setSeed, haltonDimension + 1u );
+  } else if ( aState.myType == SamplerType::SOBOL ) {
+    sample = GetOwenScrambledSobol( aState.mySampleIdx, dimension, GetPixelSeed( pixel, aState.myScrambleSeed ),
+                                    GetTable() );
+  } else {
+    // All pixels share the sequence, so neighbours only differ by the rotation. The blue-noise ranks spread the
+    // rotations evenly over every neighbourhood, which pushes the error of the first samples to high frequencies.
+    const SamplerTable & table = GetTable();
+    const uint           offset = Hash( dimension );
+    const uint           tileX = ( pixel.x + offset ) & ( SAMPLER_BLUE_NOISE_SIZE - 1u );
+    const uint           tileY = ( pixel.y + ( offset >> 8u ) ) & ( SAMPLER_BLUE_NOISE_SIZE - 1u );
+    const uint           rank =
+        table.myData[ SAMPLER_TABLE_BLUE_NOISE_OFFSET + tileY * SAMPLER_BLUE_NOISE_SIZE + tileX ];
+    sample = GetOwenScrambledSobol( aState.mySampleIdx, dimension, Hash( aState.myScrambleSeed ), table );
+    sample += ( rank << BLUE_NOISE_RANK_SHIFT ) + ( 1u << ( BLUE_NOISE_RANK_SHIFT - 1u ) );
+  }
+
+  return UintToFloat( sample );
+}
+
+void CpuRt::SetSamplerDimension( SamplerState & aState, uint aBounceIdx, SamplerBounceDimension aBounceDimension ) {
+  aState.myRngState.w = SAMPLER_CAMERA_DIMENSIONS + aBounceIdx * SAMPLER_BOUNCE_DIMENSIONS + aBounceDimension;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+#include "CpuRtShading.h"
+
+using namespace Fancy;
+
+// Where the path tracers take the random numbers of a path from. Same values as the SAMPLER_* defines in
+// Sampler.hlsl.
+enum class SamplerType : uint {
+  RANDOM,      // Independent numbers from the PCG hash of the pixel, frame seed and dimension
+  HALTON,      // 4D Halton sequence in bases 2, 3, 5 and 7, offset and rotated per pixel and set of four dimensions
+  SOBOL,       // 4D Sobol sequence, Owen-scrambled and shuffled per pixel and set of four dimensions
+  BLUE_NOISE,  // One Owen-scrambled Sobol sequence for all pixels, rotated per pixel by the ranks of a blue-noise tile
+  NUM
+};
+
+const char * GetSamplerName( SamplerType aType );
+
+// The sequences are padded from independent sets of SAMPLER_SET_DIMENSIONS dimensions, only the dimensions within
+// a set are stratified against each other. Every decision of a path has its own dimensions, so a dimension holds the
+// same decision in every sample of a pixel no matter how many numbers the earlier bounces took, and the numbers of a
+// decision come from the same set. The camera sample starts at dimension 0, bounce i at SAMPLER_CAMERA_DIMENSIONS +
+// i * SAMPLER_BOUNCE_DIMENSIONS. Same as in Sampler.hlsl.
+const uint SAMPLER_SET_DIMENSIONS = 4u;
+const uint SAMPLER_CAMERA_DIMENSIONS = 4u;  // Pixel jitter
+const uint SAMPLER_BOUNCE_DIMENSIONS = 16u;
+
+// First dimension of each decision of a bounce
+enum SamplerBounceDimension : uint {
+  SAMPLER_LIGHT_DIMENSION = 0u,     // Light triangle and point on it
+  SAMPLER_SUN_DIMENSION = 4u,       // Point on the sun disc
+  SAMPLER_BRDF_DIMENSION = 8u,      // Lobe and direction
+  SAMPLER_ROULETTE_DIMENSION = 12u  // Russian roulette
+};
+
+// Layout of the sampler table that the GPU reads from a buffer, same as in Sampler.hlsl: the generator matrices of
+// the SAMPLER_SET_DIMENSIONS Sobol dimensions with one column per uint, followed by the ranks of the blue-noise tile in
+// row-major order
+const uint SAMPLER_SOBOL_BITS = 32u;
+const uint SAMPLER_BLUE_NOISE_SIZE = 64u;
+const uint SAMPLER_TABLE_BLUE_NOISE_OFFSET = SAMPLER_SET_DIMENSIONS * SAMPLER_SOBOL_BITS;
+const uint SAMPLER_TABLE_SIZE = SAMPLER_TABLE_BLUE_NOISE_OFFSET + SAMPLER_BLUE_NOISE_SIZE * SAMPLER_BLUE_NOISE_SIZE;
+
+// SAMPLER_TABLE_SIZE entries, built on first use. The blue-noise tile is generated with the void-and-cluster method.
+const uint * GetSamplerTable();
+
+// CPU port of Sampler.hlsl
+namespace CpuRt {
+  // Random numbers of one path. The GPU keeps the RngStateType and reads the rest from the cbuffer.
+  struct SamplerState {
+    RngStateType myRngState;      // Pixel, frame seed and next dimension, like InitRNG() sets it up
+    uint         mySampleIdx;     // Since the accumulation was restarted
+    uint         myScrambleSeed;  // Stays the same over the accumulation, so the samples of a pixel stay stratified
+    SamplerType  myType;
+  };
+
+  SamplerState InitSampler( const glm::uvec2 & aPixelCoords, const glm::uvec2 & aResolution, uint aFrameRandomSeed,
+                            uint aSampleIdx, uint aScrambleSeed, SamplerType aType );
+
+  // Number in [ 0, 1 ) of the next dimension of the path
+  float GetSample01( SamplerState & aState );
+
+  // Continues the path at aBounceDimension of bounce aBounceIdx
+  void SetSamplerDimension( SamplerState & aState, uint aBounceIdx, SamplerBounceDimension aBounceDimension );
+}  // namespace CpuRt
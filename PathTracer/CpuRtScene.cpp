@@ -0,0 +1,994 @@
+#include "CpuRtScene.h"
+
+#include <EASTL/hash_map.h>
+
+#include "Common/MathUtil.h"
+#include "CpuRtShading.h"
+#include "CpuThreadPool.h"
+#include "LinearAllocator.h"
+#include "MappedFile.h"
+#include "IO/MeshImporter.h"
+#include "IO/Scene.h"
+#include "SceneCache.h"
+#include "Timing.h"
+
+using namespace Fancy;
+
+namespace Priv_CpuRtScene {
+  glm::float3 TransformPoint( const glm::float4x4 & aMatrix, const glm::float3 & aPoint ) {
+    return glm::float3( aMatrix * glm::float4( aPoint, 1.0f ) );
+  }
+
+  glm::float3 TransformDirection( const glm::float4x4 & aMatrix, const glm::float3 & aDirection ) {
+    return glm::float3( aMatrix * glm::float4( aDirection, 0.0f ) );
+  }
+
+  CpuAabb TransformAabb( const glm::float4x4 & aMatrix, const CpuAabb & anAabb ) {
+    CpuAabb result;
+    for ( uint i = 0u; i < 8u; ++i ) {
+      const glm::float3 corner( ( i & 1u ) ? anAabb.myMax.x : anAabb.myMin.x,
+                                ( i & 2u ) ? anAabb.myMax.y : anAabb.myMin.y,
+                                ( i & 4u ) ? anAabb.myMax.z : anAabb.myMin.z );
+      result.Grow( TransformPoint( aMatrix, corner ) );
+    }
+    return result;
+  }
+
+  void SetInstanceTransform( CpuRtInstance & anInstance, const glm::float4x4 & aTransform,
+                             const CpuAabb & aMeshBounds ) {
+    anInstance.myObjectToWorld = aTransform;
+    anInstance.myWorldToObject = glm::inverse( aTransform );
+    anInstance.myWorldBounds = TransformAabb( aTransform, aMeshBounds );
+  }
+
+  const uint NUM_TLAS_BENCHMARK_FRAMES = 16u;
+
+  // Of instance anInstanceIdx of RunTlasUpdateBenchmark() in aFrame. The instance starts centered in its grid cell,
+  // then drifts along a random direction by a quarter cell per frame and spins around the y-axis.
+  glm::float4x4 GetBenchmarkInstanceTransform( uint anInstanceIdx, uint aFrame, uint aGridSize, float aCellSize,
+                                               const CpuAabb & aMeshBounds ) {
+    CpuRt::RngStateType rngState = CpuRt::InitRNG( glm::uvec2( anInstanceIdx, 0u ), glm::uvec2( 0u ), 0u );
+    const float         cosTheta = 1.0f - 2.0f * CpuRt::GetRand01( rngState );
+    const float         sinTheta = sqrtf( glm::max( 1.0f - cosTheta * cosTheta, 0.0f ) );
+    const float         phi = CpuRt::TWO_PI * CpuRt::GetRand01( rngState );
+    const glm::float3   direction( sinTheta * cosf( phi ), cosTheta, sinTheta * sinf( phi ) );
+    const float         angularSpeed = ( CpuRt::GetRand01( rngState ) - 0.5f ) * 0.5f;
+
+    const glm::uvec3  cell( anInstanceIdx % aGridSize, ( anInstanceIdx / aGridSize ) % aGridSize,
+                            anInstanceIdx / ( aGridSize * aGridSize ) );
+    const glm::float3 position =
+        ( glm::float3( cell ) + 0.5f ) * aCellSize + direction * ( 0.25f * aCellSize * ( float ) aFrame );
+
+    // Rotates around the center of the mesh, then moves that to position
+    const float   angle = angularSpeed * ( float ) aFrame;
+    glm::float4x4 transform( 1.0f );
+    transform[ 0 ] = glm::float4( cosf( angle ), 0.0f, -sinf( angle ), 0.0f );
+    transform[ 2 ] = glm::float4( sinf( angle ), 0.0f, cosf( angle ), 0.0f );
+    transform[ 3 ] = glm::float4( position - TransformDirection( transform, aMeshBounds.GetCenter() ), 1.0f );
+    return transform;
+  }
+
+  void GetBenchmarkInstanceTransforms( uint aFrame, uint aGridSize, float aCellSize,
+                                       const eastl::vector< CpuRtMesh > &     someMeshes,
+                                       const eastl::vector< CpuRtInstance > & someInstances,
+                                       eastl::vector< glm::float4x4 > &       someTransformsOut ) {
+    for ( uint i = 0u; i < ( uint ) someInstances.size(); ++i ) {
+      someTransformsOut[ i ] = GetBenchmarkInstanceTransform( i, aFrame, aGridSize, aCellSize,
+                                                              someMeshes[ someInstances[ i ].myMeshIndex ].myBounds );
+    }
+  }
+
+  // Puts the instances of RunTlasUpdateBenchmark() back to their start. The TLAS has to be rebuilt afterwards.
+  void ResetBenchmarkInstances( uint aGridSize, float aCellSize, const eastl::vector< CpuRtMesh > & someMeshes,
+                                eastl::vector< CpuRtInstance > & someInstancesInOut,
+                                eastl::vector< glm::float4x4 > & someTransformsOut ) {
+    GetBenchmarkInstanceTransforms( 0u, aGridSize, aCellSize, someMeshes, someInstancesInOut, someTransformsOut );
+    for ( uint i = 0u; i < ( uint ) someInstancesInOut.size(); ++i ) {
+      CpuRtInstance & instance = someInstancesInOut[ i ];
+      SetInstanceTransform( instance, someTransformsOut[ i ], someMeshes[ instance.myMeshIndex ].myBounds );
+    }
+  }
+
+  float QuantizeUnorm8( float aValue ) {
+    return glm::floor( glm::clamp( aValue, 0.0f, 1.0f ) * 255.0f + 0.5f ) / 255.0f;
+  }
+
+  // Meshes with fewer triangles are built in parallel to each other instead of splitting up a single build
+  const uint PARALLEL_BLAS_BUILD_MIN_TRIANGLES = 64u * 1024u;
+
+  // The leaves of the wide BVH can only address CpuBvh4::MAX_PRIMITIVES triangles, larger meshes get one BLAS per
+  // range of that many. Empty meshes keep one empty BLAS.
+  uint GetNumMeshBlas( uint aNumTriangles ) {
+    const uint numFullBlas = aNumTriangles / CpuBvh4::MAX_PRIMITIVES;
+    return numFullBlas + ( aNumTriangles % CpuBvh4::MAX_PRIMITIVES != 0u || numFullBlas == 0u ? 1u : 0u );
+  }
+
+  void GetTriangleBounds( const CpuRtMesh & aMesh, uint aFirstTriangle, uint aNumTriangles,
+                          LinearVector< CpuAabb > & someBoundsOut ) {
+    someBoundsOut.resize( aNumTriangles );
+    for ( uint i = 0u; i < aNumTriangles; ++i ) {
+      const glm::uvec3 & tri = aMesh.myTriangles[ aFirstTriangle + i ];
+      CpuAabb &          bounds = someBoundsOut[ i ];
+      bounds = CpuAabb();
+      bounds.Grow( aMesh.myPositions[ tri.x ] );
+      bounds.Grow( aMesh.myPositions[ tri.y ] );
+      bounds.Grow( aMesh.myPositions[ tri.z ] );
+    }
+  }
+
+  struct MeshStreamOffsets {
+    uint64 myPositions = 0u;
+    uint64 myVertexData = 0u;  // CpuRtVertexData or CpuRtCompactVertexData, depending on the RtVertexFormat
+    uint64 myTriangles = 0u;
+    uint64 myCompactTriangles = 0u;
+    uint   myNumVertices = 0u;
+    uint   myNumTriangles = 0u;
+    uint   myNumCompactIndices = 0u;  // 0 if the mesh keeps 32-bit indices
+  };
+
+  // The GPU loads the 16-bit indices in pairs of 32-bit words
+  uint GetNumCompactIndices( uint aNumTriangles ) {
+    return ( aNumTriangles * 3u + 1u ) & ~1u;
+  }
+
+  // Inverse of CpuRt::DecodeOctahedralNormal()
+  uint EncodeOctahedralNormal( const glm::float3 & aNormal ) {
+    const float l1Norm = glm::abs( aNormal.x ) + glm::abs( aNormal.y ) + glm::abs( aNormal.z );
+    if ( l1Norm <= 0.0f )
+      return glm::packSnorm2x16( glm::float2( 0.0f ) );
+
+    const glm::float3 n = aNormal / l1Norm;
+    glm::float2       encoded( n.x, n.y );
+    if ( n.z < 0.0f ) {
+      encoded.x = ( 1.0f - glm::abs( n.y ) ) * ( n.x >= 0.0f ? 1.0f : -1.0f );
+      encoded.y = ( 1.0f - glm::abs( n.x ) ) * ( n.y >= 0.0f ? 1.0f : -1.0f );
+    }
+    return glm::packSnorm2x16( encoded );
+  }
+
+  CpuRtVertexData LoadVertexData( const CpuRtMesh & aMesh, uint aVertexIdx ) {
+    if ( aMesh.myCompactVertexData.mySize == 0u )
+      return aMesh.myVertexData[ aVertexIdx ];
+
+    const CpuRtCompactVertexData & compact = aMesh.myCompactVertexData[ aVertexIdx ];
+    CpuRtVertexData                result;
+    result.myNormal = CpuRt::DecodeOctahedralNormal( compact.myNormal );
+    result.myUv = glm::unpackHalf2x16( compact.myUv );
+    return result;
+  }
+
+  glm::uvec3 LoadTriangleIndices( const CpuRtMesh & aMesh, uint aTriangleIdx ) {
+    if ( aMesh.myCompactTriangles.mySize == 0u )
+      return aMesh.myTriangles[ aTriangleIdx ];
+
+    const uint16 * compactIndices = &aMesh.myCompactTriangles[ aTriangleIdx * 3u ];
+    return glm::uvec3( compactIndices[ 0 ], compactIndices[ 1 ], compactIndices[ 2 ] );
+  }
+
+  uint64 HashCombine( uint64 aSeed, uint64 aValue ) {
+    return aSeed ^ ( aValue + 0x9E3779B97F4A7C15ull + ( aSeed << 6 ) + ( aSeed >> 2 ) );
+  }
+
+  // Of the vertex and index data of all parts, meshes with the same hash are compared with MeshesAreEqual()
+  uint64 GetMeshHash( const MeshData & aMesh ) {
+    uint64 hash = aMesh.myParts.size();
+    for ( const MeshPartData & meshPart : aMesh.myParts ) {
+      hash = HashCombine( hash, MathUtil::ByteHash( meshPart.myVertexData.data(), meshPart.myVertexData.size() ) );
+      hash = HashCombine( hash, MathUtil::ByteHash( meshPart.myIndexData.data(), meshPart.myIndexData.size() ) );
+    }
+    return hash;
+  }
+
+  bool MeshesAreEqual( const MeshData & aMesh, const MeshData & anOtherMesh ) {
+    if ( aMesh.myParts.size() != anOtherMesh.myParts.size() )
+      return false;
+
+    for ( uint iPart = 0u; iPart < ( uint ) aMesh.myParts.size(); ++iPart ) {
+      const MeshPartData & part = aMesh.myParts[ iPart ];
+      const MeshPartData & otherPart = anOtherMesh.myParts[ iPart ];
+      if ( part.myVertexData.size() != otherPart.myVertexData.size() ||
+           part.myIndexData.size() != otherPart.myIndexData.size() ||
+           memcmp( part.myVertexData.data(), otherPart.myVertexData.data(), part.myVertexData.size() ) != 0 ||
+           memcmp( part.myIndexData.data(), otherPart.myIndexData.data(), part.myIndexData.size() ) != 0 )
+        return false;
+    }
+    return true;
+  }
+
+  uint64 AlignStreamOffset( uint64 anOffset ) {
+    const uint64 alignment = CpuRtScene::GEOMETRY_STREAM_ALIGNMENT;
+    return ( anOffset + alignment - 1u ) & ~( alignment - 1u );
+  }
+
+  // De-interleaves the parts of aMesh into the arena ranges given by someOffsets and encodes the shading attributes
+  // in aVertexFormat
+  void FillMeshStreams( const MeshData & aMesh, const MeshStreamOffsets & someOffsets, uint aNormalOffset,
+                        uint aUvOffset, RtVertexFormat aVertexFormat, uint8 * anArena, CpuRtMesh & aCpuMeshOut ) {
+    const bool        isCompact = aVertexFormat == RtVertexFormat::COMPACT;
+    glm::float3 *     dstPositions = reinterpret_cast< glm::float3 * >( anArena + someOffsets.myPositions );
+    CpuRtVertexData * dstVertexData = reinterpret_cast< CpuRtVertexData * >( anArena + someOffsets.myVertexData );
+    CpuRtCompactVertexData * dstCompactVertexData =
+        reinterpret_cast< CpuRtCompactVertexData * >( anArena + someOffsets.myVertexData );
+    glm::uvec3 * dstTriangles = reinterpret_cast< glm::uvec3 * >( anArena + someOffsets.myTriangles );
+    aCpuMeshOut.myPositions = { dstPositions, someOffsets.myNumVertices };
+    if ( isCompact )
+      aCpuMeshOut.myCompactVertexData = { dstCompactVertexData, someOffsets.myNumVertices };
+    else
+      aCpuMeshOut.myVertexData = { dstVertexData, someOffsets.myNumVertices };
+    aCpuMeshOut.myTriangles = { dstTriangles, someOffsets.myNumTriangles };
+
+    uint baseVertex = 0u;
+    for ( const MeshPartData & meshPart : aMesh.myParts ) {
+      const VertexInputLayoutProperties & vertexProps = meshPart.myVertexLayoutProperties;
+      ASSERT( !vertexProps.myAttributes.empty() &&
+              vertexProps.myAttributes[ 0 ].mySemantic == VertexAttributeSemantic::POSITION );
+
+      const uint    srcVertexStride = vertexProps.GetOverallVertexSize();
+      const uint    numVertices = VECTOR_BYTESIZE( meshPart.myVertexData ) / srcVertexStride;
+      const uint8 * srcData = meshPart.myVertexData.data();
+      for ( uint i = 0u; i < numVertices; ++i ) {
+        memcpy( dstPositions, srcData, sizeof( glm::float3 ) );
+        aCpuMeshOut.myBounds.Grow( *dstPositions );
+        CpuRtVertexData vertexData;
+        memcpy( &vertexData.myNormal, srcData + aNormalOffset, sizeof( vertexData.myNormal ) );
+        memcpy( &vertexData.myUv, srcData + aUvOffset, sizeof( vertexData.myUv ) );
+        if ( isCompact ) {
+          dstCompactVertexData->myNormal = EncodeOctahedralNormal( vertexData.myNormal );
+          dstCompactVertexData->myUv = glm::packHalf2x16( vertexData.myUv );
+          ++dstCompactVertexData;
+        } else {
+          *dstVertexData++ = vertexData;
+        }
+        ++dstPositions;
+        srcData += srcVertexStride;
+      }
+
+      // Parts are offset into the merged vertex stream, so each mesh is a single geometry on the CPU and the GPU
+      const uint         numTriangles = VECTOR_BYTESIZE( meshPart.myIndexData ) / sizeof( glm::uvec3 );
+      const glm::uvec3 * srcTriangles = reinterpret_cast< const glm::uvec3 * >( meshPart.myIndexData.data() );
+      for ( uint i = 0u; i < numTriangles; ++i )
+        *dstTriangles++ = srcTriangles[ i ] + glm::uvec3( baseVertex );
+
+      baseVertex += numVertices;
+    }
+
+    if ( someOffsets.myNumCompactIndices > 0u ) {
+      uint16 * dstIndices = reinterpret_cast< uint16 * >( anArena + someOffsets.myCompactTriangles );
+      aCpuMeshOut.myCompactTriangles = { dstIndices, someOffsets.myNumCompactIndices };
+      for ( uint i = 0u; i < someOffsets.myNumTriangles; ++i ) {
+        const glm::uvec3 & tri = aCpuMeshOut.myTriangles[ i ];
+        *dstIndices++ = ( uint16 ) tri.x;
+        *dstIndices++ = ( uint16 ) tri.y;
+        *dstIndices++ = ( uint16 ) tri.z;
+      }
+      if ( someOffsets.myNumCompactIndices > someOffsets.myNumTriangles * 3u )
+        *dstIndices = 0u;
+    }
+  }
+
+  template < class T >
+  void ReadStream( SceneCacheReader & aReader, CpuRtStream< T > & aStreamOut ) {
+    uint64 count;
+    aStreamOut.myData = aReader.ReadArray< T >( count );
+    aStreamOut.mySize = ( uint ) count;
+  }
+
+  // Builds the binary SAH trees and collapses them into the wide BVHs that are used for traversal, one per BLAS of the
+  // mesh. The temporaries come from aScratch, which is reset after every BLAS.
+  void BuildMeshBvh( CpuRtMesh & aMesh, CpuThreadPool * aThreadPool, LinearAllocator & aScratch,
+                     CpuBvhBuildStats & someStatsOut ) {
+    aMesh.myNumBlas = GetNumMeshBlas( aMesh.myTriangles.mySize );
+    aMesh.myBlas.clear();
+    aMesh.myBlas.resize( aMesh.myNumBlas );
+    someStatsOut = CpuBvhBuildStats();
+    for ( uint iBlas = 0u; iBlas < aMesh.myNumBlas; ++iBlas ) {
+      const uint firstTriangle = iBlas * CpuBvh4::MAX_PRIMITIVES;
+      const uint numTriangles = glm::min( aMesh.myTriangles.mySize - firstTriangle, ( uint ) CpuBvh4::MAX_PRIMITIVES );
+
+      const LinearEastlAllocator scratchAllocator( &aScratch );
+      LinearVector< CpuAabb >    primBounds( scratchAllocator );
+      GetTriangleBounds( aMesh, firstTriangle, numTriangles, primBounds );
+
+      CpuBvh binaryBvh;
+      binaryBvh.Build( primBounds.data(), numTriangles, aThreadPool, &aScratch );
+
+      // The primitive indices of the range become indices into the triangles of the whole mesh
+      CpuRtBlas & blas = aMesh.myBlas[ iBlas ];
+      const bool  isBuilt = blas.myBvh.Build( binaryBvh );
+      ASSERT( isBuilt );
+      ( void ) isBuilt;
+      for ( uint & primitiveIdx : blas.myBvh.myPrimitiveIndices )
+        primitiveIdx += firstTriangle;
+
+      blas.myTriangleStore.Build( aMesh.myPositions.myData, aMesh.myTriangles.myData,
+                                  blas.myBvh.myPrimitiveIndices.data(), numTriangles );
+      someStatsOut.Accumulate( binaryBvh.GetStats() );
+      aScratch.Reset();
+    }
+  }
+}  // namespace Priv_CpuRtScene
+
+const char * GetVertexFormatName( RtVertexFormat aFormat ) {
+  switch ( aFormat ) {
+    case RtVertexFormat::FULL: return "full";
+    case RtVertexFormat::COMPACT: return "compact";
+    default: return "unknown";
+  }
+}
+
+uint CpuRtMesh::GetVertexFlags() const {
+  return ( myCompactVertexData.mySize > 0u ? RT_VERTEX_FLAG_COMPACT : 0u ) |
+         ( myCompactTriangles.mySize > 0u ? RT_VERTEX_FLAG_INDEX16 : 0u );
+}
+
+uint64 CpuRtMesh::GetShadingVertexSize() const {
+  return myVertexData.GetByteSize() + myCompactVertexData.GetByteSize();
+}
+
+uint64 CpuRtMesh::GetShadingIndexSize() const {
+  return myCompactTriangles.mySize > 0u ? myCompactTriangles.GetByteSize() : myTriangles.GetByteSize();
+}
+
+glm::uvec2 GetOffsetSize( const VertexInputLayoutProperties & someVertexProps, VertexAttributeSemantic aSemantic,
+                          uint aSemanticIndex ) {
+  uint offset = 0;
+  for ( const VertexInputAttributeDesc & attribute : someVertexProps.myAttributes ) {
+    uint size = BITS_TO_BYTES( DataFormatInfo::GetFormatInfo( attribute.myFormat ).myBitsPerPixel );
+    if ( attribute.mySemantic == aSemantic && attribute.mySemanticIndex == aSemanticIndex ) {
+      return { offset, size };
+    }
+    offset += size;
+  }
+
+  ASSERT( false );
+  return glm::uvec2( 0, 0 );
+}
+
+void CpuRtScene::Init( const SceneData & aScene, CpuThreadPool * aThreadPool, SceneCache * aCache,
+                       RtVertexFormat aVertexFormat, uint64 aBlasStreamingBudget ) {
+  using namespace Priv_CpuRtScene;
+
+  myInstances.clear();
+  myMaterials.clear();
+  myVertexFormat = aVertexFormat;
+  myBlasCache.reset();
+
+  const bool meshesFromCache = aCache != nullptr && ReadMeshes( aScene, *aCache, aBlasStreamingBudget );
+  if ( !meshesFromCache && aBlasStreamingBudget > 0u ) {
+    // The SceneData of a streamed scene has no mesh data to build the BLAS from
+    Log( "Scene cache: can't stream the BLAS without a valid scene cache" );
+    myMeshes.clear();
+    mySceneMeshToMesh.clear();
+    myNumBlas = 0u;
+    myTlas = CpuBvh();
+    myTlasPrimBounds.clear();
+    myBounds = CpuAabb();
+    myBlasStats = CpuBvhBuildStats();
+    return;
+  }
+
+  if ( !meshesFromCache )
+    InitMeshes( aScene, aThreadPool );
+
+  myInstances.reserve( aScene.myInstances.size() );
+  for ( const SceneMeshInstance & instance : aScene.myInstances ) {
+    CpuRtInstance & cpuInstance = myInstances.push_back();
+    cpuInstance.myMeshIndex = mySceneMeshToMesh[ instance.myMeshIndex ];
+    cpuInstance.myMaterialIndex = instance.myMaterialIndex;
+    SetInstanceTransform( cpuInstance, instance.myTransform, myMeshes[ cpuInstance.myMeshIndex ].myBounds );
+  }
+
+  myMaterials.reserve( aScene.myMaterials.size() );
+  for ( const MaterialDesc & mat : aScene.myMaterials ) {
+    const glm::float4 & color = mat.myParameters[ ( uint ) MaterialParameterType::COLOR ];
+
+    CpuRtMaterial & cpuMat = myMaterials.push_back();
+    cpuMat.myEmission = glm::float3( mat.myParameters[ ( uint ) MaterialParameterType::EMISSION ] );
+    cpuMat.myColor = glm::float3( QuantizeUnorm8( color.x ), QuantizeUnorm8( color.y ), QuantizeUnorm8( color.z ) );
+  }
+
+  BuildBvhs( aThreadPool, !meshesFromCache );
+}
+
+void CpuRtScene::InitMeshes( const SceneData & aScene, CpuThreadPool * aThreadPool ) {
+  using namespace Priv_CpuRtScene;
+
+  const glm::uvec2 normalOffsetSize =
+      GetOffsetSize( aScene.myVertexInputLayoutProperties, VertexAttributeSemantic::NORMAL, 0u );
+  const glm::uvec2 uvOffsetSize =
+      GetOffsetSize( aScene.myVertexInputLayoutProperties, VertexAttributeSemantic::TEXCOORD, 0u );
+  ASSERT( normalOffsetSize.y == sizeof( glm::float3 ) );
+  ASSERT( uvOffsetSize.y == sizeof( glm::float2 ) );
+
+  // Scenes often place the same mesh several times as separate meshes. Those share one CpuRtMesh, so they only take
+  // up memory and a BLAS build once. The hash only finds the candidates, they are compared byte by byte.
+  eastl::vector< uint >           uniqueSceneMeshes;  // Index into aScene.myMeshes of each mesh of myMeshes
+  eastl::vector< uint >           nextWithSameHash;   // Chains the unique meshes whose hashes collide
+  eastl::hash_map< uint64, uint > hashToMesh;
+  mySceneMeshToMesh.resize( aScene.myMeshes.size() );
+  for ( uint iSceneMesh = 0u; iSceneMesh < ( uint ) aScene.myMeshes.size(); ++iSceneMesh ) {
+    const MeshData & sceneMesh = aScene.myMeshes[ iSceneMesh ];
+    const uint64     hash = GetMeshHash( sceneMesh );
+
+    uint                                      meshIdx = UINT_MAX;
+    eastl::hash_map< uint64, uint >::iterator it = hashToMesh.find( hash );
+    if ( it != hashToMesh.end() ) {
+      uint candidateIdx = it->second;
+      while ( candidateIdx != UINT_MAX && meshIdx == UINT_MAX ) {
+        if ( MeshesAreEqual( sceneMesh, aScene.myMeshes[ uniqueSceneMeshes[ candidateIdx ] ] ) )
+          meshIdx = candidateIdx;
+        candidateIdx = nextWithSameHash[ candidateIdx ];
+      }
+    }
+
+    if ( meshIdx == UINT_MAX ) {
+      meshIdx = ( uint ) uniqueSceneMeshes.size();
+      uniqueSceneMeshes.push_back( iSceneMesh );
+      nextWithSameHash.push_back( it != hashToMesh.end() ? it->second : UINT_MAX );
+      hashToMesh[ hash ] = meshIdx;
+    }
+    mySceneMeshToMesh[ iSceneMesh ] = meshIdx;
+  }
+
+  // Lay out the streams of all meshes in one arena, so the de-interleaving writes every vertex exactly once and no
+  // stream is ever reallocated
+  const bool   isCompact = myVertexFormat == RtVertexFormat::COMPACT;
+  const uint64 vertexDataSize = isCompact ? sizeof( CpuRtCompactVertexData ) : sizeof( CpuRtVertexData );
+  eastl::vector< MeshStreamOffsets > streamOffsets( uniqueSceneMeshes.size() );
+  uint64                             arenaSize = 0u;
+  for ( uint iMesh = 0u; iMesh < ( uint ) uniqueSceneMeshes.size(); ++iMesh ) {
+    uint numMeshVertices = 0u;
+    uint numMeshTriangles = 0u;
+    for ( const MeshPartData & meshPart : aScene.myMeshes[ uniqueSceneMeshes[ iMesh ] ].myParts ) {
+      numMeshVertices +=
+          VECTOR_BYTESIZE( meshPart.myVertexData ) / meshPart.myVertexLayoutProperties.GetOverallVertexSize();
+      numMeshTriangles += VECTOR_BYTESIZE( meshPart.myIndexData ) / sizeof( glm::uvec3 );
+    }
+
+    MeshStreamOffsets & offsets = streamOffsets[ iMesh ];
+    offsets.myNumVertices = numMeshVertices;
+    offsets.myNumTriangles = numMeshTriangles;
+    offsets.myNumCompactIndices = isCompact && numMeshVertices <= RT_INDEX16_MAX_VERTICES && numMeshTriangles > 0u
+                                      ? GetNumCompactIndices( numMeshTriangles )
+                                      : 0u;
+    offsets.myPositions = AlignStreamOffset( arenaSize );
+    offsets.myVertexData = AlignStreamOffset( offsets.myPositions + numMeshVertices * sizeof( glm::float3 ) );
+    offsets.myTriangles = AlignStreamOffset( offsets.myVertexData + numMeshVertices * vertexDataSize );
+    offsets.myCompactTriangles = AlignStreamOffset( offsets.myTriangles + numMeshTriangles * sizeof( glm::uvec3 ) );
+    arenaSize = offsets.myCompactTriangles + offsets.myNumCompactIndices * sizeof( uint16 );
+  }
+
+  myGeometryFile.reset();
+  myGeometryArena.clear();
+  myGeometryArena.set_capacity( arenaSize );
+  myGeometryArena.resize( arenaSize );
+  myGeometryMemorySize = arenaSize;
+
+  myMeshes.clear();
+  myMeshes.resize( uniqueSceneMeshes.size() );
+
+  if ( aThreadPool != nullptr ) {
+    aThreadPool->ParallelFor( ( uint ) myMeshes.size(), [ & ]( uint anItemIdx, uint /*aThreadIdx*/ ) {
+      FillMeshStreams( aScene.myMeshes[ uniqueSceneMeshes[ anItemIdx ] ], streamOffsets[ anItemIdx ],
+                       normalOffsetSize.x, uvOffsetSize.x, myVertexFormat, myGeometryArena.data(),
+                       myMeshes[ anItemIdx ] );
+    } );
+  } else {
+    for ( uint iMesh = 0u; iMesh < ( uint ) myMeshes.size(); ++iMesh )
+      FillMeshStreams( aScene.myMeshes[ uniqueSceneMeshes[ iMesh ] ], streamOffsets[ iMesh ], normalOffsetSize.x,
+                       uvOffsetSize.x, myVertexFormat, myGeometryArena.data(), myMeshes[ iMesh ] );
+  }
+}
+
+void CpuRtScene::WriteCache( SceneCacheWriter & aWriter ) const {
+  ASSERT( !myBlasCache );
+  aWriter.Write( myBlasStats );
+  aWriter.Write( myVertexFormat );
+  aWriter.WriteVector( mySceneMeshToMesh );
+  aWriter.Write( ( uint64 ) myMeshes.size() );
+  aWriter.Write( myNumBlas );
+  for ( const CpuRtMesh & mesh : myMeshes ) {
+    aWriter.WriteArray( mesh.myPositions.myData, mesh.myPositions.mySize );
+    aWriter.WriteArray( mesh.myVertexData.myData, mesh.myVertexData.mySize );
+    aWriter.WriteArray( mesh.myCompactVertexData.myData, mesh.myCompactVertexData.mySize );
+    aWriter.WriteArray( mesh.myTriangles.myData, mesh.myTriangles.mySize );
+    aWriter.WriteArray( mesh.myCompactTriangles.myData, mesh.myCompactTriangles.mySize );
+    aWriter.Write( mesh.myBounds );
+    aWriter.Write( mesh.myNumBlas );
+    for ( const CpuRtBlas & blas : mesh.myBlas ) {
+      aWriter.WriteVector( blas.myBvh.myNodes );
+      aWriter.WriteVector( blas.myBvh.myPrimitiveIndices );
+      blas.myTriangleStore.WriteCache( aWriter );
+    }
+  }
+}
+
+bool CpuRtScene::ReadMeshes( const SceneData & aScene, SceneCache & aCache, uint64 aBlasStreamingBudget ) {
+  using namespace Priv_CpuRtScene;
+
+  SceneCacheReader & reader = aCache.GetReader();
+
+  uint64         numMeshes;
+  RtVertexFormat vertexFormat;
+  reader.Read( myBlasStats );
+  reader.Read( vertexFormat );
+  reader.ReadVector( mySceneMeshToMesh );
+  reader.Read( numMeshes );
+  reader.Read( myNumBlas );
+
+  myGeometryArena.clear();
+  myGeometryArena.set_capacity( 0u );
+  myGeometryMemorySize = 0u;
+
+  // The streams are used in place from the mapped file, only the BVHs and triangle stores are copied out
+  if ( !reader.HasFailed() && vertexFormat != myVertexFormat ) {
+    Log( "Scene cache: written with the %s vertex format, rebuilding the BLAS", GetVertexFormatName( vertexFormat ) );
+    mySceneMeshToMesh.clear();
+    return false;
+  }
+
+  bool isValid = !reader.HasFailed() && mySceneMeshToMesh.size() == aScene.myMeshes.size() &&
+                 numMeshes <= aScene.myMeshes.size() && myNumBlas >= numMeshes &&
+                 myNumBlas <= numMeshes * GetNumMeshBlas( UINT_MAX );
+  for ( uint i = 0u; isValid && i < ( uint ) mySceneMeshToMesh.size(); ++i )
+    isValid = mySceneMeshToMesh[ i ] < numMeshes;
+
+  if ( isValid ) {
+    myMeshes.clear();
+    myMeshes.resize( numMeshes );
+    myBlasMemorySize = 0u;
+    myTriangleStoreMemorySize = 0u;
+    if ( aBlasStreamingBudget > 0u )
+      myBlasCache.reset( new CpuBlasCache( aCache.GetFile(), myNumBlas, aBlasStreamingBudget ) );
+
+    uint numBlas = 0u;
+    for ( uint iMesh = 0u; isValid && iMesh < ( uint ) myMeshes.size(); ++iMesh ) {
+      CpuRtMesh & mesh = myMeshes[ iMesh ];
+      ReadStream( reader, mesh.myPositions );
+      ReadStream( reader, mesh.myVertexData );
+      ReadStream( reader, mesh.myCompactVertexData );
+      ReadStream( reader, mesh.myTriangles );
+      ReadStream( reader, mesh.myCompactTriangles );
+      reader.Read( mesh.myBounds );
+      reader.Read( mesh.myNumBlas );
+      mesh.myFirstBlas = numBlas;
+      isValid = !reader.HasFailed() && mesh.myNumBlas == GetNumMeshBlas( mesh.myTriangles.mySize ) &&
+                mesh.myNumBlas <= myNumBlas - numBlas;
+      if ( isValid && !myBlasCache )
+        mesh.myBlas.resize( mesh.myNumBlas );
+
+      // Streamed BLAS are only checked here and read when the traversal first needs them
+      uint64 numPrimitiveIndices = 0u;
+      for ( uint iBlas = 0u; isValid && iBlas < mesh.myNumBlas; ++iBlas ) {
+        uint64 numBlasPrimitiveIndices;
+        if ( myBlasCache ) {
+          const SceneCacheReader blasReader = reader;
+          uint64                 numNodes;
+          uint64                 triangleStoreSize;
+          reader.ReadArray< CpuBvh4Node >( numNodes );
+          reader.ReadArray< uint >( numBlasPrimitiveIndices );
+          isValid = CpuRtTriangleStore::SkipCache( reader, triangleStoreSize );
+          myBlasMemorySize += numNodes * sizeof( CpuBvh4Node ) + numBlasPrimitiveIndices * sizeof( uint );
+          myTriangleStoreMemorySize += triangleStoreSize;
+          myBlasCache->SetSource( mesh.myFirstBlas + iBlas, blasReader,
+                                  numNodes * sizeof( CpuBvh4Node ) + numBlasPrimitiveIndices * sizeof( uint ) +
+                                      triangleStoreSize );
+        } else {
+          CpuRtBlas & blas = mesh.myBlas[ iBlas ];
+          reader.ReadVector( blas.myBvh.myNodes );
+          reader.ReadVector( blas.myBvh.myPrimitiveIndices );
+          numBlasPrimitiveIndices = blas.myBvh.myPrimitiveIndices.size();
+          isValid = blas.myTriangleStore.ReadCache( reader );
+        }
+        isValid = isValid && numBlasPrimitiveIndices <= CpuBvh4::MAX_PRIMITIVES;
+        numPrimitiveIndices += numBlasPrimitiveIndices;
+      }
+      numBlas += mesh.myNumBlas;
+
+      isValid = isValid && !reader.HasFailed() &&
+                mesh.myPositions.mySize == mesh.myVertexData.mySize + mesh.myCompactVertexData.mySize &&
+                ( mesh.myCompactTriangles.mySize == 0u ||
+                  mesh.myCompactTriangles.mySize == GetNumCompactIndices( mesh.myTriangles.mySize ) ) &&
+                numPrimitiveIndices == mesh.myTriangles.mySize;
+      myGeometryMemorySize += mesh.myPositions.GetByteSize() + mesh.GetShadingVertexSize() +
+                              mesh.myTriangles.GetByteSize() + mesh.myCompactTriangles.GetByteSize();
+    }
+    isValid = isValid && numBlas == myNumBlas;
+  }
+
+  if ( !isValid ) {
+    Log( "Scene cache: invalid CPU scene data, rebuilding the BLAS" );
+    myMeshes.clear();
+    mySceneMeshToMesh.clear();
+    myNumBlas = 0u;
+    myGeometryMemorySize = 0u;
+    myBlasCache.reset();
+    return false;
+  }
+
+  myGeometryFile = aCache.GetFile();
+  return true;
+}
+
+void CpuRtScene::BuildBvhs( CpuThreadPool * aThreadPool, bool aBuildBlas ) {
+  using namespace Priv_CpuRtScene;
+
+  // Scratch memory of the builds, one arena per thread. Each arena is reset after every mesh, so it only grows to the
+  // largest mesh of its thread instead of allocating the temporaries of every mesh anew.
+  const uint                       numThreads = aThreadPool != nullptr ? aThreadPool->GetNumThreads() : 1u;
+  eastl::vector< LinearAllocator > threadScratch;
+  threadScratch.reserve( numThreads );
+  for ( uint i = 0u; i < numThreads; ++i )
+    threadScratch.push_back( LinearAllocator() );
+
+  // Cached BLAS keep the stats of the build that produced them
+  if ( aBuildBlas ) {
+    eastl::vector< CpuBvhBuildStats > meshStats( myMeshes.size() );
+    eastl::vector< uint >             smallMeshes;
+    for ( uint iMesh = 0u; iMesh < ( uint ) myMeshes.size(); ++iMesh ) {
+      if ( aThreadPool != nullptr && myMeshes[ iMesh ].myTriangles.mySize < PARALLEL_BLAS_BUILD_MIN_TRIANGLES )
+        smallMeshes.push_back( iMesh );
+      else
+        BuildMeshBvh( myMeshes[ iMesh ], aThreadPool, threadScratch[ 0 ], meshStats[ iMesh ] );
+    }
+
+    // The pool can't be used from within its own jobs, so the small meshes are built single-threaded each
+    if ( !smallMeshes.empty() ) {
+      aThreadPool->ParallelFor( ( uint ) smallMeshes.size(), [ & ]( uint anItemIdx, uint aThreadIdx ) {
+        const uint meshIdx = smallMeshes[ anItemIdx ];
+        BuildMeshBvh( myMeshes[ meshIdx ], nullptr, threadScratch[ aThreadIdx ], meshStats[ meshIdx ] );
+      } );
+    }
+
+    myBlasStats = CpuBvhBuildStats();
+    for ( const CpuBvhBuildStats & stats : meshStats )
+      myBlasStats.Accumulate( stats );
+  }
+
+  // ReadMeshes() already summed up the streamed BLAS
+  if ( !myBlasCache ) {
+    myBlasMemorySize = 0u;
+    myTriangleStoreMemorySize = 0u;
+    myNumBlas = 0u;
+    for ( CpuRtMesh & mesh : myMeshes ) {
+      mesh.myFirstBlas = myNumBlas;
+      myNumBlas += mesh.myNumBlas;
+      for ( const CpuRtBlas & blas : mesh.myBlas ) {
+        myBlasMemorySize += blas.myBvh.GetMemorySize();
+        myTriangleStoreMemorySize += blas.myTriangleStore.GetMemorySize();
+      }
+    }
+  }
+
+  BuildTlas( aThreadPool, &threadScratch[ 0 ] );
+
+  const CpuBvhBuildStats & tlasStats = myTlas.GetStats();
+  Log( "CPU BLAS: %d meshes (%d in the scene, %u BLAS), %d triangles, %d nodes, %d leaves, max depth %d, max leaf "
+       "size %d, SAH cost %.2f, %.2f ms (summed over meshes)",
+       ( int ) myMeshes.size(), ( int ) mySceneMeshToMesh.size(), myNumBlas, myBlasStats.myNumPrimitives,
+       myBlasStats.myNumNodes,
+       myBlasStats.myNumLeaves, myBlasStats.myMaxDepth, myBlasStats.myMaxLeafSize, myBlasStats.mySahCost,
+       myBlasStats.myBuildTimeMs );
+  Log( "CPU TLAS: %d instances, %d nodes, max depth %d, SAH cost %.2f, %.2f ms", tlasStats.myNumPrimitives,
+       tlasStats.myNumNodes, tlasStats.myMaxDepth, tlasStats.mySahCost, tlasStats.myBuildTimeMs );
+  Log( "CPU BLAS memory: binary %.2f MiB (%d B/node), BVH4 %.2f MiB (%d B/node), %.1f%%",
+       ( float ) myBlasStats.myMemorySize / ( 1024.0f * 1024.0f ), ( int ) sizeof( CpuBvhNode ),
+       ( float ) myBlasMemorySize / ( 1024.0f * 1024.0f ), ( int ) sizeof( CpuBvh4Node ),
+       myBlasStats.myMemorySize > 0u ? 100.0f * ( float ) myBlasMemorySize / ( float ) myBlasStats.myMemorySize
+                                     : 0.0f );
+  Log( "CPU triangle store: %.2f MiB (%d B/triangle)", ( float ) myTriangleStoreMemorySize / ( 1024.0f * 1024.0f ),
+       ( int ) ( CpuRtTriangleStore::NUM_COMPONENTS * sizeof( float ) ) );
+  Log( "CPU geometry streams: %.2f MiB (%s, %s vertex format)", ( float ) myGeometryMemorySize / ( 1024.0f * 1024.0f ),
+       myGeometryFile ? "mapped from scene cache" : "arena", GetVertexFormatName( myVertexFormat ) );
+  if ( myBlasCache ) {
+    Log( "CPU BLAS streamed from the scene cache: %.2f MiB of BVH4 and triangle store, %.2f MiB budget",
+         ( float ) ( myBlasMemorySize + myTriangleStoreMemorySize ) / ( 1024.0f * 1024.0f ),
+         ( float ) myBlasCache->GetBudget() / ( 1024.0f * 1024.0f ) );
+  }
+  GetMemoryReport().PrintToLog( "CPU" );
+}
+
+void CpuRtScene::BuildTlas( CpuThreadPool * aThreadPool, LinearAllocator * aScratch ) {
+  myTlasPrimBounds.resize( myInstances.size() );
+  for ( uint i = 0u; i < ( uint ) myInstances.size(); ++i )
+    myTlasPrimBounds[ i ] = myInstances[ i ].myWorldBounds;
+  myTlas.Build( myTlasPrimBounds.data(), ( uint ) myTlasPrimBounds.size(), aThreadPool, aScratch );
+
+  myTlasBuildSahCost = myTlas.GetStats().mySahCost;
+  myBounds = myTlas.myNodes.empty() ? CpuAabb() : myTlas.myNodes[ 0 ].myBounds;
+}
+
+void CpuRtScene::SetInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                                        uint aNumInstances ) {
+  using namespace Priv_CpuRtScene;
+
+  for ( uint i = 0u; i < aNumInstances; ++i ) {
+    const uint instanceIdx = someInstanceIndices[ i ];
+    ASSERT( instanceIdx < ( uint ) myInstances.size() );
+
+    CpuRtInstance & instance = myInstances[ instanceIdx ];
+    SetInstanceTransform( instance, someTransforms[ i ], myMeshes[ instance.myMeshIndex ].myBounds );
+    myTlasPrimBounds[ instanceIdx ] = instance.myWorldBounds;
+  }
+}
+
+CpuTlasUpdate CpuRtScene::UpdateInstanceTransforms( const uint * someInstanceIndices,
+                                                    const glm::float4x4 * someTransforms, uint aNumInstances,
+                                                    CpuThreadPool * aThreadPool ) {
+  SetInstanceTransforms( someInstanceIndices, someTransforms, aNumInstances );
+
+  // The refit is linear in the number of nodes, a build several times more expensive. Only once the instances moved so
+  // far that the old topology makes traversal noticeably slower, the build pays off.
+  myTlas.Refit( myTlasPrimBounds.data() );
+  if ( myTlas.GetStats().mySahCost > myTlasBuildSahCost * TLAS_REBUILD_SAH_RATIO ) {
+    BuildTlas( aThreadPool, nullptr );
+    return CpuTlasUpdate::REBUILD;
+  }
+
+  myBounds = myTlas.myNodes.empty() ? CpuAabb() : myTlas.myNodes[ 0 ].myBounds;
+  return CpuTlasUpdate::REFIT;
+}
+
+CpuTlasUpdateBenchmarkResults CpuRtScene::RunTlasUpdateBenchmark( uint aNumInstances, CpuThreadPool * aThreadPool ) {
+  using namespace Priv_CpuRtScene;
+
+  CpuTlasUpdateBenchmarkResults results;
+  if ( myMeshes.empty() || aNumInstances == 0u )
+    return results;
+
+  // The TLAS of the scene is rebuilt afterwards
+  eastl::vector< CpuRtInstance > sceneInstances;
+  sceneInstances.swap( myInstances );
+
+  // Cells large enough for every mesh, so the instances don't overlap before they start moving
+  float cellSize = 0.0f;
+  for ( const CpuRtMesh & mesh : myMeshes ) {
+    if ( mesh.myBounds.IsValid() )
+      cellSize = glm::max( cellSize, glm::length( mesh.myBounds.GetExtent() ) );
+  }
+  cellSize = glm::max( cellSize, 1.0f );
+
+  uint gridSize = 1u;
+  while ( gridSize * gridSize * gridSize < aNumInstances )
+    ++gridSize;
+
+  eastl::vector< uint >          instanceIndices( aNumInstances );
+  eastl::vector< glm::float4x4 > transforms( aNumInstances );
+  myInstances.resize( aNumInstances );
+  for ( uint i = 0u; i < aNumInstances; ++i ) {
+    instanceIndices[ i ] = i;
+    myInstances[ i ].myMeshIndex = i % ( uint ) myMeshes.size();
+    myInstances[ i ].myMaterialIndex = 0u;
+  }
+
+  // Both runs start from the same build and move the instances through the same frames. Only the updates are timed.
+  ResetBenchmarkInstances( gridSize, cellSize, myMeshes, myInstances, transforms );
+  BuildTlas( aThreadPool, nullptr );
+  results.myBuildSahCost = myTlasBuildSahCost;
+
+  float64 updateTimeMs = 0.0;
+  for ( uint frame = 1u; frame <= NUM_TLAS_BENCHMARK_FRAMES; ++frame ) {
+    GetBenchmarkInstanceTransforms( frame, gridSize, cellSize, myMeshes, myInstances, transforms );
+    const float64 startTime = SampleTimeMs();
+    if ( UpdateInstanceTransforms( instanceIndices.data(), transforms.data(), aNumInstances, aThreadPool ) ==
+         CpuTlasUpdate::REBUILD )
+      ++results.myNumRebuilds;
+    updateTimeMs += SampleTimeMs() - startTime;
+  }
+  results.myUpdateSahCost = myTlas.GetStats().mySahCost;
+
+  ResetBenchmarkInstances( gridSize, cellSize, myMeshes, myInstances, transforms );
+  BuildTlas( aThreadPool, nullptr );
+  float64 rebuildTimeMs = 0.0;
+  for ( uint frame = 1u; frame <= NUM_TLAS_BENCHMARK_FRAMES; ++frame ) {
+    GetBenchmarkInstanceTransforms( frame, gridSize, cellSize, myMeshes, myInstances, transforms );
+    const float64 startTime = SampleTimeMs();
+    SetInstanceTransforms( instanceIndices.data(), transforms.data(), aNumInstances );
+    BuildTlas( aThreadPool, nullptr );
+    rebuildTimeMs += SampleTimeMs() - startTime;
+  }
+  results.myRebuildSahCost = myTlasBuildSahCost;
+
+  results.myNumInstances = aNumInstances;
+  results.myNumFrames = NUM_TLAS_BENCHMARK_FRAMES;
+  results.myUpdateTimeMs = ( float ) ( updateTimeMs / NUM_TLAS_BENCHMARK_FRAMES );
+  results.myRebuildTimeMs = ( float ) ( rebuildTimeMs / NUM_TLAS_BENCHMARK_FRAMES );
+  results.myBlasBuildTimeMs = ( float ) myBlasStats.myBuildTimeMs;
+
+  myInstances.swap( sceneInstances );
+  BuildTlas( aThreadPool, nullptr );
+
+  Log( "TLAS update benchmark, %u instances, %u frames: update %.3f ms (%u rebuilds, SAH cost %.2f), rebuild %.3f ms "
+       "(SAH cost %.2f), initial SAH cost %.2f, a full rebuild adds %.2f ms of BLAS builds",
+       results.myNumInstances, results.myNumFrames, results.myUpdateTimeMs, results.myNumRebuilds,
+       results.myUpdateSahCost, results.myRebuildTimeMs, results.myRebuildSahCost, results.myBuildSahCost,
+       results.myBlasBuildTimeMs );
+  return results;
+}
+
+RtMemoryReport CpuRtScene::GetMemoryReport() const {
+  RtMemoryReport report;
+  report.myMeshes.resize( myMeshes.size() );
+  for ( uint iMesh = 0u; iMesh < ( uint ) myMeshes.size(); ++iMesh ) {
+    const CpuRtMesh & mesh = myMeshes[ iMesh ];
+    RtMeshMemory &    meshMemory = report.myMeshes[ iMesh ];
+    for ( uint iBlas = 0u; iBlas < mesh.myNumBlas; ++iBlas ) {
+      meshMemory.myBlasSize += myBlasCache ? myBlasCache->GetSize( mesh.myFirstBlas + iBlas )
+                                           : mesh.myBlas[ iBlas ].myBvh.GetMemorySize() +
+                                                 mesh.myBlas[ iBlas ].myTriangleStore.GetMemorySize();
+    }
+    meshMemory.myVertexSize = mesh.myPositions.GetByteSize() + mesh.GetShadingVertexSize();
+    meshMemory.myIndexSize = mesh.myTriangles.GetByteSize() + mesh.myCompactTriangles.GetByteSize();
+  }
+
+  for ( uint meshIdx : mySceneMeshToMesh )
+    ++report.myMeshes[ meshIdx ].myNumSceneMeshes;
+  for ( const CpuRtInstance & instance : myInstances )
+    ++report.myMeshes[ instance.myMeshIndex ].myNumInstances;
+
+  report.myTlasSize = myTlas.GetMemorySize();
+  report.myInstanceSize = myInstances.size() * sizeof( CpuRtInstance ) + myTlasPrimBounds.size() * sizeof( CpuAabb );
+  return report;
+}
+
+uint64 RtMemoryReport::GetMeshesSize() const {
+  uint64 size = 0u;
+  for ( const RtMeshMemory & meshMemory : myMeshes )
+    size += meshMemory.myBlasSize + meshMemory.myVertexSize + meshMemory.myIndexSize;
+  return size;
+}
+
+uint64 RtMemoryReport::GetTotalSize() const {
+  return GetMeshesSize() + myTlasSize + myInstanceSize;
+}
+
+uint64 RtMemoryReport::GetDeduplicatedSize() const {
+  uint64 size = 0u;
+  for ( const RtMeshMemory & meshMemory : myMeshes ) {
+    if ( meshMemory.myNumSceneMeshes > 1u )
+      size += ( meshMemory.myNumSceneMeshes - 1u ) *
+              ( meshMemory.myBlasSize + meshMemory.myVertexSize + meshMemory.myIndexSize );
+  }
+  return size;
+}
+
+void RtMemoryReport::PrintToLog( const char * aName ) const {
+  const float toKiB = 1.0f / 1024.0f;
+  Log( "%s raytracing memory: %.1f KiB, %u meshes %.1f KiB, TLAS %.1f KiB, instances %.1f KiB, %.1f KiB saved by "
+         "sharing identical meshes",
+         aName, ( float ) GetTotalSize() * toKiB, ( uint ) myMeshes.size(), ( float ) GetMeshesSize() * toKiB,
+         ( float ) myTlasSize * toKiB, ( float ) myInstanceSize * toKiB, ( float ) GetDeduplicatedSize() * toKiB );
+  for ( uint iMesh = 0u; iMesh < ( uint ) myMeshes.size(); ++iMesh ) {
+    const RtMeshMemory & meshMemory = myMeshes[ iMesh ];
+    Log( "  Mesh %u: BLAS %.1f KiB, vertices %.1f KiB, indices %.1f KiB, %u scene meshes, %u instances", iMesh,
+           ( float ) meshMemory.myBlasSize * toKiB, ( float ) meshMemory.myVertexSize * toKiB,
+           ( float ) meshMemory.myIndexSize * toKiB, meshMemory.myNumSceneMeshes, meshMemory.myNumInstances );
+  }
+}
+
+bool CpuRtScene::TraceClosest( const CpuRay & aRay, CpuHit & aHitOut ) const {
+  aHitOut = CpuHit();
+  aHitOut.myT = aRay.myTMax;
+  return Trace( aRay, false, aHitOut );
+}
+
+bool CpuRtScene::TraceAny( const CpuRay & aRay ) const {
+  CpuHit hit;
+  hit.myT = aRay.myTMax;
+  return Trace( aRay, true, hit );
+}
+
+bool CpuRtScene::Trace( const CpuRay & aRay, bool anAnyHit, CpuHit & aHitInOut ) const {
+  struct InstanceLeafFunc {
+    bool operator()( uint anInstanceIdx, float & aTMaxInOut ) {
+      const bool hasHit = myScene->IntersectInstance( anInstanceIdx, *myRay, myAnyHit, *myHit );
+      aTMaxInOut = myHit->myT;
+      return hasHit;
+    }
+
+    const CpuRtScene * myScene;
+    const CpuRay *     myRay;
+    CpuHit *           myHit;
+    bool               myAnyHit;
+  };
+
+  InstanceLeafFunc leafFunc = { this, &aRay, &aHitInOut, anAnyHit };
+  float            tMax = aHitInOut.myT;
+  return myTlas.Traverse( aRay.myOrigin, 1.0f / aRay.myDirection, aRay.myTMin, tMax, anAnyHit, leafFunc );
+}
+
+bool CpuRtScene::IntersectInstance( uint anInstanceIdx, const CpuRay & aWorldRay, bool anAnyHit,
+                                    CpuHit & aHitInOut ) const {
+  using namespace Priv_CpuRtScene;
+
+  struct TriangleLeafFunc {
+    bool operator()( uint aFirstPrimitive, uint aNumPrimitives, float & aTMaxInOut ) {
+      uint        slot;
+      glm::float2 barycentrics;
+      if ( !myTriangleStore->IntersectClosest( aFirstPrimitive, aNumPrimitives, myOrigin, myDirection, myTMin,
+                                               aTMaxInOut, slot, barycentrics ) )
+        return false;
+
+      myHit->myT = aTMaxInOut;
+      myHit->myBarycentrics = barycentrics;
+      myHit->myInstanceIdx = myInstanceIdx;
+      myHit->myPrimitiveIdx = myBvh->myPrimitiveIndices[ slot ];
+      return true;
+    }
+
+    const CpuBvh4 *            myBvh;
+    const CpuRtTriangleStore * myTriangleStore;
+    glm::float3                myOrigin;
+    glm::float3                myDirection;
+    float                      myTMin;
+    uint                       myInstanceIdx;
+    CpuHit *                   myHit;
+  };
+
+  const CpuRtInstance & instance = myInstances[ anInstanceIdx ];
+
+  // The direction is not renormalized so t stays a world-space distance
+  TriangleLeafFunc leafFunc;
+  leafFunc.myOrigin = TransformPoint( instance.myWorldToObject, aWorldRay.myOrigin );
+  leafFunc.myDirection = TransformDirection( instance.myWorldToObject, aWorldRay.myDirection );
+  leafFunc.myTMin = aWorldRay.myTMin;
+  leafFunc.myInstanceIdx = anInstanceIdx;
+  leafFunc.myHit = &aHitInOut;
+
+  // A closer hit in one BLAS of the mesh shortens the rays of the next ones
+  bool       hasHit = false;
+  const uint numBlas = myMeshes[ instance.myMeshIndex ].myNumBlas;
+  for ( uint iBlas = 0u; iBlas < numBlas && !( hasHit && anAnyHit ); ++iBlas ) {
+    const CpuRtBlas & blas = AcquireBlas( instance.myMeshIndex, iBlas );
+    leafFunc.myBvh = &blas.myBvh;
+    leafFunc.myTriangleStore = &blas.myTriangleStore;
+
+    float tMax = aHitInOut.myT;
+    hasHit |= blas.myBvh.Traverse( leafFunc.myOrigin, 1.0f / leafFunc.myDirection, aWorldRay.myTMin, tMax, anAnyHit,
+                                   leafFunc );
+    ReleaseBlas( instance.myMeshIndex, iBlas );
+  }
+  return hasHit;
+}
+
+const CpuRtBlas & CpuRtScene::AcquireBlas( uint aMeshIdx, uint aBlasIdx ) const {
+  const CpuRtMesh & mesh = myMeshes[ aMeshIdx ];
+  ASSERT( aBlasIdx < mesh.myNumBlas );
+  return myBlasCache ? myBlasCache->Acquire( mesh.myFirstBlas + aBlasIdx ) : mesh.myBlas[ aBlasIdx ];
+}
+
+void CpuRtScene::ReleaseBlas( uint aMeshIdx, uint aBlasIdx ) const {
+  if ( myBlasCache )
+    myBlasCache->Release( myMeshes[ aMeshIdx ].myFirstBlas + aBlasIdx );
+}
+
+CpuRtVertexData CpuRtScene::GetInterpolatedVertexData( const CpuHit & aHit ) const {
+  using namespace Priv_CpuRtScene;
+
+  const CpuRtMesh & mesh = myMeshes[ myInstances[ aHit.myInstanceIdx ].myMeshIndex ];
+  const glm::uvec3  indices = LoadTriangleIndices( mesh, aHit.myPrimitiveIdx );
+
+  const CpuRtVertexData v0 = LoadVertexData( mesh, indices.x );
+  const CpuRtVertexData v1 = LoadVertexData( mesh, indices.y );
+  const CpuRtVertexData v2 = LoadVertexData( mesh, indices.z );
+
+  const float     baryZ = 1.0f - ( aHit.myBarycentrics.x + aHit.myBarycentrics.y );
+  CpuRtVertexData result;
+  result.myNormal = aHit.myBarycentrics.x * v0.myNormal + aHit.myBarycentrics.y * v1.myNormal + baryZ * v2.myNormal;
+  result.myUv = aHit.myBarycentrics.x * v0.myUv + aHit.myBarycentrics.y * v1.myUv + baryZ * v2.myUv;
+  return result;
+}
+
+void CpuRtScene::GetHitTriangle( const CpuHit & aHit, glm::float3 somePositionsOut[ 3 ],
+                                 glm::float2 someUvsOut[ 3 ] ) const {
+  using namespace Priv_CpuRtScene;
+
+  const CpuRtInstance & instance = myInstances[ aHit.myInstanceIdx ];
+  const CpuRtMesh &     mesh = myMeshes[ instance.myMeshIndex ];
+  const glm::uvec3      indices = LoadTriangleIndices( mesh, aHit.myPrimitiveIdx );
+  for ( uint i = 0u; i < 3u; ++i ) {
+    const glm::float3 & position = mesh.myPositions[ indices[ i ] ];
+    somePositionsOut[ i ] = glm::float3( instance.myObjectToWorld * glm::float4( position, 1.0f ) );
+    someUvsOut[ i ] = LoadVertexData( mesh, indices[ i ] ).myUv;
+  }
+}
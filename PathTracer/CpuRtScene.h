@@ -0,0 +1,298 @@
+#pragma once
+
+#include <float.h>
+#include <limits.h>
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+#include "Common/Ptr.h"
+#include "Rendering/RendererPrerequisites.h"
+#include "CpuBlasCache.h"
+#include "CpuBvh4.h"
+#include "CpuRtTriangleStore.h"
+#include "CpuSimd.h"
+
+class CpuThreadPool;
+class LinearAllocator;
+class MappedFile;
+class SceneCache;
+class SceneCacheWriter;
+
+namespace Fancy {
+  struct SceneData;
+}
+
+using namespace Fancy;
+
+glm::uvec2 GetOffsetSize( const VertexInputLayoutProperties & someVertexProps, VertexAttributeSemantic aSemantic,
+                          uint aSemanticIndex );
+
+struct CpuRay {
+  glm::float3 myOrigin;
+  float       myTMin = 0.0f;
+  glm::float3 myDirection;
+  float       myTMax = FLT_MAX;
+};
+
+struct CpuHit {
+  float       myT = FLT_MAX;
+  glm::float2 myBarycentrics;  // Weights of the second and third vertex, like BuiltInTriangleIntersectionAttributes
+  uint        myInstanceIdx = UINT_MAX;
+  uint        myPrimitiveIdx = UINT_MAX;
+};
+
+// Lanes of a ray packet, the widest instruction set the packet kernels are compiled for (AVX-512)
+const uint CPU_MAX_PACKET_WIDTH = 16u;
+
+// Coherent rays in SoA layout that are traced together. Only the first CpuRtScene::GetPacketWidth() lanes are used.
+struct alignas( 64 ) CpuRayPacket {
+  void   SetRay( uint aLane, const CpuRay & aRay );
+  CpuRay GetRay( uint aLane ) const;
+
+  float myOriginX[ CPU_MAX_PACKET_WIDTH ];
+  float myOriginY[ CPU_MAX_PACKET_WIDTH ];
+  float myOriginZ[ CPU_MAX_PACKET_WIDTH ];
+  float myDirectionX[ CPU_MAX_PACKET_WIDTH ];
+  float myDirectionY[ CPU_MAX_PACKET_WIDTH ];
+  float myDirectionZ[ CPU_MAX_PACKET_WIDTH ];
+  float myTMin[ CPU_MAX_PACKET_WIDTH ];
+  float myTMax[ CPU_MAX_PACKET_WIDTH ];
+};
+
+struct alignas( 64 ) CpuHitPacket {
+  CpuHit GetHit( uint aLane ) const;
+
+  float myT[ CPU_MAX_PACKET_WIDTH ];
+  float myBarycentricsX[ CPU_MAX_PACKET_WIDTH ];
+  float myBarycentricsY[ CPU_MAX_PACKET_WIDTH ];
+  uint  myInstanceIdx[ CPU_MAX_PACKET_WIDTH ];
+  uint  myPrimitiveIdx[ CPU_MAX_PACKET_WIDTH ];
+};
+
+// Same layout as the VertexData stream that InitRtScene uploads for the GPU
+struct CpuRtVertexData {
+  glm::float3 myNormal;
+  glm::float2 myUv;
+};
+
+// 8 instead of 20 bytes per vertex, same layout as CompactVertexData in Common.hlsl
+struct CpuRtCompactVertexData {
+  uint myNormal;  // Octahedral, packed with glm::packSnorm2x16()
+  uint myUv;      // Packed with glm::packHalf2x16()
+};
+
+// Layout of the shading attributes of the meshes, chosen for the whole scene
+enum class RtVertexFormat : uint {
+  FULL,     // CpuRtVertexData and 32-bit indices
+  COMPACT,  // CpuRtCompactVertexData, and 16-bit indices for the meshes whose vertices they can address
+  NUM
+};
+
+const char * GetVertexFormatName( RtVertexFormat aFormat );
+
+// How the closest hits load the shading attributes of a mesh, the GPU gets them per instance. Same values as the
+// VERTEX_FLAG_* defines in Common.hlsl.
+enum RtVertexFlags : uint {
+  RT_VERTEX_FLAG_COMPACT = 1u,  // CpuRtCompactVertexData instead of CpuRtVertexData
+  RT_VERTEX_FLAG_INDEX16 = 2u,  // 16-bit triangle indices
+};
+
+const uint RT_INDEX16_MAX_VERTICES = 1u << 16;
+
+// View of one geometry stream of a mesh. The data lives in the geometry arena of the CpuRtScene or in its mapped
+// scene cache.
+template < class T >
+struct CpuRtStream {
+  const T & operator[]( uint anIndex ) const {
+    return myData[ anIndex ];
+  }
+
+  uint64 GetByteSize() const {
+    return ( uint64 ) mySize * sizeof( T );
+  }
+
+  const T * myData = nullptr;
+  uint      mySize = 0u;
+};
+
+// One mesh = one BLAS, or several for meshes with more triangles than CpuBvh4::MAX_PRIMITIVES. All mesh parts are
+// merged into a single vertex/triangle stream, with the triangles offset into the merged vertices. These streams are
+// used as they are for the GPU buffers and the GPU BLAS build as well. Intersection only reads myBlas, the vertex data
+// and the triangle indices are the shading attributes that are read once per closest hit. myBlas is empty in streamed
+// scenes, see CpuRtScene::AcquireBlas(). Depending on the RtVertexFormat, either myVertexData or myCompactVertexData is
+// filled.
+// myCompactTriangles replaces myTriangles for the shading where it is filled, the BVH builds and the lights keep using
+// myTriangles.
+struct CpuRtMesh {
+  // RT_VERTEX_FLAG_* of the streams of the mesh
+  uint GetVertexFlags() const;
+
+  // Of the streams the closest hits read, which are the ones the GPU gets
+  uint64 GetShadingVertexSize() const;
+  uint64 GetShadingIndexSize() const;
+
+  CpuRtStream< glm::float3 >            myPositions;
+  CpuRtStream< CpuRtVertexData >        myVertexData;
+  CpuRtStream< CpuRtCompactVertexData > myCompactVertexData;
+  CpuRtStream< glm::uvec3 >             myTriangles;
+  CpuRtStream< uint16 >                 myCompactTriangles;  // 3 per triangle, padded to a multiple of 4 bytes
+  CpuAabb                               myBounds;
+  // Over consecutive ranges of at most CpuBvh4::MAX_PRIMITIVES triangles, the primitive indices of their BVHs index
+  // into myTriangles
+  eastl::vector< CpuRtBlas >            myBlas;
+  uint                                  myFirstBlas = 0u;  // Of myBlas in the CpuBlasCache of a streamed scene
+  uint                                  myNumBlas = 0u;
+};
+
+struct CpuRtInstance {
+  glm::float4x4 myObjectToWorld;
+  glm::float4x4 myWorldToObject;
+  CpuAabb       myWorldBounds;
+  uint          myMeshIndex = 0u;
+  uint          myMaterialIndex = 0u;
+};
+
+// Mirrors MaterialData in InitRtScene. The color goes through the same unorm8 quantization as on the GPU.
+struct CpuRtMaterial {
+  glm::float3 myEmission;
+  glm::float3 myColor;
+  uint        myBaseColorTexture = UINT_MAX;  // Into the CpuTextureCache of the CpuPathTracer, multiplies myColor
+};
+
+// Bytes of the raytracing data of one mesh, on the CPU or the GPU
+struct RtMeshMemory {
+  uint64 myBlasSize = 0u;
+  uint64 myVertexSize = 0u;      // Positions and shading attributes
+  uint64 myIndexSize = 0u;
+  uint   myNumSceneMeshes = 0u;  // Identical meshes of the SceneData that share this one
+  uint   myNumInstances = 0u;
+};
+
+// Bytes of the raytracing data of a scene, see CpuRtScene::GetMemoryReport() and RaytracingScene::GetMemoryReport().
+// Shared meshes are counted once.
+struct RtMemoryReport {
+  uint64 GetMeshesSize() const;
+  uint64 GetTotalSize() const;
+  uint64 GetDeduplicatedSize() const;  // That the copies of the shared meshes would add without the sharing
+
+  // One line for the totals and one per mesh
+  void PrintToLog( const char * aName ) const;
+
+  eastl::vector< RtMeshMemory > myMeshes;
+  uint64                        myTlasSize = 0u;
+  uint64                        myInstanceSize = 0u;  // Of the per-instance data next to the TLAS
+};
+
+// How CpuRtScene::UpdateInstanceTransforms() updated the TLAS
+enum class CpuTlasUpdate { REFIT, REBUILD };
+
+// CpuRtScene::UpdateInstanceTransforms() rebuilds the TLAS once a refit made its SAH cost this much higher than after
+// its last build
+const float TLAS_REBUILD_SAH_RATIO = 1.5f;
+
+// Cost of moving all instances of a large scene every frame, see CpuRtScene::RunTlasUpdateBenchmark()
+struct CpuTlasUpdateBenchmarkResults {
+  uint  myNumInstances = 0u;
+  uint  myNumFrames = 0u;
+  float myUpdateTimeMs = 0.0f;     // Per frame, of UpdateInstanceTransforms()
+  uint  myNumRebuilds = 0u;        // Frames in which UpdateInstanceTransforms() rebuilt instead of refitting
+  float myRebuildTimeMs = 0.0f;    // Per frame, of the same transform update with a TLAS build every frame
+  float myBlasBuildTimeMs = 0.0f;  // That a full rebuild of the scene spends on top, summed over the meshes
+  float myBuildSahCost = 0.0f;     // Of the TLAS before the first frame
+  float myUpdateSahCost = 0.0f;    // Of the TLAS after the last frame of UpdateInstanceTransforms()
+  float myRebuildSahCost = 0.0f;   // Of the TLAS built after the last frame
+};
+
+// CPU-side copy of the raytracing scene that InitRtScene builds for the GPU
+class CpuRtScene {
+public:
+  enum { GEOMETRY_STREAM_ALIGNMENT = 64 };
+
+  // Builds the BLAS of all meshes and the TLAS over all instances. Meshes of the SceneData with the same vertex and
+  // index data share one CpuRtMesh. aThreadPool is optional. If aCache is given, the meshes and their BLAS are read
+  // from it instead and only the TLAS is built. The geometry streams then point into the mapped cache file, which is
+  // kept open for the lifetime of the scene. A cache written with another aVertexFormat is not used.
+  // With a streaming budget, the BLAS stay in aCache as well and are only paged in by the traversal, see CpuBlasCache.
+  // The SceneData then needs no vertex and index data. If the scene can't be streamed from aCache, it is left empty.
+  void Init( const SceneData & aScene, CpuThreadPool * aThreadPool, SceneCache * aCache = nullptr,
+             RtVertexFormat aVertexFormat = RtVertexFormat::FULL, uint64 aBlasStreamingBudget = 0u );
+
+  // Writes the meshes and their BLAS in the format Init() reads back from a cache. Not for streamed scenes.
+  void WriteCache( SceneCacheWriter & aWriter ) const;
+
+  // Sets the object-to-world transforms of the given instances and updates the TLAS, the BLAS stay as they are. The
+  // TLAS is refit, unless that leaves its SAH cost more than TLAS_REBUILD_SAH_RATIO times the one of its last build.
+  CpuTlasUpdate UpdateInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                                          uint aNumInstances, CpuThreadPool * aThreadPool );
+
+  // Replaces the instances with aNumInstances copies of the meshes on a grid and moves all of them for a few frames,
+  // once with UpdateInstanceTransforms() and once with a TLAS build per frame. The instances of the scene are restored
+  // and its TLAS rebuilt afterwards.
+  CpuTlasUpdateBenchmarkResults RunTlasUpdateBenchmark( uint aNumInstances, CpuThreadPool * aThreadPool );
+
+  bool TraceClosest( const CpuRay & aRay, CpuHit & aHitOut ) const;
+  bool TraceAny( const CpuRay & aRay ) const;
+
+  // Packet versions of TraceClosest/TraceAny. Only lanes set in aLaneMask are traced. Both return the mask of lanes
+  // that hit something, the hit data of the other lanes is undefined.
+  uint TraceClosestPacket( const CpuRayPacket & aPacket, uint aLaneMask, CpuHitPacket & someHitsOut ) const;
+  uint TraceAnyPacket( const CpuRayPacket & aPacket, uint aLaneMask ) const;
+
+  // Lanes per packet and instruction set of the packet kernel, which is picked by the features of the CPU at startup
+  static uint         GetPacketWidth();
+  static const char * GetPacketIsaName();
+
+  // Same interpolation as LoadInterpolatedVertexData in Common.hlsl
+  CpuRtVertexData GetInterpolatedVertexData( const CpuHit & aHit ) const;
+
+  // World-space positions and UVs of the corners of the hit triangle, for the texture LOD
+  void GetHitTriangle( const CpuHit & aHit, glm::float3 somePositionsOut[ 3 ], glm::float2 someUvsOut[ 3 ] ) const;
+
+  // BLAS aBlasIdx of the CpuRtMesh::myNumBlas of a mesh for the traversal. In streamed scenes, this pins the BLAS in
+  // the BLAS cache and pages it in if it isn't resident. Every call has to be matched by ReleaseBlas() then.
+  const CpuRtBlas & AcquireBlas( uint aMeshIdx, uint aBlasIdx ) const;
+  void              ReleaseBlas( uint aMeshIdx, uint aBlasIdx ) const;
+
+  // nullptr unless the scene is streamed
+  CpuBlasCache * GetBlasCache() const {
+    return myBlasCache.get();
+  }
+
+  RtMemoryReport GetMemoryReport() const;
+
+  eastl::vector< CpuRtMesh >     myMeshes;           // Unique meshes, the instances index into these
+  eastl::vector< uint >          mySceneMeshToMesh;  // Index into myMeshes of each mesh of the SceneData
+  eastl::vector< CpuRtInstance > myInstances;
+  eastl::vector< CpuRtMaterial > myMaterials;
+  CpuAabb                        myBounds;
+  RtVertexFormat                 myVertexFormat = RtVertexFormat::FULL;
+
+  CpuBvh           myTlas;                     // Over the world bounds of myInstances
+  float            myTlasBuildSahCost = 0.0f;  // Of the last build of myTlas, the refits are measured against it
+  CpuBvhBuildStats myBlasStats;
+  // Of all meshes, in streamed scenes also of the BLAS that aren't resident
+  uint64           myBlasMemorySize = 0u;  // Of the wide BVHs, myBlasStats holds the size of the binary ones
+  uint             myNumBlas = 0u;         // Of all meshes
+  uint64           myTriangleStoreMemorySize = 0u;
+  uint64           myGeometryMemorySize = 0u;  // Of all mesh streams
+
+private:
+  void InitMeshes( const SceneData & aScene, CpuThreadPool * aThreadPool );
+  bool ReadMeshes( const SceneData & aScene, SceneCache & aCache, uint64 aBlasStreamingBudget );
+  void BuildBvhs( CpuThreadPool * aThreadPool, bool aBuildBlas );
+  void BuildTlas( CpuThreadPool * aThreadPool, LinearAllocator * aScratch );
+  void SetInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                              uint aNumInstances );
+  bool Trace( const CpuRay & aRay, bool anAnyHit, CpuHit & aHitInOut ) const;
+  bool IntersectInstance( uint anInstanceIdx, const CpuRay & aWorldRay, bool anAnyHit, CpuHit & aHitInOut ) const;
+
+  // Backing memory of the mesh streams, either myGeometryArena or a part of myGeometryFile
+  eastl::vector< uint8 >  myGeometryArena;
+  SharedPtr< MappedFile > myGeometryFile;
+
+  UniquePtr< CpuBlasCache > myBlasCache;  // Only for streamed scenes, the BLAS of myMeshes are empty then
+
+  // World bounds of myInstances as the TLAS builds and refits take them, kept for the updates
+  eastl::vector< CpuAabb > myTlasPrimBounds;
+};
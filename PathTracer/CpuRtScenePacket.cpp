@@ -0,0 +1,119 @@
+#include "CpuRtScenePacket.h"
+
+#if CPU_SIMD_X86
+  #if defined( _MSC_VER )
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+// Packet traversal with the baseline SIMD wrappers the target is compiled for, and the selection of the packet kernel
+// at startup. The AVX2 and AVX-512 kernels live in CpuRtScenePacketAvx2.cpp and CpuRtScenePacketAvx512.cpp.
+
+namespace Priv_CpuRtScenePacket {
+#include "CpuRtScenePacketKernel.h"
+
+#if CPU_SIMD_X86
+  void GetCpuid( uint aLeaf, uint aSubLeaf, uint someRegistersOut[ 4 ] ) {
+  #if defined( _MSC_VER )
+    __cpuidex( ( int * ) someRegistersOut, ( int ) aLeaf, ( int ) aSubLeaf );
+  #else
+    __cpuid_count( aLeaf, aSubLeaf, someRegistersOut[ 0 ], someRegistersOut[ 1 ], someRegistersOut[ 2 ],
+                   someRegistersOut[ 3 ] );
+  #endif
+  }
+
+  // The register state the OS saves on context switches
+  uint64 GetXcr0() {
+  #if defined( _MSC_VER )
+    return _xgetbv( 0 );
+  #else
+    uint low;
+    uint high;
+    __asm__( "xgetbv" : "=a"( low ), "=d"( high ) : "c"( 0 ) );
+    return ( ( uint64 ) high << 32 ) | low;
+  #endif
+  }
+#endif
+
+  const CpuRtPacketKernel & SelectKernel() {
+    static const CpuRtPacketKernel baselineKernel = { TraceClosestPacket, TraceAnyPacket, SIMD_WIDTH, SimdGetName() };
+
+#if CPU_SIMD_X86
+    uint registers[ 4 ];
+    GetCpuid( 0u, 0u, registers );
+    const uint maxLeaf = registers[ 0 ];
+
+    // AVX needs OSXSAVE and the OS saving the XMM and YMM registers, AVX-512 additionally the opmask and ZMM registers
+    GetCpuid( 1u, 0u, registers );
+    const bool hasOsAvx = ( registers[ 2 ] & ( 1u << 27 ) ) && ( registers[ 2 ] & ( 1u << 28 ) );
+    if ( !hasOsAvx || maxLeaf < 7u )
+      return baselineKernel;
+
+    const uint64 xcr0 = GetXcr0();
+    if ( ( xcr0 & 0x6u ) != 0x6u )
+      return baselineKernel;
+
+    GetCpuid( 7u, 0u, registers );
+    const bool hasAvx2 = ( registers[ 1 ] & ( 1u << 5 ) ) != 0u;
+    const bool hasAvx512 = ( registers[ 1 ] & ( 1u << 16 ) ) != 0u && ( xcr0 & 0xE0u ) == 0xE0u;
+    if ( hasAvx512 && SIMD_WIDTH < 16u )
+      return GetCpuRtPacketKernelAvx512();
+    if ( hasAvx2 && SIMD_WIDTH < 8u )
+      return GetCpuRtPacketKernelAvx2();
+#endif
+
+    return baselineKernel;
+  }
+
+  const CpuRtPacketKernel & GetKernel() {
+    static const CpuRtPacketKernel & kernel = SelectKernel();
+    return kernel;
+  }
+}  // namespace Priv_CpuRtScenePacket
+
+void CpuRayPacket::SetRay( uint aLane, const CpuRay & aRay ) {
+  myOriginX[ aLane ] = aRay.myOrigin.x;
+  myOriginY[ aLane ] = aRay.myOrigin.y;
+  myOriginZ[ aLane ] = aRay.myOrigin.z;
+  myDirectionX[ aLane ] = aRay.myDirection.x;
+  myDirectionY[ aLane ] = aRay.myDirection.y;
+  myDirectionZ[ aLane ] = aRay.myDirection.z;
+  myTMin[ aLane ] = aRay.myTMin;
+  myTMax[ aLane ] = aRay.myTMax;
+}
+
+CpuRay CpuRayPacket::GetRay( uint aLane ) const {
+  CpuRay ray;
+  ray.myOrigin = glm::float3( myOriginX[ aLane ], myOriginY[ aLane ], myOriginZ[ aLane ] );
+  ray.myDirection = glm::float3( myDirectionX[ aLane ], myDirectionY[ aLane ], myDirectionZ[ aLane ] );
+  ray.myTMin = myTMin[ aLane ];
+  ray.myTMax = myTMax[ aLane ];
+  return ray;
+}
+
+CpuHit CpuHitPacket::GetHit( uint aLane ) const {
+  CpuHit hit;
+  hit.myT = myT[ aLane ];
+  hit.myBarycentrics = glm::float2( myBarycentricsX[ aLane ], myBarycentricsY[ aLane ] );
+  hit.myInstanceIdx = myInstanceIdx[ aLane ];
+  hit.myPrimitiveIdx = myPrimitiveIdx[ aLane ];
+  return hit;
+}
+
+uint CpuRtScene::TraceClosestPacket( const CpuRayPacket & aPacket, uint aLaneMask, CpuHitPacket & someHitsOut ) const {
+  return Priv_CpuRtScenePacket::GetKernel().myTraceClosest( *this, aPacket, aLaneMask, someHitsOut );
+}
+
+uint CpuRtScene::TraceAnyPacket( const CpuRayPacket & aPacket, uint aLaneMask ) const {
+  return Priv_CpuRtScenePacket::GetKernel().myTraceAny( *this, aPacket, aLaneMask );
+}
+
+uint CpuRtScene::GetPacketWidth() {
+  return Priv_CpuRtScenePacket::GetKernel().myWidth;
+}
+
+const char * CpuRtScene::GetPacketIsaName() {
+  return Priv_CpuRtScenePacket::GetKernel().myName;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "CpuRtScene.h"
+
+// The packet traversal of CpuRtScene is compiled once per instruction set, each into its own namespace, from
+// CpuRtScenePacketKernel.h. CpuRtScene::TraceClosestPacket/TraceAnyPacket forward to the widest one the CPU supports.
+struct CpuRtPacketKernel {
+  uint ( *myTraceClosest )( const CpuRtScene & aScene, const CpuRayPacket & aPacket, uint aLaneMask,
+                            CpuHitPacket & someHitsOut );
+  uint ( *myTraceAny )( const CpuRtScene & aScene, const CpuRayPacket & aPacket, uint aLaneMask );
+  uint         myWidth;
+  const char * myName;
+};
+
+#if CPU_SIMD_X86
+const CpuRtPacketKernel & GetCpuRtPacketKernelAvx2();    // CpuRtScenePacketAvx2.cpp
+const CpuRtPacketKernel & GetCpuRtPacketKernelAvx512();  // CpuRtScenePacketAvx512.cpp
+#endif
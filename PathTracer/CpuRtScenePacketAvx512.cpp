@@ -0,0 +1,37 @@
+#include "CpuRtScenePacket.h"
+
+// The packet kernel for AVX-512. Only this code uses the instruction set, which GCC and Clang enable per function
+// below (MSVC needs nothing to emit it), so the rest of the target stays runnable on the SSE2 baseline.
+
+#if CPU_SIMD_X86
+
+#if defined( __clang__ )
+  #pragma clang attribute push( __attribute__( ( target( "avx512f" ) ) ), apply_to = function )
+#elif defined( __GNUC__ )
+  #pragma GCC push_options
+  #pragma GCC target( "avx512f" )
+#endif
+
+namespace Priv_CpuRtScenePacketAvx512 {
+#define CPU_SIMD_IMPL_ISA CPU_SIMD_ISA_AVX512
+#include "CpuSimdImpl.h"
+#undef CPU_SIMD_IMPL_ISA
+#include "CpuRtTriangleSimd.h"
+#include "CpuRtScenePacketKernel.h"
+}  // namespace Priv_CpuRtScenePacketAvx512
+
+#if defined( __clang__ )
+  #pragma clang attribute pop
+#elif defined( __GNUC__ )
+  #pragma GCC pop_options
+#endif
+
+const CpuRtPacketKernel & GetCpuRtPacketKernelAvx512() {
+  static const CpuRtPacketKernel kernel = { Priv_CpuRtScenePacketAvx512::TraceClosestPacket,
+                                            Priv_CpuRtScenePacketAvx512::TraceAnyPacket,
+                                            Priv_CpuRtScenePacketAvx512::SIMD_WIDTH,
+                                            Priv_CpuRtScenePacketAvx512::SimdGetName() };
+  return kernel;
+}
+
+#endif
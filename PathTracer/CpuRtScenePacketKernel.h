@@ -0,0 +1,259 @@
+// No include guard: the packet traversal of the two-level CPU BVH, included into one namespace per instruction set
+// after the SIMD wrappers for it (see CpuRtScenePacket.cpp). All rays of a packet walk the tree together: a node is
+// visited if any active lane hits its bounds, and the box and triangle tests run for all SIMD_WIDTH lanes at once.
+
+struct PacketRays {
+  SimdFloat myOrigin[ 3 ];
+  SimdFloat myDirection[ 3 ];
+  SimdFloat myInvDirection[ 3 ];
+};
+
+struct PacketState {
+  PacketRays myWorldRays;
+  SimdFloat  myTMin;
+  SimdFloat  myTMax;  // Distance to the closest hit so far
+  SimdFloat  myBarycentricsX;
+  SimdFloat  myBarycentricsY;
+  SimdMask   myActive;  // Lanes that still need to be traced
+  uint       myHitMask;
+  uint       myInstanceIdx[ SIMD_WIDTH ];
+  uint       myPrimitiveIdx[ SIMD_WIDTH ];
+  bool       myAnyHit;
+};
+
+float GetMinOverLanes( SimdFloat aValue, uint aLaneMask ) {
+  float values[ SIMD_WIDTH ];
+  SimdStore( values, aValue );
+
+  float result = FLT_MAX;
+  for ( uint lane = 0u; lane < SIMD_WIDTH; ++lane ) {
+    if ( aLaneMask & ( 1u << lane ) )
+      result = glm::min( result, values[ lane ] );
+  }
+  return result;
+}
+
+void TransformRays( const glm::float4x4 & aMatrix, const PacketRays & someRays, PacketRays & someRaysOut ) {
+  for ( uint i = 0u; i < 3u; ++i ) {
+    const SimdFloat m0 = SimdSet1( aMatrix[ 0 ][ i ] );
+    const SimdFloat m1 = SimdSet1( aMatrix[ 1 ][ i ] );
+    const SimdFloat m2 = SimdSet1( aMatrix[ 2 ][ i ] );
+    const SimdFloat m3 = SimdSet1( aMatrix[ 3 ][ i ] );
+
+    someRaysOut.myOrigin[ i ] = SimdAdd( SimdAdd( SimdMul( m0, someRays.myOrigin[ 0 ] ),
+                                                  SimdMul( m1, someRays.myOrigin[ 1 ] ) ),
+                                         SimdAdd( SimdMul( m2, someRays.myOrigin[ 2 ] ), m3 ) );
+    someRaysOut.myDirection[ i ] = SimdAdd( SimdAdd( SimdMul( m0, someRays.myDirection[ 0 ] ),
+                                                     SimdMul( m1, someRays.myDirection[ 1 ] ) ),
+                                            SimdMul( m2, someRays.myDirection[ 2 ] ) );
+  }
+
+  const SimdFloat one = SimdSet1( 1.0f );
+  for ( uint i = 0u; i < 3u; ++i )
+    someRaysOut.myInvDirection[ i ] = SimdDiv( one, someRaysOut.myDirection[ i ] );
+}
+
+SimdMask IntersectAabb( const CpuAabb & anAabb, const PacketRays & someRays, SimdFloat aTMin, SimdFloat aTMax,
+                        SimdFloat & aTEnterOut ) {
+  SimdFloat tEnter = aTMin;
+  SimdFloat tExit = aTMax;
+  for ( uint i = 0u; i < 3u; ++i ) {
+    const SimdFloat t0 = SimdMul( SimdSub( SimdSet1( anAabb.myMin[ i ] ), someRays.myOrigin[ i ] ),
+                                  someRays.myInvDirection[ i ] );
+    const SimdFloat t1 = SimdMul( SimdSub( SimdSet1( anAabb.myMax[ i ] ), someRays.myOrigin[ i ] ),
+                                  someRays.myInvDirection[ i ] );
+    tEnter = SimdMax( tEnter, SimdMin( t0, t1 ) );
+    tExit = SimdMin( tExit, SimdMax( t0, t1 ) );
+  }
+
+  aTEnterOut = tEnter;
+  return SimdCmpLe( tEnter, tExit );
+}
+
+// Returns false once all lanes of an any-hit packet found a hit
+bool TraverseBlas( const CpuBvh4 & aBvh, const CpuRtTriangleStore & aTriangleStore, uint anInstanceIdx,
+                   const PacketRays & someRays, PacketState & aState ) {
+  if ( aBvh.myNodes.empty() )
+    return true;
+
+  uint stack[ CpuBvh4::MAX_TRAVERSAL_STACK_SIZE ];
+  uint stackSize = 0u;
+  stack[ stackSize++ ] = 0u;
+
+  while ( stackSize > 0u ) {
+    const uint childRef = stack[ --stackSize ];
+
+    if ( CpuBvh4Node::IsLeaf( childRef ) ) {
+      const uint primBegin = CpuBvh4Node::GetLeafFirstPrimitive( childRef );
+      const uint primEnd = primBegin + CpuBvh4Node::GetLeafNumPrimitives( childRef );
+      for ( uint i = primBegin; i < primEnd; ++i ) {
+        // One triangle against all lanes
+        SimdFloat triangle[ CpuRtTriangleStore::NUM_COMPONENTS ];
+        for ( uint c = 0u; c < CpuRtTriangleStore::NUM_COMPONENTS; ++c )
+          triangle[ c ] = SimdSet1( aTriangleStore.GetComponent( ( CpuRtTriangleStore::Component ) c )[ i ] );
+
+        SimdFloat t;
+        SimdFloat u;
+        SimdFloat v;
+        SimdMask  hitMask = IntersectTrianglesSimd(
+            someRays.myOrigin, someRays.myDirection, triangle + CpuRtTriangleStore::V0_X,
+            triangle + CpuRtTriangleStore::EDGE1_X, triangle + CpuRtTriangleStore::EDGE2_X, aState.myTMin,
+            aState.myTMax, t, u, v );
+        hitMask = SimdAnd( hitMask, aState.myActive );
+
+        const uint hitBits = SimdMoveMask( hitMask );
+        if ( hitBits == 0u )
+          continue;
+
+        aState.myTMax = SimdSelect( hitMask, t, aState.myTMax );
+        aState.myBarycentricsX = SimdSelect( hitMask, u, aState.myBarycentricsX );
+        aState.myBarycentricsY = SimdSelect( hitMask, v, aState.myBarycentricsY );
+        aState.myHitMask |= hitBits;
+        for ( uint lane = 0u; lane < SIMD_WIDTH; ++lane ) {
+          if ( hitBits & ( 1u << lane ) ) {
+            aState.myInstanceIdx[ lane ] = anInstanceIdx;
+            aState.myPrimitiveIdx[ lane ] = aBvh.myPrimitiveIndices[ i ];
+          }
+        }
+
+        if ( aState.myAnyHit ) {
+          aState.myActive = SimdAndNot( aState.myActive, hitMask );
+          if ( SimdMoveMask( aState.myActive ) == 0u )
+            return false;
+        }
+      }
+      continue;
+    }
+
+    // Push the children that any lane hits, sorted far to near by the closest entry distance over all lanes
+    const CpuBvh4Node & node = aBvh.myNodes[ childRef ];
+    uint                hitRefs[ 4 ];
+    float               hitDistances[ 4 ];
+    uint                numHits = 0u;
+    for ( uint i = 0u; i < 4u; ++i ) {
+      if ( node.myChildren[ i ] == CpuBvh4Node::EMPTY_CHILD )
+        continue;
+
+      SimdFloat      tEnter;
+      const SimdMask childMask =
+          IntersectAabb( node.GetChildBounds( i ), someRays, aState.myTMin, aState.myTMax, tEnter );
+      const uint     laneBits = SimdMoveMask( SimdAnd( childMask, aState.myActive ) );
+      if ( laneBits == 0u )
+        continue;
+
+      const float distance = GetMinOverLanes( tEnter, laneBits );
+      uint        insertIdx = numHits++;
+      for ( ; insertIdx > 0u && hitDistances[ insertIdx - 1u ] < distance; --insertIdx ) {
+        hitRefs[ insertIdx ] = hitRefs[ insertIdx - 1u ];
+        hitDistances[ insertIdx ] = hitDistances[ insertIdx - 1u ];
+      }
+      hitRefs[ insertIdx ] = node.myChildren[ i ];
+      hitDistances[ insertIdx ] = distance;
+    }
+
+    ASSERT( stackSize + numHits <= CpuBvh4::MAX_TRAVERSAL_STACK_SIZE );
+    for ( uint i = 0u; i < numHits; ++i )
+      stack[ stackSize++ ] = hitRefs[ i ];
+  }
+
+  return true;
+}
+
+void TraverseTlas( const CpuRtScene & aScene, PacketState & aState ) {
+  const CpuBvh & tlas = aScene.myTlas;
+  if ( tlas.myNodes.empty() )
+    return;
+
+  uint stack[ CpuBvh::MAX_TRAVERSAL_DEPTH ];
+  uint stackSize = 0u;
+  stack[ stackSize++ ] = 0u;
+
+  while ( stackSize > 0u ) {
+    const CpuBvhNode & node = tlas.myNodes[ stack[ --stackSize ] ];
+
+    SimdFloat tEnter;
+    if ( SimdMoveMask( SimdAnd( IntersectAabb( node.myBounds, aState.myWorldRays, aState.myTMin, aState.myTMax,
+                                               tEnter ),
+                                aState.myActive ) ) == 0u )
+      continue;
+
+    if ( !node.IsLeaf() ) {
+      ASSERT( stackSize + 2u <= CpuBvh::MAX_TRAVERSAL_DEPTH );
+      stack[ stackSize++ ] = node.myLeftChildOrFirstPrimitive + 1u;
+      stack[ stackSize++ ] = node.myLeftChildOrFirstPrimitive;
+      continue;
+    }
+
+    const uint primEnd = node.myLeftChildOrFirstPrimitive + node.myNumPrimitives;
+    for ( uint i = node.myLeftChildOrFirstPrimitive; i < primEnd; ++i ) {
+      const uint            instanceIdx = tlas.myPrimitiveIndices[ i ];
+      const CpuRtInstance & instance = aScene.myInstances[ instanceIdx ];
+
+      // The directions are not renormalized so t stays a world-space distance
+      PacketRays objectRays;
+      TransformRays( instance.myWorldToObject, aState.myWorldRays, objectRays );
+
+      const uint numBlas = aScene.myMeshes[ instance.myMeshIndex ].myNumBlas;
+      for ( uint iBlas = 0u; iBlas < numBlas; ++iBlas ) {
+        const CpuRtBlas & blas = aScene.AcquireBlas( instance.myMeshIndex, iBlas );
+        const bool continueTraversal =
+            TraverseBlas( blas.myBvh, blas.myTriangleStore, instanceIdx, objectRays, aState );
+        aScene.ReleaseBlas( instance.myMeshIndex, iBlas );
+        if ( !continueTraversal )
+          return;
+      }
+    }
+  }
+}
+
+void InitState( const CpuRayPacket & aPacket, uint aLaneMask, bool anAnyHit, PacketState & aStateOut ) {
+  // Inactive lanes may contain garbage, give them a valid ray so they can't produce NaNs or FP exceptions
+  CpuRayPacket packet = aPacket;
+  for ( uint lane = 0u; lane < SIMD_WIDTH; ++lane ) {
+    if ( ( aLaneMask & ( 1u << lane ) ) == 0u )
+      packet.SetRay( lane, CpuRay { glm::float3( 0.0f ), 0.0f, glm::float3( 0.0f, 0.0f, 1.0f ), 0.0f } );
+  }
+
+  aStateOut.myWorldRays.myOrigin[ 0 ] = SimdLoad( packet.myOriginX );
+  aStateOut.myWorldRays.myOrigin[ 1 ] = SimdLoad( packet.myOriginY );
+  aStateOut.myWorldRays.myOrigin[ 2 ] = SimdLoad( packet.myOriginZ );
+  aStateOut.myWorldRays.myDirection[ 0 ] = SimdLoad( packet.myDirectionX );
+  aStateOut.myWorldRays.myDirection[ 1 ] = SimdLoad( packet.myDirectionY );
+  aStateOut.myWorldRays.myDirection[ 2 ] = SimdLoad( packet.myDirectionZ );
+  for ( uint i = 0u; i < 3u; ++i )
+    aStateOut.myWorldRays.myInvDirection[ i ] =
+        SimdDiv( SimdSet1( 1.0f ), aStateOut.myWorldRays.myDirection[ i ] );
+
+  aStateOut.myTMin = SimdLoad( packet.myTMin );
+  aStateOut.myTMax = SimdLoad( packet.myTMax );
+  aStateOut.myBarycentricsX = SimdSet1( 0.0f );
+  aStateOut.myBarycentricsY = SimdSet1( 0.0f );
+  aStateOut.myActive = SimdMaskFromBits( aLaneMask );
+  aStateOut.myHitMask = 0u;
+  aStateOut.myAnyHit = anAnyHit;
+}
+
+uint TraceClosestPacket( const CpuRtScene & aScene, const CpuRayPacket & aPacket, uint aLaneMask,
+                         CpuHitPacket & someHitsOut ) {
+  PacketState state;
+  InitState( aPacket, aLaneMask, false, state );
+  TraverseTlas( aScene, state );
+
+  SimdStore( someHitsOut.myT, state.myTMax );
+  SimdStore( someHitsOut.myBarycentricsX, state.myBarycentricsX );
+  SimdStore( someHitsOut.myBarycentricsY, state.myBarycentricsY );
+  for ( uint lane = 0u; lane < SIMD_WIDTH; ++lane ) {
+    const bool hasHit = ( state.myHitMask & ( 1u << lane ) ) != 0u;
+    someHitsOut.myInstanceIdx[ lane ] = hasHit ? state.myInstanceIdx[ lane ] : UINT_MAX;
+    someHitsOut.myPrimitiveIdx[ lane ] = hasHit ? state.myPrimitiveIdx[ lane ] : UINT_MAX;
+  }
+
+  return state.myHitMask;
+}
+
+uint TraceAnyPacket( const CpuRtScene & aScene, const CpuRayPacket & aPacket, uint aLaneMask ) {
+  PacketState state;
+  InitState( aPacket, aLaneMask, true, state );
+  TraverseTlas( aScene, state );
+  return state.myHitMask;
+}
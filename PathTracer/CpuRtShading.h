@@ -0,0 +1,219 @@
+#pragma once
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+
+// CPU ports of the sampling and shading helpers in resources/shaders/raytracing (Random.hlsl, Common.hlsl and
+// brdfSampling.hlsl). They intentionally follow the shader code line by line, including its conventions, so the CPU
+// backend produces the same estimator as the GPU path tracer.
+namespace CpuRt {
+  const float PI = 3.14159265358979f;
+  const float TWO_PI = 6.28318530717958f;
+
+  //---------------------------------------------------------------------------//
+  // Random.hlsl
+  //---------------------------------------------------------------------------//
+  typedef glm::uvec4 RngStateType;
+
+  inline glm::uvec4 pcg4d( glm::uvec4 v ) {
+    v = v * 1664525u + glm::uvec4( 1013904223u );
+
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+
+    v.x ^= v.x >> 16u;
+    v.y ^= v.y >> 16u;
+    v.z ^= v.z >> 16u;
+    v.w ^= v.w >> 16u;
+
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+
+    return v;
+  }
+
+  inline float UintToFloat( uint x ) {
+    const uint bits = 0x3f800000u | ( x >> 9 );
+    float      result;
+    memcpy( &result, &bits, sizeof( result ) );
+    return result - 1.0f;
+  }
+
+  inline RngStateType InitRNG( const glm::uvec2 & aPixelCoords, const glm::uvec2 & /*aResolution*/,
+                               uint aFrameNumber ) {
+    return RngStateType( aPixelCoords.x, aPixelCoords.y, aFrameNumber, 0u );
+  }
+
+  inline float GetRand01( RngStateType & aRngState ) {
+    aRngState.w++;
+    return UintToFloat( pcg4d( aRngState ).x );
+  }
+
+  //---------------------------------------------------------------------------//
+  // Common.hlsl
+  //---------------------------------------------------------------------------//
+  inline float GetLuminance( const glm::float3 & aRadiance ) {
+    return glm::dot( aRadiance, glm::float3( 0.2126f, 0.7152f, 0.0722f ) );
+  }
+
+  // Normal of CpuRtCompactVertexData, the inverse of EncodeOctahedralNormal() in CpuRtScene.cpp
+  inline glm::float3 DecodeOctahedralNormal( uint anEncoded ) {
+    const glm::float2 f = glm::unpackSnorm2x16( anEncoded );
+    glm::float3       n( f.x, f.y, 1.0f - glm::abs( f.x ) - glm::abs( f.y ) );
+    const float       t = glm::max( -n.z, 0.0f );
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize( n );
+  }
+
+  // Mip of a texture of aTextureSize at aPos on the triangle, for a pixel footprint given by the camera-facing steps
+  // aPixelStepX/Y at the distance of aPos. The steps are projected onto the triangle along the view direction and
+  // mapped to UV steps through the barycentric derivatives, the longer of the two picks the mip.
+  inline float GetTextureLod( const glm::float3 & aPos, const glm::float3 & aCameraPos, const glm::float3 & aPixelStepX,
+                              const glm::float3 & aPixelStepY, const glm::float3 somePositions[ 3 ],
+                              const glm::float2 someUvs[ 3 ], const glm::float2 & aTextureSize ) {
+    const glm::float3 e1 = somePositions[ 1 ] - somePositions[ 0 ];
+    const glm::float3 e2 = somePositions[ 2 ] - somePositions[ 0 ];
+    const float       e1e1 = glm::dot( e1, e1 );
+    const float       e1e2 = glm::dot( e1, e2 );
+    const float       e2e2 = glm::dot( e2, e2 );
+    const float       det = e1e1 * e2e2 - e1e2 * e1e2;
+    if ( det <= 1e-12f * e1e1 * e2e2 )
+      return 0.0f;
+
+    // Grazing angles give a large footprint instead of an infinite one
+    const glm::float3 normal = glm::cross( e1, e2 );
+    const glm::float3 viewDir = glm::normalize( aPos - aCameraPos );
+    float             viewDotNormal = glm::dot( viewDir, normal );
+    const float       minViewDotNormal = 1e-4f * glm::length( normal );
+    if ( glm::abs( viewDotNormal ) < minViewDotNormal )
+      viewDotNormal = viewDotNormal < 0.0f ? -minViewDotNormal : minViewDotNormal;
+
+    const glm::float3 pixelSteps[ 2 ] = { aPixelStepX, aPixelStepY };
+    float             maxUvStepSq = 0.0f;
+    for ( uint i = 0u; i < 2u; ++i ) {
+      const glm::float3 step = pixelSteps[ i ] - viewDir * ( glm::dot( pixelSteps[ i ], normal ) / viewDotNormal );
+      const float       stepE1 = glm::dot( step, e1 );
+      const float       stepE2 = glm::dot( step, e2 );
+      const float       b1 = ( e2e2 * stepE1 - e1e2 * stepE2 ) / det;
+      const float       b2 = ( e1e1 * stepE2 - e1e2 * stepE1 ) / det;
+      const glm::float2 uvStep = ( b1 * ( someUvs[ 1 ] - someUvs[ 0 ] ) + b2 * ( someUvs[ 2 ] - someUvs[ 0 ] ) ) *
+                                 aTextureSize;
+      maxUvStepSq = glm::max( maxUvStepSq, glm::dot( uvStep, uvStep ) );
+    }
+    return maxUvStepSq > 0.0f ? 0.5f * glm::log2( maxUvStepSq ) : 0.0f;
+  }
+
+  inline float GetFresnelSchlick( const glm::float3 & aNormal, const glm::float3 & aView ) {
+    const float f0 = 0.04f;  // Assuming dielectrics for now
+    const float cosTheta = glm::max( 0.0f, glm::dot( aNormal, aView ) );
+    return glm::clamp( f0 + ( 1.0f - f0 ) * powf( 1.0f - cosTheta, 5.0f ), 0.0f, 1.0f );
+  }
+
+  inline glm::float3 GetUniformRandomDirectionInSphere( const glm::float2 & aRand01 ) {
+    const float phi = 2.0f * PI * aRand01.x;
+    const float theta = 2.0f * acosf( sqrtf( 1.0f - aRand01.y ) );
+    return glm::float3( sinf( theta ) * cosf( phi ), sinf( theta ) * sinf( phi ), cosf( theta ) );
+  }
+
+  inline glm::float3 GetCosineWeightedHemisphereDirection( const glm::float2 & aRand01, const glm::float3 & aNormal ) {
+    return glm::normalize( aNormal + GetUniformRandomDirectionInSphere( aRand01 ) );
+  }
+
+  inline void GetCoordinateFrame( const glm::float3 & aNormal, glm::float3 & aTangentOut,
+                                  glm::float3 & aBitangentOut ) {
+    const glm::float3 side = glm::abs( aNormal.x ) < 0.999f ? glm::float3( 1, 0, 0 ) : glm::float3( 0, 0, 1 );
+    const glm::float3 z = glm::normalize( glm::cross( -aNormal, -side ) );
+    const glm::float3 x = glm::cross( z, aNormal );
+    aTangentOut = x;
+    aBitangentOut = z;
+  }
+
+  inline glm::float3 GetHemisphereDirection( const glm::float2 & aRand11, const glm::float3 & aNormal ) {
+    glm::float3 tangent;
+    glm::float3 bitangent;
+    GetCoordinateFrame( aNormal, tangent, bitangent );
+    return glm::normalize( aNormal + tangent * aRand11.x + bitangent * aRand11.y );
+  }
+
+  // aDir is in tangent space with y along the normal. mul( aDir, float3x3( tangent, normal, bitangent ) ) in HLSL.
+  inline glm::float3 TransformToNormalFrame( const glm::float3 & aNormal, const glm::float3 & aDir ) {
+    glm::float3 tangent;
+    glm::float3 bitangent;
+    GetCoordinateFrame( aNormal, tangent, bitangent );
+    return tangent * aDir.x + aNormal * aDir.y + bitangent * aDir.z;
+  }
+
+  //---------------------------------------------------------------------------//
+  // brdfSampling.hlsl
+  //---------------------------------------------------------------------------//
+  inline glm::float3 GetLambertianBRDF( const glm::float3 & aDiffuseReflectance, const glm::float3 & N,
+                                        const glm::float3 & L ) {
+    return aDiffuseReflectance * glm::max( 0.0f, glm::dot( N, L ) ) * ( 1.0f / PI );
+  }
+
+  inline float GetLambertianPDF( const glm::float3 & N, const glm::float3 & L ) {
+    return glm::max( 0.0f, glm::dot( N, L ) ) * ( 1.0f / PI );
+  }
+
+  inline float EvaluateModifiedPhong( const glm::float3 & N, const glm::float3 & L, const glm::float3 & V,
+                                      float aSpecularStrength, float aSpecularPower ) {
+    const glm::float3 R = glm::normalize( glm::reflect( -L, N ) );
+    const float       cosAlpha = glm::max( 0.0f, glm::dot( R, V ) );
+    return aSpecularStrength * ( ( aSpecularPower + 2.0f ) / TWO_PI ) * powf( cosAlpha, aSpecularPower ) *
+           glm::max( 0.0f, glm::dot( N, L ) );
+  }
+
+  inline glm::float3 SampleModifiedPhong( const glm::float2 & aRand01, const glm::float3 & aNormal,
+                                          float aSpecularPower, float & aPdfOut ) {
+    const float cosTheta = powf( 1.0f - aRand01.x, 1.0f / ( 2.0f + aSpecularPower ) );
+    const float sinTheta = sqrtf( 1.0f - cosTheta * cosTheta );
+    const float phi = TWO_PI * aRand01.y;
+
+    aPdfOut = ( ( aSpecularPower + 2.0f ) / TWO_PI ) * powf( cosTheta, aSpecularPower + 1.0f );
+
+    const glm::float3 sampleDir( cosf( phi ) * sinTheta, cosTheta, sinf( phi ) * sinTheta );
+    return TransformToNormalFrame( aNormal, sampleDir );
+  }
+
+  inline float GetModifiedPhongPDF( const glm::float3 & aNormal, const glm::float3 & aDir, float aSpecularPower ) {
+    const float cosTheta = glm::max( 0.0f, glm::dot( aNormal, aDir ) );
+    return ( ( aSpecularPower + 2.0f ) / TWO_PI ) * powf( cosTheta, aSpecularPower + 1.0f );
+  }
+
+  inline float EstimateSpecularRayProbability( float aMaterialSpecularStrength, const glm::float3 & aMaterialBaseColor,
+                                               float aFresnel ) {
+    const float spec = aFresnel * aMaterialSpecularStrength;
+    const float diffuse = ( 1.0f - aFresnel ) * GetLuminance( aMaterialBaseColor );
+    const float specAndDiffuse = spec + diffuse;
+    const float specRayProbability = specAndDiffuse > 0.001f ? spec / specAndDiffuse : 0.0f;
+    return glm::clamp( specRayProbability, 0.1f, 0.9f );
+  }
+
+  // Both lobes of the material, weighted like the lobe selection in RayGen. Includes the cosine term, like the
+  // functions above.
+  inline glm::float3 EvaluateBrdf( const glm::float3 & aNormal, const glm::float3 & L, const glm::float3 & V,
+                                   const glm::float3 & aBaseColor, float aFresnel, float aSpecularStrength,
+                                   float aSpecularPower ) {
+    return ( 1.0f - aFresnel ) * GetLambertianBRDF( aBaseColor, aNormal, L ) +
+           aFresnel * EvaluateModifiedPhong( aNormal, L, V, aSpecularStrength, aSpecularPower );
+  }
+
+  // Density of the directions that RayGen samples, over both lobes
+  inline float GetBrdfPDF( const glm::float3 & aNormal, const glm::float3 & L, float aSpecRayProbability,
+                           float aSpecularPower ) {
+    return aSpecRayProbability * GetModifiedPhongPDF( aNormal, L, aSpecularPower ) +
+           ( 1.0f - aSpecRayProbability ) * GetLambertianPDF( aNormal, L );
+  }
+
+  // Multiple importance sampling weight of the strategy with aPdf against the one with anOtherPdf
+  inline float GetPowerHeuristic( float aPdf, float anOtherPdf ) {
+    const float pdfSq = aPdf * aPdf;
+    const float sumSq = pdfSq + anOtherPdf * anOtherPdf;
+    return sumSq > 0.0f ? pdfSq / sumSq : 0.0f;
+  }
+}  // namespace CpuRt
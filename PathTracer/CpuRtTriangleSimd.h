@@ -0,0 +1,30 @@
+// No include guard: like CpuSimdImpl.h, this is included once for the baseline SIMD wrappers by CpuRtTriangleStore.h
+// and once more into the namespace of each wider ray packet kernel (see CpuRtScenePacket.cpp).
+
+// Möller-Trumbore for SIMD_WIDTH ray/triangle pairs, either one ray against several triangles or several rays
+// against one triangle. Returns the barycentrics of v1 and v2, matching the DXR convention.
+inline SimdMask IntersectTrianglesSimd( const SimdFloat * anOrigin, const SimdFloat * aDirection, const SimdFloat * v0,
+                                        const SimdFloat * anEdge1, const SimdFloat * anEdge2, SimdFloat aTMin,
+                                        SimdFloat aTMax, SimdFloat & aTOut, SimdFloat & aUOut, SimdFloat & aVOut ) {
+  SimdFloat p[ 3 ];
+  SimdCross3( aDirection, anEdge2, p );
+  const SimdFloat det = SimdDot3( anEdge1, p );
+  const SimdFloat invDet = SimdDiv( SimdSet1( 1.0f ), det );
+
+  const SimdFloat s[ 3 ] = { SimdSub( anOrigin[ 0 ], v0[ 0 ] ), SimdSub( anOrigin[ 1 ], v0[ 1 ] ),
+                             SimdSub( anOrigin[ 2 ], v0[ 2 ] ) };
+  aUOut = SimdMul( SimdDot3( s, p ), invDet );
+
+  SimdFloat q[ 3 ];
+  SimdCross3( s, anEdge1, q );
+  aVOut = SimdMul( SimdDot3( aDirection, q ), invDet );
+  aTOut = SimdMul( SimdDot3( anEdge2, q ), invDet );
+
+  const SimdFloat zero = SimdSet1( 0.0f );
+  const SimdFloat one = SimdSet1( 1.0f );
+  SimdMask        mask = SimdCmpLt( SimdSet1( 1e-24f ), SimdMul( det, det ) );
+  mask = SimdAnd( mask, SimdAnd( SimdCmpLe( zero, aUOut ), SimdCmpLe( aUOut, one ) ) );
+  mask = SimdAnd( mask, SimdAnd( SimdCmpLe( zero, aVOut ), SimdCmpLe( SimdAdd( aUOut, aVOut ), one ) ) );
+  mask = SimdAnd( mask, SimdAnd( SimdCmpLe( aTMin, aTOut ), SimdCmpLe( aTOut, aTMax ) ) );
+  return mask;
+}
@@ -0,0 +1,131 @@
+#include "CpuRtTriangleStore.h"
+
+#include <float.h>
+
+#include "SceneCache.h"
+
+namespace Priv_CpuRtTriangleStore {
+  // Each component array starts on a cache line
+  const uint STRIDE_ALIGNMENT = 64u / sizeof( float );
+}  // namespace Priv_CpuRtTriangleStore
+
+void CpuRtTriangleStore::Build( const glm::float3 * somePositions, const glm::uvec3 * someTriangles,
+                                const uint * someTriangleOrder, uint aNumTriangles ) {
+  using namespace Priv_CpuRtTriangleStore;
+
+  // The padding lets IntersectClosest() load a full SIMD vector at any slot. The padded triangles are degenerate and
+  // never hit.
+  myNumTriangles = aNumTriangles;
+  myStride = ( aNumTriangles + CPU_SIMD_WIDTH + STRIDE_ALIGNMENT - 1u ) / STRIDE_ALIGNMENT * STRIDE_ALIGNMENT;
+  myData.clear();
+  myData.resize( NUM_COMPONENTS * myStride, 0.0f );
+
+  float * components[ NUM_COMPONENTS ];
+  for ( uint i = 0u; i < NUM_COMPONENTS; ++i )
+    components[ i ] = myData.data() + i * myStride;
+
+  for ( uint slot = 0u; slot < aNumTriangles; ++slot ) {
+    const glm::uvec3 &  tri = someTriangles[ someTriangleOrder[ slot ] ];
+    const glm::float3 & v0 = somePositions[ tri.x ];
+    const glm::float3   edge1 = somePositions[ tri.y ] - v0;
+    const glm::float3   edge2 = somePositions[ tri.z ] - v0;
+
+    components[ V0_X ][ slot ] = v0.x;
+    components[ V0_Y ][ slot ] = v0.y;
+    components[ V0_Z ][ slot ] = v0.z;
+    components[ EDGE1_X ][ slot ] = edge1.x;
+    components[ EDGE1_Y ][ slot ] = edge1.y;
+    components[ EDGE1_Z ][ slot ] = edge1.z;
+    components[ EDGE2_X ][ slot ] = edge2.x;
+    components[ EDGE2_Y ][ slot ] = edge2.y;
+    components[ EDGE2_Z ][ slot ] = edge2.z;
+  }
+}
+
+uint64 CpuRtTriangleStore::GetMemorySize() const {
+  return myData.size() * sizeof( float );
+}
+
+void CpuRtTriangleStore::WriteCache( SceneCacheWriter & aWriter ) const {
+  aWriter.Write( myNumTriangles );
+  aWriter.Write( myStride );
+  aWriter.WriteVector( myData );
+}
+
+bool CpuRtTriangleStore::ReadCache( SceneCacheReader & aReader ) {
+  aReader.Read( myNumTriangles );
+  aReader.Read( myStride );
+  aReader.ReadVector( myData );
+
+  // The padding depends on CPU_SIMD_WIDTH, which may differ from the build that wrote the cache
+  const bool isValid = !aReader.HasFailed() && myStride >= myNumTriangles + CPU_SIMD_WIDTH &&
+                       myData.size() == ( size_t ) NUM_COMPONENTS * myStride;
+  if ( !isValid ) {
+    myData.clear();
+    myStride = 0u;
+    myNumTriangles = 0u;
+  }
+  return isValid;
+}
+
+bool CpuRtTriangleStore::SkipCache( SceneCacheReader & aReader, uint64 & aMemorySizeOut ) {
+  uint   numTriangles;
+  uint   stride;
+  uint64 numFloats;
+  aReader.Read( numTriangles );
+  aReader.Read( stride );
+  aReader.ReadArray< float >( numFloats );
+
+  const bool isValid = !aReader.HasFailed() && stride >= numTriangles + CPU_SIMD_WIDTH &&
+                       numFloats == ( uint64 ) NUM_COMPONENTS * stride;
+  aMemorySizeOut = isValid ? numFloats * sizeof( float ) : 0u;
+  return isValid;
+}
+
+bool CpuRtTriangleStore::IntersectClosest( uint aFirstSlot, uint aNumSlots, const glm::float3 & anOrigin,
+                                           const glm::float3 & aDirection, float aTMin, float & aTMaxInOut,
+                                           uint & aSlotOut, glm::float2 & aBarycentricsOut ) const {
+  const SimdFloat origin[ 3 ] = { SimdSet1( anOrigin.x ), SimdSet1( anOrigin.y ), SimdSet1( anOrigin.z ) };
+  const SimdFloat direction[ 3 ] = { SimdSet1( aDirection.x ), SimdSet1( aDirection.y ), SimdSet1( aDirection.z ) };
+  const SimdFloat tMin = SimdSet1( aTMin );
+
+  bool       hasHit = false;
+  const uint endSlot = aFirstSlot + aNumSlots;
+  for ( uint slot = aFirstSlot; slot < endSlot; slot += CPU_SIMD_WIDTH ) {
+    const float *   data = myData.data() + slot;
+    const SimdFloat v0[ 3 ] = { SimdLoad( data + V0_X * myStride ), SimdLoad( data + V0_Y * myStride ),
+                                SimdLoad( data + V0_Z * myStride ) };
+    const SimdFloat edge1[ 3 ] = { SimdLoad( data + EDGE1_X * myStride ), SimdLoad( data + EDGE1_Y * myStride ),
+                                   SimdLoad( data + EDGE1_Z * myStride ) };
+    const SimdFloat edge2[ 3 ] = { SimdLoad( data + EDGE2_X * myStride ), SimdLoad( data + EDGE2_Y * myStride ),
+                                   SimdLoad( data + EDGE2_Z * myStride ) };
+
+    SimdFloat      t;
+    SimdFloat      u;
+    SimdFloat      v;
+    const SimdMask hitMask =
+        IntersectTrianglesSimd( origin, direction, v0, edge1, edge2, tMin, SimdSet1( aTMaxInOut ), t, u, v );
+
+    const uint numLanes = glm::min( endSlot - slot, ( uint ) CPU_SIMD_WIDTH );
+    const uint hitBits = SimdMoveMask( hitMask ) & ( uint ) ( ( 1ull << numLanes ) - 1ull );
+    if ( hitBits == 0u )
+      continue;
+
+    float ts[ CPU_SIMD_WIDTH ];
+    float us[ CPU_SIMD_WIDTH ];
+    float vs[ CPU_SIMD_WIDTH ];
+    SimdStore( ts, t );
+    SimdStore( us, u );
+    SimdStore( vs, v );
+    for ( uint lane = 0u; lane < numLanes; ++lane ) {
+      if ( ( hitBits & ( 1u << lane ) ) && ts[ lane ] <= aTMaxInOut ) {
+        aTMaxInOut = ts[ lane ];
+        aSlotOut = slot + lane;
+        aBarycentricsOut = glm::float2( us[ lane ], vs[ lane ] );
+        hasHit = true;
+      }
+    }
+  }
+
+  return hasHit;
+}
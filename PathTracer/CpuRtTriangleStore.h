@@ -0,0 +1,63 @@
+#pragma once
+
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+#include "CpuSimd.h"
+
+using namespace Fancy;
+
+class SceneCacheWriter;
+class SceneCacheReader;
+
+// Intersection data of all triangles of a BLAS, stored in the order in which the BVH leaves reference them, so a leaf
+// is a contiguous range. Each triangle holds its first vertex and the two Möller-Trumbore edges, and each of those
+// 9 components lives in its own array. CPU_SIMD_WIDTH neighboring triangles can thus be tested against one ray with a
+// single load per component, and the intersection never needs the index buffer or the vertex data.
+class CpuRtTriangleStore {
+public:
+  enum Component {
+    V0_X,
+    V0_Y,
+    V0_Z,
+    EDGE1_X,
+    EDGE1_Y,
+    EDGE1_Z,
+    EDGE2_X,
+    EDGE2_Y,
+    EDGE2_Z,
+    NUM_COMPONENTS
+  };
+
+  // someTriangleOrder maps each slot of the store to the triangle index in someTriangles
+  void   Build( const glm::float3 * somePositions, const glm::uvec3 * someTriangles, const uint * someTriangleOrder,
+                uint aNumTriangles );
+  uint64 GetMemorySize() const;
+
+  void WriteCache( SceneCacheWriter & aWriter ) const;
+  bool ReadCache( SceneCacheReader & aReader );
+
+  // Moves the reader past a store that WriteCache() wrote, with the same checks as ReadCache(). aMemorySizeOut is the
+  // GetMemorySize() of the store once read.
+  static bool SkipCache( SceneCacheReader & aReader, uint64 & aMemorySizeOut );
+
+  // Closest hit of the ray against the triangles in [aFirstSlot, aFirstSlot + aNumSlots). Returns the slot of the hit.
+  bool IntersectClosest( uint aFirstSlot, uint aNumSlots, const glm::float3 & anOrigin, const glm::float3 & aDirection,
+                         float aTMin, float & aTMaxInOut, uint & aSlotOut, glm::float2 & aBarycentricsOut ) const;
+
+  const float * GetComponent( Component aComponent ) const {
+    return myData.data() + aComponent * myStride;
+  }
+
+  uint GetNumTriangles() const {
+    return myNumTriangles;
+  }
+
+private:
+  eastl::vector< float > myData;  // NUM_COMPONENTS arrays of myStride floats each
+  uint                   myStride = 0u;
+  uint                   myNumTriangles = 0u;
+};
+
+#include "CpuRtTriangleSimd.h"
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Common/FancyCoreDefines.h"
+
+// Thin wrapper around a float vector. The PathTracer target is built for the x64 baseline, so the wrappers at global
+// scope are SSE2 with 4 lanes, or a scalar fallback with 1 lane on other architectures (or AVX2/AVX-512 if the
+// compiler is told to target it). The ray packet kernels are additionally compiled for AVX2 (8 lanes) and AVX-512
+// (16 lanes) and picked at startup by the features of the CPU, see CpuRtScenePacket.cpp.
+// Masks are opaque, use SimdMoveMask() to get one bit per lane.
+
+#define CPU_SIMD_ISA_SCALAR 0
+#define CPU_SIMD_ISA_SSE2   1
+#define CPU_SIMD_ISA_AVX2   2
+#define CPU_SIMD_ISA_AVX512 3
+
+#if defined( _M_X64 ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( __i386__ )
+  #define CPU_SIMD_X86 1
+  #include <immintrin.h>
+#endif
+#include <math.h>
+
+#if defined( __AVX512F__ )
+  #define CPU_SIMD_ISA   CPU_SIMD_ISA_AVX512
+  #define CPU_SIMD_WIDTH 16
+#elif defined( __AVX2__ )
+  #define CPU_SIMD_ISA   CPU_SIMD_ISA_AVX2
+  #define CPU_SIMD_WIDTH 8
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+  #define CPU_SIMD_ISA   CPU_SIMD_ISA_SSE2
+  #define CPU_SIMD_WIDTH 4
+#else
+  #define CPU_SIMD_ISA   CPU_SIMD_ISA_SCALAR
+  #define CPU_SIMD_WIDTH 1
+#endif
+
+#define CPU_SIMD_IMPL_ISA CPU_SIMD_ISA
+#include "CpuSimdImpl.h"
+#undef CPU_SIMD_IMPL_ISA
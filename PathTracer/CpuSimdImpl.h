@@ -0,0 +1,412 @@
+// No include guard: the SIMD wrappers for the instruction set selected by CPU_SIMD_IMPL_ISA, with SIMD_WIDTH lanes.
+// CpuSimd.h includes them once at global scope for the baseline the target is compiled for, the ray packet kernels
+// include them again inside their own namespace for AVX2 and AVX-512 (see CpuRtScenePacket.cpp).
+
+#if CPU_SIMD_IMPL_ISA == CPU_SIMD_ISA_AVX512
+const uint SIMD_WIDTH = 16u;
+
+typedef __m512    SimdFloat;
+typedef __mmask16 SimdMask;
+
+inline const char * SimdGetName() {
+  return "AVX-512";
+}
+
+inline SimdFloat SimdLoad( const float * someValues ) {
+  return _mm512_loadu_ps( someValues );
+}
+
+inline void SimdStore( float * someValuesOut, SimdFloat aValue ) {
+  _mm512_storeu_ps( someValuesOut, aValue );
+}
+
+inline SimdFloat SimdSet1( float aValue ) {
+  return _mm512_set1_ps( aValue );
+}
+
+inline SimdFloat SimdAdd( SimdFloat a, SimdFloat b ) {
+  return _mm512_add_ps( a, b );
+}
+
+inline SimdFloat SimdSub( SimdFloat a, SimdFloat b ) {
+  return _mm512_sub_ps( a, b );
+}
+
+inline SimdFloat SimdMul( SimdFloat a, SimdFloat b ) {
+  return _mm512_mul_ps( a, b );
+}
+
+inline SimdFloat SimdDiv( SimdFloat a, SimdFloat b ) {
+  return _mm512_div_ps( a, b );
+}
+
+inline SimdFloat SimdMin( SimdFloat a, SimdFloat b ) {
+  return _mm512_min_ps( a, b );
+}
+
+inline SimdFloat SimdMax( SimdFloat a, SimdFloat b ) {
+  return _mm512_max_ps( a, b );
+}
+
+inline SimdMask SimdCmpLt( SimdFloat a, SimdFloat b ) {
+  return _mm512_cmp_ps_mask( a, b, _CMP_LT_OQ );
+}
+
+inline SimdMask SimdCmpLe( SimdFloat a, SimdFloat b ) {
+  return _mm512_cmp_ps_mask( a, b, _CMP_LE_OQ );
+}
+
+inline SimdMask SimdAnd( SimdMask a, SimdMask b ) {
+  return ( SimdMask ) ( a & b );
+}
+
+inline SimdMask SimdOr( SimdMask a, SimdMask b ) {
+  return ( SimdMask ) ( a | b );
+}
+
+inline SimdMask SimdAndNot( SimdMask a, SimdMask aNotB ) {
+  return ( SimdMask ) ( a & ~aNotB );
+}
+
+inline SimdFloat SimdSelect( SimdMask aMask, SimdFloat aTrueValue, SimdFloat aFalseValue ) {
+  return _mm512_mask_blend_ps( aMask, aFalseValue, aTrueValue );
+}
+
+inline uint SimdMoveMask( SimdMask aMask ) {
+  return ( uint ) aMask;
+}
+
+inline SimdMask SimdMaskFromBits( uint someBits ) {
+  return ( SimdMask ) someBits;
+}
+
+inline SimdFloat SimdSqrt( SimdFloat a ) {
+  return _mm512_sqrt_ps( a );
+}
+
+inline SimdFloat SimdRound( SimdFloat a ) {
+  return _mm512_roundscale_ps( a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+}
+
+// 2^anInteger for integral values in [-126, 127]
+inline SimdFloat SimdPow2i( SimdFloat anInteger ) {
+  const __m512i biased = _mm512_add_epi32( _mm512_cvtps_epi32( anInteger ), _mm512_set1_epi32( 127 ) );
+  return _mm512_castsi512_ps( _mm512_slli_epi32( biased, 23 ) );
+}
+
+#elif CPU_SIMD_IMPL_ISA == CPU_SIMD_ISA_AVX2
+const uint SIMD_WIDTH = 8u;
+
+typedef __m256 SimdFloat;
+typedef __m256 SimdMask;
+
+inline const char * SimdGetName() {
+  return "AVX2";
+}
+
+inline SimdFloat SimdLoad( const float * someValues ) {
+  return _mm256_loadu_ps( someValues );
+}
+
+inline void SimdStore( float * someValuesOut, SimdFloat aValue ) {
+  _mm256_storeu_ps( someValuesOut, aValue );
+}
+
+inline SimdFloat SimdSet1( float aValue ) {
+  return _mm256_set1_ps( aValue );
+}
+
+inline SimdFloat SimdAdd( SimdFloat a, SimdFloat b ) {
+  return _mm256_add_ps( a, b );
+}
+
+inline SimdFloat SimdSub( SimdFloat a, SimdFloat b ) {
+  return _mm256_sub_ps( a, b );
+}
+
+inline SimdFloat SimdMul( SimdFloat a, SimdFloat b ) {
+  return _mm256_mul_ps( a, b );
+}
+
+inline SimdFloat SimdDiv( SimdFloat a, SimdFloat b ) {
+  return _mm256_div_ps( a, b );
+}
+
+inline SimdFloat SimdMin( SimdFloat a, SimdFloat b ) {
+  return _mm256_min_ps( a, b );
+}
+
+inline SimdFloat SimdMax( SimdFloat a, SimdFloat b ) {
+  return _mm256_max_ps( a, b );
+}
+
+inline SimdMask SimdCmpLt( SimdFloat a, SimdFloat b ) {
+  return _mm256_cmp_ps( a, b, _CMP_LT_OQ );
+}
+
+inline SimdMask SimdCmpLe( SimdFloat a, SimdFloat b ) {
+  return _mm256_cmp_ps( a, b, _CMP_LE_OQ );
+}
+
+inline SimdMask SimdAnd( SimdMask a, SimdMask b ) {
+  return _mm256_and_ps( a, b );
+}
+
+inline SimdMask SimdOr( SimdMask a, SimdMask b ) {
+  return _mm256_or_ps( a, b );
+}
+
+inline SimdMask SimdAndNot( SimdMask a, SimdMask aNotB ) {
+  return _mm256_andnot_ps( aNotB, a );
+}
+
+inline SimdFloat SimdSelect( SimdMask aMask, SimdFloat aTrueValue, SimdFloat aFalseValue ) {
+  return _mm256_blendv_ps( aFalseValue, aTrueValue, aMask );
+}
+
+inline uint SimdMoveMask( SimdMask aMask ) {
+  return ( uint ) _mm256_movemask_ps( aMask );
+}
+
+inline SimdMask SimdMaskFromBits( uint someBits ) {
+  const __m256i laneBits = _mm256_setr_epi32( 1, 2, 4, 8, 16, 32, 64, 128 );
+  const __m256i bits = _mm256_and_si256( _mm256_set1_epi32( ( int ) someBits ), laneBits );
+  return _mm256_castsi256_ps( _mm256_cmpeq_epi32( bits, laneBits ) );
+}
+
+inline SimdFloat SimdSqrt( SimdFloat a ) {
+  return _mm256_sqrt_ps( a );
+}
+
+inline SimdFloat SimdRound( SimdFloat a ) {
+  return _mm256_round_ps( a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+}
+
+// 2^anInteger for integral values in [-126, 127]
+inline SimdFloat SimdPow2i( SimdFloat anInteger ) {
+  const __m256i biased = _mm256_add_epi32( _mm256_cvtps_epi32( anInteger ), _mm256_set1_epi32( 127 ) );
+  return _mm256_castsi256_ps( _mm256_slli_epi32( biased, 23 ) );
+}
+
+#elif CPU_SIMD_IMPL_ISA == CPU_SIMD_ISA_SSE2
+const uint SIMD_WIDTH = 4u;
+
+typedef __m128 SimdFloat;
+typedef __m128 SimdMask;
+
+inline const char * SimdGetName() {
+  return "SSE2";
+}
+
+inline SimdFloat SimdLoad( const float * someValues ) {
+  return _mm_loadu_ps( someValues );
+}
+
+inline void SimdStore( float * someValuesOut, SimdFloat aValue ) {
+  _mm_storeu_ps( someValuesOut, aValue );
+}
+
+inline SimdFloat SimdSet1( float aValue ) {
+  return _mm_set1_ps( aValue );
+}
+
+inline SimdFloat SimdAdd( SimdFloat a, SimdFloat b ) {
+  return _mm_add_ps( a, b );
+}
+
+inline SimdFloat SimdSub( SimdFloat a, SimdFloat b ) {
+  return _mm_sub_ps( a, b );
+}
+
+inline SimdFloat SimdMul( SimdFloat a, SimdFloat b ) {
+  return _mm_mul_ps( a, b );
+}
+
+inline SimdFloat SimdDiv( SimdFloat a, SimdFloat b ) {
+  return _mm_div_ps( a, b );
+}
+
+inline SimdFloat SimdMin( SimdFloat a, SimdFloat b ) {
+  return _mm_min_ps( a, b );
+}
+
+inline SimdFloat SimdMax( SimdFloat a, SimdFloat b ) {
+  return _mm_max_ps( a, b );
+}
+
+inline SimdMask SimdCmpLt( SimdFloat a, SimdFloat b ) {
+  return _mm_cmplt_ps( a, b );
+}
+
+inline SimdMask SimdCmpLe( SimdFloat a, SimdFloat b ) {
+  return _mm_cmple_ps( a, b );
+}
+
+inline SimdMask SimdAnd( SimdMask a, SimdMask b ) {
+  return _mm_and_ps( a, b );
+}
+
+inline SimdMask SimdOr( SimdMask a, SimdMask b ) {
+  return _mm_or_ps( a, b );
+}
+
+inline SimdMask SimdAndNot( SimdMask a, SimdMask aNotB ) {
+  return _mm_andnot_ps( aNotB, a );
+}
+
+inline SimdFloat SimdSelect( SimdMask aMask, SimdFloat aTrueValue, SimdFloat aFalseValue ) {
+  return _mm_or_ps( _mm_and_ps( aMask, aTrueValue ), _mm_andnot_ps( aMask, aFalseValue ) );
+}
+
+inline uint SimdMoveMask( SimdMask aMask ) {
+  return ( uint ) _mm_movemask_ps( aMask );
+}
+
+inline SimdMask SimdMaskFromBits( uint someBits ) {
+  const __m128i laneBits = _mm_setr_epi32( 1, 2, 4, 8 );
+  const __m128i bits = _mm_and_si128( _mm_set1_epi32( ( int ) someBits ), laneBits );
+  return _mm_castsi128_ps( _mm_cmpeq_epi32( bits, laneBits ) );
+}
+
+inline SimdFloat SimdSqrt( SimdFloat a ) {
+  return _mm_sqrt_ps( a );
+}
+
+// Round to nearest with the default rounding mode. Only valid for |a| < 2^31, which is all SimdExp() needs.
+inline SimdFloat SimdRound( SimdFloat a ) {
+  return _mm_cvtepi32_ps( _mm_cvtps_epi32( a ) );
+}
+
+// 2^anInteger for integral values in [-126, 127]
+inline SimdFloat SimdPow2i( SimdFloat anInteger ) {
+  const __m128i biased = _mm_add_epi32( _mm_cvtps_epi32( anInteger ), _mm_set1_epi32( 127 ) );
+  return _mm_castsi128_ps( _mm_slli_epi32( biased, 23 ) );
+}
+
+#else
+const uint SIMD_WIDTH = 1u;
+
+typedef float SimdFloat;
+typedef bool  SimdMask;
+
+inline const char * SimdGetName() {
+  return "Scalar";
+}
+
+inline SimdFloat SimdLoad( const float * someValues ) {
+  return someValues[ 0 ];
+}
+
+inline void SimdStore( float * someValuesOut, SimdFloat aValue ) {
+  someValuesOut[ 0 ] = aValue;
+}
+
+inline SimdFloat SimdSet1( float aValue ) {
+  return aValue;
+}
+
+inline SimdFloat SimdAdd( SimdFloat a, SimdFloat b ) {
+  return a + b;
+}
+
+inline SimdFloat SimdSub( SimdFloat a, SimdFloat b ) {
+  return a - b;
+}
+
+inline SimdFloat SimdMul( SimdFloat a, SimdFloat b ) {
+  return a * b;
+}
+
+inline SimdFloat SimdDiv( SimdFloat a, SimdFloat b ) {
+  return a / b;
+}
+
+inline SimdFloat SimdMin( SimdFloat a, SimdFloat b ) {
+  return a < b ? a : b;
+}
+
+inline SimdFloat SimdMax( SimdFloat a, SimdFloat b ) {
+  return a > b ? a : b;
+}
+
+inline SimdMask SimdCmpLt( SimdFloat a, SimdFloat b ) {
+  return a < b;
+}
+
+inline SimdMask SimdCmpLe( SimdFloat a, SimdFloat b ) {
+  return a <= b;
+}
+
+inline SimdMask SimdAnd( SimdMask a, SimdMask b ) {
+  return a && b;
+}
+
+inline SimdMask SimdOr( SimdMask a, SimdMask b ) {
+  return a || b;
+}
+
+inline SimdMask SimdAndNot( SimdMask a, SimdMask aNotB ) {
+  return a && !aNotB;
+}
+
+inline SimdFloat SimdSelect( SimdMask aMask, SimdFloat aTrueValue, SimdFloat aFalseValue ) {
+  return aMask ? aTrueValue : aFalseValue;
+}
+
+inline uint SimdMoveMask( SimdMask aMask ) {
+  return aMask ? 1u : 0u;
+}
+
+inline SimdMask SimdMaskFromBits( uint someBits ) {
+  return ( someBits & 1u ) != 0u;
+}
+
+inline SimdFloat SimdSqrt( SimdFloat a ) {
+  return sqrtf( a );
+}
+
+inline SimdFloat SimdRound( SimdFloat a ) {
+  return roundf( a );
+}
+
+inline SimdFloat SimdPow2i( SimdFloat anInteger ) {
+  return ldexpf( 1.0f, ( int ) anInteger );
+}
+
+#endif
+
+const uint SIMD_ALL_LANES_MASK = ( uint ) ( ( 1ull << SIMD_WIDTH ) - 1ull );
+
+// Vectors of three SimdFloats, one per component
+inline SimdFloat SimdDot3( const SimdFloat * a, const SimdFloat * b ) {
+  return SimdAdd( SimdAdd( SimdMul( a[ 0 ], b[ 0 ] ), SimdMul( a[ 1 ], b[ 1 ] ) ), SimdMul( a[ 2 ], b[ 2 ] ) );
+}
+
+inline void SimdCross3( const SimdFloat * a, const SimdFloat * b, SimdFloat * aResultOut ) {
+  aResultOut[ 0 ] = SimdSub( SimdMul( a[ 1 ], b[ 2 ] ), SimdMul( a[ 2 ], b[ 1 ] ) );
+  aResultOut[ 1 ] = SimdSub( SimdMul( a[ 2 ], b[ 0 ] ), SimdMul( a[ 0 ], b[ 2 ] ) );
+  aResultOut[ 2 ] = SimdSub( SimdMul( a[ 0 ], b[ 1 ] ), SimdMul( a[ 1 ], b[ 0 ] ) );
+}
+
+inline SimdFloat SimdFloor( SimdFloat a ) {
+  const SimdFloat rounded = SimdRound( a );
+  return SimdSelect( SimdCmpLt( a, rounded ), SimdSub( rounded, SimdSet1( 1.0f ) ), rounded );
+}
+
+// exp() with the range reduction and polynomial of Cephes' expf, relative error below 2e-7. Inputs are clamped to
+// [-87, 88], so large negative exponents return ~1e-38 instead of 0.
+inline SimdFloat SimdExp( SimdFloat a ) {
+  a = SimdMin( SimdMax( a, SimdSet1( -87.0f ) ), SimdSet1( 88.0f ) );
+  const SimdFloat n = SimdRound( SimdMul( a, SimdSet1( 1.44269504088896341f ) ) );
+  a = SimdSub( a, SimdMul( n, SimdSet1( 0.693359375f ) ) );
+  a = SimdSub( a, SimdMul( n, SimdSet1( -2.12194440e-4f ) ) );
+
+  SimdFloat p = SimdSet1( 1.9875691500e-4f );
+  p = SimdAdd( SimdMul( p, a ), SimdSet1( 1.3981999507e-3f ) );
+  p = SimdAdd( SimdMul( p, a ), SimdSet1( 8.3334519073e-3f ) );
+  p = SimdAdd( SimdMul( p, a ), SimdSet1( 4.1665795894e-2f ) );
+  p = SimdAdd( SimdMul( p, a ), SimdSet1( 1.6666665459e-1f ) );
+  p = SimdAdd( SimdMul( p, a ), SimdSet1( 5.0000001201e-1f ) );
+  p = SimdAdd( SimdAdd( SimdMul( p, SimdMul( a, a ) ), a ), SimdSet1( 1.0f ) );
+  return SimdMul( p, SimdPow2i( n ) );
+}
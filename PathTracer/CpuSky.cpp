@@ -0,0 +1,939 @@
+#include "CpuSky.h"
+
+#include <math.h>
+
+#include "Common/MathUtil.h"
+#include "CpuRtShading.h"
+#include "CpuSimd.h"
+#include "CpuThreadPool.h"
+#include "Timing.h"
+
+namespace Priv_CpuSky {
+  const float PI = 3.14159265358979f;
+
+  // 1 - cos of the angular radius of the sun disc, as 2 sin^2( radius / 2 ) to keep its precision
+  const float SUN_ANGULAR_RADIUS = 0.5f * 0.505f * PI / 180.0f;
+  const float SUN_ONE_MINUS_COS_RADIUS = 2.0f * sinf( 0.5f * SUN_ANGULAR_RADIUS ) * sinf( 0.5f * SUN_ANGULAR_RADIUS );
+  const float PLANET_RADIUS_OFFSET = 10.0f;
+  const float SKY_LUT_HEIGHT_BUCKET_SIZE = 100.0f;
+
+  // Sample counts of the LUT compute shaders
+  const float       TRANSMITTANCE_SAMPLE_COUNT = 40.0f;
+  const glm::float2 RAY_MARCH_MIN_MAX_SPP = glm::float2( 4.0f, 14.0f );
+
+  const uint NUM_BENCHMARK_LOOKUPS = 64u * 1024u;
+
+  struct ScatteringResult {
+    glm::float3 myL = glm::float3( 0.0f );
+    glm::float3 myOpticalDepth = glm::float3( 0.0f );
+  };
+
+  float FromUnitToSubUvs( float u, float aResolution ) {
+    return ( u + 0.5f / aResolution ) * ( aResolution / ( aResolution + 1.0f ) );
+  }
+
+  float FromSubUvsToUnit( float u, float aResolution ) {
+    return ( u - 0.5f / aResolution ) * ( aResolution / ( aResolution - 1.0f ) );
+  }
+
+  float RaySphereIntersectNearest( const glm::float3 & anOrigin, const glm::float3 & aDir,
+                                   const glm::float3 & aSphereCenter, float aSphereRadius ) {
+    const float       a = glm::dot( aDir, aDir );
+    const glm::float3 centerToOrigin = anOrigin - aSphereCenter;
+    const float       b = 2.0f * glm::dot( aDir, centerToOrigin );
+    const float       c = glm::dot( centerToOrigin, centerToOrigin ) - aSphereRadius * aSphereRadius;
+    const float       delta = b * b - 4.0f * a * c;
+    if ( delta < 0.0f || a == 0.0f )
+      return -1.0f;
+
+    const float sol0 = ( -b - sqrtf( delta ) ) / ( 2.0f * a );
+    const float sol1 = ( -b + sqrtf( delta ) ) / ( 2.0f * a );
+    if ( sol0 < 0.0f && sol1 < 0.0f )
+      return -1.0f;
+    if ( sol0 < 0.0f )
+      return glm::max( 0.0f, sol1 );
+    if ( sol1 < 0.0f )
+      return glm::max( 0.0f, sol0 );
+    return glm::max( 0.0f, glm::min( sol0, sol1 ) );
+  }
+
+  glm::float2 LutTransmittanceParamsToUv( const AtmosphereParameters & anAtmosphere, float aViewHeight,
+                                          float aViewZenithCosAngle ) {
+    const float topRadius = anAtmosphere.TopRadius;
+    const float bottomRadius = anAtmosphere.BottomRadius;
+    const float H = sqrtf( glm::max( 0.0f, topRadius * topRadius - bottomRadius * bottomRadius ) );
+    const float rho = sqrtf( glm::max( 0.0f, aViewHeight * aViewHeight - bottomRadius * bottomRadius ) );
+
+    const float discriminant =
+        aViewHeight * aViewHeight * ( aViewZenithCosAngle * aViewZenithCosAngle - 1.0f ) + topRadius * topRadius;
+    const float d = glm::max( 0.0f, -aViewHeight * aViewZenithCosAngle + sqrtf( glm::max( discriminant, 0.0f ) ) );
+
+    const float dMin = topRadius - aViewHeight;
+    const float dMax = rho + H;
+    return glm::float2( ( d - dMin ) / ( dMax - dMin ), rho / H );
+  }
+
+  void UvToLutTransmittanceParams( const AtmosphereParameters & anAtmosphere, const glm::float2 & aUv,
+                                   float & aViewHeightOut, float & aViewZenithCosAngleOut ) {
+    const float topRadius = anAtmosphere.TopRadius;
+    const float bottomRadius = anAtmosphere.BottomRadius;
+    const float H = sqrtf( topRadius * topRadius - bottomRadius * bottomRadius );
+    const float rho = H * aUv.y;
+    aViewHeightOut = sqrtf( rho * rho + bottomRadius * bottomRadius );
+
+    const float dMin = topRadius - aViewHeightOut;
+    const float dMax = rho + H;
+    const float d = dMin + aUv.x * ( dMax - dMin );
+    aViewZenithCosAngleOut = d == 0.0f ? 1.0f : ( H * H - rho * rho - d * d ) / ( 2.0f * aViewHeightOut * d );
+    aViewZenithCosAngleOut = glm::clamp( aViewZenithCosAngleOut, -1.0f, 1.0f );
+  }
+
+  void UvToSkyViewLutParams( const AtmosphereParameters & anAtmosphere, float aViewHeight, glm::float2 aUv,
+                             float & aViewZenithCosAngleOut, float & aLightViewCosAngleOut ) {
+    aUv = glm::float2( FromSubUvsToUnit( aUv.x, ( float ) SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH ),
+                       FromSubUvsToUnit( aUv.y, ( float ) SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT ) );
+
+    const float bottomRadius = anAtmosphere.BottomRadius;
+    const float vHorizon = sqrtf( aViewHeight * aViewHeight - bottomRadius * bottomRadius );
+    const float beta = acosf( vHorizon / aViewHeight );
+    const float zenithHorizonAngle = PI - beta;
+
+    if ( aUv.y < 0.5f ) {
+      float coord = 1.0f - 2.0f * aUv.y;
+      coord = 1.0f - coord * coord;
+      aViewZenithCosAngleOut = cosf( zenithHorizonAngle * coord );
+    } else {
+      float coord = aUv.y * 2.0f - 1.0f;
+      coord *= coord;
+      aViewZenithCosAngleOut = cosf( zenithHorizonAngle + beta * coord );
+    }
+
+    const float coord = aUv.x * aUv.x;
+    aLightViewCosAngleOut = -( coord * 2.0f - 1.0f );
+  }
+
+  glm::float2 SkyViewLutParamsToUv( const AtmosphereParameters & anAtmosphere, bool anIntersectsGround,
+                                    float aViewZenithCosAngle, float aLightViewCosAngle, float aViewHeight ) {
+    const float bottomRadius = anAtmosphere.BottomRadius;
+    const float vHorizon = sqrtf( glm::max( aViewHeight * aViewHeight - bottomRadius * bottomRadius, 0.0f ) );
+    const float beta = acosf( glm::clamp( vHorizon / aViewHeight, -1.0f, 1.0f ) );
+    const float zenithHorizonAngle = PI - beta;
+    const float viewZenithAngle = acosf( glm::clamp( aViewZenithCosAngle, -1.0f, 1.0f ) );
+
+    glm::float2 uv;
+    if ( !anIntersectsGround ) {
+      const float coord = 1.0f - sqrtf( glm::max( 1.0f - viewZenithAngle / zenithHorizonAngle, 0.0f ) );
+      uv.y = coord * 0.5f;
+    } else {
+      const float coord = sqrtf( glm::max( ( viewZenithAngle - zenithHorizonAngle ) / beta, 0.0f ) );
+      uv.y = coord * 0.5f + 0.5f;
+    }
+    uv.x = sqrtf( glm::max( -aLightViewCosAngle * 0.5f + 0.5f, 0.0f ) );
+
+    return glm::float2( FromUnitToSubUvs( uv.x, ( float ) SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH ),
+                        FromUnitToSubUvs( uv.y, ( float ) SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT ) );
+  }
+
+  bool MoveToTopAtmosphere( glm::float3 & aPosWorldInOut, const glm::float3 & aViewDir, float aTopRadius ) {
+    const float viewHeight = glm::length( aPosWorldInOut );
+    if ( viewHeight <= aTopRadius )
+      return true;
+
+    const float tTop = RaySphereIntersectNearest( aPosWorldInOut, aViewDir, glm::float3( 0.0f ), aTopRadius );
+    if ( tTop < 0.0f )
+      return false;
+
+    const glm::float3 upOffset = aPosWorldInOut / viewHeight * -PLANET_RADIUS_OFFSET;
+    aPosWorldInOut = aPosWorldInOut + aViewDir * tTop + upOffset;
+    return true;
+  }
+
+  float CornetteShanksMiePhaseFunction( float g, float aCosTheta ) {
+    const float k = 3.0f / ( 8.0f * PI ) * ( 1.0f - g * g ) / ( 2.0f + g * g );
+    return k * ( 1.0f + aCosTheta * aCosTheta ) / powf( 1.0f + g * g - 2.0f * g * -aCosTheta, 1.5f );
+  }
+
+  float RayleighPhase( float aCosTheta ) {
+    return 3.0f / ( 16.0f * PI ) * ( 1.0f + aCosTheta * aCosTheta );
+  }
+
+  glm::float3 SampleBilinear( const eastl::vector< glm::float3 > & someTexels, uint aWidth, uint aHeight,
+                              const glm::float2 & aUv ) {
+    const glm::float2 texelPos = aUv * glm::float2( ( float ) aWidth, ( float ) aHeight ) - 0.5f;
+    const glm::float2 texelFloor = glm::floor( texelPos );
+    const glm::float2 weight = texelPos - texelFloor;
+
+    const int  x0 = ( int ) texelFloor.x;
+    const int  y0 = ( int ) texelFloor.y;
+    const uint xs[ 2 ] = { ( uint ) glm::clamp( x0, 0, ( int ) aWidth - 1 ),
+                           ( uint ) glm::clamp( x0 + 1, 0, ( int ) aWidth - 1 ) };
+    const uint ys[ 2 ] = { ( uint ) glm::clamp( y0, 0, ( int ) aHeight - 1 ),
+                           ( uint ) glm::clamp( y0 + 1, 0, ( int ) aHeight - 1 ) };
+
+    const glm::float3 top = glm::mix( someTexels[ ys[ 0 ] * aWidth + xs[ 0 ] ],
+                                      someTexels[ ys[ 0 ] * aWidth + xs[ 1 ] ], weight.x );
+    const glm::float3 bottom = glm::mix( someTexels[ ys[ 1 ] * aWidth + xs[ 0 ] ],
+                                         someTexels[ ys[ 1 ] * aWidth + xs[ 1 ] ], weight.x );
+    return glm::mix( top, bottom, weight.y );
+  }
+
+  template < class FuncT >
+  void RunParallel( CpuThreadPool * aThreadPool, uint aNumItems, const FuncT & aFunc ) {
+    if ( aThreadPool != nullptr ) {
+      aThreadPool->ParallelFor( aNumItems, aFunc );
+    } else {
+      for ( uint i = 0u; i < aNumItems; ++i )
+        aFunc( i, 0u );
+    }
+  }
+
+  // SIMD versions of the functions above, one ray per lane. Spheres are centered at the origin.
+  SimdFloat RaySphereIntersectNearestSimd( const SimdFloat * anOrigin, const SimdFloat * aDir, float aSphereRadius ) {
+    const SimdFloat a = SimdDot3( aDir, aDir );
+    const SimdFloat b = SimdMul( SimdSet1( 2.0f ), SimdDot3( aDir, anOrigin ) );
+    const SimdFloat c = SimdSub( SimdDot3( anOrigin, anOrigin ), SimdSet1( aSphereRadius * aSphereRadius ) );
+    const SimdFloat delta = SimdSub( SimdMul( b, b ), SimdMul( SimdSet1( 4.0f ), SimdMul( a, c ) ) );
+
+    const SimdFloat zero = SimdSet1( 0.0f );
+    const SimdFloat sqrtDelta = SimdSqrt( SimdMax( delta, zero ) );
+    const SimdFloat rcpTwoA = SimdDiv( SimdSet1( 0.5f ), a );
+    const SimdFloat sol0 = SimdMul( SimdSub( SimdSub( zero, b ), sqrtDelta ), rcpTwoA );
+    const SimdFloat sol1 = SimdMul( SimdSub( sqrtDelta, b ), rcpTwoA );
+
+    // sol0 <= sol1, so the nearest non-negative solution is sol0 unless the origin is inside the sphere
+    const SimdMask miss = SimdOr( SimdCmpLt( delta, zero ), SimdCmpLt( sol1, zero ) );
+    return SimdSelect( miss, SimdSet1( -1.0f ), SimdSelect( SimdCmpLt( sol0, zero ), sol1, sol0 ) );
+  }
+
+  struct SimdMedium {
+    SimdFloat myScatteringMie[ 3 ];
+    SimdFloat myScatteringRay[ 3 ];
+    SimdFloat myExtinction[ 3 ];
+  };
+
+  void SampleMediumSimd( const AtmosphereParameters & anAtmosphere, SimdFloat aHeight, SimdMedium & aMediumOut ) {
+    const SimdFloat densityMie = SimdExp( SimdMul( SimdSet1( anAtmosphere.MieDensityExpScale ), aHeight ) );
+    const SimdFloat densityRay = SimdExp( SimdMul( SimdSet1( anAtmosphere.RayleighDensityExpScale ), aHeight ) );
+    const SimdFloat densityOzo0 = SimdAdd( SimdMul( SimdSet1( anAtmosphere.AbsorptionDensity0LinearTerm ), aHeight ),
+                                           SimdSet1( anAtmosphere.AbsorptionDensity0ConstantTerm ) );
+    const SimdFloat densityOzo1 = SimdAdd( SimdMul( SimdSet1( anAtmosphere.AbsorptionDensity1LinearTerm ), aHeight ),
+                                           SimdSet1( anAtmosphere.AbsorptionDensity1ConstantTerm ) );
+    const SimdMask  inLayer0 = SimdCmpLt( aHeight, SimdSet1( anAtmosphere.AbsorptionDensity0LayerWidth ) );
+    const SimdFloat densityOzo = SimdMin( SimdMax( SimdSelect( inLayer0, densityOzo0, densityOzo1 ), SimdSet1( 0.0f ) ),
+                                          SimdSet1( 1.0f ) );
+
+    for ( uint c = 0u; c < 3u; ++c ) {
+      aMediumOut.myScatteringMie[ c ] = SimdMul( densityMie, SimdSet1( anAtmosphere.MieScattering[ c ] ) );
+      aMediumOut.myScatteringRay[ c ] = SimdMul( densityRay, SimdSet1( anAtmosphere.RayleighScattering[ c ] ) );
+      aMediumOut.myExtinction[ c ] =
+          SimdAdd( SimdAdd( SimdMul( densityMie, SimdSet1( anAtmosphere.MieExtinction[ c ] ) ),
+                            aMediumOut.myScatteringRay[ c ] ),
+                   SimdMul( densityOzo, SimdSet1( anAtmosphere.AbsorptionExtinction[ c ] ) ) );
+    }
+  }
+
+  // Same as IntegrateScatteredLuminance(): the distance to the ground or the top of the atmosphere
+  SimdFloat GetRayMarchDistanceSimd( const AtmosphereParameters & anAtmosphere, const SimdFloat * aPos,
+                                     const SimdFloat * aDir ) {
+    const SimdFloat zero = SimdSet1( 0.0f );
+    const SimdFloat tBottom = RaySphereIntersectNearestSimd( aPos, aDir, anAtmosphere.BottomRadius );
+    const SimdFloat tTop = RaySphereIntersectNearestSimd( aPos, aDir, anAtmosphere.TopRadius );
+    return SimdSelect( SimdCmpLt( tBottom, zero ), SimdMax( tTop, zero ),
+                       SimdSelect( SimdCmpLt( zero, tTop ), SimdMin( tTop, tBottom ), zero ) );
+  }
+
+  // The transmittance LUT is fetched per lane, the UVs are computed for all lanes at once
+  void SampleTransmittanceLutSimd( const eastl::vector< glm::float3 > & aLut, const AtmosphereParameters & anAtmosphere,
+                                   SimdFloat aViewHeight, SimdFloat aViewZenithCosAngle,
+                                   SimdFloat * aTransmittanceOut ) {
+    const float     topRadius = anAtmosphere.TopRadius;
+    const float     bottomRadius = anAtmosphere.BottomRadius;
+    const float     H = sqrtf( glm::max( 0.0f, topRadius * topRadius - bottomRadius * bottomRadius ) );
+    const SimdFloat zero = SimdSet1( 0.0f );
+    const SimdFloat viewHeightSq = SimdMul( aViewHeight, aViewHeight );
+    const SimdFloat rho = SimdSqrt( SimdMax( zero, SimdSub( viewHeightSq, SimdSet1( bottomRadius * bottomRadius ) ) ) );
+
+    const SimdFloat cosSqMinusOne = SimdSub( SimdMul( aViewZenithCosAngle, aViewZenithCosAngle ), SimdSet1( 1.0f ) );
+    const SimdFloat discriminant =
+        SimdAdd( SimdMul( viewHeightSq, cosSqMinusOne ), SimdSet1( topRadius * topRadius ) );
+    const SimdFloat d = SimdMax(
+        zero, SimdSub( SimdSqrt( SimdMax( discriminant, zero ) ), SimdMul( aViewHeight, aViewZenithCosAngle ) ) );
+    const SimdFloat dMin = SimdSub( SimdSet1( topRadius ), aViewHeight );
+    const SimdFloat dMax = SimdAdd( rho, SimdSet1( H ) );
+
+    float us[ CPU_SIMD_WIDTH ];
+    float vs[ CPU_SIMD_WIDTH ];
+    SimdStore( us, SimdDiv( SimdSub( d, dMin ), SimdSub( dMax, dMin ) ) );
+    SimdStore( vs, SimdDiv( rho, SimdSet1( H ) ) );
+
+    float transmittances[ 3 ][ CPU_SIMD_WIDTH ];
+    for ( uint lane = 0u; lane < CPU_SIMD_WIDTH; ++lane ) {
+      const glm::float2 uv =
+          glm::clamp( glm::float2( us[ lane ], vs[ lane ] ), glm::float2( 0.0f ), glm::float2( 1.0f ) );
+      const glm::float3 transmittance = SampleBilinear( aLut, SkyLutConsts::TRANSMITTANCE_TEXTURE_WIDTH,
+                                                        SkyLutConsts::TRANSMITTANCE_TEXTURE_HEIGHT, uv );
+      for ( uint c = 0u; c < 3u; ++c )
+        transmittances[ c ][ lane ] = transmittance[ c ];
+    }
+    for ( uint c = 0u; c < 3u; ++c )
+      aTransmittanceOut[ c ] = SimdLoad( transmittances[ c ] );
+  }
+}  // namespace Priv_CpuSky
+
+void SetupEarthAtmosphere( AtmosphereParameters & someParams ) {
+  // All units in kilometers
+  const float EarthBottomRadius = 6360000.0f;
+  const float EarthTopRadius = 6460000.0f;  // 100km atmosphere radius, less edge visible and it contain 99.99% of the
+                                            // atmosphere medium https://en.wikipedia.org/wiki/K%C3%A1rm%C3%A1n_line
+  const float EarthRayleighScaleHeight = 8000.0f;
+  const float EarthMieScaleHeight = 1200.0f;
+
+  someParams.RayleighScattering = { 0.000005802f, 0.000013558f, 0.000033100f };  // 1/km
+  someParams.RayleighDensityExpScale = -1.0f / EarthRayleighScaleHeight;
+  someParams.AbsorptionExtinction = { 0.000000650f, 0.000001881f, 0.0000000085f };  // 1/km
+  someParams.BottomRadius = EarthBottomRadius;
+  someParams.GroundAlbedo = { 0.0f, 0.0f, 0.0f };
+  someParams.TopRadius = EarthTopRadius;
+  someParams.MieScattering = { 0.000003996f, 0.000003996f, 0.000003996f };  // 1/km
+  someParams.MieDensityExpScale = -1.0f / EarthMieScaleHeight;
+  someParams.MieExtinction = { 0.000004440f, 0.000004440f, 0.000004440f };  // 1/km
+  someParams.MiePhaseG = 0.8f;
+  someParams.MieAbsorption = glm::max( glm::float3( 0, 0, 0 ), someParams.MieExtinction - someParams.MieScattering );
+  someParams.AbsorptionDensity0LayerWidth = 25000.0f;
+  someParams.AbsorptionDensity0ConstantTerm = -2.0f / 3.0f;
+  someParams.AbsorptionDensity0LinearTerm = 1.0f / 15.0f;
+  someParams.AbsorptionDensity1ConstantTerm = 8.0f / 3.0f;
+  someParams.AbsorptionDensity1LinearTerm = -1.0f / 15.0f;
+}
+
+uint64 GetAtmosphereHash( const AtmosphereParameters & someParams ) {
+  static_assert( sizeof( AtmosphereParameters ) == 28 * sizeof( float ), "Padding would be hashed" );
+  return MathUtil::ByteHash( reinterpret_cast< const uint8 * >( &someParams ), sizeof( someParams ) );
+}
+
+uint64 GetSkyLutParametersHash( const SkyLutParameters & someParams ) {
+  static_assert( sizeof( SkyLutParameters ) == 34 * sizeof( float ), "Padding would be hashed" );
+  return MathUtil::ByteHash( reinterpret_cast< const uint8 * >( &someParams ), sizeof( someParams ) );
+}
+
+int GetSkyLutHeightBucket( float aCameraHeight ) {
+  return ( int ) floorf( aCameraHeight / Priv_CpuSky::SKY_LUT_HEIGHT_BUCKET_SIZE );
+}
+
+float GetSkyLutBucketHeight( int aBucket ) {
+  return ( ( float ) aBucket + 0.5f ) * Priv_CpuSky::SKY_LUT_HEIGHT_BUCKET_SIZE;
+}
+
+uint GetSkyRadianceLutTextureWidth() {
+  return SkyLutConsts::SKY_RADIANCE_LUT_WIDTH + 1u;
+}
+
+glm::float2 SkyRadianceLutDirToUv( const glm::float3 & aDir ) {
+  using namespace Priv_CpuSky;
+
+  const float       phi = atan2f( aDir.z, aDir.x );
+  const float       theta = acosf( glm::clamp( aDir.y, -1.0f, 1.0f ) );
+  const glm::float2 gridSize( SkyLutConsts::SKY_RADIANCE_LUT_WIDTH, SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT - 1 );
+  const glm::float2 texel = glm::float2( phi / ( 2.0f * PI ) + 0.5f, theta / PI ) * gridSize;
+  return ( texel + 0.5f ) / glm::float2( GetSkyRadianceLutTextureWidth(), SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT );
+}
+
+glm::float3 SkyRadianceLutTexelToDir( uint aTexelX, uint aTexelY ) {
+  using namespace Priv_CpuSky;
+
+  const float phi = ( ( float ) aTexelX / ( float ) SkyLutConsts::SKY_RADIANCE_LUT_WIDTH - 0.5f ) * 2.0f * PI;
+  const float theta = ( float ) aTexelY / ( float ) ( SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT - 1 ) * PI;
+  return glm::float3( sinf( theta ) * cosf( phi ), cosf( theta ), sinf( theta ) * sinf( phi ) );
+}
+
+float GetSunSolidAngle() {
+  using namespace Priv_CpuSky;
+  return 2.0f * PI * SUN_ONE_MINUS_COS_RADIUS;
+}
+
+bool IsInSunDisc( const glm::float3 & aDir, const glm::float3 & aSunDirection ) {
+  using namespace Priv_CpuSky;
+  return 1.0f - glm::dot( aDir, aSunDirection ) <= SUN_ONE_MINUS_COS_RADIUS;
+}
+
+glm::float3 SampleSunDisc( const glm::float2 & aRand01, const glm::float3 & aSunDirection ) {
+  using namespace Priv_CpuSky;
+
+  // Uniform over the cone of directions
+  const float oneMinusCosTheta = aRand01.x * SUN_ONE_MINUS_COS_RADIUS;
+  const float sinTheta = sqrtf( oneMinusCosTheta * ( 2.0f - oneMinusCosTheta ) );
+  const float phi = 2.0f * PI * aRand01.y;
+
+  const glm::float3 sampleDir( cosf( phi ) * sinTheta, 1.0f - oneMinusCosTheta, sinf( phi ) * sinTheta );
+  return glm::normalize( CpuRt::TransformToNormalFrame( aSunDirection, sampleDir ) );
+}
+
+uint SkyLutCache::Acquire( uint64 aParamsHash, int aHeightBucket, bool & aNeedsComputeOut ) {
+  ++myUseCounter;
+
+  uint leastRecentSlot = 0u;
+  for ( uint i = 0u; i < NUM_SLOTS; ++i ) {
+    if ( myLastUses[ i ] != 0u && myParamsHashes[ i ] == aParamsHash && myHeightBuckets[ i ] == aHeightBucket ) {
+      myLastUses[ i ] = myUseCounter;
+      aNeedsComputeOut = false;
+      return i;
+    }
+    if ( myLastUses[ i ] < myLastUses[ leastRecentSlot ] )
+      leastRecentSlot = i;
+  }
+
+  myParamsHashes[ leastRecentSlot ] = aParamsHash;
+  myHeightBuckets[ leastRecentSlot ] = aHeightBucket;
+  myLastUses[ leastRecentSlot ] = myUseCounter;
+  aNeedsComputeOut = true;
+  return leastRecentSlot;
+}
+
+void SkyLutCache::Clear() {
+  for ( uint64 & lastUse : myLastUses )
+    lastUse = 0u;
+}
+
+CpuSky::CpuSky( CpuThreadPool * aThreadPool ) : myThreadPool( aThreadPool ) {}
+
+void CpuSky::Update( const SkyLutParameters & someParams, float aCameraHeight, SkyLookup aLookup ) {
+  myParams = someParams;
+  myLookup = aLookup;
+
+  const uint64 atmosphereHash = GetAtmosphereHash( someParams.myAtmosphere );
+  if ( myTransmittanceLut.empty() || atmosphereHash != myTransmittanceLutHash ) {
+    ComputeTransmittanceLut();
+    myTransmittanceLutHash = atmosphereHash;
+    ++myFrameStats.myNumTransmittanceComputed;
+  } else {
+    ++myFrameStats.myNumTransmittanceSkipped;
+  }
+
+  if ( aLookup == SkyLookup::INTEGRATE )
+    return;
+
+  bool         needsCompute;
+  const int    heightBucket = GetSkyLutHeightBucket( aCameraHeight );
+  const uint64 paramsHash = GetSkyLutParametersHash( someParams );
+  if ( aLookup == SkyLookup::SKY_VIEW_LUT ) {
+    myCurrentSkyViewLut = mySkyViewLutCache.Acquire( paramsHash, heightBucket, needsCompute );
+    if ( needsCompute ) {
+      ComputeSkyViewLut( GetSkyLutBucketHeight( heightBucket ), mySkyViewLuts[ myCurrentSkyViewLut ] );
+      ++myFrameStats.myNumSkyViewComputed;
+    } else {
+      ++myFrameStats.myNumSkyViewSkipped;
+    }
+  } else {
+    myCurrentRadianceLut = myRadianceLutCache.Acquire( paramsHash, heightBucket, needsCompute );
+    if ( needsCompute ) {
+      ComputeRadianceLut( GetSkyLutBucketHeight( heightBucket ), myRadianceLuts[ myCurrentRadianceLut ] );
+      ++myFrameStats.myNumRadianceComputed;
+    } else {
+      ++myFrameStats.myNumRadianceSkipped;
+    }
+  }
+}
+
+void CpuSky::ResetFrameStats() {
+  myFrameStats = SkyLutStats();
+}
+
+const SkyLutStats & CpuSky::GetFrameStats() const {
+  return myFrameStats;
+}
+
+glm::float3 CpuSky::SampleSkyLuminance( const glm::float3 & aViewPos, const glm::float3 & aViewDir ) const {
+  using namespace Priv_CpuSky;
+
+  const AtmosphereParameters & atmosphere = myParams.myAtmosphere;
+
+  const glm::float3 viewPos = aViewPos + glm::float3( 0.0f, atmosphere.BottomRadius, 0.0f );
+  if ( myLookup == SkyLookup::INTEGRATE )
+    return IntegrateLuminance( viewPos, aViewDir );
+
+  if ( myLookup == SkyLookup::RADIANCE_LUT )
+    return SampleBilinear( myRadianceLuts[ myCurrentRadianceLut ], GetSkyRadianceLutTextureWidth(),
+                           SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT, SkyRadianceLutDirToUv( aViewDir ) );
+
+  const float       viewHeight = glm::length( viewPos );
+  const glm::float3 upVector = viewPos / viewHeight;
+  const float       viewZenithCosAngle = glm::dot( aViewDir, upVector );
+
+  // render_sky.hlsl assumes that the view direction isn't parallel to the up vector and the sun isn't at the zenith.
+  // The azimuth doesn't matter in both cases, so any side vector will do.
+  glm::float3 sideVector = glm::cross( upVector, aViewDir );
+  if ( glm::dot( sideVector, sideVector ) < 1e-12f ) {
+    const glm::float3 otherAxis = glm::abs( upVector.x ) < 0.9f ? glm::float3( 1, 0, 0 ) : glm::float3( 0, 0, 1 );
+    sideVector = glm::cross( upVector, otherAxis );
+  }
+  sideVector = glm::normalize( sideVector );
+  const glm::float3 forwardVector = glm::normalize( glm::cross( sideVector, upVector ) );
+
+  const glm::float2 lightOnPlane( glm::dot( myParams.mySunDirection, forwardVector ),
+                                  glm::dot( myParams.mySunDirection, sideVector ) );
+  const float       lightOnPlaneLength = glm::length( lightOnPlane );
+  const float       lightViewCosAngle = lightOnPlaneLength > 1e-6f ? lightOnPlane.x / lightOnPlaneLength : 1.0f;
+
+  const bool intersectsGround =
+      RaySphereIntersectNearest( viewPos, aViewDir, glm::float3( 0.0f ), atmosphere.BottomRadius ) >= 0.0f;
+
+  const glm::float2 uv =
+      SkyViewLutParamsToUv( atmosphere, intersectsGround, viewZenithCosAngle, lightViewCosAngle, viewHeight );
+  return SampleBilinear( mySkyViewLuts[ myCurrentSkyViewLut ], SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH,
+                         SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT, uv );
+}
+
+void CpuSky::SampleSkyLuminanceBatch( const glm::float3 * someViewPositions, const glm::float3 * someViewDirs,
+                                      uint aCount, glm::float3 * aLuminancesOut ) const {
+  if ( myLookup != SkyLookup::INTEGRATE ) {
+    for ( uint i = 0u; i < aCount; ++i )
+      aLuminancesOut[ i ] = SampleSkyLuminance( someViewPositions[ i ], someViewDirs[ i ] );
+    return;
+  }
+
+  // IntegrateLuminanceBatch() takes positions relative to the planet center
+  const uint        BATCH_SIZE = 64u;
+  const glm::float3 planetCenterOffset( 0.0f, myParams.myAtmosphere.BottomRadius, 0.0f );
+  glm::float3       planetPositions[ BATCH_SIZE ];
+  for ( uint first = 0u; first < aCount; first += BATCH_SIZE ) {
+    const uint count = glm::min( aCount - first, BATCH_SIZE );
+    for ( uint i = 0u; i < count; ++i )
+      planetPositions[ i ] = someViewPositions[ first + i ] + planetCenterOffset;
+    IntegrateLuminanceBatch( planetPositions, someViewDirs + first, count, aLuminancesOut + first );
+  }
+}
+
+glm::float3 CpuSky::GetSunIlluminance( const glm::float3 & aViewPos ) const {
+  using namespace Priv_CpuSky;
+
+  const AtmosphereParameters & atmosphere = myParams.myAtmosphere;
+  const glm::float3 &          sunDir = myParams.mySunDirection;
+
+  const glm::float3 planetPos = aViewPos + glm::float3( 0.0f, atmosphere.BottomRadius, 0.0f );
+  if ( RaySphereIntersectNearest( planetPos, sunDir, glm::float3( 0.0f ), atmosphere.BottomRadius ) >= 0.0f )
+    return glm::float3( 0.0f );
+
+  const float viewHeight = glm::length( planetPos );
+  return myParams.mySunIlluminance * SampleTransmittanceLut( viewHeight, glm::dot( sunDir, planetPos / viewHeight ) );
+}
+
+glm::float3 CpuSky::GetSunDiscLuminance( const glm::float3 & aViewPos, const glm::float3 & aViewDir ) const {
+  if ( !IsInSunDisc( aViewDir, myParams.mySunDirection ) )
+    return glm::float3( 0.0f );
+  return GetSunIlluminance( aViewPos ) / GetSunSolidAngle();
+}
+
+glm::float3 CpuSky::SampleTransmittanceLut( float aViewHeight, float aViewZenithCosAngle ) const {
+  using namespace Priv_CpuSky;
+
+  const glm::float2 uv = LutTransmittanceParamsToUv( myParams.myAtmosphere, aViewHeight, aViewZenithCosAngle );
+  return SampleBilinear( myTransmittanceLut, SkyLutConsts::TRANSMITTANCE_TEXTURE_WIDTH,
+                         SkyLutConsts::TRANSMITTANCE_TEXTURE_HEIGHT, glm::clamp( uv, glm::float2( 0.0f ),
+                                                                                 glm::float2( 1.0f ) ) );
+}
+
+void CpuSky::ComputeTransmittanceLut() {
+  using namespace Priv_CpuSky;
+
+  const AtmosphereParameters & atmosphere = myParams.myAtmosphere;
+  const uint                   width = SkyLutConsts::TRANSMITTANCE_TEXTURE_WIDTH;
+  const uint                   height = SkyLutConsts::TRANSMITTANCE_TEXTURE_HEIGHT;
+
+  myTransmittanceLut.resize( width * height );
+  RunParallel( myThreadPool, height, [ & ]( uint y, uint /*aThreadIdx*/ ) {
+    for ( uint firstX = 0u; firstX < width; firstX += CPU_SIMD_WIDTH ) {
+      const uint numLanes = glm::min( width - firstX, ( uint ) CPU_SIMD_WIDTH );
+
+      float viewHeights[ CPU_SIMD_WIDTH ];
+      float viewZenithCosAngles[ CPU_SIMD_WIDTH ];
+      for ( uint lane = 0u; lane < CPU_SIMD_WIDTH; ++lane ) {
+        const uint        x = firstX + glm::min( lane, numLanes - 1u );
+        const glm::float2 uv = ( glm::float2( ( float ) x, ( float ) y ) + 0.5f ) / glm::float2( width, height );
+        UvToLutTransmittanceParams( atmosphere, uv, viewHeights[ lane ], viewZenithCosAngles[ lane ] );
+      }
+
+      const SimdFloat zero = SimdSet1( 0.0f );
+      const SimdFloat viewZenithCosAngle = SimdLoad( viewZenithCosAngles );
+      const SimdFloat viewZenithSinAngle =
+          SimdSqrt( SimdMax( zero, SimdSub( SimdSet1( 1.0f ), SimdMul( viewZenithCosAngle, viewZenithCosAngle ) ) ) );
+      const SimdFloat pos[ 3 ] = { zero, SimdLoad( viewHeights ), zero };
+      const SimdFloat dir[ 3 ] = { zero, viewZenithCosAngle, viewZenithSinAngle };
+
+      // Same as IntegrateScatteredLuminance() with OPTICAL_DEPTH_ONLY and a fixed sample count
+      const SimdFloat tMax = GetRayMarchDistanceSimd( atmosphere, pos, dir );
+      SimdFloat       opticalDepth[ 3 ] = { zero, zero, zero };
+      SimdFloat       t = zero;
+      for ( float s = 0.0f; s < TRANSMITTANCE_SAMPLE_COUNT; s += 1.0f ) {
+        const SimdFloat newT = SimdMul( tMax, SimdSet1( ( s + 0.3f ) / TRANSMITTANCE_SAMPLE_COUNT ) );
+        const SimdFloat dt = SimdSub( newT, t );
+        t = newT;
+
+        const SimdFloat samplePos[ 3 ] = { SimdMul( t, dir[ 0 ] ), SimdAdd( pos[ 1 ], SimdMul( t, dir[ 1 ] ) ),
+                                           SimdMul( t, dir[ 2 ] ) };
+        const SimdFloat sampleHeight =
+            SimdSub( SimdSqrt( SimdDot3( samplePos, samplePos ) ), SimdSet1( atmosphere.BottomRadius ) );
+
+        SimdMedium medium;
+        SampleMediumSimd( atmosphere, sampleHeight, medium );
+        for ( uint c = 0u; c < 3u; ++c )
+          opticalDepth[ c ] = SimdAdd( opticalDepth[ c ], SimdMul( medium.myExtinction[ c ], dt ) );
+      }
+
+      float transmittances[ 3 ][ CPU_SIMD_WIDTH ];
+      for ( uint c = 0u; c < 3u; ++c )
+        SimdStore( transmittances[ c ], SimdExp( SimdSub( zero, opticalDepth[ c ] ) ) );
+      for ( uint lane = 0u; lane < numLanes; ++lane ) {
+        myTransmittanceLut[ y * width + firstX + lane ] =
+            glm::float3( transmittances[ 0 ][ lane ], transmittances[ 1 ][ lane ], transmittances[ 2 ][ lane ] );
+      }
+    }
+  } );
+}
+
+void CpuSky::ComputeSkyViewLut( float aCameraHeight, eastl::vector< glm::float3 > & aLutOut ) const {
+  using namespace Priv_CpuSky;
+
+  const AtmosphereParameters & atmosphere = myParams.myAtmosphere;
+  const uint                   width = SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH;
+  const uint                   height = SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT;
+  const float                  viewHeight = aCameraHeight + atmosphere.BottomRadius;
+
+  aLutOut.resize( width * height );
+  RunParallel( myThreadPool, height, [ & ]( uint y, uint /*aThreadIdx*/ ) {
+    glm::float3 planetPositions[ width ];
+    glm::float3 dirs[ width ];
+    for ( uint x = 0u; x < width; ++x ) {
+      const glm::float2 uv = glm::float2( ( float ) x, ( float ) y ) / glm::float2( width, height );
+      float             viewZenithCosAngle;
+      float             lightViewCosAngle;
+      UvToSkyViewLutParams( atmosphere, viewHeight, uv, viewZenithCosAngle, lightViewCosAngle );
+
+      const float viewZenithSinAngle = sqrtf( 1.0f - viewZenithCosAngle * viewZenithCosAngle );
+      planetPositions[ x ] = glm::float3( 0.0f, viewHeight, 0.0f );
+      dirs[ x ] = glm::float3( viewZenithSinAngle * lightViewCosAngle, viewZenithCosAngle,
+                               viewZenithSinAngle * sqrtf( 1.0f - lightViewCosAngle * lightViewCosAngle ) );
+    }
+
+    // Like the shader, this integrates with the world-space sun direction
+    IntegrateLuminanceBatch( planetPositions, dirs, width, &aLutOut[ y * width ] );
+  } );
+}
+
+void CpuSky::ComputeRadianceLut( float aCameraHeight, eastl::vector< glm::float3 > & aLutOut ) const {
+  const uint width = SkyLutConsts::SKY_RADIANCE_LUT_WIDTH + 1u;  // GetSkyRadianceLutTextureWidth()
+  const uint height = SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT;
+  const float viewHeight = aCameraHeight + myParams.myAtmosphere.BottomRadius;
+
+  aLutOut.resize( width * height );
+  Priv_CpuSky::RunParallel( myThreadPool, height, [ & ]( uint y, uint /*aThreadIdx*/ ) {
+    glm::float3 planetPositions[ width ];
+    glm::float3 dirs[ width ];
+    for ( uint x = 0u; x < width; ++x ) {
+      planetPositions[ x ] = glm::float3( 0.0f, viewHeight, 0.0f );
+      dirs[ x ] = SkyRadianceLutTexelToDir( x, y );
+    }
+    IntegrateLuminanceBatch( planetPositions, dirs, width, &aLutOut[ y * width ] );
+  } );
+}
+
+glm::float3 CpuSky::IntegrateLuminance( glm::float3 aPlanetPos, const glm::float3 & aDir ) const {
+  using namespace Priv_CpuSky;
+
+  const AtmosphereParameters & atmosphere = myParams.myAtmosphere;
+  const glm::float3 &          sunDir = myParams.mySunDirection;
+
+  glm::float3 luminance( 0.0f );
+  if ( !MoveToTopAtmosphere( aPlanetPos, aDir, atmosphere.TopRadius ) )
+    return luminance;
+
+  // IntegrateScatteredLuminance() with a variable sample count and the Mie/Rayleigh phase functions
+  const float tBottom = RaySphereIntersectNearest( aPlanetPos, aDir, glm::float3( 0.0f ), atmosphere.BottomRadius );
+  const float tTop = RaySphereIntersectNearest( aPlanetPos, aDir, glm::float3( 0.0f ), atmosphere.TopRadius );
+  float       tMax = 0.0f;
+  if ( tBottom < 0.0f )
+    tMax = tTop < 0.0f ? 0.0f : tTop;
+  else if ( tTop > 0.0f )
+    tMax = glm::min( tTop, tBottom );
+  tMax = glm::min( tMax, 9000000.0f );
+
+  const float sampleCount =
+      glm::mix( RAY_MARCH_MIN_MAX_SPP.x, RAY_MARCH_MIN_MAX_SPP.y, glm::clamp( tMax * 0.01f, 0.0f, 1.0f ) );
+  const float sampleCountFloor = floorf( sampleCount );
+  const float tMaxFloor = tMax * sampleCountFloor / sampleCount;
+
+  const float cosTheta = glm::dot( sunDir, aDir );
+  const float miePhaseValue = CornetteShanksMiePhaseFunction( atmosphere.MiePhaseG, -cosTheta );
+  const float rayleighPhaseValue = RayleighPhase( cosTheta );
+
+  glm::float3 throughput( 1.0f );
+  for ( float s = 0.0f; s < sampleCount; s += 1.0f ) {
+    float t0 = s / sampleCountFloor;
+    float t1 = ( s + 1.0f ) / sampleCountFloor;
+    t0 = tMaxFloor * t0 * t0;
+    t1 = t1 * t1 > 1.0f ? tMax : tMaxFloor * t1 * t1;
+    const float t = t0 + ( t1 - t0 ) * 0.3f;
+    const float dt = t1 - t0;
+
+    const glm::float3 samplePos = aPlanetPos + t * aDir;
+    const float       samplePosLength = glm::length( samplePos );
+    const float       sampleHeight = samplePosLength - atmosphere.BottomRadius;
+
+    const float densityMie = expf( atmosphere.MieDensityExpScale * sampleHeight );
+    const float densityRay = expf( atmosphere.RayleighDensityExpScale * sampleHeight );
+    const float densityOzo = glm::clamp( sampleHeight < atmosphere.AbsorptionDensity0LayerWidth
+                                             ? atmosphere.AbsorptionDensity0LinearTerm * sampleHeight +
+                                                   atmosphere.AbsorptionDensity0ConstantTerm
+                                             : atmosphere.AbsorptionDensity1LinearTerm * sampleHeight +
+                                                   atmosphere.AbsorptionDensity1ConstantTerm,
+                                         0.0f, 1.0f );
+    const glm::float3 scatteringMie = densityMie * atmosphere.MieScattering;
+    const glm::float3 scatteringRay = densityRay * atmosphere.RayleighScattering;
+    const glm::float3 extinction =
+        densityMie * atmosphere.MieExtinction + scatteringRay + densityOzo * atmosphere.AbsorptionExtinction;
+    const glm::float3 sampleTransmittance = glm::exp( -extinction * dt );
+
+    const glm::float3 upVector = samplePos / samplePosLength;
+    const float       sunZenithCosAngle = glm::dot( sunDir, upVector );
+    const glm::float3 transmittanceToSun = SampleTransmittanceLut( samplePosLength, sunZenithCosAngle );
+    const glm::float3 phaseTimesScattering = scatteringMie * miePhaseValue + scatteringRay * rayleighPhaseValue;
+
+    const float tEarth =
+        RaySphereIntersectNearest( samplePos, sunDir, PLANET_RADIUS_OFFSET * upVector, atmosphere.BottomRadius );
+    const float earthShadow = tEarth >= 0.0f ? 0.0f : 1.0f;
+
+    // Integrate along the current step segment, see slide 28 of "Physically Based and Unified Volumetric Rendering in
+    // Frostbite"
+    const glm::float3 S = myParams.mySunIlluminance * ( earthShadow * transmittanceToSun * phaseTimesScattering );
+    luminance += throughput * ( S - S * sampleTransmittance ) / extinction;
+    throughput *= sampleTransmittance;
+  }
+
+  return luminance;
+}
+
+void CpuSky::IntegrateLuminanceBatch( const glm::float3 * somePlanetPositions, const glm::float3 * someDirs,
+                                      uint aCount, glm::float3 * aLuminancesOut ) const {
+  using namespace Priv_CpuSky;
+
+  const AtmosphereParameters & atmosphere = myParams.myAtmosphere;
+  const SimdFloat              zero = SimdSet1( 0.0f );
+  const SimdFloat              one = SimdSet1( 1.0f );
+  const SimdFloat              sunDir[ 3 ] = { SimdSet1( myParams.mySunDirection.x ),
+                                               SimdSet1( myParams.mySunDirection.y ),
+                                               SimdSet1( myParams.mySunDirection.z ) };
+
+  // CornetteShanksMiePhaseFunction() without the per-ray terms
+  const float g = atmosphere.MiePhaseG;
+  const float mieK = 3.0f / ( 8.0f * PI ) * ( 1.0f - g * g ) / ( 2.0f + g * g );
+
+  for ( uint first = 0u; first < aCount; first += CPU_SIMD_WIDTH ) {
+    const uint numLanes = glm::min( aCount - first, ( uint ) CPU_SIMD_WIDTH );
+
+    // Unused lanes repeat the last ray
+    float rays[ 6 ][ CPU_SIMD_WIDTH ];
+    for ( uint lane = 0u; lane < CPU_SIMD_WIDTH; ++lane ) {
+      const uint i = first + glm::min( lane, numLanes - 1u );
+      for ( uint c = 0u; c < 3u; ++c ) {
+        rays[ c ][ lane ] = somePlanetPositions[ i ][ c ];
+        rays[ 3u + c ][ lane ] = someDirs[ i ][ c ];
+      }
+    }
+    SimdFloat       pos[ 3 ] = { SimdLoad( rays[ 0 ] ), SimdLoad( rays[ 1 ] ), SimdLoad( rays[ 2 ] ) };
+    const SimdFloat dir[ 3 ] = { SimdLoad( rays[ 3 ] ), SimdLoad( rays[ 4 ] ), SimdLoad( rays[ 5 ] ) };
+
+    // MoveToTopAtmosphere(), lanes that miss the atmosphere march over a distance of 0
+    const SimdFloat viewHeight = SimdSqrt( SimdDot3( pos, pos ) );
+    const SimdMask  isAboveTop = SimdCmpLt( SimdSet1( atmosphere.TopRadius ), viewHeight );
+    const SimdFloat tTopStart = RaySphereIntersectNearestSimd( pos, dir, atmosphere.TopRadius );
+    const SimdMask  missesAtmosphere = SimdAnd( isAboveTop, SimdCmpLt( tTopStart, zero ) );
+    const SimdFloat upOffset = SimdDiv( SimdSet1( -PLANET_RADIUS_OFFSET ), viewHeight );
+    for ( uint c = 0u; c < 3u; ++c ) {
+      const SimdFloat posAtTop =
+          SimdAdd( SimdAdd( pos[ c ], SimdMul( dir[ c ], tTopStart ) ), SimdMul( pos[ c ], upOffset ) );
+      pos[ c ] = SimdSelect( isAboveTop, posAtTop, pos[ c ] );
+    }
+
+    const SimdFloat rayMarchDistance =
+        SimdMin( GetRayMarchDistanceSimd( atmosphere, pos, dir ), SimdSet1( 9000000.0f ) );
+    const SimdFloat tMax = SimdSelect( missesAtmosphere, zero, rayMarchDistance );
+    const SimdFloat sampleCount =
+        SimdAdd( SimdSet1( RAY_MARCH_MIN_MAX_SPP.x ),
+                 SimdMul( SimdSet1( RAY_MARCH_MIN_MAX_SPP.y - RAY_MARCH_MIN_MAX_SPP.x ),
+                          SimdMin( SimdMax( SimdMul( tMax, SimdSet1( 0.01f ) ), zero ), one ) ) );
+    const SimdFloat sampleCountFloor = SimdFloor( sampleCount );
+    const SimdFloat tMaxFloor = SimdDiv( SimdMul( tMax, sampleCountFloor ), sampleCount );
+
+    const SimdFloat cosTheta = SimdDot3( sunDir, dir );
+    const SimdFloat onePlusCosThetaSq = SimdAdd( one, SimdMul( cosTheta, cosTheta ) );
+    const SimdFloat mieDenom = SimdSub( SimdSet1( 1.0f + g * g ), SimdMul( SimdSet1( 2.0f * g ), cosTheta ) );
+    const SimdFloat miePhaseValue =
+        SimdDiv( SimdMul( SimdSet1( mieK ), onePlusCosThetaSq ), SimdMul( mieDenom, SimdSqrt( mieDenom ) ) );
+    const SimdFloat rayleighPhaseValue = SimdMul( SimdSet1( 3.0f / ( 16.0f * PI ) ), onePlusCosThetaSq );
+
+    SimdFloat luminance[ 3 ] = { zero, zero, zero };
+    SimdFloat throughput[ 3 ] = { one, one, one };
+    for ( float s = 0.0f; s < RAY_MARCH_MIN_MAX_SPP.y; s += 1.0f ) {
+      // Lanes past their sample count keep marching with a step of 0
+      const SimdMask isActive = SimdCmpLt( SimdSet1( s ), sampleCount );
+      if ( SimdMoveMask( isActive ) == 0u )
+        break;
+
+      const SimdFloat t0Unit = SimdDiv( SimdSet1( s ), sampleCountFloor );
+      const SimdFloat t1Unit = SimdDiv( SimdSet1( s + 1.0f ), sampleCountFloor );
+      const SimdFloat t1UnitSq = SimdMul( t1Unit, t1Unit );
+      const SimdFloat t0 = SimdMul( tMaxFloor, SimdMul( t0Unit, t0Unit ) );
+      const SimdFloat t1 = SimdSelect( SimdCmpLt( one, t1UnitSq ), tMax, SimdMul( tMaxFloor, t1UnitSq ) );
+      const SimdFloat t = SimdAdd( t0, SimdMul( SimdSub( t1, t0 ), SimdSet1( 0.3f ) ) );
+      const SimdFloat dt = SimdSelect( isActive, SimdSub( t1, t0 ), zero );
+
+      SimdFloat samplePos[ 3 ];
+      for ( uint c = 0u; c < 3u; ++c )
+        samplePos[ c ] = SimdAdd( pos[ c ], SimdMul( t, dir[ c ] ) );
+      const SimdFloat samplePosLength = SimdSqrt( SimdDot3( samplePos, samplePos ) );
+
+      SimdMedium medium;
+      SampleMediumSimd( atmosphere, SimdSub( samplePosLength, SimdSet1( atmosphere.BottomRadius ) ), medium );
+
+      SimdFloat upVector[ 3 ];
+      SimdFloat shadowOrigin[ 3 ];
+      for ( uint c = 0u; c < 3u; ++c ) {
+        upVector[ c ] = SimdDiv( samplePos[ c ], samplePosLength );
+        shadowOrigin[ c ] = SimdSub( samplePos[ c ], SimdMul( SimdSet1( PLANET_RADIUS_OFFSET ), upVector[ c ] ) );
+      }
+
+      SimdFloat transmittanceToSun[ 3 ];
+      SampleTransmittanceLutSimd( myTransmittanceLut, atmosphere, samplePosLength, SimdDot3( sunDir, upVector ),
+                                  transmittanceToSun );
+
+      const SimdFloat tEarth = RaySphereIntersectNearestSimd( shadowOrigin, sunDir, atmosphere.BottomRadius );
+      const SimdFloat earthShadow = SimdSelect( SimdCmpLt( tEarth, zero ), one, zero );
+
+      for ( uint c = 0u; c < 3u; ++c ) {
+        const SimdFloat sampleTransmittance = SimdExp( SimdMul( SimdSub( zero, medium.myExtinction[ c ] ), dt ) );
+        const SimdFloat phaseTimesScattering = SimdAdd( SimdMul( medium.myScatteringMie[ c ], miePhaseValue ),
+                                                        SimdMul( medium.myScatteringRay[ c ], rayleighPhaseValue ) );
+        const SimdFloat S = SimdMul( SimdSet1( myParams.mySunIlluminance[ c ] ),
+                                     SimdMul( SimdMul( earthShadow, transmittanceToSun[ c ] ), phaseTimesScattering ) );
+        const SimdFloat integral = SimdDiv( SimdSub( S, SimdMul( S, sampleTransmittance ) ), medium.myExtinction[ c ] );
+        luminance[ c ] = SimdAdd( luminance[ c ], SimdMul( throughput[ c ], integral ) );
+        throughput[ c ] = SimdMul( throughput[ c ], sampleTransmittance );
+      }
+    }
+
+    float luminances[ 3 ][ CPU_SIMD_WIDTH ];
+    for ( uint c = 0u; c < 3u; ++c )
+      SimdStore( luminances[ c ], luminance[ c ] );
+    for ( uint lane = 0u; lane < numLanes; ++lane ) {
+      aLuminancesOut[ first + lane ] =
+          glm::float3( luminances[ 0 ][ lane ], luminances[ 1 ][ lane ], luminances[ 2 ][ lane ] );
+    }
+  }
+}
+
+SkyLookupBenchmarkResults RunSkyLookupBenchmark( const SkyLutParameters & someParams, float aCameraHeight ) {
+  using namespace Priv_CpuSky;
+
+  SkyLookupBenchmarkResults results;
+  results.myNumLookups = NUM_BENCHMARK_LOOKUPS;
+
+  // Fibonacci sphere, so all directions are covered evenly
+  eastl::vector< glm::float3 > dirs( NUM_BENCHMARK_LOOKUPS );
+  const float                  goldenAngle = PI * ( 3.0f - sqrtf( 5.0f ) );
+  for ( uint i = 0u; i < NUM_BENCHMARK_LOOKUPS; ++i ) {
+    const float y = 1.0f - 2.0f * ( ( float ) i + 0.5f ) / ( float ) NUM_BENCHMARK_LOOKUPS;
+    const float radius = sqrtf( glm::max( 0.0f, 1.0f - y * y ) );
+    const float phi = goldenAngle * ( float ) i;
+    dirs[ i ] = glm::float3( cosf( phi ) * radius, y, sinf( phi ) * radius );
+  }
+
+  const glm::float3 viewPos( 0.0f, aCameraHeight, 0.0f );
+  const SkyLookup   lookups[] = { SkyLookup::INTEGRATE, SkyLookup::SKY_VIEW_LUT, SkyLookup::RADIANCE_LUT };
+  float *           buildTimes[] = { nullptr, &results.mySkyViewLutBuildMs, &results.myRadianceLutBuildMs };
+  float *           lookupTimes[] = { &results.myIntegrateNs, &results.mySkyViewLutNs, &results.myRadianceLutNs };
+  float *           errors[] = { nullptr, &results.mySkyViewLutError, &results.myRadianceLutError };
+
+  eastl::vector< glm::float3 > reference;
+  eastl::vector< glm::float3 > luminances( NUM_BENCHMARK_LOOKUPS );
+  for ( uint lookupIdx = 0u; lookupIdx < ARRAY_LENGTH( lookups ); ++lookupIdx ) {
+    // Fresh sky, so the LUTs are computed once for the build timing. The transmittance LUT is built before.
+    CpuSky sky;
+    sky.Update( someParams, aCameraHeight, SkyLookup::INTEGRATE );
+
+    const float64 buildStartMs = SampleTimeMs();
+    sky.Update( someParams, aCameraHeight, lookups[ lookupIdx ] );
+    if ( buildTimes[ lookupIdx ] )
+      *buildTimes[ lookupIdx ] = ( float ) ( SampleTimeMs() - buildStartMs );
+
+    const float64 lookupStartMs = SampleTimeMs();
+    for ( uint i = 0u; i < NUM_BENCHMARK_LOOKUPS; ++i )
+      luminances[ i ] = sky.SampleSkyLuminance( viewPos, dirs[ i ] );
+    *lookupTimes[ lookupIdx ] =
+        ( float ) ( ( SampleTimeMs() - lookupStartMs ) * 1000000.0 / ( float64 ) NUM_BENCHMARK_LOOKUPS );
+
+    if ( !errors[ lookupIdx ] ) {
+      reference = luminances;
+
+      const eastl::vector< glm::float3 > viewPositions( NUM_BENCHMARK_LOOKUPS, viewPos );
+      const float64                      batchStartMs = SampleTimeMs();
+      sky.SampleSkyLuminanceBatch( viewPositions.data(), dirs.data(), NUM_BENCHMARK_LOOKUPS, luminances.data() );
+      results.myIntegrateBatchNs =
+          ( float ) ( ( SampleTimeMs() - batchStartMs ) * 1000000.0 / ( float64 ) NUM_BENCHMARK_LOOKUPS );
+      continue;
+    }
+
+    float64 squaredError = 0.0;
+    float64 squaredReference = 0.0;
+    for ( uint i = 0u; i < NUM_BENCHMARK_LOOKUPS; ++i ) {
+      const glm::float3 diff = luminances[ i ] - reference[ i ];
+      squaredError += glm::dot( diff, diff );
+      squaredReference += glm::dot( reference[ i ], reference[ i ] );
+    }
+    *errors[ lookupIdx ] = squaredReference > 0.0 ? ( float ) sqrt( squaredError / squaredReference ) : 0.0f;
+  }
+
+  Log( "Sky lookup benchmark (%d lookups): integrate %.1f ns (%.1f ns batched), sky-view LUT %.1f ns (build %.2f ms, "
+       "error %.4f), radiance LUT %.1f ns (build %.2f ms, error %.4f)",
+       results.myNumLookups, results.myIntegrateNs, results.myIntegrateBatchNs, results.mySkyViewLutNs,
+       results.mySkyViewLutBuildMs, results.mySkyViewLutError, results.myRadianceLutNs, results.myRadianceLutBuildMs,
+       results.myRadianceLutError );
+
+  return results;
+}
+
+eastl::vector< SkyLutBuildBenchmarkResults > RunSkyLutBuildBenchmark( const SkyLutParameters & someParams,
+                                                                      float                    aCameraHeight ) {
+  using namespace Priv_CpuSky;
+
+  eastl::vector< uint > threadCounts;
+  const uint            maxThreads = glm::max( 1u, std::thread::hardware_concurrency() );
+  for ( uint numThreads = 1u; numThreads < maxThreads; numThreads *= 2u )
+    threadCounts.push_back( numThreads );
+  threadCounts.push_back( maxThreads );
+
+  eastl::vector< SkyLutBuildBenchmarkResults > results;
+  for ( uint numThreads : threadCounts ) {
+    CpuThreadPool                 threadPool( numThreads );
+    SkyLutBuildBenchmarkResults & result = results.push_back();
+    result.myNumThreads = threadPool.GetNumThreads();
+
+    // Fresh sky per LUT, the transmittance LUT is built by the first update and reused by the second
+    const SkyLookup lookups[] = { SkyLookup::SKY_VIEW_LUT, SkyLookup::RADIANCE_LUT };
+    float *         buildTimes[] = { &result.mySkyViewMs, &result.myRadianceMs };
+    for ( uint lookupIdx = 0u; lookupIdx < ARRAY_LENGTH( lookups ); ++lookupIdx ) {
+      CpuSky sky( &threadPool );
+
+      const float64 transmittanceStartMs = SampleTimeMs();
+      sky.Update( someParams, aCameraHeight, SkyLookup::INTEGRATE );
+      result.myTransmittanceMs = ( float ) ( SampleTimeMs() - transmittanceStartMs );
+
+      const float64 buildStartMs = SampleTimeMs();
+      sky.Update( someParams, aCameraHeight, lookups[ lookupIdx ] );
+      *buildTimes[ lookupIdx ] = ( float ) ( SampleTimeMs() - buildStartMs );
+    }
+
+    Log( "Sky LUT build benchmark (%d threads): transmittance %.2f ms, sky-view %.2f ms, radiance %.2f ms",
+         result.myNumThreads, result.myTransmittanceMs, result.mySkyViewMs, result.myRadianceMs );
+  }
+
+  return results;
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+
+class CpuThreadPool;
+
+using namespace Fancy;
+
+struct AtmosphereParameters {
+  // Rayleigh scattering coefficients
+  glm::float3 RayleighScattering;
+  // Rayleigh scattering exponential distribution scale in the atmosphere
+  float RayleighDensityExpScale;
+
+  // This other medium only absorb light, e.g. useful to represent ozone in the earth atmosphere
+  glm::float3 AbsorptionExtinction;
+  // Radius of the planet (center to ground)
+  float BottomRadius;
+
+  // The albedo of the ground.
+  glm::float3 GroundAlbedo;
+  // Maximum considered atmosphere height (center to atmosphere top)
+  float TopRadius;
+
+  // Mie scattering coefficients
+  glm::float3 MieScattering;
+  // Mie scattering exponential distribution scale in the atmosphere
+  float MieDensityExpScale;
+
+  // Mie extinction coefficients
+  glm::float3 MieExtinction;
+  // Mie phase function excentricity
+  float MiePhaseG;
+
+  // Mie absorption coefficients
+  glm::float3 MieAbsorption;
+  // Another medium type in the atmosphere
+  float AbsorptionDensity0LayerWidth;
+
+  float AbsorptionDensity0ConstantTerm;
+  float AbsorptionDensity0LinearTerm;
+  float AbsorptionDensity1ConstantTerm;
+  float AbsorptionDensity1LinearTerm;
+};
+
+// Everything the sky LUTs depend on, apart from the camera height
+struct SkyLutParameters {
+  AtmosphereParameters myAtmosphere;
+  glm::float3          mySunDirection = glm::float3( 0, 1, 0 );
+  glm::float3          mySunIlluminance = glm::float3( 1000.0f );
+};
+
+struct SkyLutConsts {
+  enum {
+    TRANSMITTANCE_TEXTURE_WIDTH = 256,
+    TRANSMITTANCE_TEXTURE_HEIGHT = 64,
+    SKY_VIEW_TEXTURE_WIDTH = 192,
+    SKY_VIEW_TEXTURE_HEIGHT = 108,
+    SKY_RADIANCE_LUT_WIDTH = 256,  // The texture has an extra column, see GetSkyRadianceLutTextureWidth()
+    SKY_RADIANCE_LUT_HEIGHT = 128,
+    SCATTERING_TEXTURE_R_SIZE = 32,
+    SCATTERING_TEXTURE_MU_SIZE = 128,
+    SCATTERING_TEXTURE_MU_S_SIZE = 32,
+    SCATTERING_TEXTURE_NU_SIZE = 8,
+    IRRADIANCE_TEXTURE_WIDTH = 64,
+    IRRADIANCE_TEXTURE_HEIGHT = 16,
+    MULTI_SCATTERING_LUT_RES = 32,
+
+    SCATTERING_TEXTURE_WIDTH = SCATTERING_TEXTURE_NU_SIZE * SCATTERING_TEXTURE_MU_S_SIZE,
+    SCATTERING_TEXTURE_HEIGHT = SCATTERING_TEXTURE_MU_SIZE,
+    SCATTERING_TEXTURE_DEPTH = SCATTERING_TEXTURE_R_SIZE,
+  };
+};
+
+// LUT computations and skipped recomputations since the last ResetFrameStats()
+struct SkyLutStats {
+  uint myNumTransmittanceComputed = 0u;
+  uint myNumTransmittanceSkipped = 0u;
+  uint myNumSkyViewComputed = 0u;
+  uint myNumSkyViewSkipped = 0u;
+  uint myNumRadianceComputed = 0u;
+  uint myNumRadianceSkipped = 0u;
+};
+
+// How CpuSky::SampleSkyLuminance() evaluates the sky
+enum class SkyLookup {
+  INTEGRATE,     // Raymarches the atmosphere per lookup, like SampleSky.hlsl
+  SKY_VIEW_LUT,  // Sky-view LUT of the camera height bucket, like render_sky.hlsl
+  RADIANCE_LUT,  // Full-sphere radiance LUT of the camera height bucket, see compute_sky_radiance_lut.hlsl
+};
+
+// Cost and error of the sky lookups on the CPU, see RunSkyLookupBenchmark()
+struct SkyLookupBenchmarkResults {
+  uint  myNumLookups = 0u;
+  float mySkyViewLutBuildMs = 0.0f;
+  float myRadianceLutBuildMs = 0.0f;
+  float myIntegrateNs = 0.0f;  // Per lookup
+  float myIntegrateBatchNs = 0.0f;
+  float mySkyViewLutNs = 0.0f;
+  float myRadianceLutNs = 0.0f;
+  float mySkyViewLutError = 0.0f;  // Relative RMSE against INTEGRATE
+  float myRadianceLutError = 0.0f;
+};
+
+// LUT build times with a given number of threads, see RunSkyLutBuildBenchmark()
+struct SkyLutBuildBenchmarkResults {
+  uint  myNumThreads = 0u;
+  float myTransmittanceMs = 0.0f;
+  float mySkyViewMs = 0.0f;
+  float myRadianceMs = 0.0f;
+};
+
+void SetupEarthAtmosphere( AtmosphereParameters & someParams );
+
+// The transmittance LUT only depends on the atmosphere, the sky-view LUT on all parameters
+uint64 GetAtmosphereHash( const AtmosphereParameters & someParams );
+uint64 GetSkyLutParametersHash( const SkyLutParameters & someParams );
+
+// Sky-view and radiance LUTs are computed for the center height of a camera height bucket, so small camera movements
+// keep using the cached LUT
+int   GetSkyLutHeightBucket( float aCameraHeight );
+float GetSkyLutBucketHeight( int aBucket );
+
+// The radiance LUT is an equirect map whose texel centers lie on the corners of a SKY_RADIANCE_LUT_WIDTH x
+// (SKY_RADIANCE_LUT_HEIGHT - 1) grid, so the first column is repeated at the end. That way bilinear filtering with a
+// clamp sampler has no seam at phi = +-pi and the poles are texel centers. Same as the functions in sky/Common.hlsl.
+uint        GetSkyRadianceLutTextureWidth();
+glm::float2 SkyRadianceLutDirToUv( const glm::float3 & aDir );
+glm::float3 SkyRadianceLutTexelToDir( uint aTexelX, uint aTexelY );
+
+// The sun is a disc of 0.505 degrees, like GetSunLuminance() in sky/Common.hlsl. The path tracers spread the
+// illuminance of CpuSky::GetSunIlluminance() evenly over it, so BRDF samples can hit it and next-event estimation can
+// sample it. Same as the functions in SampleSky.hlsl.
+float       GetSunSolidAngle();
+bool        IsInSunDisc( const glm::float3 & aDir, const glm::float3 & aSunDirection );
+glm::float3 SampleSunDisc( const glm::float2 & aRand01, const glm::float3 & aSunDirection );
+
+// Small LRU cache of LUT slots, keyed by the parameter hash and the camera height bucket. The GPU sky and the CPU sky
+// keep their sky-view and radiance LUTs in the slots of one of these each.
+class SkyLutCache {
+public:
+  enum { NUM_SLOTS = 4 };
+
+  // Returns the slot that holds the LUT for the key. If aNeedsComputeOut is true, the slot was evicted or never used
+  // and the LUT has to be computed into it.
+  uint Acquire( uint64 aParamsHash, int aHeightBucket, bool & aNeedsComputeOut );
+  void Clear();
+
+private:
+  uint64 myParamsHashes[ NUM_SLOTS ] = {};
+  int    myHeightBuckets[ NUM_SLOTS ] = {};
+  uint64 myLastUses[ NUM_SLOTS ] = {};  // 0 = unused
+  uint64 myUseCounter = 0u;
+};
+
+// CPU evaluator of the transmittance, sky-view and radiance LUTs of the Sky, a port of compute_transmittance_lut.hlsl,
+// compute_skyView_lut.hlsl and compute_sky_radiance_lut.hlsl. Lookups follow render_sky.hlsl and SampleSky.hlsl. The
+// LUTs are only recomputed when their parameters or the camera height bucket change, and only the one needed by the
+// lookup is kept up to date. LUT texels are integrated CPU_SIMD_WIDTH at a time, with the rows spread over the thread
+// pool if there is one.
+class CpuSky {
+public:
+  explicit CpuSky( CpuThreadPool * aThreadPool = nullptr );
+
+  void Update( const SkyLutParameters & someParams, float aCameraHeight, SkyLookup aLookup );
+
+  void                ResetFrameStats();
+  const SkyLutStats & GetFrameStats() const;
+
+  // Needs a previous Update(). Only reads the LUTs, so it can be called from any thread.
+  glm::float3 SampleSkyLuminance( const glm::float3 & aViewPos, const glm::float3 & aViewDir ) const;
+
+  // Same as SampleSkyLuminance() for every position/direction pair. INTEGRATE evaluates CPU_SIMD_WIDTH rays at a time.
+  void SampleSkyLuminanceBatch( const glm::float3 * someViewPositions, const glm::float3 * someViewDirs, uint aCount,
+                                glm::float3 * aLuminancesOut ) const;
+
+  // Illuminance of the sun at aViewPos after the transmittance of the atmosphere, 0 if the sun is below the horizon.
+  // Same as GetSunIlluminance() in SampleSky.hlsl.
+  glm::float3 GetSunIlluminance( const glm::float3 & aViewPos ) const;
+
+  // GetSunIlluminance() over the solid angle of the sun disc if aViewDir points into it, otherwise 0
+  glm::float3 GetSunDiscLuminance( const glm::float3 & aViewPos, const glm::float3 & aViewDir ) const;
+
+private:
+  void        ComputeTransmittanceLut();
+  void        ComputeSkyViewLut( float aCameraHeight, eastl::vector< glm::float3 > & aLutOut ) const;
+  void        ComputeRadianceLut( float aCameraHeight, eastl::vector< glm::float3 > & aLutOut ) const;
+  glm::float3 SampleTransmittanceLut( float aViewHeight, float aViewZenithCosAngle ) const;
+  glm::float3 IntegrateLuminance( glm::float3 aPlanetPos, const glm::float3 & aDir ) const;
+  void        IntegrateLuminanceBatch( const glm::float3 * somePlanetPositions, const glm::float3 * someDirs,
+                                       uint aCount, glm::float3 * aLuminancesOut ) const;
+
+  CpuThreadPool *  myThreadPool;
+  SkyLutParameters myParams;
+  SkyLookup        myLookup = SkyLookup::SKY_VIEW_LUT;
+  SkyLutStats      myFrameStats;
+
+  eastl::vector< glm::float3 > myTransmittanceLut;
+  uint64                       myTransmittanceLutHash = 0u;
+
+  SkyLutCache                  mySkyViewLutCache;
+  eastl::vector< glm::float3 > mySkyViewLuts[ SkyLutCache::NUM_SLOTS ];
+  uint                         myCurrentSkyViewLut = 0u;
+
+  SkyLutCache                  myRadianceLutCache;
+  eastl::vector< glm::float3 > myRadianceLuts[ SkyLutCache::NUM_SLOTS ];
+  uint                         myCurrentRadianceLut = 0u;
+};
+
+// Times a sphere of lookups from aCameraHeight with each SkyLookup and measures the error of the LUTs against the
+// integration. The LUT build times are measured separately.
+SkyLookupBenchmarkResults RunSkyLookupBenchmark( const SkyLutParameters & someParams, float aCameraHeight );
+
+// Builds each LUT once with 1, 2, 4, ... threads, up to the number of hardware threads
+eastl::vector< SkyLutBuildBenchmarkResults > RunSkyLutBuildBenchmark( const SkyLutParameters & someParams,
+                                                                      float                    aCameraHeight );
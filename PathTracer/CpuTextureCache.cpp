@@ -0,0 +1,570 @@
+#include "CpuTextureCache.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include <EASTL/algorithm.h>
+
+namespace Priv_CpuTextureCache {
+  // Offsets into the DDS file, including the magic
+  const uint DDS_MAGIC = 0x20534444u;  // "DDS "
+  const uint DDS_FLAGS_OFFSET = 8u;
+  const uint DDS_HEIGHT_OFFSET = 12u;
+  const uint DDS_WIDTH_OFFSET = 16u;
+  const uint DDS_MIP_COUNT_OFFSET = 28u;
+  const uint DDS_PIXEL_FORMAT_FLAGS_OFFSET = 80u;
+  const uint DDS_FOURCC_OFFSET = 84u;
+  const uint DDS_BIT_COUNT_OFFSET = 88u;
+  const uint DDS_MASKS_OFFSET = 92u;  // R, G, B and A
+  const uint DDS_HEADER_SIZE = 128u;
+  const uint DDS_DX10_HEADER_SIZE = 20u;
+
+  const uint DDSD_MIPMAPCOUNT = 0x20000u;
+  const uint DDPF_FOURCC = 0x4u;
+  const uint DDPF_RGB = 0x40u;
+
+  const uint DXGI_FORMAT_R8G8B8A8_UNORM = 28u;
+  const uint DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29u;
+  const uint DXGI_FORMAT_BC1_UNORM = 71u;
+  const uint DXGI_FORMAT_BC1_UNORM_SRGB = 72u;
+  const uint DXGI_FORMAT_BC3_UNORM = 77u;
+  const uint DXGI_FORMAT_BC3_UNORM_SRGB = 78u;
+  const uint DXGI_FORMAT_B8G8R8A8_UNORM = 87u;
+  const uint DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91u;
+
+  const uint MIN_SLOTS_PER_SHARD = 4u;
+  const uint MIN_BUDGET = MIN_SLOTS_PER_SHARD * TEXTURE_TILE_BYTES;
+
+  // Small budgets use fewer shards rather than more slots than they have room for, so only budgets below one shard
+  // get rounded up
+  void GetSlotLayout( uint64 aBudget, uint & aNumShardsOut, uint & aNumSlotsPerShardOut ) {
+    const uint64 numSlots = glm::max( aBudget / TEXTURE_TILE_BYTES, ( uint64 ) MIN_SLOTS_PER_SHARD );
+    aNumShardsOut = ( uint ) glm::min( numSlots / MIN_SLOTS_PER_SHARD, ( uint64 ) CpuTextureCache::MAX_NUM_SHARDS );
+    aNumSlotsPerShardOut = ( uint ) ( numSlots / aNumShardsOut );
+  }
+
+  uint MakeFourCc( char a, char b, char c, char d ) {
+    return ( uint ) ( uint8 ) a | ( ( uint ) ( uint8 ) b << 8 ) | ( ( uint ) ( uint8 ) c << 16 ) |
+           ( ( uint ) ( uint8 ) d << 24 );
+  }
+
+  uint ReadUint( const uint8 * aData, uint64 anOffset ) {
+    uint value;
+    memcpy( &value, aData + anOffset, sizeof( value ) );
+    return value;
+  }
+
+  bool IsBlockCompressed( CpuTextureFile::Format aFormat ) {
+    return aFormat == CpuTextureFile::Format::BC1 || aFormat == CpuTextureFile::Format::BC3;
+  }
+
+  uint GetBlockSize( CpuTextureFile::Format aFormat ) {
+    return aFormat == CpuTextureFile::Format::BC1 ? 8u : 16u;
+  }
+
+  uint64 GetMipSize( CpuTextureFile::Format aFormat, uint aWidth, uint aHeight ) {
+    if ( IsBlockCompressed( aFormat ) )
+      return ( uint64 ) ( ( aWidth + 3u ) / 4u ) * ( ( aHeight + 3u ) / 4u ) * GetBlockSize( aFormat );
+    return ( uint64 ) aWidth * aHeight * sizeof( uint );
+  }
+
+  uint PackRgba( const glm::uvec3 & aColor, uint anAlpha ) {
+    return aColor.x | ( aColor.y << 8 ) | ( aColor.z << 16 ) | ( anAlpha << 24 );
+  }
+
+  glm::uvec3 ExpandRgb565( uint aColor ) {
+    const uint r = ( aColor >> 11 ) & 31u;
+    const uint g = ( aColor >> 5 ) & 63u;
+    const uint b = aColor & 31u;
+    return glm::uvec3( ( r << 3 ) | ( r >> 2 ), ( g << 2 ) | ( g >> 4 ), ( b << 3 ) | ( b >> 2 ) );
+  }
+
+  // BC1 blocks with the first endpoint not above the second have three colors and transparent black, the color blocks
+  // of BC3 always have four colors
+  void DecodeColorBlock( const uint8 * aBlock, bool anAllowThreeColors, uint someTexelsOut[ 16 ] ) {
+    const uint       color0 = aBlock[ 0 ] | ( aBlock[ 1 ] << 8 );
+    const uint       color1 = aBlock[ 2 ] | ( aBlock[ 3 ] << 8 );
+    const glm::uvec3 rgb0 = ExpandRgb565( color0 );
+    const glm::uvec3 rgb1 = ExpandRgb565( color1 );
+
+    uint palette[ 4 ];
+    palette[ 0 ] = PackRgba( rgb0, 255u );
+    palette[ 1 ] = PackRgba( rgb1, 255u );
+    if ( !anAllowThreeColors || color0 > color1 ) {
+      palette[ 2 ] = PackRgba( ( 2u * rgb0 + rgb1 ) / 3u, 255u );
+      palette[ 3 ] = PackRgba( ( rgb0 + 2u * rgb1 ) / 3u, 255u );
+    } else {
+      palette[ 2 ] = PackRgba( ( rgb0 + rgb1 ) / 2u, 255u );
+      palette[ 3 ] = 0u;
+    }
+
+    const uint indices = ReadUint( aBlock, 4u );
+    for ( uint i = 0u; i < 16u; ++i )
+      someTexelsOut[ i ] = palette[ ( indices >> ( 2u * i ) ) & 3u ];
+  }
+
+  void DecodeAlphaBlock( const uint8 * aBlock, uint someTexelsInOut[ 16 ] ) {
+    const uint alpha0 = aBlock[ 0 ];
+    const uint alpha1 = aBlock[ 1 ];
+
+    uint palette[ 8 ] = { alpha0, alpha1 };
+    if ( alpha0 > alpha1 ) {
+      for ( uint i = 2u; i < 8u; ++i )
+        palette[ i ] = ( ( 8u - i ) * alpha0 + ( i - 1u ) * alpha1 ) / 7u;
+    } else {
+      for ( uint i = 2u; i < 6u; ++i )
+        palette[ i ] = ( ( 6u - i ) * alpha0 + ( i - 1u ) * alpha1 ) / 5u;
+      palette[ 6 ] = 0u;
+      palette[ 7 ] = 255u;
+    }
+
+    uint64 indices = 0u;
+    for ( uint i = 0u; i < 6u; ++i )
+      indices |= ( uint64 ) aBlock[ 2u + i ] << ( 8u * i );
+
+    for ( uint i = 0u; i < 16u; ++i ) {
+      const uint alpha = palette[ ( indices >> ( 3u * i ) ) & 7u ];
+      someTexelsInOut[ i ] = ( someTexelsInOut[ i ] & 0x00FFFFFFu ) | ( alpha << 24 );
+    }
+  }
+
+  // Texture index, mip and tile coordinates. Up to 2^21 tiles per row and column.
+  uint64 MakeTileKey( uint aTexture, uint aMip, uint aTileX, uint aTileY ) {
+    return ( ( uint64 ) aTexture << 46 ) | ( ( uint64 ) aMip << 42 ) | ( ( uint64 ) aTileY << 21 ) | aTileX;
+  }
+
+  uint64 HashTileKey( uint64 aKey ) {
+    aKey ^= aKey >> 30;
+    aKey *= 0xBF58476D1CE4E5B9ull;
+    aKey ^= aKey >> 27;
+    aKey *= 0x94D049BB133111EBull;
+    return aKey ^ ( aKey >> 31 );
+  }
+
+  // The shard takes the low bits of the hash, the table of the shard the high ones
+  uint GetShardIndex( uint64 aHash, uint aNumShards ) {
+    return ( uint ) ( aHash % aNumShards );
+  }
+
+  uint GetHomeEntry( uint64 aHash, uint aTableMask ) {
+    return ( uint ) ( aHash >> 32 ) & aTableMask;
+  }
+
+  struct SrgbToLinearTable {
+    SrgbToLinearTable() {
+      for ( uint i = 0u; i < 256u; ++i ) {
+        const float srgb = ( float ) i / 255.0f;
+        myValues[ i ] = srgb <= 0.04045f ? srgb / 12.92f : powf( ( srgb + 0.055f ) / 1.055f, 2.4f );
+      }
+    }
+
+    float myValues[ 256 ];
+  };
+
+  const SrgbToLinearTable theSrgbToLinear;
+
+  glm::float3 DecodeSrgb( uint aTexel ) {
+    return glm::float3( theSrgbToLinear.myValues[ aTexel & 0xFFu ], theSrgbToLinear.myValues[ ( aTexel >> 8 ) & 0xFFu ],
+                        theSrgbToLinear.myValues[ ( aTexel >> 16 ) & 0xFFu ] );
+  }
+}  // namespace Priv_CpuTextureCache
+
+using namespace Priv_CpuTextureCache;
+
+bool CpuTextureFile::Open( const char * aPath ) {
+  myFile.Close();
+  myNumMips = 0u;
+  if ( !myFile.Open( aPath ) )
+    return false;
+
+  const uint8 * data = myFile.GetData();
+  const uint64  size = myFile.GetSize();
+  if ( size < DDS_HEADER_SIZE || ReadUint( data, 0u ) != DDS_MAGIC ) {
+    myFile.Close();
+    return false;
+  }
+
+  const uint pixelFormatFlags = ReadUint( data, DDS_PIXEL_FORMAT_FLAGS_OFFSET );
+  const uint fourCc = ReadUint( data, DDS_FOURCC_OFFSET );
+  uint64     dataOffset = DDS_HEADER_SIZE;
+  bool       isSupported = true;
+  if ( pixelFormatFlags & DDPF_FOURCC ) {
+    if ( fourCc == MakeFourCc( 'D', 'X', 'T', '1' ) ) {
+      myFormat = Format::BC1;
+    } else if ( fourCc == MakeFourCc( 'D', 'X', 'T', '5' ) ) {
+      myFormat = Format::BC3;
+    } else if ( fourCc == MakeFourCc( 'D', 'X', '1', '0' ) && size >= DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE ) {
+      dataOffset += DDS_DX10_HEADER_SIZE;
+      const uint dxgiFormat = ReadUint( data, DDS_HEADER_SIZE );
+      if ( dxgiFormat == DXGI_FORMAT_BC1_UNORM || dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB )
+        myFormat = Format::BC1;
+      else if ( dxgiFormat == DXGI_FORMAT_BC3_UNORM || dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB )
+        myFormat = Format::BC3;
+      else if ( dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM || dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB )
+        myFormat = Format::RGBA8;
+      else if ( dxgiFormat == DXGI_FORMAT_B8G8R8A8_UNORM || dxgiFormat == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB )
+        myFormat = Format::BGRA8;
+      else
+        isSupported = false;
+    } else {
+      isSupported = false;
+    }
+  } else if ( ( pixelFormatFlags & DDPF_RGB ) && ReadUint( data, DDS_BIT_COUNT_OFFSET ) == 32u ) {
+    const uint redMask = ReadUint( data, DDS_MASKS_OFFSET );
+    if ( redMask == 0x000000FFu )
+      myFormat = Format::RGBA8;
+    else if ( redMask == 0x00FF0000u )
+      myFormat = Format::BGRA8;
+    else
+      isSupported = false;
+  } else {
+    isSupported = false;
+  }
+
+  myWidth = ReadUint( data, DDS_WIDTH_OFFSET );
+  myHeight = ReadUint( data, DDS_HEIGHT_OFFSET );
+  if ( !isSupported || myWidth == 0u || myHeight == 0u || glm::max( myWidth, myHeight ) >= ( 1u << 27 ) ) {
+    myFile.Close();
+    return false;
+  }
+
+  // Mips beyond the 1x1 one or TEXTURE_MAX_MIPS are ignored
+  uint numMips = 1u;
+  if ( ReadUint( data, DDS_FLAGS_OFFSET ) & DDSD_MIPMAPCOUNT )
+    numMips = glm::max( ReadUint( data, DDS_MIP_COUNT_OFFSET ), 1u );
+  uint fullChainLength = 1u;
+  while ( ( glm::max( myWidth, myHeight ) >> fullChainLength ) > 0u )
+    ++fullChainLength;
+  numMips = glm::min( glm::min( numMips, fullChainLength ), TEXTURE_MAX_MIPS );
+
+  for ( uint mip = 0u; mip < numMips; ++mip ) {
+    const uint64 mipSize = GetMipSize( myFormat, GetWidth( mip ), GetHeight( mip ) );
+    if ( dataOffset + mipSize > size ) {
+      myFile.Close();
+      return false;
+    }
+    myMipData[ mip ] = data + dataOffset;
+    dataOffset += mipSize;
+  }
+
+  myNumMips = numMips;
+  return true;
+}
+
+void CpuTextureFile::DecodeTile( uint aMip, uint aTileX, uint aTileY, uint * someTexelsOut ) const {
+  const uint x = aTileX * TEXTURE_TILE_SIZE;
+  const uint y = aTileY * TEXTURE_TILE_SIZE;
+  const uint width = glm::min( TEXTURE_TILE_SIZE, GetWidth( aMip ) - x );
+  const uint height = glm::min( TEXTURE_TILE_SIZE, GetHeight( aMip ) - y );
+  DecodeRect( aMip, x, y, width, height, someTexelsOut, TEXTURE_TILE_SIZE );
+}
+
+void CpuTextureFile::DecodeMip( uint aMip, uint * someTexelsOut ) const {
+  DecodeRect( aMip, 0u, 0u, GetWidth( aMip ), GetHeight( aMip ), someTexelsOut, GetWidth( aMip ) );
+}
+
+void CpuTextureFile::DecodeRect( uint aMip, uint aX, uint aY, uint aWidth, uint aHeight, uint * someTexelsOut,
+                                 uint aRowPitch ) const {
+  const uint8 * mipData = myMipData[ aMip ];
+  const uint    mipWidth = GetWidth( aMip );
+
+  if ( !IsBlockCompressed( myFormat ) ) {
+    for ( uint row = 0u; row < aHeight; ++row ) {
+      uint * dst = someTexelsOut + ( uint64 ) row * aRowPitch;
+      memcpy( dst, mipData + ( ( uint64 ) ( aY + row ) * mipWidth + aX ) * sizeof( uint ), aWidth * sizeof( uint ) );
+      if ( myFormat == Format::BGRA8 ) {
+        for ( uint i = 0u; i < aWidth; ++i )
+          dst[ i ] = ( dst[ i ] & 0xFF00FF00u ) | ( ( dst[ i ] >> 16 ) & 0xFFu ) | ( ( dst[ i ] & 0xFFu ) << 16 );
+      }
+    }
+    return;
+  }
+
+  const uint blockSize = GetBlockSize( myFormat );
+  const uint numBlocksX = ( mipWidth + 3u ) / 4u;
+  for ( uint blockY = aY / 4u; blockY <= ( aY + aHeight - 1u ) / 4u; ++blockY ) {
+    for ( uint blockX = aX / 4u; blockX <= ( aX + aWidth - 1u ) / 4u; ++blockX ) {
+      const uint8 * block = mipData + ( ( uint64 ) blockY * numBlocksX + blockX ) * blockSize;
+
+      uint blockTexels[ 16 ];
+      if ( myFormat == Format::BC1 ) {
+        DecodeColorBlock( block, true, blockTexels );
+      } else {
+        DecodeColorBlock( block + 8u, false, blockTexels );
+        DecodeAlphaBlock( block, blockTexels );
+      }
+
+      // Blocks at the border of the rect only contribute the texels inside it
+      const uint minX = glm::max( blockX * 4u, aX );
+      const uint maxX = glm::min( blockX * 4u + 4u, aX + aWidth );
+      const uint minY = glm::max( blockY * 4u, aY );
+      const uint maxY = glm::min( blockY * 4u + 4u, aY + aHeight );
+      for ( uint y = minY; y < maxY; ++y ) {
+        for ( uint x = minX; x < maxX; ++x )
+          someTexelsOut[ ( uint64 ) ( y - aY ) * aRowPitch + ( x - aX ) ] = blockTexels[ ( y & 3u ) * 4u + ( x & 3u ) ];
+      }
+    }
+  }
+}
+
+CpuTextureCache::CpuTextureCache( uint64 aBudget ) : myBudget( aBudget ), myShards( new Shard[ MAX_NUM_SHARDS ] ) {}
+
+void CpuTextureCache::SetBudget( uint64 aBudget ) {
+  myBudget = aBudget;
+  myTexels.reset();
+  if ( !myTextures.empty() )
+    AllocateSlots();
+}
+
+void CpuTextureCache::Clear() {
+  myTextures.clear();
+  myTextureIndices.clear();
+  if ( myTexels )
+    ResetSlots();
+}
+
+uint CpuTextureCache::AddTexture( const char * aPath ) {
+  eastl::hash_map< eastl::string, uint >::iterator it = myTextureIndices.find( aPath );
+  if ( it != myTextureIndices.end() )
+    return it->second;
+
+  // Failures are remembered as well, so each file is only reported once
+  UniquePtr< CpuTextureFile > texture( new CpuTextureFile() );
+  uint                        textureIdx = CPU_TEXTURE_NONE;
+  if ( texture->Open( aPath ) ) {
+    textureIdx = ( uint ) myTextures.size();
+    myTextures.push_back( std::move( texture ) );
+    if ( !myTexels )
+      AllocateSlots();
+  } else {
+    Log( "CPU texture cache: failed reading %s, only DDS files with BC1, BC3 or 32-bit RGBA texels are supported",
+         aPath );
+  }
+
+  myTextureIndices[ aPath ] = textureIdx;
+  return textureIdx;
+}
+
+glm::float3 CpuTextureCache::Sample( uint aTexture, const glm::float2 & aUv, float aLod ) {
+  const float maxLod = ( float ) ( myTextures[ aTexture ]->GetNumMips() - 1u );
+  const float lod = aLod > 0.0f ? glm::min( aLod, maxLod ) : 0.0f;
+  const uint  mip = ( uint ) lod;
+  const float mipWeight = lod - ( float ) mip;
+
+  const glm::float3 color = SampleBilinear( aTexture, mip, aUv );
+  if ( mipWeight <= 0.0f )
+    return color;
+  return glm::mix( color, SampleBilinear( aTexture, mip + 1u, aUv ), mipWeight );
+}
+
+CpuTextureCacheStats CpuTextureCache::GetStats() const {
+  CpuTextureCacheStats stats;
+  for ( uint i = 0u; i < myNumShards && myTexels; ++i ) {
+    Shard &                      shard = myShards[ i ];
+    std::lock_guard< std::mutex > lock( shard.myMutex );
+    stats.myNumLookups += shard.myNumLookups;
+    stats.myNumMisses += shard.myNumMisses;
+    stats.myNumEvictions += shard.myNumEvictions;
+    stats.myResidentSize += ( uint64 ) shard.myNumUsedSlots * TEXTURE_TILE_BYTES;
+  }
+
+  uint numShards;
+  uint numSlotsPerShard;
+  GetSlotLayout( myBudget, numShards, numSlotsPerShard );
+  stats.myBudget = ( uint64 ) numShards * numSlotsPerShard * TEXTURE_TILE_BYTES;
+  stats.myNumTextures = ( uint ) myTextures.size();
+  for ( const UniquePtr< CpuTextureFile > & texture : myTextures ) {
+    for ( uint mip = 0u; mip < texture->GetNumMips(); ++mip )
+      stats.myTextureSize += ( uint64 ) texture->GetWidth( mip ) * texture->GetHeight( mip ) * sizeof( uint );
+  }
+  return stats;
+}
+
+void CpuTextureCache::ResetStats() {
+  for ( uint i = 0u; i < myNumShards; ++i ) {
+    Shard &                      shard = myShards[ i ];
+    std::lock_guard< std::mutex > lock( shard.myMutex );
+    shard.myNumLookups = 0u;
+    shard.myNumMisses = 0u;
+    shard.myNumEvictions = 0u;
+  }
+}
+
+void CpuTextureCache::AllocateSlots() {
+  if ( myBudget < MIN_BUDGET ) {
+    Log( "CPU texture cache: warning, the budget of %.1f KiB is below the minimum of %.1f KiB and is raised to it",
+         ( float ) myBudget / 1024.0f, ( float ) MIN_BUDGET / 1024.0f );
+  }
+
+  uint numSlotsPerShard;
+  GetSlotLayout( myBudget, myNumShards, numSlotsPerShard );
+
+  // At most half of the entries are used, which keeps the probe sequences short
+  uint tableSize = 1u;
+  while ( tableSize < 2u * numSlotsPerShard )
+    tableSize *= 2u;
+
+  for ( uint i = 0u; i < myNumShards; ++i ) {
+    Shard & shard = myShards[ i ];
+    shard.myFirstSlot = i * numSlotsPerShard;
+    shard.myNumSlots = numSlotsPerShard;
+    shard.myFirstTableEntry = i * tableSize;
+    shard.myTableMask = tableSize - 1u;
+  }
+
+  mySlotKeys.resize( ( uint64 ) numSlotsPerShard * myNumShards );
+  mySlotPrev.resize( ( uint64 ) numSlotsPerShard * myNumShards );
+  mySlotNext.resize( ( uint64 ) numSlotsPerShard * myNumShards );
+  myTable.resize( ( uint64 ) tableSize * myNumShards );
+  myTexels.reset( new uint[ ( uint64 ) numSlotsPerShard * myNumShards * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE ] );
+  ResetSlots();
+}
+
+void CpuTextureCache::ResetSlots() {
+  for ( uint i = 0u; i < myNumShards; ++i ) {
+    Shard & shard = myShards[ i ];
+    shard.myNumUsedSlots = 0u;
+    shard.myLruHead = UINT_MAX;
+    shard.myLruTail = UINT_MAX;
+  }
+  eastl::fill( myTable.begin(), myTable.end(), UINT_MAX );
+}
+
+uint CpuTextureCache::FindTableEntry( const Shard & aShard, uint64 aKey, uint64 aHash ) const {
+  const uint * table = &myTable[ aShard.myFirstTableEntry ];
+  uint         entry = GetHomeEntry( aHash, aShard.myTableMask );
+  while ( table[ entry ] != UINT_MAX && mySlotKeys[ table[ entry ] ] != aKey )
+    entry = ( entry + 1u ) & aShard.myTableMask;
+  return entry;
+}
+
+void CpuTextureCache::RemoveTableEntry( Shard & aShard, uint anEntry ) {
+  // Backward-shift deletion: the entries after the hole move into it unless that would put them before their home
+  uint * table = &myTable[ aShard.myFirstTableEntry ];
+  uint   hole = anEntry;
+  for ( uint entry = ( hole + 1u ) & aShard.myTableMask; table[ entry ] != UINT_MAX;
+        entry = ( entry + 1u ) & aShard.myTableMask ) {
+    const uint home = GetHomeEntry( HashTileKey( mySlotKeys[ table[ entry ] ] ), aShard.myTableMask );
+    const bool homeAfterHole = hole <= entry ? home > hole && home <= entry : home > hole || home <= entry;
+    if ( !homeAfterHole ) {
+      table[ hole ] = table[ entry ];
+      hole = entry;
+    }
+  }
+  table[ hole ] = UINT_MAX;
+}
+
+void CpuTextureCache::UnlinkLru( Shard & aShard, uint aSlot ) {
+  const uint prev = mySlotPrev[ aSlot ];
+  const uint next = mySlotNext[ aSlot ];
+  if ( prev != UINT_MAX )
+    mySlotNext[ prev ] = next;
+  else
+    aShard.myLruHead = next;
+  if ( next != UINT_MAX )
+    mySlotPrev[ next ] = prev;
+  else
+    aShard.myLruTail = prev;
+}
+
+void CpuTextureCache::LinkLruHead( Shard & aShard, uint aSlot ) {
+  mySlotPrev[ aSlot ] = UINT_MAX;
+  mySlotNext[ aSlot ] = aShard.myLruHead;
+  if ( aShard.myLruHead != UINT_MAX )
+    mySlotPrev[ aShard.myLruHead ] = aSlot;
+  else
+    aShard.myLruTail = aSlot;
+  aShard.myLruHead = aSlot;
+}
+
+uint CpuTextureCache::AcquireTile( Shard & aShard, uint64 aKey, uint64 aHash ) {
+  ++aShard.myNumLookups;
+
+  const uint entry = FindTableEntry( aShard, aKey, aHash );
+  uint       slot = myTable[ aShard.myFirstTableEntry + entry ];
+  if ( slot != UINT_MAX ) {
+    if ( aShard.myLruHead != slot ) {
+      UnlinkLru( aShard, slot );
+      LinkLruHead( aShard, slot );
+    }
+    return slot;
+  }
+
+  ++aShard.myNumMisses;
+  if ( aShard.myNumUsedSlots < aShard.myNumSlots ) {
+    slot = aShard.myFirstSlot + aShard.myNumUsedSlots++;
+  } else {
+    ++aShard.myNumEvictions;
+    slot = aShard.myLruTail;
+    UnlinkLru( aShard, slot );
+    const uint64 evictedKey = mySlotKeys[ slot ];
+    RemoveTableEntry( aShard, FindTableEntry( aShard, evictedKey, HashTileKey( evictedKey ) ) );
+  }
+
+  // The removal may have moved the free entry of the new key
+  mySlotKeys[ slot ] = aKey;
+  myTable[ aShard.myFirstTableEntry + FindTableEntry( aShard, aKey, aHash ) ] = slot;
+  LinkLruHead( aShard, slot );
+
+  const uint texture = ( uint ) ( aKey >> 46 );
+  const uint mip = ( uint ) ( aKey >> 42 ) & 15u;
+  const uint tileY = ( uint ) ( aKey >> 21 ) & ( ( 1u << 21 ) - 1u );
+  const uint tileX = ( uint ) aKey & ( ( 1u << 21 ) - 1u );
+  myTextures[ texture ]->DecodeTile( mip, tileX, tileY,
+                                     &myTexels[ ( uint64 ) slot * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE ] );
+  return slot;
+}
+
+void CpuTextureCache::FetchTexels( uint aTexture, uint aMip, const glm::uvec2 someCoords[ 4 ],
+                                   uint someTexelsOut[ 4 ] ) {
+  // The texels of a bilinear lookup mostly lie in the same tile, which is then only looked up once
+  std::unique_lock< std::mutex > lock;
+  Shard *                        shard = nullptr;
+  uint64                         lastKey = UINT64_MAX;
+  const uint *                   tileTexels = nullptr;
+  for ( uint i = 0u; i < 4u; ++i ) {
+    const glm::uvec2 tile = someCoords[ i ] / TEXTURE_TILE_SIZE;
+    const uint64     key = MakeTileKey( aTexture, aMip, tile.x, tile.y );
+    if ( key != lastKey ) {
+      const uint64 hash = HashTileKey( key );
+      Shard &      keyShard = myShards[ GetShardIndex( hash, myNumShards ) ];
+      if ( &keyShard != shard ) {
+        // Only one shard is locked at a time, two threads locking two shards in opposite order would deadlock
+        if ( lock.owns_lock() )
+          lock.unlock();
+        lock = std::unique_lock< std::mutex >( keyShard.myMutex );
+        shard = &keyShard;
+      }
+      tileTexels = &myTexels[ ( uint64 ) AcquireTile( *shard, key, hash ) * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE ];
+      lastKey = key;
+    }
+
+    const glm::uvec2 texel = someCoords[ i ] - tile * TEXTURE_TILE_SIZE;
+    someTexelsOut[ i ] = tileTexels[ texel.y * TEXTURE_TILE_SIZE + texel.x ];
+  }
+}
+
+glm::float3 CpuTextureCache::SampleBilinear( uint aTexture, uint aMip, const glm::float2 & aUv ) {
+  const CpuTextureFile & texture = *myTextures[ aTexture ];
+  const glm::uvec2       size( texture.GetWidth( aMip ), texture.GetHeight( aMip ) );
+
+  // Texel centers are at half-integer coordinates, the wrapped UV gives coordinates in [ -0.5, size - 0.5 )
+  const glm::float2 coords = ( aUv - glm::floor( aUv ) ) * glm::float2( size ) - 0.5f;
+  const glm::float2 coordsFloor = glm::floor( coords );
+  const glm::float2 weight = coords - coordsFloor;
+
+  const uint x0 = coordsFloor.x < 0.0f ? size.x - 1u : glm::min( ( uint ) coordsFloor.x, size.x - 1u );
+  const uint y0 = coordsFloor.y < 0.0f ? size.y - 1u : glm::min( ( uint ) coordsFloor.y, size.y - 1u );
+  const uint x1 = x0 + 1u < size.x ? x0 + 1u : 0u;
+  const uint y1 = y0 + 1u < size.y ? y0 + 1u : 0u;
+
+  const glm::uvec2 coordsToFetch[ 4 ] = { glm::uvec2( x0, y0 ), glm::uvec2( x1, y0 ), glm::uvec2( x0, y1 ),
+                                          glm::uvec2( x1, y1 ) };
+  uint             texels[ 4 ];
+  FetchTexels( aTexture, aMip, coordsToFetch, texels );
+
+  const glm::float3 top = glm::mix( DecodeSrgb( texels[ 0 ] ), DecodeSrgb( texels[ 1 ] ), weight.x );
+  const glm::float3 bottom = glm::mix( DecodeSrgb( texels[ 2 ] ), DecodeSrgb( texels[ 3 ] ), weight.x );
+  return glm::mix( top, bottom, weight.y );
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <limits.h>
+#include <mutex>
+#include <EASTL/hash_map.h>
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/MathIncludes.h"
+#include "Common/Ptr.h"
+#include "MappedFile.h"
+
+using namespace Fancy;
+
+// Texels are RGBA8 with R in the lowest byte, the layout of DataFormat::SRGB_8_A_8. The CPU decodes the sRGB on lookup.
+const uint TEXTURE_TILE_SIZE = 64u;
+const uint TEXTURE_TILE_BYTES = TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE * sizeof( uint );
+const uint TEXTURE_MAX_MIPS = 16u;
+const uint CPU_TEXTURE_NONE = UINT_MAX;
+
+// Mapped DDS file whose mips are decoded on demand, one tile or one whole mip at a time. Reads BC1, BC3 and 32-bit
+// RGBA/BGRA, only the first surface of arrays and cube maps. BC blocks and uncompressed rows can be decoded wherever
+// they are, so a tile never touches more of the file than its own texels.
+class CpuTextureFile {
+public:
+  enum class Format { BC1, BC3, RGBA8, BGRA8 };
+
+  bool Open( const char * aPath );
+
+  uint GetWidth( uint aMip ) const {
+    return glm::max( myWidth >> aMip, 1u );
+  }
+
+  uint GetHeight( uint aMip ) const {
+    return glm::max( myHeight >> aMip, 1u );
+  }
+
+  uint GetNumMips() const {
+    return myNumMips;
+  }
+
+  Format GetFormat() const {
+    return myFormat;
+  }
+
+  // Writes the texels of the tile that lie inside the mip, the rest of the TEXTURE_TILE_SIZE^2 texels keep their value
+  void DecodeTile( uint aMip, uint aTileX, uint aTileY, uint * someTexelsOut ) const;
+
+  // GetWidth( aMip ) * GetHeight( aMip ) texels
+  void DecodeMip( uint aMip, uint * someTexelsOut ) const;
+
+private:
+  void DecodeRect( uint aMip, uint aX, uint aY, uint aWidth, uint aHeight, uint * someTexelsOut,
+                   uint aRowPitch ) const;
+
+  MappedFile    myFile;
+  const uint8 * myMipData[ TEXTURE_MAX_MIPS ] = {};
+  uint          myWidth = 0u;
+  uint          myHeight = 0u;
+  uint          myNumMips = 0u;
+  Format        myFormat = Format::RGBA8;
+};
+
+// Tile lookups and tile loads since the last CpuTextureCache::ResetStats()
+struct CpuTextureCacheStats {
+  float GetHitRate() const {
+    return myNumLookups > 0u ? 1.0f - ( float ) myNumMisses / ( float ) myNumLookups : 1.0f;
+  }
+
+  uint64 myNumLookups = 0u;
+  uint64 myNumMisses = 0u;     // Lookups that decoded the tile
+  uint64 myNumEvictions = 0u;  // Misses that replaced a resident tile
+  uint64 myResidentSize = 0u;  // Bytes of the decoded tiles
+  uint64 myBudget = 0u;        // Bytes of the tiles the cache keeps, at most the budget unless that is below one shard
+  uint   myNumTextures = 0u;
+  uint64 myTextureSize = 0u;  // Bytes all mips of all textures would take decoded
+};
+
+// Base-color textures of the CPU path tracer. The textures stay in their files, only the decoded tiles of
+// TEXTURE_TILE_SIZE^2 texels that lookups hit are kept, up to a fixed memory budget. The least recently used tile makes
+// room for the next one, so scenes whose textures don't fit into memory still render, just slower.
+// Lookups are thread-safe. The tiles are split into up to MAX_NUM_SHARDS shards by their key, each with its own lock,
+// LRU list and share of the budget, so the render threads rarely wait for each other. A miss decodes its tile under the
+// lock of the shard.
+class CpuTextureCache {
+public:
+  enum { MAX_NUM_SHARDS = 64 };
+  enum : uint64 { DEFAULT_BUDGET = 256ull * 1024u * 1024u };
+
+  explicit CpuTextureCache( uint64 aBudget = DEFAULT_BUDGET );
+
+  // Drops the resident tiles. The memory for them is only allocated once the first texture is added. Each shard keeps
+  // a few tiles, small budgets get fewer shards. A budget below a single shard is raised to it with a warning.
+  void SetBudget( uint64 aBudget );
+
+  uint64 GetBudget() const {
+    return myBudget;
+  }
+
+  // Removes all textures and tiles
+  void Clear();
+
+  // Returns the index of the texture for Sample() or CPU_TEXTURE_NONE if the file can't be read. Adding the same path
+  // again returns the same index.
+  uint AddTexture( const char * aPath );
+
+  const CpuTextureFile & GetTexture( uint aTexture ) const {
+    return *myTextures[ aTexture ];
+  }
+
+  // Trilinear lookup with wrapped UVs, in linear color. aLod is in mips of the texture and clamped to its mip chain.
+  glm::float3 Sample( uint aTexture, const glm::float2 & aUv, float aLod );
+
+  CpuTextureCacheStats GetStats() const;
+  void                 ResetStats();
+
+private:
+  struct alignas( 64 ) Shard {
+    std::mutex myMutex;
+    uint       myFirstSlot = 0u;
+    uint       myNumSlots = 0u;
+    uint       myNumUsedSlots = 0u;
+    uint       myLruHead = UINT_MAX;  // Most recently used
+    uint       myLruTail = UINT_MAX;
+    uint       myTableMask = 0u;
+    uint       myFirstTableEntry = 0u;  // Open addressing with linear probing, slot per entry or UINT_MAX
+    uint64     myNumLookups = 0u;
+    uint64     myNumMisses = 0u;
+    uint64     myNumEvictions = 0u;
+  };
+
+  void        AllocateSlots();
+  void        ResetSlots();
+  uint        FindTableEntry( const Shard & aShard, uint64 aKey, uint64 aHash ) const;
+  void        RemoveTableEntry( Shard & aShard, uint anEntry );
+  void        UnlinkLru( Shard & aShard, uint aSlot );
+  void        LinkLruHead( Shard & aShard, uint aSlot );
+  uint        AcquireTile( Shard & aShard, uint64 aKey, uint64 aHash );
+  void        FetchTexels( uint aTexture, uint aMip, const glm::uvec2 someCoords[ 4 ], uint someTexelsOut[ 4 ] );
+  glm::float3 SampleBilinear( uint aTexture, uint aMip, const glm::float2 & aUv );
+
+  uint64 myBudget;
+  uint   myNumShards = MAX_NUM_SHARDS;  // Of the current budget, set by AllocateSlots()
+
+  eastl::vector< UniquePtr< CpuTextureFile > > myTextures;
+  eastl::hash_map< eastl::string, uint >       myTextureIndices;
+
+  // The slots of a shard are a contiguous range of the slot arrays, its table a contiguous range of myTable
+  UniquePtr< Shard[] >    myShards;
+  eastl::vector< uint64 > mySlotKeys;
+  eastl::vector< uint >   mySlotPrev;
+  eastl::vector< uint >   mySlotNext;
+  eastl::vector< uint >   myTable;
+  UniquePtr< uint[] >     myTexels;  // TEXTURE_TILE_SIZE^2 per slot, left uninitialized so unused slots cost no RAM
+};
@@ -0,0 +1,152 @@
+#include "CpuThreadPool.h"
+
+#include "Common/MathIncludes.h"
+
+namespace Priv_CpuThreadPool {
+  uint64 PackRange( uint aBegin, uint anEnd ) {
+    return ( uint64 ) aBegin | ( ( uint64 ) anEnd << 32u );
+  }
+
+  void UnpackRange( uint64 aRange, uint & aBeginOut, uint & anEndOut ) {
+    aBeginOut = ( uint ) aRange;
+    anEndOut = ( uint ) ( aRange >> 32u );
+  }
+}  // namespace Priv_CpuThreadPool
+
+using namespace Priv_CpuThreadPool;
+
+CpuThreadPool::CpuThreadPool( uint aNumThreads ) {
+  uint numThreads = aNumThreads;
+  if ( numThreads == 0u )
+    numThreads = glm::max( 1u, ( uint ) std::thread::hardware_concurrency() );
+
+  myItemRanges.reset( new ItemRange[ numThreads ] );
+  for ( uint i = 0u; i < numThreads; ++i )
+    myItemRanges[ i ].myRange.store( 0ull );
+
+  myWorkers.reserve( numThreads - 1u );
+  for ( uint i = 1u; i < numThreads; ++i )
+    myWorkers.push_back( std::thread( &CpuThreadPool::WorkerMain, this, i ) );
+}
+
+CpuThreadPool::~CpuThreadPool() {
+  {
+    std::lock_guard< std::mutex > lock( myMutex );
+    myShutdown = true;
+  }
+  myWakeCondition.notify_all();
+
+  for ( std::thread & worker : myWorkers )
+    worker.join();
+}
+
+void CpuThreadPool::Run( JobFunc aFunc, void * aContext, uint aNumItems ) {
+  if ( aNumItems == 0u )
+    return;
+
+  if ( myWorkers.empty() || aNumItems == 1u ) {
+    for ( uint i = 0u; i < aNumItems; ++i )
+      aFunc( aContext, i, 0u );
+    return;
+  }
+
+  // Contiguous ranges of about the same size. With fewer items than threads, every item gets a thread of its own and
+  // there is nothing to steal.
+  const uint numThreads = glm::min( GetNumThreads(), aNumItems );
+  for ( uint i = 0u; i < numThreads; ++i ) {
+    const uint begin = ( uint ) ( ( uint64 ) aNumItems * i / numThreads );
+    const uint end = ( uint ) ( ( uint64 ) aNumItems * ( i + 1u ) / numThreads );
+    myItemRanges[ i ].myRange.store( PackRange( begin, end ) );
+  }
+
+  {
+    std::lock_guard< std::mutex > lock( myMutex );
+    myJobFunc = aFunc;
+    myJobContext = aContext;
+    myJobNumThreads = numThreads;
+    myNumActiveWorkers = ( uint ) myWorkers.size();
+    ++myJobGeneration;
+  }
+  myWakeCondition.notify_all();
+
+  ProcessItems( 0u );
+
+  std::unique_lock< std::mutex > lock( myMutex );
+  myDoneCondition.wait( lock, [ this ]() { return myNumActiveWorkers == 0u; } );
+  myJobFunc = nullptr;
+  myJobContext = nullptr;
+}
+
+void CpuThreadPool::WorkerMain( uint aThreadIdx ) {
+  uint64 lastGeneration = 0ull;
+  while ( true ) {
+    {
+      std::unique_lock< std::mutex > lock( myMutex );
+      myWakeCondition.wait( lock, [ this, lastGeneration ]() {
+        return myShutdown || myJobGeneration != lastGeneration;
+      } );
+      if ( myShutdown )
+        return;
+      lastGeneration = myJobGeneration;
+    }
+
+    ProcessItems( aThreadIdx );
+
+    {
+      std::lock_guard< std::mutex > lock( myMutex );
+      --myNumActiveWorkers;
+    }
+    myDoneCondition.notify_one();
+  }
+}
+
+void CpuThreadPool::ProcessItems( uint aThreadIdx ) {
+  if ( aThreadIdx >= myJobNumThreads )
+    return;
+
+  // A thread is done once a full round over the other ranges found nothing to steal. Items that a thief took but
+  // hasn't published in its own range yet are processed by the thief itself.
+  uint item;
+  while ( PopItem( aThreadIdx, item ) || StealItem( aThreadIdx, item ) )
+    myJobFunc( myJobContext, item, aThreadIdx );
+}
+
+bool CpuThreadPool::PopItem( uint aThreadIdx, uint & anItemOut ) {
+  std::atomic< uint64 > & range = myItemRanges[ aThreadIdx ].myRange;
+  uint64                  current = range.load();
+  while ( true ) {
+    uint begin, end;
+    UnpackRange( current, begin, end );
+    if ( begin >= end )
+      return false;
+
+    if ( range.compare_exchange_weak( current, PackRange( begin + 1u, end ) ) ) {
+      anItemOut = begin;
+      return true;
+    }
+  }
+}
+
+bool CpuThreadPool::StealItem( uint aThreadIdx, uint & anItemOut ) {
+  for ( uint i = 1u; i < myJobNumThreads; ++i ) {
+    std::atomic< uint64 > & victimRange = myItemRanges[ ( aThreadIdx + i ) % myJobNumThreads ].myRange;
+    uint64                  current = victimRange.load();
+    while ( true ) {
+      uint begin, end;
+      UnpackRange( current, begin, end );
+      if ( begin >= end )
+        break;
+
+      // The back half, rounded up so that the last item can be stolen too. The victim keeps the items next to the
+      // ones it is working on.
+      const uint stealBegin = end - ( end - begin + 1u ) / 2u;
+      if ( victimRange.compare_exchange_weak( current, PackRange( begin, stealBegin ) ) ) {
+        // Only the owner refills its empty range, thieves skip it until then
+        myItemRanges[ aThreadIdx ].myRange.store( PackRange( stealBegin + 1u, end ) );
+        anItemOut = stealBegin;
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/Ptr.h"
+
+// Fixed set of worker threads that execute ParallelFor-jobs. The calling thread participates as thread 0, so a pool
+// with N threads spawns N-1 workers. Jobs are passed as a function pointer + context so dispatching does not allocate.
+// Each thread starts on its own contiguous range of the items and steals half of the remaining items of another thread
+// once its range is done, so neighboring items mostly end up on the same thread.
+class CpuThreadPool {
+public:
+  explicit CpuThreadPool( uint aNumThreads = 0u );
+  ~CpuThreadPool();
+
+  uint GetNumThreads() const {
+    return ( uint ) myWorkers.size() + 1u;
+  }
+
+  // Calls aFunc( anItemIdx, aThreadIdx ) for every item in [0, aNumItems) and blocks until all items are done.
+  // aThreadIdx is in [0, GetNumThreads()) and can be used to index per-thread scratch data.
+  template < class FuncT >
+  void ParallelFor( uint aNumItems, const FuncT & aFunc ) {
+    struct Invoker {
+      static void Invoke( void * aContext, uint anItemIdx, uint aThreadIdx ) {
+        ( *static_cast< const FuncT * >( aContext ) )( anItemIdx, aThreadIdx );
+      }
+    };
+    Run( &Invoker::Invoke, const_cast< FuncT * >( &aFunc ), aNumItems );
+  }
+
+private:
+  typedef void ( *JobFunc )( void * aContext, uint anItemIdx, uint aThreadIdx );
+
+  void Run( JobFunc aFunc, void * aContext, uint aNumItems );
+  void WorkerMain( uint aThreadIdx );
+  void ProcessItems( uint aThreadIdx );
+  bool PopItem( uint aThreadIdx, uint & anItemOut );
+  bool StealItem( uint aThreadIdx, uint & anItemOut );
+
+  // Items [ begin, end ) that a thread hasn't started yet, with begin in the lower and end in the upper 32 bits. The
+  // owner takes items from the front, thieves from the back. Each range has its own cache line, the owner updates it
+  // for every item.
+  struct alignas( 64 ) ItemRange {
+    std::atomic< uint64 > myRange;
+  };
+
+  eastl::vector< std::thread >    myWorkers;
+  Fancy::UniquePtr< ItemRange[] > myItemRanges;
+
+  std::mutex              myMutex;
+  std::condition_variable myWakeCondition;
+  std::condition_variable myDoneCondition;
+  uint64                  myJobGeneration = 0ull;
+  uint                    myNumActiveWorkers = 0u;
+  bool                    myShutdown = false;
+
+  JobFunc myJobFunc = nullptr;
+  void *  myJobContext = nullptr;
+  uint    myJobNumThreads = 0u;  // Threads that got a range, the others sit the job out
+};
@@ -0,0 +1,152 @@
+#include "LinearAllocator.h"
+
+#include <new>
+
+#include "Common/MathIncludes.h"
+
+namespace Priv_LinearAllocator {
+  // Of the memory after the chunk header, enough for every type the scene code allocates
+  const uint64 CHUNK_ALIGNMENT = 16u;
+
+  uint64 AlignUp( uint64 aValue, uint64 anAlignment ) {
+    return ( aValue + anAlignment - 1u ) & ~( anAlignment - 1u );
+  }
+
+  const uint64 CHUNK_HEADER_SIZE = AlignUp( sizeof( void * ) + sizeof( uint64 ), CHUNK_ALIGNMENT );
+}  // namespace Priv_LinearAllocator
+
+using namespace Priv_LinearAllocator;
+
+LinearAllocator::LinearAllocator( uint64 aMinChunkSize ) : myMinChunkSize( aMinChunkSize ) {}
+
+LinearAllocator::~LinearAllocator() {
+  FreeChunks();
+}
+
+LinearAllocator::LinearAllocator( LinearAllocator && anOther )
+  : myMinChunkSize( anOther.myMinChunkSize ),
+    myCurrentChunk( anOther.myCurrentChunk ),
+    myCurrentOffset( anOther.myCurrentOffset ),
+    myUsedSize( anOther.myUsedSize ),
+    myCapacity( anOther.myCapacity ),
+    myNumChunks( anOther.myNumChunks ) {
+  anOther.myCurrentChunk = nullptr;
+  anOther.myCurrentOffset = 0u;
+  anOther.myUsedSize = 0u;
+  anOther.myCapacity = 0u;
+  anOther.myNumChunks = 0u;
+}
+
+void * LinearAllocator::Allocate( uint64 aSize, uint64 anAlignment ) {
+  ASSERT( anAlignment > 0u && ( anAlignment & ( anAlignment - 1u ) ) == 0u );
+
+  // Aligns the address rather than the offset, the chunks themselves are only CHUNK_ALIGNMENT-aligned
+  uint64 offset = 0u;
+  if ( myCurrentChunk != nullptr ) {
+    const uintptr_t chunkData = ( uintptr_t ) myCurrentChunk + CHUNK_HEADER_SIZE;
+    offset = AlignUp( chunkData + myCurrentOffset, anAlignment ) - chunkData;
+  }
+
+  if ( myCurrentChunk == nullptr || offset + aSize > myCurrentChunk->mySize ) {
+    // The slack covers alignments above the one of the chunk
+    AddChunk( aSize + ( anAlignment > CHUNK_ALIGNMENT ? anAlignment : 0u ) );
+    const uintptr_t chunkData = ( uintptr_t ) myCurrentChunk + CHUNK_HEADER_SIZE;
+    offset = AlignUp( chunkData, anAlignment ) - chunkData;
+  }
+
+  uint8 * result = ( uint8 * ) myCurrentChunk + CHUNK_HEADER_SIZE + offset;
+  myUsedSize += aSize;
+  myCurrentOffset = offset + aSize;
+  return result;
+}
+
+void LinearAllocator::Reset() {
+  if ( myNumChunks > 1u ) {
+    const uint64 capacity = myCapacity;
+    FreeChunks();
+    AddChunk( capacity );
+  }
+
+  myCurrentOffset = 0u;
+  myUsedSize = 0u;
+}
+
+uint64 LinearAllocator::GetUsedSize() const {
+  return myUsedSize;
+}
+
+uint64 LinearAllocator::GetCapacity() const {
+  return myCapacity;
+}
+
+void LinearAllocator::AddChunk( uint64 aMinSize ) {
+  // Grows geometrically, so a round that keeps growing only adds a logarithmic number of chunks
+  const uint64 size = AlignUp( glm::max( glm::max( aMinSize, myMinChunkSize ), myCapacity ), CHUNK_ALIGNMENT );
+  Chunk *      chunk = static_cast< Chunk * >( ::operator new( CHUNK_HEADER_SIZE + size ) );
+  chunk->myPrevious = myCurrentChunk;
+  chunk->mySize = size;
+
+  myCurrentChunk = chunk;
+  myCurrentOffset = 0u;
+  myCapacity += size;
+  ++myNumChunks;
+}
+
+void LinearAllocator::FreeChunks() {
+  while ( myCurrentChunk != nullptr ) {
+    Chunk * previous = myCurrentChunk->myPrevious;
+    ::operator delete( myCurrentChunk );
+    myCurrentChunk = previous;
+  }
+
+  myCurrentOffset = 0u;
+  myUsedSize = 0u;
+  myCapacity = 0u;
+  myNumChunks = 0u;
+}
+
+LinearEastlAllocator::LinearEastlAllocator( const char * aName ) : myAllocator( nullptr ), myHeapAllocator( aName ) {}
+
+LinearEastlAllocator::LinearEastlAllocator( LinearAllocator * anAllocator, const char * aName )
+  : myAllocator( anAllocator ), myHeapAllocator( aName ) {}
+
+LinearEastlAllocator::LinearEastlAllocator( const LinearEastlAllocator & anOther, const char * aName )
+  : myAllocator( anOther.myAllocator ), myHeapAllocator( aName ) {}
+
+void * LinearEastlAllocator::allocate( size_t aSize, int someFlags ) {
+  if ( myAllocator == nullptr )
+    return myHeapAllocator.allocate( aSize, someFlags );
+
+  return myAllocator->Allocate( aSize, CHUNK_ALIGNMENT );
+}
+
+void * LinearEastlAllocator::allocate( size_t aSize, size_t anAlignment, size_t anOffset, int someFlags ) {
+  if ( myAllocator == nullptr )
+    return myHeapAllocator.allocate( aSize, anAlignment, anOffset, someFlags );
+
+  // EASTL containers only ask for an offset of 0
+  ASSERT( anOffset == 0u );
+  return myAllocator->Allocate( aSize, glm::max( ( uint64 ) anAlignment, CHUNK_ALIGNMENT ) );
+}
+
+void LinearEastlAllocator::deallocate( void * aPtr, size_t aSize ) {
+  // Arena memory is only freed by LinearAllocator::Reset()
+  if ( myAllocator == nullptr )
+    myHeapAllocator.deallocate( aPtr, aSize );
+}
+
+const char * LinearEastlAllocator::get_name() const {
+  return myHeapAllocator.get_name();
+}
+
+void LinearEastlAllocator::set_name( const char * aName ) {
+  myHeapAllocator.set_name( aName );
+}
+
+bool operator==( const LinearEastlAllocator & aLeft, const LinearEastlAllocator & aRight ) {
+  return aLeft.GetAllocator() == aRight.GetAllocator();
+}
+
+bool operator!=( const LinearEastlAllocator & aLeft, const LinearEastlAllocator & aRight ) {
+  return !( aLeft == aRight );
+}
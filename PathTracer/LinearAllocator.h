@@ -0,0 +1,79 @@
+#pragma once
+
+#include <EASTL/vector.h>
+
+#include "Common/FancyCoreDefines.h"
+
+using namespace Fancy;
+
+// Bump allocator for temporaries that die at the same time, like the scratch data of a scene load. Allocations are
+// only freed all at once by Reset(), which keeps the memory for the next round. Not thread-safe, threads that need
+// scratch memory get an allocator each.
+class LinearAllocator {
+public:
+  explicit LinearAllocator( uint64 aMinChunkSize = 64u * 1024u );
+  ~LinearAllocator();
+
+  LinearAllocator( LinearAllocator && anOther );
+  LinearAllocator( const LinearAllocator & ) = delete;
+  LinearAllocator & operator=( const LinearAllocator & ) = delete;
+
+  void * Allocate( uint64 aSize, uint64 anAlignment );
+
+  // Frees all allocations. If the last round needed more than one chunk, they are replaced by a single chunk of their
+  // combined size, so a round that doesn't need more memory than the last one doesn't allocate.
+  void Reset();
+
+  // Bytes handed out since the last Reset() and bytes of all chunks
+  uint64 GetUsedSize() const;
+  uint64 GetCapacity() const;
+
+private:
+  // The header sits at the start of the memory of each chunk, the chunks form a list from the newest to the oldest
+  struct Chunk {
+    Chunk * myPrevious;
+    uint64  mySize;  // Without the header
+  };
+
+  void AddChunk( uint64 aMinSize );
+  void FreeChunks();
+
+  uint64  myMinChunkSize;
+  Chunk * myCurrentChunk = nullptr;
+  uint64  myCurrentOffset = 0u;  // Into the memory after the header of myCurrentChunk
+  uint64  myUsedSize = 0u;
+  uint64  myCapacity = 0u;
+  uint    myNumChunks = 0u;
+};
+
+// EASTL allocator on a LinearAllocator. Without one, it falls back to the default EASTL allocator, so code can take
+// scratch memory from an arena when the caller has one and from the heap otherwise.
+class LinearEastlAllocator {
+public:
+  explicit LinearEastlAllocator( const char * aName = nullptr );
+  explicit LinearEastlAllocator( LinearAllocator * anAllocator, const char * aName = nullptr );
+  LinearEastlAllocator( const LinearEastlAllocator & anOther, const char * aName );
+  LinearEastlAllocator( const LinearEastlAllocator & anOther ) = default;
+  LinearEastlAllocator & operator=( const LinearEastlAllocator & anOther ) = default;
+
+  void * allocate( size_t aSize, int someFlags = 0 );
+  void * allocate( size_t aSize, size_t anAlignment, size_t anOffset, int someFlags = 0 );
+  void   deallocate( void * aPtr, size_t aSize );
+
+  const char * get_name() const;
+  void         set_name( const char * aName );
+
+  LinearAllocator * GetAllocator() const {
+    return myAllocator;
+  }
+
+private:
+  LinearAllocator * myAllocator;
+  eastl::allocator  myHeapAllocator;
+};
+
+bool operator==( const LinearEastlAllocator & aLeft, const LinearEastlAllocator & aRight );
+bool operator!=( const LinearEastlAllocator & aLeft, const LinearEastlAllocator & aRight );
+
+template < class T >
+using LinearVector = eastl::vector< T, LinearEastlAllocator >;
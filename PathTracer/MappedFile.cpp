@@ -0,0 +1,91 @@
+#include "MappedFile.h"
+
+#if defined( _WIN32 )
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open( const char * aPath ) {
+  Close();
+
+#if defined( _WIN32 )
+  HANDLE file = CreateFileA( aPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+  if ( file == INVALID_HANDLE_VALUE )
+    return false;
+
+  LARGE_INTEGER size;
+  if ( !GetFileSizeEx( file, &size ) || size.QuadPart == 0 ) {
+    CloseHandle( file );
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+  if ( mapping == nullptr ) {
+    CloseHandle( file );
+    return false;
+  }
+
+  const void * data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+  if ( data == nullptr ) {
+    CloseHandle( mapping );
+    CloseHandle( file );
+    return false;
+  }
+
+  myFileHandle = file;
+  myMappingHandle = mapping;
+  myData = static_cast< const uint8 * >( data );
+  mySize = ( uint64 ) size.QuadPart;
+#else
+  const int file = open( aPath, O_RDONLY );
+  if ( file < 0 )
+    return false;
+
+  struct stat fileStat;
+  if ( fstat( file, &fileStat ) != 0 || fileStat.st_size == 0 ) {
+    close( file );
+    return false;
+  }
+
+  // The mapping keeps its own reference to the file
+  void * data = mmap( nullptr, ( size_t ) fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+  close( file );
+  if ( data == MAP_FAILED )
+    return false;
+
+  myData = static_cast< const uint8 * >( data );
+  mySize = ( uint64 ) fileStat.st_size;
+#endif
+
+  return true;
+}
+
+void MappedFile::Close() {
+#if defined( _WIN32 )
+  if ( myData )
+    UnmapViewOfFile( myData );
+  if ( myMappingHandle )
+    CloseHandle( myMappingHandle );
+  if ( myFileHandle )
+    CloseHandle( myFileHandle );
+  myMappingHandle = nullptr;
+  myFileHandle = nullptr;
+#else
+  if ( myData )
+    munmap( const_cast< uint8 * >( myData ), ( size_t ) mySize );
+#endif
+
+  myData = nullptr;
+  mySize = 0u;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Common/FancyCoreDefines.h"
+
+using namespace Fancy;
+
+// Read-only memory mapping of a whole file. The mapping stays valid until Close() or destruction.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile( const MappedFile & ) = delete;
+  MappedFile & operator=( const MappedFile & ) = delete;
+
+  bool Open( const char * aPath );
+  void Close();
+
+  const uint8 * GetData() const {
+    return myData;
+  }
+
+  uint64 GetSize() const {
+    return mySize;
+  }
+
+private:
+  const uint8 * myData = nullptr;
+  uint64        mySize = 0u;
+#if defined( _WIN32 )
+  void * myFileHandle = nullptr;
+  void * myMappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,872 @@
+#include "ObjImporter.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <EASTL/hash_map.h>
+#include <EASTL/string.h>
+#include <EASTL/vector.h>
+
+#include "Common/MathIncludes.h"
+#include "Common/MathUtil.h"
+#include "IO/MeshImporter.h"
+#include "IO/PathService.h"
+#include "CpuThreadPool.h"
+#include "MappedFile.h"
+#include "Timing.h"
+
+namespace Priv_ObjImporter {
+  // Files are split into at most CHUNKS_PER_THREAD chunks per thread, but none smaller than MIN_CHUNK_SIZE
+  const uint64 MIN_CHUNK_SIZE = 1024u * 1024u;
+  const uint   CHUNKS_PER_THREAD = 4u;
+
+  // Vertex deduplication partitions the corners by the top bits of their hash, and each shard builds its own table
+  const uint DEDUP_SHARD_BITS = 6u;
+  const uint NUM_DEDUP_SHARDS = 1u << DEDUP_SHARD_BITS;
+  const uint DEDUP_BLOCK_SIZE = 64u * 1024u;
+
+  const uint NO_INDEX = UINT_MAX;
+
+  struct ObjCorner {
+    uint myPosition;
+    uint myUv;
+    uint myNormal;
+  };
+
+  enum class ObjEventType {
+    GROUP,  // o or g
+    MATERIAL,
+    MATERIAL_LIB
+  };
+
+  struct ObjEvent {
+    ObjEventType  myType;
+    uint          myFirstTriangle;
+    eastl::string myName;
+  };
+
+  struct ObjChunk {
+    const char * myBegin = nullptr;
+    const char * myEnd = nullptr;
+
+    // Counted in the first pass, so the second pass can write to its final place in the merged streams
+    uint myNumPositions = 0u;
+    uint myNumUvs = 0u;
+    uint myNumNormals = 0u;
+    uint myNumTriangles = 0u;
+    uint myFirstPosition = 0u;
+    uint myFirstUv = 0u;
+    uint myFirstNormal = 0u;
+    uint myFirstTriangle = 0u;
+
+    // Triangles with corners that have no vn index, counted in the second pass. They get a face normal appended to the
+    // normals of the file.
+    uint myNumFaceNormals = 0u;
+    uint myFirstFaceNormal = 0u;
+
+    eastl::vector< ObjEvent > myEvents;
+    bool                      myHasError = false;
+  };
+
+  struct ObjStreams {
+    eastl::vector< glm::float3 > myPositions;
+    eastl::vector< glm::float2 > myUvs;
+    eastl::vector< glm::float3 > myNormals;
+    eastl::vector< ObjCorner >   myCorners;  // 3 per triangle
+  };
+
+  struct ObjMeshRange {
+    uint myFirstTriangle;
+    uint myNumTriangles;
+    uint myMaterialIndex;
+  };
+
+  enum class ObjAttributeSource {
+    POSITION,
+    UV,
+    NORMAL,
+    NONE
+  };
+
+  struct ObjVertexAttribute {
+    uint               myOffset;
+    uint               mySize;
+    ObjAttributeSource mySource;
+  };
+
+  template < class FuncT >
+  void RunParallel( CpuThreadPool * aThreadPool, uint aNumItems, const FuncT & aFunc ) {
+    if ( aThreadPool != nullptr ) {
+      aThreadPool->ParallelFor( aNumItems, aFunc );
+    } else {
+      for ( uint i = 0u; i < aNumItems; ++i )
+        aFunc( i, 0u );
+    }
+  }
+
+  bool IsSpace( char aChar ) {
+    return aChar == ' ' || aChar == '\t' || aChar == '\r';
+  }
+
+  const char * SkipSpaces( const char * aCursor, const char * anEnd ) {
+    while ( aCursor < anEnd && IsSpace( *aCursor ) )
+      ++aCursor;
+    return aCursor;
+  }
+
+  const char * FindTokenEnd( const char * aCursor, const char * anEnd ) {
+    while ( aCursor < anEnd && !IsSpace( *aCursor ) )
+      ++aCursor;
+    return aCursor;
+  }
+
+  const char * FindLineEnd( const char * aCursor, const char * anEnd ) {
+    const char * lineEnd = static_cast< const char * >( memchr( aCursor, '\n', anEnd - aCursor ) );
+    return lineEnd ? lineEnd : anEnd;
+  }
+
+  // True if the line at aCursor starts with the statement aKeyword, followed by whitespace or the line end
+  bool IsStatement( const char * aCursor, const char * aLineEnd, const char * aKeyword ) {
+    const size_t length = strlen( aKeyword );
+    return ( size_t ) ( aLineEnd - aCursor ) >= length && memcmp( aCursor, aKeyword, length ) == 0 &&
+           ( aCursor + length == aLineEnd || IsSpace( aCursor[ length ] ) );
+  }
+
+  eastl::string GetArgument( const char * aCursor, const char * aLineEnd ) {
+    const char * begin = SkipSpaces( aCursor, aLineEnd );
+    const char * end = aLineEnd;
+    while ( end > begin && IsSpace( end[ -1 ] ) )
+      --end;
+    return eastl::string( begin, end );
+  }
+
+  uint CountTokens( const char * aCursor, const char * aLineEnd ) {
+    uint numTokens = 0u;
+    for ( aCursor = SkipSpaces( aCursor, aLineEnd ); aCursor < aLineEnd; aCursor = SkipSpaces( aCursor, aLineEnd ) ) {
+      aCursor = FindTokenEnd( aCursor, aLineEnd );
+      ++numTokens;
+    }
+    return numTokens;
+  }
+
+  bool ParseInt( const char *& aCursor, const char * anEnd, int & aValueOut ) {
+    const bool   isNegative = aCursor < anEnd && *aCursor == '-';
+    const char * digits = isNegative || ( aCursor < anEnd && *aCursor == '+' ) ? aCursor + 1 : aCursor;
+
+    int64        value = 0;
+    const char * cursor = digits;
+    for ( ; cursor < anEnd && *cursor >= '0' && *cursor <= '9' && value <= INT_MAX; ++cursor )
+      value = value * 10 + ( *cursor - '0' );
+
+    if ( cursor == digits || value > INT_MAX )
+      return false;
+
+    aValueOut = ( int ) ( isNegative ? -value : value );
+    aCursor = cursor;
+    return true;
+  }
+
+  // Decimal float parser without locale handling or correct rounding of more than 19 significant digits, which is
+  // all OBJ needs. Reads up to aTokenEnd and returns false if that isn't a number.
+  bool ParseFloat( const char * aCursor, const char * aTokenEnd, float & aValueOut ) {
+    static const float64 POWERS_OF_TEN[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const bool isNegative = aCursor < aTokenEnd && *aCursor == '-';
+    if ( aCursor < aTokenEnd && ( *aCursor == '-' || *aCursor == '+' ) )
+      ++aCursor;
+
+    uint64 mantissa = 0u;
+    int    exponent = 0;
+    uint   numDigits = 0u;
+    uint   numSignificantDigits = 0u;
+    for ( ; aCursor < aTokenEnd && *aCursor >= '0' && *aCursor <= '9'; ++aCursor, ++numDigits ) {
+      if ( numSignificantDigits < 19u ) {
+        mantissa = mantissa * 10u + ( uint64 ) ( *aCursor - '0' );
+        numSignificantDigits += mantissa != 0u;
+      } else {
+        ++exponent;
+      }
+    }
+
+    if ( aCursor < aTokenEnd && *aCursor == '.' ) {
+      for ( ++aCursor; aCursor < aTokenEnd && *aCursor >= '0' && *aCursor <= '9'; ++aCursor, ++numDigits ) {
+        if ( numSignificantDigits < 19u ) {
+          mantissa = mantissa * 10u + ( uint64 ) ( *aCursor - '0' );
+          numSignificantDigits += mantissa != 0u;
+          --exponent;
+        }
+      }
+    }
+
+    if ( numDigits == 0u )
+      return false;
+
+    if ( aCursor < aTokenEnd && ( *aCursor == 'e' || *aCursor == 'E' ) ) {
+      ++aCursor;
+      int exponentValue;
+      if ( !ParseInt( aCursor, aTokenEnd, exponentValue ) )
+        return false;
+      exponent += glm::clamp( exponentValue, -1000, 1000 );
+    }
+
+    if ( aCursor != aTokenEnd )
+      return false;
+
+    float64 value = ( float64 ) mantissa;
+    if ( exponent < 0 )
+      value = -exponent <= 22 ? value / POWERS_OF_TEN[ -exponent ] : value * pow( 10.0, exponent );
+    else if ( exponent > 0 )
+      value = exponent <= 22 ? value * POWERS_OF_TEN[ exponent ] : value * pow( 10.0, exponent );
+
+    aValueOut = ( float ) ( isNegative ? -value : value );
+    return true;
+  }
+
+  // Parses up to aNumValues whitespace-separated floats. Missing values are left untouched.
+  bool ParseFloats( const char * aCursor, const char * aLineEnd, float * someValuesOut, uint aNumValues ) {
+    for ( uint i = 0u; i < aNumValues; ++i ) {
+      aCursor = SkipSpaces( aCursor, aLineEnd );
+      if ( aCursor == aLineEnd )
+        return i > 0u;
+
+      const char * tokenEnd = FindTokenEnd( aCursor, aLineEnd );
+      if ( !ParseFloat( aCursor, tokenEnd, someValuesOut[ i ] ) )
+        return false;
+      aCursor = tokenEnd;
+    }
+    return true;
+  }
+
+  // OBJ indices are 1-based, negative ones count back from the last element defined before the face
+  uint ResolveIndex( int anIndex, uint aNumDefined, uint aNumTotal, bool & aHasErrorOut ) {
+    const int64 index = anIndex > 0 ? ( int64 ) anIndex - 1 : ( int64 ) aNumDefined + anIndex;
+    if ( anIndex == 0 || index < 0 || index >= ( int64 ) aNumTotal ) {
+      aHasErrorOut = true;
+      return 0u;
+    }
+    return ( uint ) index;
+  }
+
+  void CountChunk( ObjChunk & aChunk ) {
+    for ( const char * line = aChunk.myBegin; line < aChunk.myEnd; ) {
+      const char * lineEnd = FindLineEnd( line, aChunk.myEnd );
+      const char * cursor = SkipSpaces( line, lineEnd );
+
+      if ( IsStatement( cursor, lineEnd, "v" ) )
+        ++aChunk.myNumPositions;
+      else if ( IsStatement( cursor, lineEnd, "vt" ) )
+        ++aChunk.myNumUvs;
+      else if ( IsStatement( cursor, lineEnd, "vn" ) )
+        ++aChunk.myNumNormals;
+      else if ( IsStatement( cursor, lineEnd, "f" ) )
+        aChunk.myNumTriangles += glm::max( CountTokens( cursor + 1, lineEnd ), 2u ) - 2u;
+
+      line = lineEnd + 1;
+    }
+  }
+
+  bool HasMissingNormal( const ObjCorner * aTriangle ) {
+    return aTriangle[ 0 ].myNormal == NO_INDEX || aTriangle[ 1 ].myNormal == NO_INDEX ||
+           aTriangle[ 2 ].myNormal == NO_INDEX;
+  }
+
+  // Gives the corners without a vn index the normal of their triangle, otherwise the shading frame would be built from
+  // a zero normal. Every triangle gets its own normal, so the deduplication can't merge corners of different faces.
+  void AddFaceNormals( const ObjChunk & aChunk, ObjStreams & someStreams ) {
+    uint numFaceNormals = aChunk.myFirstFaceNormal;
+    for ( uint i = aChunk.myFirstTriangle; i < aChunk.myFirstTriangle + aChunk.myNumTriangles; ++i ) {
+      ObjCorner * triangle = &someStreams.myCorners[ ( uint64 ) i * 3u ];
+      if ( !HasMissingNormal( triangle ) )
+        continue;
+
+      const glm::float3 & p0 = someStreams.myPositions[ triangle[ 0 ].myPosition ];
+      const glm::float3 & p1 = someStreams.myPositions[ triangle[ 1 ].myPosition ];
+      const glm::float3 & p2 = someStreams.myPositions[ triangle[ 2 ].myPosition ];
+      const glm::float3   normal = glm::cross( p1 - p0, p2 - p0 );
+      const float         length = glm::length( normal );
+
+      // Degenerate triangles can't be hit, any unit normal keeps them free of NaNs
+      someStreams.myNormals[ numFaceNormals ] = length > 0.0f ? normal / length : glm::float3( 0.0f, 0.0f, 1.0f );
+      for ( uint iCorner = 0u; iCorner < 3u; ++iCorner ) {
+        if ( triangle[ iCorner ].myNormal == NO_INDEX )
+          triangle[ iCorner ].myNormal = numFaceNormals;
+      }
+      ++numFaceNormals;
+    }
+  }
+
+  void ParseChunk( ObjChunk & aChunk, ObjStreams & someStreams ) {
+    const uint numTotalPositions = ( uint ) someStreams.myPositions.size();
+    const uint numTotalUvs = ( uint ) someStreams.myUvs.size();
+    const uint numTotalNormals = ( uint ) someStreams.myNormals.size();
+
+    uint numPositions = aChunk.myFirstPosition;
+    uint numUvs = aChunk.myFirstUv;
+    uint numNormals = aChunk.myFirstNormal;
+    uint numTriangles = aChunk.myFirstTriangle;
+
+    for ( const char * line = aChunk.myBegin; line < aChunk.myEnd; ) {
+      const char * lineEnd = FindLineEnd( line, aChunk.myEnd );
+      const char * cursor = SkipSpaces( line, lineEnd );
+
+      if ( IsStatement( cursor, lineEnd, "v" ) ) {
+        glm::float3 & position = someStreams.myPositions[ numPositions++ ];
+        position = glm::float3( 0.0f );
+        aChunk.myHasError |= !ParseFloats( cursor + 1, lineEnd, &position.x, 3u );
+      } else if ( IsStatement( cursor, lineEnd, "vt" ) ) {
+        glm::float2 & uv = someStreams.myUvs[ numUvs++ ];
+        uv = glm::float2( 0.0f );
+        aChunk.myHasError |= !ParseFloats( cursor + 2, lineEnd, &uv.x, 2u );
+      } else if ( IsStatement( cursor, lineEnd, "vn" ) ) {
+        glm::float3 & normal = someStreams.myNormals[ numNormals++ ];
+        normal = glm::float3( 0.0f );
+        aChunk.myHasError |= !ParseFloats( cursor + 2, lineEnd, &normal.x, 3u );
+      } else if ( IsStatement( cursor, lineEnd, "f" ) ) {
+        // Must visit the same tokens as CountTokens() in the first pass
+        ObjCorner firstCorner = {};
+        ObjCorner prevCorner = {};
+        uint      numCorners = 0u;
+        for ( cursor = SkipSpaces( cursor + 1, lineEnd ); cursor < lineEnd; cursor = SkipSpaces( cursor, lineEnd ) ) {
+          const char * tokenEnd = FindTokenEnd( cursor, lineEnd );
+
+          ObjCorner corner = { 0u, NO_INDEX, NO_INDEX };
+          int       index;
+          if ( ParseInt( cursor, tokenEnd, index ) )
+            corner.myPosition = ResolveIndex( index, numPositions, numTotalPositions, aChunk.myHasError );
+          else
+            aChunk.myHasError = true;
+
+          if ( cursor < tokenEnd && *cursor == '/' ) {
+            ++cursor;
+            if ( cursor < tokenEnd && *cursor != '/' ) {
+              if ( ParseInt( cursor, tokenEnd, index ) )
+                corner.myUv = ResolveIndex( index, numUvs, numTotalUvs, aChunk.myHasError );
+              else
+                aChunk.myHasError = true;
+            }
+            if ( cursor < tokenEnd && *cursor == '/' ) {
+              ++cursor;
+              if ( ParseInt( cursor, tokenEnd, index ) )
+                corner.myNormal = ResolveIndex( index, numNormals, numTotalNormals, aChunk.myHasError );
+              else
+                aChunk.myHasError = true;
+            }
+          }
+
+          if ( numCorners == 0u ) {
+            firstCorner = corner;
+          } else if ( numCorners >= 2u ) {
+            ObjCorner * triangle = &someStreams.myCorners[ numTriangles++ * 3u ];
+            triangle[ 0 ] = firstCorner;
+            triangle[ 1 ] = prevCorner;
+            triangle[ 2 ] = corner;
+            if ( HasMissingNormal( triangle ) )
+              ++aChunk.myNumFaceNormals;
+          }
+          prevCorner = corner;
+          ++numCorners;
+          cursor = tokenEnd;
+        }
+      } else if ( IsStatement( cursor, lineEnd, "o" ) || IsStatement( cursor, lineEnd, "g" ) ) {
+        aChunk.myEvents.push_back( { ObjEventType::GROUP, numTriangles, GetArgument( cursor + 1, lineEnd ) } );
+      } else if ( IsStatement( cursor, lineEnd, "usemtl" ) ) {
+        aChunk.myEvents.push_back( { ObjEventType::MATERIAL, numTriangles, GetArgument( cursor + 6, lineEnd ) } );
+      } else if ( IsStatement( cursor, lineEnd, "mtllib" ) ) {
+        aChunk.myEvents.push_back( { ObjEventType::MATERIAL_LIB, numTriangles, GetArgument( cursor + 6, lineEnd ) } );
+      }
+
+      line = lineEnd + 1;
+    }
+  }
+
+  eastl::string GetDirectory( const char * aPath ) {
+    const char * separator = strrchr( aPath, '/' );
+    const char * backslash = strrchr( aPath, '\\' );
+    if ( backslash > separator )
+      separator = backslash;
+    return separator ? eastl::string( aPath, separator + 1 ) : eastl::string();
+  }
+
+  MaterialDesc CreateMaterial() {
+    MaterialDesc material;
+    for ( glm::float4 & parameter : material.myParameters )
+      parameter = glm::float4( 0.0f );
+    material.myParameters[ ( uint ) MaterialParameterType::COLOR ] = glm::float4( 1.0f );
+    return material;
+  }
+
+  // Texture paths are stored as absolute paths, relative ones in the MTL file are relative to the OBJ file
+  void LoadMaterialLib( const eastl::string & aPath, const eastl::string & aDirectory,
+                        eastl::vector< MaterialDesc > & someMaterialsOut,
+                        eastl::hash_map< eastl::string, uint > & aNameToIndexInOut ) {
+    MappedFile file;
+    if ( !file.Open( aPath.c_str() ) ) {
+      Log( "ObjImporter: Failed opening material lib %s", aPath.c_str() );
+      return;
+    }
+
+    const char *   end = reinterpret_cast< const char * >( file.GetData() ) + file.GetSize();
+    MaterialDesc * material = nullptr;
+    for ( const char * line = reinterpret_cast< const char * >( file.GetData() ); line < end; ) {
+      const char * lineEnd = FindLineEnd( line, end );
+      const char * cursor = SkipSpaces( line, lineEnd );
+
+      if ( IsStatement( cursor, lineEnd, "newmtl" ) ) {
+        aNameToIndexInOut[ GetArgument( cursor + 6, lineEnd ) ] = ( uint ) someMaterialsOut.size();
+        material = &someMaterialsOut.push_back();
+        *material = CreateMaterial();
+      } else if ( material != nullptr ) {
+        glm::float4 & color = material->myParameters[ ( uint ) MaterialParameterType::COLOR ];
+        glm::float4 & emission = material->myParameters[ ( uint ) MaterialParameterType::EMISSION ];
+        if ( IsStatement( cursor, lineEnd, "Kd" ) )
+          ParseFloats( cursor + 2, lineEnd, &color.x, 3u );
+        else if ( IsStatement( cursor, lineEnd, "d" ) )
+          ParseFloats( cursor + 1, lineEnd, &color.w, 1u );
+        else if ( IsStatement( cursor, lineEnd, "Ke" ) )
+          ParseFloats( cursor + 2, lineEnd, &emission.x, 3u );
+        else if ( IsStatement( cursor, lineEnd, "map_Kd" ) )
+          material->myTextures[ ( uint ) MaterialTextureType::BASE_COLOR ] =
+              aDirectory + GetArgument( cursor + 6, lineEnd );
+      }
+
+      line = lineEnd + 1;
+    }
+  }
+
+  uint64 HashCorner( const ObjCorner & aCorner ) {
+    uint64 hash = ( uint64 ) aCorner.myPosition * 0x9E3779B97F4A7C15ull;
+    hash ^= ( hash >> 32 ) ^ ( ( uint64 ) aCorner.myUv * 0xC2B2AE3D27D4EB4Full );
+    hash ^= ( hash >> 29 ) ^ ( ( uint64 ) aCorner.myNormal * 0x165667B19E3779F9ull );
+    return hash ^ ( hash >> 32 );
+  }
+
+  bool operator==( const ObjCorner & aLeft, const ObjCorner & aRight ) {
+    return aLeft.myPosition == aRight.myPosition && aLeft.myUv == aRight.myUv && aLeft.myNormal == aRight.myNormal;
+  }
+
+  void WriteVertex( const ObjStreams & someStreams, const ObjCorner & aCorner,
+                    const eastl::fixed_vector< ObjVertexAttribute, 16 > & someAttributes, uint8 * aVertexOut ) {
+    for ( const ObjVertexAttribute & attribute : someAttributes ) {
+      const void * src = nullptr;
+      uint         srcSize = 0u;
+      if ( attribute.mySource == ObjAttributeSource::POSITION ) {
+        src = &someStreams.myPositions[ aCorner.myPosition ];
+        srcSize = sizeof( glm::float3 );
+      } else if ( attribute.mySource == ObjAttributeSource::UV && aCorner.myUv != NO_INDEX ) {
+        src = &someStreams.myUvs[ aCorner.myUv ];
+        srcSize = sizeof( glm::float2 );
+      } else if ( attribute.mySource == ObjAttributeSource::NORMAL && aCorner.myNormal != NO_INDEX ) {
+        src = &someStreams.myNormals[ aCorner.myNormal ];
+        srcSize = sizeof( glm::float3 );
+      }
+
+      const uint copySize = glm::min( srcSize, attribute.mySize );
+      if ( copySize > 0u )
+        memcpy( aVertexOut + attribute.myOffset, src, copySize );
+      if ( copySize < attribute.mySize )
+        memset( aVertexOut + attribute.myOffset + copySize, 0, attribute.mySize - copySize );
+    }
+  }
+
+  // Deduplicates the corners of one mesh into an indexed vertex buffer. The corners are bucketed into shards by their
+  // hash, then every shard deduplicates its corners with its own open-addressing table. Vertices are ordered by shard
+  // and by first use within a shard.
+  void BuildMeshPart( const ObjStreams & someStreams, const ObjCorner * someCorners, uint aNumCorners,
+                      const eastl::fixed_vector< ObjVertexAttribute, 16 > & someAttributes, uint aVertexStride,
+                      CpuThreadPool * aThreadPool, MeshPartData & aPartOut ) {
+    const uint numBlocks = ( aNumCorners + DEDUP_BLOCK_SIZE - 1u ) / DEDUP_BLOCK_SIZE;
+
+    eastl::vector< uint8 > cornerShards( aNumCorners );
+    eastl::vector< uint >  blockShardOffsets( numBlocks * NUM_DEDUP_SHARDS, 0u );
+    RunParallel( aThreadPool, numBlocks, [ & ]( uint aBlockIdx, uint /*aThreadIdx*/ ) {
+      uint *     counts = &blockShardOffsets[ aBlockIdx * NUM_DEDUP_SHARDS ];
+      const uint end = glm::min( ( aBlockIdx + 1u ) * DEDUP_BLOCK_SIZE, aNumCorners );
+      for ( uint i = aBlockIdx * DEDUP_BLOCK_SIZE; i < end; ++i ) {
+        const uint8 shard = ( uint8 ) ( HashCorner( someCorners[ i ] ) >> ( 64u - DEDUP_SHARD_BITS ) );
+        cornerShards[ i ] = shard;
+        ++counts[ shard ];
+      }
+    } );
+
+    // Shard-major order keeps the corners of each shard contiguous and in increasing order
+    uint shardBegins[ NUM_DEDUP_SHARDS + 1u ];
+    uint numCornersBefore = 0u;
+    for ( uint shard = 0u; shard < NUM_DEDUP_SHARDS; ++shard ) {
+      shardBegins[ shard ] = numCornersBefore;
+      for ( uint block = 0u; block < numBlocks; ++block ) {
+        uint & offset = blockShardOffsets[ block * NUM_DEDUP_SHARDS + shard ];
+        const uint count = offset;
+        offset = numCornersBefore;
+        numCornersBefore += count;
+      }
+    }
+    shardBegins[ NUM_DEDUP_SHARDS ] = numCornersBefore;
+
+    eastl::vector< uint > shardCorners( aNumCorners );
+    RunParallel( aThreadPool, numBlocks, [ & ]( uint aBlockIdx, uint /*aThreadIdx*/ ) {
+      uint *     offsets = &blockShardOffsets[ aBlockIdx * NUM_DEDUP_SHARDS ];
+      const uint end = glm::min( ( aBlockIdx + 1u ) * DEDUP_BLOCK_SIZE, aNumCorners );
+      for ( uint i = aBlockIdx * DEDUP_BLOCK_SIZE; i < end; ++i )
+        shardCorners[ offsets[ cornerShards[ i ] ]++ ] = i;
+    } );
+
+    aPartOut.myIndexData.resize( aNumCorners * sizeof( uint ) );
+    uint * indices = reinterpret_cast< uint * >( aPartOut.myIndexData.data() );
+
+    eastl::vector< ObjCorner > shardVertices[ NUM_DEDUP_SHARDS ];
+    RunParallel( aThreadPool, NUM_DEDUP_SHARDS, [ & ]( uint aShardIdx, uint /*aThreadIdx*/ ) {
+      const uint numShardCorners = shardBegins[ aShardIdx + 1u ] - shardBegins[ aShardIdx ];
+      uint       tableSize = 16u;
+      while ( tableSize < numShardCorners * 2u )
+        tableSize *= 2u;
+
+      eastl::vector< uint > table( tableSize, NO_INDEX );  // Vertex index within the shard
+      eastl::vector< ObjCorner > & vertices = shardVertices[ aShardIdx ];
+      for ( uint i = shardBegins[ aShardIdx ]; i < shardBegins[ aShardIdx + 1u ]; ++i ) {
+        const uint        cornerIdx = shardCorners[ i ];
+        const ObjCorner & corner = someCorners[ cornerIdx ];
+
+        uint slot = ( uint ) HashCorner( corner ) & ( tableSize - 1u );
+        while ( table[ slot ] != NO_INDEX && !( vertices[ table[ slot ] ] == corner ) )
+          slot = ( slot + 1u ) & ( tableSize - 1u );
+
+        if ( table[ slot ] == NO_INDEX ) {
+          table[ slot ] = ( uint ) vertices.size();
+          vertices.push_back( corner );
+        }
+        indices[ cornerIdx ] = table[ slot ];
+      }
+    } );
+
+    uint shardFirstVertices[ NUM_DEDUP_SHARDS ];
+    uint numVertices = 0u;
+    for ( uint shard = 0u; shard < NUM_DEDUP_SHARDS; ++shard ) {
+      shardFirstVertices[ shard ] = numVertices;
+      numVertices += ( uint ) shardVertices[ shard ].size();
+    }
+
+    aPartOut.myVertexData.resize( ( uint64 ) numVertices * aVertexStride );
+    uint8 * vertexData = aPartOut.myVertexData.data();
+    RunParallel( aThreadPool, NUM_DEDUP_SHARDS, [ & ]( uint aShardIdx, uint /*aThreadIdx*/ ) {
+      const uint                         firstVertex = shardFirstVertices[ aShardIdx ];
+      const eastl::vector< ObjCorner > & vertices = shardVertices[ aShardIdx ];
+      for ( uint i = 0u; i < ( uint ) vertices.size(); ++i ) {
+        WriteVertex( someStreams, vertices[ i ], someAttributes,
+                     vertexData + ( uint64 ) ( firstVertex + i ) * aVertexStride );
+      }
+
+      for ( uint i = shardBegins[ aShardIdx ]; i < shardBegins[ aShardIdx + 1u ]; ++i )
+        indices[ shardCorners[ i ] ] += firstVertex;
+    } );
+  }
+}  // namespace Priv_ObjImporter
+
+ObjImporter::ObjImporter( CpuThreadPool * aThreadPool )
+  : myThreadPool( aThreadPool ) {
+}
+
+bool ObjImporter::Import( const char * aPath,
+                          const eastl::fixed_vector< VertexShaderAttributeDesc, 16 > & someVertexAttributes,
+                          SceneData & aSceneOut ) {
+  using namespace Priv_ObjImporter;
+
+  myStats = ObjImportStats();
+  aSceneOut = SceneData();
+
+  const float64 startTimeMs = SampleTimeMs();
+
+  const eastl::string absolutePath = Path::GetAbsolutePath( aPath );
+
+  MappedFile file;
+  if ( !file.Open( absolutePath.c_str() ) ) {
+    Log( "ObjImporter: Failed opening %s", aPath );
+    return false;
+  }
+
+  const char * const fileBegin = reinterpret_cast< const char * >( file.GetData() );
+  const char * const fileEnd = fileBegin + file.GetSize();
+  myStats.myFileSize = file.GetSize();
+
+  const uint numThreads = myThreadPool != nullptr ? myThreadPool->GetNumThreads() : 1u;
+  const uint64 maxNumChunks = glm::max( file.GetSize() / MIN_CHUNK_SIZE, ( uint64 ) 1u );
+  const uint   numChunks = ( uint ) glm::min( maxNumChunks, ( uint64 ) ( numThreads * CHUNKS_PER_THREAD ) );
+  eastl::vector< ObjChunk > chunks( numChunks );
+  for ( uint i = 0u; i < numChunks; ++i ) {
+    ObjChunk & chunk = chunks[ i ];
+    chunk.myBegin = i == 0u ? fileBegin : chunks[ i - 1u ].myEnd;
+    chunk.myEnd = i + 1u == numChunks ? fileEnd : fileBegin + file.GetSize() * ( i + 1u ) / numChunks;
+    if ( chunk.myEnd < chunk.myBegin )
+      chunk.myEnd = chunk.myBegin;
+    if ( chunk.myEnd < fileEnd )
+      chunk.myEnd = FindLineEnd( chunk.myEnd, fileEnd );
+    if ( chunk.myEnd < fileEnd )
+      ++chunk.myEnd;
+  }
+  myStats.myNumChunks = numChunks;
+
+  RunParallel( myThreadPool, numChunks,
+               [ & ]( uint aChunkIdx, uint /*aThreadIdx*/ ) { CountChunk( chunks[ aChunkIdx ] ); } );
+
+  ObjChunk totals;
+  for ( ObjChunk & chunk : chunks ) {
+    chunk.myFirstPosition = totals.myNumPositions;
+    chunk.myFirstUv = totals.myNumUvs;
+    chunk.myFirstNormal = totals.myNumNormals;
+    chunk.myFirstTriangle = totals.myNumTriangles;
+    totals.myNumPositions += chunk.myNumPositions;
+    totals.myNumUvs += chunk.myNumUvs;
+    totals.myNumNormals += chunk.myNumNormals;
+    totals.myNumTriangles += chunk.myNumTriangles;
+  }
+
+  ObjStreams streams;
+  streams.myPositions.resize( totals.myNumPositions );
+  streams.myUvs.resize( totals.myNumUvs );
+  streams.myNormals.resize( totals.myNumNormals );
+  streams.myCorners.resize( ( uint64 ) totals.myNumTriangles * 3u );
+
+  RunParallel( myThreadPool, numChunks,
+               [ & ]( uint aChunkIdx, uint /*aThreadIdx*/ ) { ParseChunk( chunks[ aChunkIdx ], streams ); } );
+
+  uint numFaceNormals = 0u;
+  for ( ObjChunk & chunk : chunks ) {
+    if ( chunk.myHasError ) {
+      Log( "ObjImporter: Invalid statement or index in %s", aPath );
+      return false;
+    }
+    chunk.myFirstFaceNormal = totals.myNumNormals + numFaceNormals;
+    numFaceNormals += chunk.myNumFaceNormals;
+  }
+
+  if ( numFaceNormals > 0u ) {
+    streams.myNormals.resize( totals.myNumNormals + numFaceNormals );
+    RunParallel( myThreadPool, numChunks,
+                 [ & ]( uint aChunkIdx, uint /*aThreadIdx*/ ) { AddFaceNormals( chunks[ aChunkIdx ], streams ); } );
+  }
+
+  const eastl::string                    directory = GetDirectory( absolutePath.c_str() );
+  eastl::hash_map< eastl::string, uint > materialIndices;
+  for ( const ObjChunk & chunk : chunks ) {
+    for ( const ObjEvent & event : chunk.myEvents ) {
+      if ( event.myType == ObjEventType::MATERIAL_LIB )
+        LoadMaterialLib( directory + event.myName, directory, aSceneOut.myMaterials, materialIndices );
+    }
+  }
+
+  // Split the triangles into meshes at every group or material change
+  eastl::vector< ObjMeshRange > meshRanges;
+  uint                          defaultMaterialIndex = NO_INDEX;
+  uint                          firstTriangle = 0u;
+  eastl::string                 materialName;
+  bool                          hasMaterial = false;
+  for ( uint i = 0u; i <= numChunks; ++i ) {
+    const uint numEvents = i < numChunks ? ( uint ) chunks[ i ].myEvents.size() : 1u;
+    for ( uint iEvent = 0u; iEvent < numEvents; ++iEvent ) {
+      const ObjEvent * event = i < numChunks ? &chunks[ i ].myEvents[ iEvent ] : nullptr;
+      if ( event != nullptr && event->myType == ObjEventType::MATERIAL_LIB )
+        continue;
+      if ( event != nullptr && event->myType == ObjEventType::MATERIAL && hasMaterial && event->myName == materialName )
+        continue;
+
+      const uint endTriangle = event != nullptr ? event->myFirstTriangle : totals.myNumTriangles;
+      if ( endTriangle > firstTriangle ) {
+        eastl::hash_map< eastl::string, uint >::iterator it = materialIndices.find( materialName );
+        uint                                             materialIndex = NO_INDEX;
+        if ( hasMaterial && it != materialIndices.end() ) {
+          materialIndex = it->second;
+        } else {
+          if ( defaultMaterialIndex == NO_INDEX ) {
+            defaultMaterialIndex = ( uint ) aSceneOut.myMaterials.size();
+            aSceneOut.myMaterials.push_back( CreateMaterial() );
+          }
+          materialIndex = defaultMaterialIndex;
+        }
+        meshRanges.push_back( { firstTriangle, endTriangle - firstTriangle, materialIndex } );
+      }
+      firstTriangle = endTriangle;
+
+      if ( event != nullptr && event->myType == ObjEventType::MATERIAL ) {
+        materialName = event->myName;
+        hasMaterial = true;
+      }
+    }
+  }
+
+  myStats.myParseTimeMs = SampleTimeMs() - startTimeMs;
+
+  VertexInputLayoutProperties &                  layout = aSceneOut.myVertexInputLayoutProperties;
+  eastl::fixed_vector< ObjVertexAttribute, 16 > attributes;
+  uint                                           vertexStride = 0u;
+  for ( const VertexShaderAttributeDesc & shaderAttribute : someVertexAttributes ) {
+    VertexInputAttributeDesc & attributeDesc = layout.myAttributes.push_back();
+    attributeDesc.myFormat = shaderAttribute.myFormat;
+    attributeDesc.mySemantic = shaderAttribute.mySemantic;
+    attributeDesc.mySemanticIndex = shaderAttribute.mySemanticIndex;
+    attributeDesc.myBufferIndex = 0u;
+
+    ObjVertexAttribute & attribute = attributes.push_back();
+    attribute.myOffset = vertexStride;
+    attribute.mySize = BITS_TO_BYTES( DataFormatInfo::GetFormatInfo( shaderAttribute.myFormat ).myBitsPerPixel );
+    attribute.mySource = ObjAttributeSource::NONE;
+    if ( shaderAttribute.mySemanticIndex == 0u ) {
+      if ( shaderAttribute.mySemantic == VertexAttributeSemantic::POSITION )
+        attribute.mySource = ObjAttributeSource::POSITION;
+      else if ( shaderAttribute.mySemantic == VertexAttributeSemantic::TEXCOORD )
+        attribute.mySource = ObjAttributeSource::UV;
+      else if ( shaderAttribute.mySemantic == VertexAttributeSemantic::NORMAL )
+        attribute.mySource = ObjAttributeSource::NORMAL;
+    }
+    vertexStride += attribute.mySize;
+  }
+
+  VertexBufferBindDesc & bufferBinding = layout.myBufferBindings.push_back();
+  bufferBinding.myStride = vertexStride;
+  bufferBinding.myInputRate = VertexInputRate::PER_VERTEX;
+
+  const float64 buildStartTimeMs = SampleTimeMs();
+
+  const uint64 pathHash =
+      MathUtil::ByteHash( reinterpret_cast< const uint8 * >( absolutePath.c_str() ), absolutePath.size() );
+
+  // Meshes are built one after another, each one is parallelized internally
+  aSceneOut.myMeshes.resize( meshRanges.size() );
+  for ( uint iMesh = 0u; iMesh < ( uint ) meshRanges.size(); ++iMesh ) {
+    const ObjMeshRange & range = meshRanges[ iMesh ];
+    MeshData &           mesh = aSceneOut.myMeshes[ iMesh ];
+    mesh.myDesc.myHash = pathHash ^ ( ( uint64 ) iMesh * 0x9E3779B97F4A7C15ull );
+
+    MeshPartData & part = mesh.myParts.push_back();
+    part.myVertexLayoutProperties = layout;
+    BuildMeshPart( streams, &streams.myCorners[ ( uint64 ) range.myFirstTriangle * 3u ], range.myNumTriangles * 3u,
+                   attributes, vertexStride, myThreadPool, part );
+
+    SceneMeshInstance & instance = aSceneOut.myInstances.push_back();
+    instance.myMeshIndex = iMesh;
+    instance.myMaterialIndex = range.myMaterialIndex;
+    instance.myTransform = glm::float4x4( 1.0f );
+
+    myStats.myNumVertices += ( uint ) ( part.myVertexData.size() / vertexStride );
+  }
+
+  myStats.myBuildTimeMs = SampleTimeMs() - buildStartTimeMs;
+  myStats.myNumMeshes = ( uint ) meshRanges.size();
+  myStats.myNumTriangles = totals.myNumTriangles;
+
+  Log( "ObjImporter: %s, %d meshes, %d triangles, %d vertices, %d chunks, parse %.2f ms, build %.2f ms", aPath,
+       myStats.myNumMeshes, myStats.myNumTriangles, myStats.myNumVertices, myStats.myNumChunks, myStats.myParseTimeMs,
+       myStats.myBuildTimeMs );
+  return true;
+}
+
+bool ObjImporter::IsObjFile( const char * aPath ) {
+  const size_t length = strlen( aPath );
+  if ( length < 4u || aPath[ length - 4u ] != '.' )
+    return false;
+
+  const char * extension = aPath + length - 3u;
+  return ( extension[ 0 ] | 0x20 ) == 'o' && ( extension[ 1 ] | 0x20 ) == 'b' && ( extension[ 2 ] | 0x20 ) == 'j';
+}
+
+bool ObjImporter::WriteReplicatedObj( const char * aSourcePath, const char * aDestPath, uint aNumCopies ) {
+  using namespace Priv_ObjImporter;
+
+  MappedFile source;
+  if ( !source.Open( Path::GetAbsolutePath( aSourcePath ).c_str() ) )
+    return false;
+
+  const char * const           sourceEnd = reinterpret_cast< const char * >( source.GetData() ) + source.GetSize();
+  eastl::vector< glm::float3 > positions;
+  eastl::vector< eastl::string > uvLines;
+  eastl::vector< eastl::string > normalLines;
+  eastl::vector< eastl::string > otherLines;  // Faces and statements, in file order
+  for ( const char * line = reinterpret_cast< const char * >( source.GetData() ); line < sourceEnd; ) {
+    const char *        lineEnd = FindLineEnd( line, sourceEnd );
+    const char *        cursor = SkipSpaces( line, lineEnd );
+    const eastl::string lineString = GetArgument( cursor, lineEnd );
+    if ( IsStatement( cursor, lineEnd, "v" ) ) {
+      glm::float3 & position = positions.push_back();
+      position = glm::float3( 0.0f );
+      ParseFloats( cursor + 1, lineEnd, &position.x, 3u );
+    } else if ( IsStatement( cursor, lineEnd, "vt" ) ) {
+      uvLines.push_back( lineString );
+    } else if ( IsStatement( cursor, lineEnd, "vn" ) ) {
+      normalLines.push_back( lineString );
+    } else if ( !lineString.empty() ) {
+      otherLines.push_back( lineString );
+    }
+    line = lineEnd + 1;
+  }
+
+  glm::float3 extent( 0.0f );
+  if ( !positions.empty() ) {
+    glm::float3 minPos = positions[ 0 ];
+    glm::float3 maxPos = positions[ 0 ];
+    for ( const glm::float3 & position : positions ) {
+      minPos = glm::min( minPos, position );
+      maxPos = glm::max( maxPos, position );
+    }
+    extent = ( maxPos - minPos ) * 1.1f;
+  }
+
+  FILE * dest = fopen( aDestPath, "wb" );
+  if ( dest == nullptr )
+    return false;
+
+  // Copies are placed on a grid with side length gridSize
+  uint gridSize = 1u;
+  while ( gridSize * gridSize * gridSize < aNumCopies )
+    ++gridSize;
+
+  for ( uint copy = 0u; copy < aNumCopies; ++copy ) {
+    const glm::float3 offset =
+        extent * glm::float3( ( float ) ( copy % gridSize ), ( float ) ( ( copy / gridSize ) % gridSize ),
+                              ( float ) ( copy / ( gridSize * gridSize ) ) );
+    for ( const glm::float3 & position : positions )
+      fprintf( dest, "v %f %f %f\n", position.x + offset.x, position.y + offset.y, position.z + offset.z );
+  }
+  for ( uint copy = 0u; copy < aNumCopies; ++copy ) {
+    for ( const eastl::string & uvLine : uvLines )
+      fprintf( dest, "%s\n", uvLine.c_str() );
+    for ( const eastl::string & normalLine : normalLines )
+      fprintf( dest, "%s\n", normalLine.c_str() );
+  }
+
+  bool isValid = true;
+  for ( const eastl::string & otherLine : otherLines ) {
+    const char * lineBegin = otherLine.c_str();
+    const char * lineEnd = lineBegin + otherLine.size();
+    if ( !IsStatement( lineBegin, lineEnd, "f" ) ) {
+      fprintf( dest, "%s\n", lineBegin );
+      continue;
+    }
+
+    for ( uint copy = 0u; copy < aNumCopies; ++copy ) {
+      const uint indexOffsets[] = { copy * ( uint ) positions.size(), copy * ( uint ) uvLines.size(),
+                                    copy * ( uint ) normalLines.size() };
+      fputc( 'f', dest );
+      for ( const char * cursor = SkipSpaces( lineBegin + 1, lineEnd ); cursor < lineEnd;
+            cursor = SkipSpaces( cursor, lineEnd ) ) {
+        const char * tokenEnd = FindTokenEnd( cursor, lineEnd );
+        fputc( ' ', dest );
+        for ( uint component = 0u; cursor < tokenEnd && component < 3u; ++component ) {
+          int index;
+          if ( *cursor != '/' ) {
+            isValid &= ParseInt( cursor, tokenEnd, index ) && index > 0;
+            fprintf( dest, "%u", ( uint ) index + indexOffsets[ component ] );
+          }
+          if ( cursor < tokenEnd && *cursor == '/' ) {
+            fputc( '/', dest );
+            ++cursor;
+          }
+        }
+        cursor = tokenEnd;
+      }
+      fputc( '\n', dest );
+    }
+  }
+
+  isValid &= fclose( dest ) == 0;
+  return isValid;
+}
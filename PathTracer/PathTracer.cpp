@@ -1,9 +1,16 @@
 #include "PathTracer.h"
 
-#include <chrono>
+#include <EASTL/algorithm.h>
+
 #include "imgui.h"
 #include "imgui_impl_fancy.h"
+#include "CpuPathTracer.h"
+#include "CpuTextureCache.h"
+#include "LinearAllocator.h"
+#include "ProcessStats.h"
+#include "SceneCache.h"
 #include "Sky.h"
+#include "Timing.h"
 #include "Common/Ptr.h"
 #include "Common/StringUtil.h"
 #include "Common/Window.h"
@@ -25,11 +32,6 @@
 
 using namespace Fancy;
 
-static float64 SampleTimeMs() {
-  const std::chrono::duration< float64, std::milli > now( std::chrono::system_clock::now().time_since_epoch() );
-  return now.count();
-}
-
 struct SceneLoadInfo {
   eastl::fixed_string< char, 64, false >  myDisplayName;
   eastl::fixed_string< char, 256, false > myPath;
@@ -38,11 +40,43 @@ struct SceneLoadInfo {
 
 SceneLoadInfo sceneLoadInfos[] = {
   { "Cornell Box", "resources/models/CornellBox.obj", glm::float3( 1.0f, 102.0f, -30.0f ) },
+  { "Cycles Cornell Box", "resources/models/Cycles.obj", glm::float3( 0.0f, 0.0f, -1000.0f ) },
   { "Epic Sun Temple", "resources/models/SunTemple_v4/SunTemple/SunTemple_Reduced.fbx",
     glm::float3( -13.0f, 513.7f, -1191.5f ) },
 };
 
+namespace Priv_PathTracer {
+  void ShowMemoryReport( const char * aName, const RtMemoryReport & aReport ) {
+    const float toKiB = 1.0f / 1024.0f;
+    if ( !ImGui::TreeNode( aName, "%s: %.1f KiB", aName, ( float ) aReport.GetTotalSize() * toKiB ) )
+      return;
+
+    ImGui::Text( "Meshes: %u, %.1f KiB (%.1f KiB saved by sharing)", ( uint ) aReport.myMeshes.size(),
+                 ( float ) aReport.GetMeshesSize() * toKiB, ( float ) aReport.GetDeduplicatedSize() * toKiB );
+    ImGui::Text( "TLAS: %.1f KiB, instances %.1f KiB", ( float ) aReport.myTlasSize * toKiB,
+                 ( float ) aReport.myInstanceSize * toKiB );
+    for ( uint iMesh = 0u; iMesh < ( uint ) aReport.myMeshes.size(); ++iMesh ) {
+      const RtMeshMemory & meshMemory = aReport.myMeshes[ iMesh ];
+      ImGui::Text( "Mesh %u: BLAS %.1f KiB, vertices %.1f KiB, indices %.1f KiB, %u instances", iMesh,
+                   ( float ) meshMemory.myBlasSize * toKiB, ( float ) meshMemory.myVertexSize * toKiB,
+                   ( float ) meshMemory.myIndexSize * toKiB, meshMemory.myNumInstances );
+    }
+    ImGui::TreePop();
+  }
+
+  void DeleteRetiredResource( RetiredRtResource & aResource ) {
+    if ( aResource.myTlas.IsValid() )
+      RenderCore::DeleteRtAccelerationStructure( aResource.myTlas );
+    if ( aResource.myBufferView.IsValid() )
+      RenderCore::DeleteBufferView( aResource.myBufferView );
+    if ( aResource.myBuffer.IsValid() )
+      RenderCore::DeleteBuffer( aResource.myBuffer );
+  }
+}  // namespace Priv_PathTracer
+
 RaytracingScene::~RaytracingScene() {
+  using namespace Priv_PathTracer;
+
   for ( BlasData & blas : myBlasDatas ) {
     if ( blas.myVertexData.IsValid() )
       RenderCore::DeleteBufferView( blas.myVertexData );
@@ -52,9 +86,17 @@ RaytracingScene::~RaytracingScene() {
       RenderCore::DeleteBufferView( blas.myTriangleIndices );
     if ( blas.myTriangleIndicesBuf.IsValid() )
       RenderCore::DeleteBuffer( blas.myTriangleIndicesBuf );
+    if ( blas.myPositions.IsValid() )
+      RenderCore::DeleteBufferView( blas.myPositions );
+    if ( blas.myPositionsBuf.IsValid() )
+      RenderCore::DeleteBuffer( blas.myPositionsBuf );
     if ( blas.myBLAS.IsValid() )
       RenderCore::DeleteRtAccelerationStructure( blas.myBLAS );
   }
+  for ( TextureViewHandle & view : myBaseColorTextureViews )
+    RenderCore::DeleteTextureView( view );
+  for ( TextureHandle & texture : myBaseColorTextures )
+    RenderCore::DeleteTexture( texture );
   if ( myInstanceData.IsValid() )
     RenderCore::DeleteBufferView( myInstanceData );
   if ( myInstanceDataBuf.IsValid() )
@@ -63,10 +105,11 @@ RaytracingScene::~RaytracingScene() {
     RenderCore::DeleteBufferView( myMaterialData );
   if ( myMaterialDataBuf.IsValid() )
     RenderCore::DeleteBuffer( myMaterialDataBuf );
-  if ( myHaltonSamples.IsValid() )
-    RenderCore::DeleteBufferView( myHaltonSamples );
-  if ( myHaltonSamplesBuf.IsValid() )
-    RenderCore::DeleteBuffer( myHaltonSamplesBuf );
+  if ( mySamplerTable.IsValid() )
+    RenderCore::DeleteBufferView( mySamplerTable );
+  if ( mySamplerTableBuf.IsValid() )
+    RenderCore::DeleteBuffer( mySamplerTableBuf );
+  DeleteLightBuffers();
   // RtPipelineState is a cached resource; not owned
   if ( mySBT.IsValid() )
     RenderCore::DeleteRtShaderBindingTable( mySBT );
@@ -74,6 +117,100 @@ RaytracingScene::~RaytracingScene() {
     RenderCore::DeleteRtShaderBindingTable( myAoSBT );
   if ( myTLAS.IsValid() )
     RenderCore::DeleteRtAccelerationStructure( myTLAS );
+  for ( RetiredRtResource & resource : myRetiredResources )
+    DeleteRetiredResource( resource );
+}
+
+void RaytracingScene::DeleteLightBuffers() {
+  if ( myLightTriangles.IsValid() )
+    RenderCore::DeleteBufferView( myLightTriangles );
+  if ( myLightTrianglesBuf.IsValid() )
+    RenderCore::DeleteBuffer( myLightTrianglesBuf );
+  if ( myLightInstanceOffsets.IsValid() )
+    RenderCore::DeleteBufferView( myLightInstanceOffsets );
+  if ( myLightInstanceOffsetsBuf.IsValid() )
+    RenderCore::DeleteBuffer( myLightInstanceOffsetsBuf );
+  if ( myLightBvh.IsValid() )
+    RenderCore::DeleteBufferView( myLightBvh );
+  if ( myLightBvhBuf.IsValid() )
+    RenderCore::DeleteBuffer( myLightBvhBuf );
+  myLightTriangles = GpuBufferViewHandle();
+  myLightTrianglesBuf = GpuBufferHandle();
+  myLightInstanceOffsets = GpuBufferViewHandle();
+  myLightInstanceOffsetsBuf = GpuBufferHandle();
+  myLightBvh = GpuBufferViewHandle();
+  myLightBvhBuf = GpuBufferHandle();
+}
+
+void RaytracingScene::RetireLightBuffers() {
+  const RetiredRtResource lightBuffers[] = {
+    { RtAccelerationStructureHandle(), myLightTrianglesBuf, myLightTriangles, Time::ourFrameIdx },
+    { RtAccelerationStructureHandle(), myLightInstanceOffsetsBuf, myLightInstanceOffsets, Time::ourFrameIdx },
+    { RtAccelerationStructureHandle(), myLightBvhBuf, myLightBvh, Time::ourFrameIdx },
+  };
+  for ( const RetiredRtResource & resource : lightBuffers ) {
+    if ( resource.myBuffer.IsValid() || resource.myBufferView.IsValid() )
+      myRetiredResources.push_back( resource );
+  }
+
+  myLightTriangles = GpuBufferViewHandle();
+  myLightTrianglesBuf = GpuBufferHandle();
+  myLightInstanceOffsets = GpuBufferViewHandle();
+  myLightInstanceOffsetsBuf = GpuBufferHandle();
+  myLightBvh = GpuBufferViewHandle();
+  myLightBvhBuf = GpuBufferHandle();
+}
+
+void RaytracingScene::UpdateInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                                                uint aNumInstances ) {
+  for ( uint i = 0u; i < aNumInstances; ++i )
+    myTlasInstances[ someInstanceIndices[ i ] ].myTransform = someTransforms[ i ];
+
+  // RenderCore only builds acceleration structures on creation, so the TLAS is replaced
+  RetiredRtResource & retiredTlas = myRetiredResources.push_back();
+  retiredTlas.myTlas = myTLAS;
+  retiredTlas.myFrameIdx = Time::ourFrameIdx;
+  myTLAS = RenderCore::CreateRtTopLevelAccelerationStructure( myTlasInstances.data(), ( uint ) myTlasInstances.size(),
+                                                              0, "TLAS" );
+}
+
+void RaytracingScene::DeleteRetiredResources() {
+  using namespace Priv_PathTracer;
+
+  // Comfortably more than the frames RenderCore keeps in flight
+  const uint64 RETIRED_RESOURCE_LIFETIME_FRAMES = 8u;
+
+  uint numKept = 0u;
+  for ( uint i = 0u; i < ( uint ) myRetiredResources.size(); ++i ) {
+    if ( Time::ourFrameIdx >= myRetiredResources[ i ].myFrameIdx + RETIRED_RESOURCE_LIFETIME_FRAMES )
+      DeleteRetiredResource( myRetiredResources[ i ] );
+    else
+      myRetiredResources[ numKept++ ] = myRetiredResources[ i ];
+  }
+  myRetiredResources.resize( numKept );
+}
+
+RtMemoryReport RaytracingScene::GetMemoryReport( const RtMemoryReport & aCpuReport ) const {
+  ASSERT( aCpuReport.myMeshes.size() == myBlasDatas.size() );
+
+  RtMemoryReport report;
+  report.myMeshes.resize( myBlasDatas.size() );
+  for ( uint iMesh = 0u; iMesh < ( uint ) myBlasDatas.size(); ++iMesh ) {
+    const BlasData & blasData = myBlasDatas[ iMesh ];
+    RtMeshMemory &   meshMemory = report.myMeshes[ iMesh ];
+    meshMemory.myBlasSize =
+        RenderCore::GetRtAccelerationStructure( blasData.myBLAS )->GetBufferRead()->GetBuffer()->GetByteSize();
+    meshMemory.myVertexSize = RenderCore::GetBuffer( blasData.myVertexDataBuf )->GetByteSize();
+    if ( blasData.myPositionsBuf.IsValid() )
+      meshMemory.myVertexSize += RenderCore::GetBuffer( blasData.myPositionsBuf )->GetByteSize();
+    meshMemory.myIndexSize = RenderCore::GetBuffer( blasData.myTriangleIndicesBuf )->GetByteSize();
+    meshMemory.myNumSceneMeshes = aCpuReport.myMeshes[ iMesh ].myNumSceneMeshes;
+    meshMemory.myNumInstances = aCpuReport.myMeshes[ iMesh ].myNumInstances;
+  }
+
+  report.myTlasSize = RenderCore::GetRtAccelerationStructure( myTLAS )->GetBufferRead()->GetBuffer()->GetByteSize();
+  report.myInstanceSize = RenderCore::GetBuffer( myInstanceDataBuf )->GetByteSize();
+  return report;
 }
 
 PathTracer::PathTracer( HINSTANCE anInstanceHandle, const char ** someArguments, uint aNumArguments, const char * aName,
@@ -85,6 +222,8 @@ PathTracer::PathTracer( HINSTANCE anInstanceHandle, const char ** someArguments,
   ImGuiRendering::Init( myRenderOutput );
 
   mySupportsRaytracing = RenderCore::GetPlatformCaps().mySupportsRaytracing;
+  myRenderCpu = !mySupportsRaytracing;
+  myCpuPathTracer.reset( new CpuPathTracer() );
 
   DepthStencilStateProperties dsProps;
   dsProps.myDepthTestEnabled = false;
@@ -107,6 +246,9 @@ PathTracer::PathTracer( HINSTANCE anInstanceHandle, const char ** someArguments,
   myClearTextureShader = RenderCore::CreateComputeShaderPipeline( "resources/shaders/clear_texture.hlsl" );
   ASSERT( myClearTextureShader.IsValid() );
 
+  myTileErrorShader = RenderCore::CreateComputeShaderPipeline( "resources/shaders/compute_tile_error.hlsl" );
+  ASSERT( myTileErrorShader.IsValid() );
+
   InitSky();
 
   LoadScene( sceneLoadInfos[ 0 ].myPath.c_str(), sceneLoadInfos[ 0 ].myCamPos );
@@ -119,15 +261,56 @@ void PathTracer::LoadScene( const char * aPath, const glm::float3 & aCamPos ) {
     { VertexAttributeSemantic::TEXCOORD, 0, DataFormat::RG_32F }
   };
 
-  SceneData    sceneData;
-  MeshImporter importer;
-  const bool   importSuccess = importer.Import( aPath, vertexAttributes, sceneData );
-  if ( !importSuccess ) {
-    Log( "Failed importing scene %s", aPath );
+  // Queued moves refer to the instances of the previous scene
+  myPendingInstanceIndices.clear();
+  myPendingInstanceTransforms.clear();
+
+  const float64 loadStartMs = SampleTimeMs();
+  const uint64  loadStartNumAllocations = GetNumHeapAllocations();
+
+  SceneData  sceneData;
+  SceneCache sceneCache;
+  const bool fromCache = myUseSceneCache &&
+                         sceneCache.Open( aPath, vertexAttributes.data(), ( uint ) vertexAttributes.size() ) &&
+                         sceneCache.ReadScene( sceneData );
+
+  bool importSuccess = fromCache;
+  if ( !fromCache ) {
+    if ( myUseObjImporter && ObjImporter::IsObjFile( aPath ) ) {
+      ObjImporter importer( myCpuPathTracer->GetThreadPool() );
+      importSuccess = importer.Import( aPath, vertexAttributes, sceneData );
+    } else {
+      MeshImporter importer;
+      importSuccess = importer.Import( aPath, vertexAttributes, sceneData );
+    }
+    if ( !importSuccess ) {
+      Log( "Failed importing scene %s", aPath );
+    }
   }
 
-  if ( mySupportsRaytracing )
-    InitRtScene( sceneData );
+  // The GPU scene is built from the streams of the CPU scene
+  myCpuPathTracer->InitScene( sceneData, fromCache ? &sceneCache : nullptr,
+                              myCompactVertexData ? RtVertexFormat::COMPACT : RtVertexFormat::FULL );
+  sceneCache.Close();
+
+  myCpuMemoryReport = myCpuPathTracer->GetScene().GetMemoryReport();
+  myGpuMemoryReport = RtMemoryReport();
+  if ( mySupportsRaytracing ) {
+    InitRtScene( sceneData, myCpuPathTracer->GetScene() );
+    myGpuMemoryReport = myRtScene->GetMemoryReport( myCpuMemoryReport );
+    myGpuMemoryReport.PrintToLog( "GPU" );
+  }
+
+  if ( myUseSceneCache && importSuccess && !fromCache ) {
+    if ( !SceneCache::Write( aPath, vertexAttributes.data(), ( uint ) vertexAttributes.size(), sceneData,
+                             myCpuPathTracer->GetScene() ) )
+      Log( "Failed writing scene cache %s", SceneCache::GetCachePath( aPath ).c_str() );
+  }
+
+  myNumLoadAllocations = GetNumHeapAllocations() - loadStartNumAllocations;
+  Log( "Loaded scene %s from %s in %.2f ms, peak RSS %.1f MiB, %u heap allocations", aPath,
+       fromCache ? "cache" : "source", SampleTimeMs() - loadStartMs,
+       ( float ) GetPeakResidentMemory() / ( 1024.0f * 1024.0f ), ( uint ) myNumLoadAllocations );
 
   myScene = eastl::make_shared< Scene >( sceneData );
 
@@ -148,128 +331,149 @@ void PathTracer::LoadScene( const char * aPath, const glm::float3 & aCamPos ) {
   myCamera.UpdateProjection();
 }
 
-void PathTracer::InitSky() {
-  SkyParameters skyParams;
-  mySky.reset( new Sky( skyParams ) );
-}
-
-glm::uvec2 GetOffsetSize( const VertexInputLayoutProperties & someVertexProps, VertexAttributeSemantic aSemantic,
-                          uint aSemanticIndex ) {
-  uint offset = 0;
-  for ( const VertexInputAttributeDesc & attribute : someVertexProps.myAttributes ) {
-    uint size = BITS_TO_BYTES( DataFormatInfo::GetFormatInfo( attribute.myFormat ).myBitsPerPixel );
-    if ( attribute.mySemantic == aSemantic && attribute.mySemanticIndex == aSemanticIndex ) {
-      return { offset, size };
-    }
-    offset += size;
-  }
+void PathTracer::RunObjImportBenchmark() {
+  const uint NUM_COPIES = 280000u;  // 36 triangles each
 
-  ASSERT( false );
-  return glm::uvec2( 0, 0 );
-}
+  // Next to the source, so the mtllib statement still resolves
+  const char * sourcePath = "resources/models/CornellBox.obj";
+  const char * benchmarkPath = "resources/models/CornellBox_Benchmark.obj";
 
-void PathTracer::InitRtScene( const SceneData & aScene ) {
-  myRtScene.reset( new RaytracingScene() );
+  eastl::fixed_vector< VertexShaderAttributeDesc, 16 > vertexAttributes = {
+    { VertexAttributeSemantic::POSITION, 0, DataFormat::RGB_32F },
+    { VertexAttributeSemantic::NORMAL, 0, DataFormat::RGB_32F },
+    { VertexAttributeSemantic::TEXCOORD, 0, DataFormat::RG_32F }
+  };
 
-  myRtScene->myBlasDatas.reserve( aScene.myMeshes.size() );
+  myObjImportBenchmark = ObjImportBenchmarkResults();
 
-  for ( uint iMesh = 0u; iMesh < ( uint ) aScene.myMeshes.size(); ++iMesh ) {
-    const MeshData & mesh = aScene.myMeshes[ iMesh ];
+  const eastl::string absoluteBenchmarkPath = Path::GetAbsolutePath( benchmarkPath );
+  if ( !ObjImporter::WriteReplicatedObj( sourcePath, absoluteBenchmarkPath.c_str(), NUM_COPIES ) ) {
+    Log( "Failed writing OBJ benchmark file %s", absoluteBenchmarkPath.c_str() );
+    remove( absoluteBenchmarkPath.c_str() );
+    return;
+  }
 
-    eastl::fixed_vector< RtAccelerationStructureGeometryData, 4 > meshPartsGeometryDatas;
+  // One import at a time to keep the peak memory down
+  {
+    SceneData     sceneData;
+    MeshImporter  importer;
+    const float64 startMs = SampleTimeMs();
+    myObjImportBenchmark.myMeshImporterSuccess = importer.Import( benchmarkPath, vertexAttributes, sceneData );
+    myObjImportBenchmark.myMeshImporterTimeMs = SampleTimeMs() - startMs;
+  }
 
-    uint numMeshVertices = 0u;
-    uint numMeshTriangles = 0u;
+  {
+    SceneData     sceneData;
+    ObjImporter   importer( myCpuPathTracer->GetThreadPool() );
+    const float64 startMs = SampleTimeMs();
+    myObjImportBenchmark.myObjImporterSuccess = importer.Import( benchmarkPath, vertexAttributes, sceneData );
+    myObjImportBenchmark.myObjImporterTimeMs = SampleTimeMs() - startMs;
+    myObjImportBenchmark.myObjImporterStats = importer.GetStats();
+  }
 
-    for ( const MeshPartData & meshPart : mesh.myParts ) {
-      const VertexInputLayoutProperties & vertexProps = meshPart.myVertexLayoutProperties;
-      ASSERT( !vertexProps.myAttributes.empty() &&
-              vertexProps.myAttributes[ 0 ].mySemantic ==
-                  VertexAttributeSemantic::POSITION );  // Assume there is no offset from the start of the vertex data
-                                                        // to the first position
-      ASSERT( vertexProps.myBufferBindings.size() == 1u );  // Assume the mesh is using only one interleaved buffer
+  remove( absoluteBenchmarkPath.c_str() );
+  myHasObjImportBenchmark = true;
 
-      const uint numVertices = VECTOR_BYTESIZE( meshPart.myVertexData ) / vertexProps.GetOverallVertexSize();
+  const ObjImportBenchmarkResults & bench = myObjImportBenchmark;
+  Log( "OBJ import benchmark (%u triangles, %.1f MiB): MeshImporter %.2f ms, ObjImporter %.2f ms",
+       bench.myObjImporterStats.myNumTriangles, ( float ) bench.myObjImporterStats.myFileSize / ( 1024.0f * 1024.0f ),
+       bench.myMeshImporterTimeMs, bench.myObjImporterTimeMs );
+}
 
-      RtAccelerationStructureGeometryData & geometryData = meshPartsGeometryDatas.push_back();
-      geometryData.myType = RtAccelerationStructureGeometryType::TRIANGLES;
-      geometryData.myFlags = ( uint ) RtAccelerationStructureGeometryFlags::OPAQUE_GEOMETRY;
-      geometryData.myVertexFormat = vertexProps.myAttributes[ 0 ].myFormat;
-      geometryData.myNumVertices = numVertices;
-      geometryData.myVertexData.myType = RT_BUFFER_DATA_TYPE_CPU_DATA;
-      geometryData.myVertexStride = vertexProps.GetOverallVertexSize();
-      geometryData.myVertexData.myCpuData.myData = meshPart.myVertexData.data();
-      geometryData.myVertexData.myCpuData.myDataSize = VECTOR_BYTESIZE( meshPart.myVertexData );
+void PathTracer::InitSky() {
+  SkyParameters skyParams;
+  mySky.reset( new Sky( skyParams ) );
+}
 
-      geometryData.myIndexFormat = DataFormat::R_32UI;
-      geometryData.myNumIndices = VECTOR_BYTESIZE( meshPart.myIndexData ) / sizeof( uint );
-      geometryData.myIndexData.myType = RT_BUFFER_DATA_TYPE_CPU_DATA;
-      geometryData.myIndexData.myCpuData.myData = meshPart.myIndexData.data();
-      geometryData.myIndexData.myCpuData.myDataSize = VECTOR_BYTESIZE( meshPart.myIndexData );
+void PathTracer::InitRtScene( const SceneData & aScene, const CpuRtScene & aCpuScene ) {
+  myRtScene.reset( new RaytracingScene() );
 
-      numMeshVertices += numVertices;
-      numMeshTriangles += geometryData.myNumIndices / 3;
-    }
+  myRtScene->myBlasDatas.reserve( aCpuScene.myMeshes.size() );
 
-    struct VertexData {
-      glm::float3 myNormal;
-      glm::float2 myUv;
-    };
+  eastl::vector< uint > materialTextures;
+  InitRtTextures( aScene, materialTextures );
 
-    glm::uvec2 normalOffsetSize =
-        GetOffsetSize( aScene.myVertexInputLayoutProperties, VertexAttributeSemantic::NORMAL, 0u );
-    glm::uvec2 uvOffsetSize =
-        GetOffsetSize( aScene.myVertexInputLayoutProperties, VertexAttributeSemantic::TEXCOORD, 0u );
-    ASSERT( normalOffsetSize.y == sizeof( glm::float3 ) );
-    ASSERT( uvOffsetSize.y == sizeof( glm::float2 ) );
-
-    eastl::vector< VertexData > vertexData;
-    vertexData.reserve( numMeshVertices );
-
-    eastl::vector< glm::uvec3 > triangleIndices;
-    triangleIndices.resize( numMeshTriangles );
-    glm::uvec3 * dstTrianglePtr = triangleIndices.data();
-
-    for ( const MeshPartData & meshPart : mesh.myParts ) {
-      const VertexInputLayoutProperties & vertexProps = meshPart.myVertexLayoutProperties;
-
-      const uint    srcVertexStride = vertexProps.GetOverallVertexSize();
-      const uint    numVertices = VECTOR_BYTESIZE( meshPart.myVertexData ) / srcVertexStride;
-      const uint8 * srcData = meshPart.myVertexData.data();
-      for ( uint i = 0u; i < numVertices; ++i ) {
-        VertexData & dstData = vertexData.push_back();
-        memcpy( &dstData.myNormal, srcData + normalOffsetSize.x, sizeof( dstData.myNormal ) );
-        memcpy( &dstData.myUv, srcData + uvOffsetSize.x, sizeof( dstData.myUv ) );
-        srcData += srcVertexStride;
-      }
+  // The closest hits of textured instances read the positions of the hit triangle for the texture LOD
+  eastl::vector< bool > meshNeedsPositions( aCpuScene.myMeshes.size(), false );
+  for ( const CpuRtInstance & instance : aCpuScene.myInstances ) {
+    if ( materialTextures[ instance.myMaterialIndex ] != UINT_MAX )
+      meshNeedsPositions[ instance.myMeshIndex ] = true;
+  }
 
-      memcpy( dstTrianglePtr, meshPart.myIndexData.data(), VECTOR_BYTESIZE( meshPart.myIndexData ) );
-      dstTrianglePtr += VECTOR_BYTESIZE( meshPart.myIndexData );
-    }
+  // The merged streams of the CPU scene are uploaded and built as they are. They live in a single arena or in the
+  // mapped scene cache, so there is no intermediate copy. Each mesh is one geometry, which keeps PrimitiveIndex()
+  // equal to the index into the merged triangle stream for meshes with several parts. Identical meshes of the scene
+  // are already merged into one CPU mesh, so they share the BLAS and the buffers.
+  for ( uint iMesh = 0u; iMesh < ( uint ) aCpuScene.myMeshes.size(); ++iMesh ) {
+    const CpuRtMesh & mesh = aCpuScene.myMeshes[ iMesh ];
+
+    RtAccelerationStructureGeometryData geometryData;
+    geometryData.myType = RtAccelerationStructureGeometryType::TRIANGLES;
+    geometryData.myFlags = ( uint ) RtAccelerationStructureGeometryFlags::OPAQUE_GEOMETRY;
+    geometryData.myVertexFormat = DataFormat::RGB_32F;
+    geometryData.myNumVertices = mesh.myPositions.mySize;
+    geometryData.myVertexData.myType = RT_BUFFER_DATA_TYPE_CPU_DATA;
+    geometryData.myVertexStride = sizeof( glm::float3 );
+    geometryData.myVertexData.myCpuData.myData = mesh.myPositions.myData;
+    geometryData.myVertexData.myCpuData.myDataSize = mesh.myPositions.GetByteSize();
+
+    geometryData.myIndexFormat = DataFormat::R_32UI;
+    geometryData.myNumIndices = mesh.myTriangles.mySize * 3u;
+    geometryData.myIndexData.myType = RT_BUFFER_DATA_TYPE_CPU_DATA;
+    geometryData.myIndexData.myCpuData.myData = mesh.myTriangles.myData;
+    geometryData.myIndexData.myCpuData.myDataSize = mesh.myTriangles.GetByteSize();
 
     BlasData & blasData = myRtScene->myBlasDatas.push_back();
 
+    // The shaders read the streams of the vertex format given by the flags of the instance, the BLAS build always
+    // takes the 32-bit indices
+    const uint vertexFlags = mesh.GetVertexFlags();
+
     GpuBufferProperties bufferProps;
     bufferProps.myBindFlags = ( uint ) GpuBufferBindFlags::SHADER_BUFFER;
-    bufferProps.myNumElements = numMeshVertices;
-    bufferProps.myElementSizeBytes = sizeof( VertexData );
     GpuBufferViewProperties bufferViewProps;
     bufferViewProps.myIsRaw = true;
     StaticString< 64 > name( "Rt mesh vertexData %d", iMesh );
-    blasData.myVertexDataBuf = RenderCore::CreateBuffer( bufferProps, name.GetBuffer(), vertexData.data() );
+    if ( vertexFlags & RT_VERTEX_FLAG_COMPACT ) {
+      bufferProps.myNumElements = mesh.myCompactVertexData.mySize;
+      bufferProps.myElementSizeBytes = sizeof( CpuRtCompactVertexData );
+      blasData.myVertexDataBuf =
+          RenderCore::CreateBuffer( bufferProps, name.GetBuffer(), mesh.myCompactVertexData.myData );
+    } else {
+      bufferProps.myNumElements = mesh.myVertexData.mySize;
+      bufferProps.myElementSizeBytes = sizeof( CpuRtVertexData );
+      blasData.myVertexDataBuf = RenderCore::CreateBuffer( bufferProps, name.GetBuffer(), mesh.myVertexData.myData );
+    }
     blasData.myVertexData = RenderCore::CreateBufferView( RenderCore::GetBuffer( blasData.myVertexDataBuf ),
                                                           bufferViewProps, name.GetBuffer() );
 
-    bufferProps.myNumElements = numMeshTriangles;
-    bufferProps.myElementSizeBytes = sizeof( glm::uvec3 );
     name.Format( "Rt mesh triangles %d", iMesh );
-    blasData.myTriangleIndicesBuf = RenderCore::CreateBuffer( bufferProps, name.GetBuffer(), triangleIndices.data() );
+    if ( vertexFlags & RT_VERTEX_FLAG_INDEX16 ) {
+      // Raw buffers are addressed in uints, the stream is padded to a multiple of them
+      bufferProps.myNumElements = ( uint ) ( mesh.myCompactTriangles.GetByteSize() / sizeof( uint ) );
+      bufferProps.myElementSizeBytes = sizeof( uint );
+      blasData.myTriangleIndicesBuf =
+          RenderCore::CreateBuffer( bufferProps, name.GetBuffer(), mesh.myCompactTriangles.myData );
+    } else {
+      bufferProps.myNumElements = mesh.myTriangles.mySize;
+      bufferProps.myElementSizeBytes = sizeof( glm::uvec3 );
+      blasData.myTriangleIndicesBuf =
+          RenderCore::CreateBuffer( bufferProps, name.GetBuffer(), mesh.myTriangles.myData );
+    }
     blasData.myTriangleIndices = RenderCore::CreateBufferView( RenderCore::GetBuffer( blasData.myTriangleIndicesBuf ),
                                                                bufferViewProps, name.GetBuffer() );
 
+    if ( meshNeedsPositions[ iMesh ] ) {
+      name.Format( "Rt mesh positions %d", iMesh );
+      bufferProps.myNumElements = mesh.myPositions.mySize;
+      bufferProps.myElementSizeBytes = sizeof( glm::float3 );
+      blasData.myPositionsBuf = RenderCore::CreateBuffer( bufferProps, name.GetBuffer(), mesh.myPositions.myData );
+      blasData.myPositions = RenderCore::CreateBufferView( RenderCore::GetBuffer( blasData.myPositionsBuf ),
+                                                           bufferViewProps, name.GetBuffer() );
+    }
+
     name.Format( "BLAS mesh %d", iMesh );
-    blasData.myBLAS = RenderCore::CreateRtBottomLevelAccelerationStructure(
-        meshPartsGeometryDatas.data(), meshPartsGeometryDatas.size(), 0u, name.GetBuffer() );
+    blasData.myBLAS = RenderCore::CreateRtBottomLevelAccelerationStructure( &geometryData, 1u, 0u, name.GetBuffer() );
     ASSERT( blasData.myBLAS.IsValid() );
   }
 
@@ -277,28 +481,46 @@ void PathTracer::InitRtScene( const SceneData & aScene ) {
     uint myIndexBufferDescriptorIndex;
     uint myVertexBufferDescriptorIndex;
     uint myMaterialIndex;
+    uint myVertexFlags;  // RtVertexFlags of the mesh
+    uint myPositionBufferDescriptorIndex;  // UINT_MAX without textures
   };
-  eastl::vector< PerInstanceData > perInstanceDatas;
+  struct MaterialData {
+    glm::float3 myEmission;
+    uint        myColor;
+    uint        myBaseColorTextureIndex;  // UINT_MAX without
+  };
+
+  // The upload data only lives until the buffers are created, so it comes from a single chunk, with some slack for the
+  // alignment of the two arrays
+  LinearAllocator            uploadArena( aScene.myInstances.size() * sizeof( PerInstanceData ) +
+                                          aScene.myMaterials.size() * sizeof( MaterialData ) + 64u );
+  const LinearEastlAllocator uploadAllocator( &uploadArena );
+
+  LinearVector< PerInstanceData > perInstanceDatas( uploadAllocator );
   perInstanceDatas.reserve( ( uint ) aScene.myInstances.size() );
 
-  eastl::fixed_vector< RtAccelerationStructureInstanceData, 16 > instanceDatas;
+  eastl::vector< RtAccelerationStructureInstanceData > & instanceDatas = myRtScene->myTlasInstances;
+  instanceDatas.reserve( aScene.myInstances.size() );
   for ( uint iInstance = 0u; iInstance < ( uint ) aScene.myInstances.size(); ++iInstance ) {
     const SceneMeshInstance & instance = aScene.myInstances[ iInstance ];
+    const uint                meshIndex = aCpuScene.myInstances[ iInstance ].myMeshIndex;
+    const BlasData &          blasData = myRtScene->myBlasDatas[ meshIndex ];
 
     PerInstanceData & perInstanceData = perInstanceDatas.push_back();
     perInstanceData.myMaterialIndex = instance.myMaterialIndex;
+    perInstanceData.myVertexFlags = aCpuScene.myMeshes[ meshIndex ].GetVertexFlags();
     perInstanceData.myIndexBufferDescriptorIndex =
-        RenderCore::GetBufferView( myRtScene->myBlasDatas[ instance.myMeshIndex ].myTriangleIndices )
-            ->GetGlobalDescriptorIndex();
+        RenderCore::GetBufferView( blasData.myTriangleIndices )->GetGlobalDescriptorIndex();
     perInstanceData.myVertexBufferDescriptorIndex =
-        RenderCore::GetBufferView( myRtScene->myBlasDatas[ instance.myMeshIndex ].myVertexData )
-            ->GetGlobalDescriptorIndex();
+        RenderCore::GetBufferView( blasData.myVertexData )->GetGlobalDescriptorIndex();
+    perInstanceData.myPositionBufferDescriptorIndex =
+        blasData.myPositions.IsValid() ? RenderCore::GetBufferView( blasData.myPositions )->GetGlobalDescriptorIndex()
+                                       : UINT_MAX;
 
     RtAccelerationStructureInstanceData & instanceData = instanceDatas.push_back();
     instanceData.myInstanceId = iInstance;
     instanceData.mySbtHitGroupOffset = 0;
-    instanceData.myInstanceBLAS =
-        RenderCore::GetRtAccelerationStructure( myRtScene->myBlasDatas[ instance.myMeshIndex ].myBLAS );
+    instanceData.myInstanceBLAS = RenderCore::GetRtAccelerationStructure( blasData.myBLAS );
     instanceData.myInstanceMask = UINT8_MAX;
     instanceData.myTransform = instance.myTransform;
     instanceData.myFlags = RT_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE | RT_INSTANCE_FLAG_FORCE_OPAQUE;
@@ -315,17 +537,15 @@ void PathTracer::InitRtScene( const SceneData & aScene ) {
   myRtScene->myInstanceData = RenderCore::CreateBufferView( RenderCore::GetBuffer( myRtScene->myInstanceDataBuf ),
                                                             bufferViewProps, "Rt per instance data" );
 
-  struct MaterialData {
-    glm::float3 myEmission;
-    uint        myColor;
-  };
-  eastl::vector< MaterialData > materialDatas;
+  LinearVector< MaterialData > materialDatas( uploadAllocator );
   materialDatas.reserve( aScene.myMaterials.size() );
 
-  for ( const MaterialDesc & mat : aScene.myMaterials ) {
-    MaterialData & matData = materialDatas.push_back();
+  for ( uint iMaterial = 0u; iMaterial < ( uint ) aScene.myMaterials.size(); ++iMaterial ) {
+    const MaterialDesc & mat = aScene.myMaterials[ iMaterial ];
+    MaterialData &       matData = materialDatas.push_back();
     matData.myEmission = mat.myParameters[ ( uint ) MaterialParameterType::EMISSION ];
     matData.myColor = MathUtil::Encode_Unorm_RGBA( mat.myParameters[ ( uint ) MaterialParameterType::COLOR ] );
+    matData.myBaseColorTextureIndex = materialTextures[ iMaterial ];
   }
 
   bufferProps.myElementSizeBytes = sizeof( MaterialData );
@@ -375,6 +595,9 @@ void PathTracer::InitRtScene( const SceneData & aScene ) {
     const uint hitIdx =
         rtPipelineProps.AddHitGroup( L"HitGroup0", RT_HIT_GROUP_TYPE_TRIANGLES, nullptr, nullptr, nullptr, nullptr,
                                      "resources/shaders/raytracing/PathTracing.hlsl", "ClosestHit" );
+    const uint hitIdxShadow =
+        rtPipelineProps.AddHitGroup( L"HitGroup1", RT_HIT_GROUP_TYPE_TRIANGLES, nullptr, nullptr, nullptr, nullptr,
+                                     "resources/shaders/raytracing/PathTracing.hlsl", "ClosestHitShadow" );
     rtPipelineProps.SetMaxAttributeSize( 32u );
     rtPipelineProps.SetMaxPayloadSize( 128u );
     rtPipelineProps.SetMaxRecursionDepth( RenderCore::GetPlatformCaps().myRaytracingMaxRecursionDepth );
@@ -390,28 +613,104 @@ void PathTracer::InitRtScene( const SceneData & aScene ) {
             RenderCore::GetRtPipelineState( myRtScene->myRtPso )->GetRayGenShaderIdentifier( raygenIdx ) );
     RenderCore::GetRtShaderBindingTable( myRtScene->mySBT )
         ->AddShaderRecord( RenderCore::GetRtPipelineState( myRtScene->myRtPso )->GetHitShaderIdentifier( hitIdx ) );
+    RenderCore::GetRtShaderBindingTable( myRtScene->mySBT )
+        ->AddShaderRecord(
+            RenderCore::GetRtPipelineState( myRtScene->myRtPso )->GetHitShaderIdentifier( hitIdxShadow ) );
   }
 
-  InitSampleSequences();
+  InitSamplerTable();
+  UpdateRtLights();
 }
 
-void PathTracer::InitSampleSequences() {
-  uint                         sampleCount = 8192;
-  eastl::vector< glm::float2 > someSamples;
-  someSamples.reserve( sampleCount );
+void PathTracer::InitRtTextures( const SceneData & aScene, eastl::vector< uint > & someMaterialTexturesOut ) {
+  someMaterialTexturesOut.resize( aScene.myMaterials.size(), UINT_MAX );
+
+  TextureSamplerProperties samplerProps;
+  samplerProps.myMinFiltering = SamplerFilterMode::TRILINEAR;
+  samplerProps.myMagFiltering = SamplerFilterMode::BILINEAR;
+  samplerProps.myAddressModeX = SamplerAddressMode::REPEAT;
+  samplerProps.myAddressModeY = SamplerAddressMode::REPEAT;
+  samplerProps.myAddressModeZ = SamplerAddressMode::REPEAT;
+  myRtScene->myLinearWrapSampler = RenderCore::CreateTextureSampler( samplerProps );
+
+  // Materials that share a file share the texture. All mips are decoded into one scratch buffer, reused for all files.
+  eastl::hash_map< eastl::string, uint > pathToDescriptorIndex;
+  eastl::vector< uint >                  texels;
+  for ( uint iMaterial = 0u; iMaterial < ( uint ) aScene.myMaterials.size(); ++iMaterial ) {
+    const eastl::string & path = aScene.myMaterials[ iMaterial ].myTextures[ ( uint ) MaterialTextureType::BASE_COLOR ];
+    if ( path.empty() )
+      continue;
+
+    eastl::hash_map< eastl::string, uint >::iterator it = pathToDescriptorIndex.find( path );
+    if ( it != pathToDescriptorIndex.end() ) {
+      someMaterialTexturesOut[ iMaterial ] = it->second;
+      continue;
+    }
+
+    CpuTextureFile file;
+    if ( !file.Open( path.c_str() ) ) {
+      Log( "Failed reading texture %s, only DDS files with BC1, BC3 or 32-bit RGBA texels are supported",
+           path.c_str() );
+      pathToDescriptorIndex[ path ] = UINT_MAX;
+      continue;
+    }
 
-  for ( uint i = 0; i < sampleCount; ++i )
-    someSamples.push_back( { MathUtil::Halton( i, 2 ), MathUtil::Halton( i, 3 ) } );
+    uint64 totalSize = 0u;
+    for ( uint mip = 0u; mip < file.GetNumMips(); ++mip )
+      totalSize += ( uint64 ) file.GetWidth( mip ) * file.GetHeight( mip ) * sizeof( uint );
+    texels.resize( totalSize / sizeof( uint ) );
+
+    TextureSubData subDatas[ TEXTURE_MAX_MIPS ];
+    uint64         offset = 0u;
+    for ( uint mip = 0u; mip < file.GetNumMips(); ++mip ) {
+      file.DecodeMip( mip, &texels[ offset / sizeof( uint ) ] );
+
+      TextureSubData & subData = subDatas[ mip ];
+      subData.myData = ( uint8 * ) &texels[ offset / sizeof( uint ) ];
+      subData.myPixelSizeBytes = sizeof( uint );
+      subData.myRowSizeBytes = file.GetWidth( mip ) * sizeof( uint );
+      subData.mySliceSizeBytes = subData.myRowSizeBytes * file.GetHeight( mip );
+      subData.myTotalSizeBytes = subData.mySliceSizeBytes;
+      offset += subData.mySliceSizeBytes;
+    }
+
+    TextureProperties props;
+    props.myDimension = GpuResourceDimension::TEXTURE_2D;
+    props.myFormat = DataFormat::SRGB_8_A_8;
+    props.myWidth = file.GetWidth( 0u );
+    props.myHeight = file.GetHeight( 0u );
+    props.myNumMipLevels = file.GetNumMips();
+    const TextureHandle texture = RenderCore::CreateTexture( props, path.c_str(), subDatas, file.GetNumMips() );
+    ASSERT( texture.IsValid() );
+    const TextureViewHandle view =
+        RenderCore::CreateTextureView( RenderCore::GetTexture( texture ), TextureViewProperties(), path.c_str() );
+    ASSERT( view.IsValid() );
+
+    myRtScene->myBaseColorTextures.push_back( texture );
+    myRtScene->myBaseColorTextureViews.push_back( view );
+    myRtScene->myTextureSize += totalSize;
+
+    const uint descriptorIndex = RenderCore::GetTextureView( view )->GetGlobalDescriptorIndex();
+    pathToDescriptorIndex[ path ] = descriptorIndex;
+    someMaterialTexturesOut[ iMaterial ] = descriptorIndex;
+  }
 
+  if ( !myRtScene->myBaseColorTextures.empty() ) {
+    Log( "GPU textures: %u, %.1f MiB", ( uint ) myRtScene->myBaseColorTextures.size(),
+         ( float ) myRtScene->myTextureSize / ( 1024.0f * 1024.0f ) );
+  }
+}
+
+void PathTracer::InitSamplerTable() {
   GpuBufferProperties props;
   props.myBindFlags = ( uint ) GpuBufferBindFlags::SHADER_BUFFER;
-  props.myElementSizeBytes = sizeof( glm::float2 );
-  props.myNumElements = sampleCount;
+  props.myElementSizeBytes = sizeof( uint );
+  props.myNumElements = SAMPLER_TABLE_SIZE;
   GpuBufferViewProperties viewProps;
   viewProps.myIsRaw = true;
-  myRtScene->myHaltonSamplesBuf = RenderCore::CreateBuffer( props, "Halton samples", someSamples.data() );
-  myRtScene->myHaltonSamples = RenderCore::CreateBufferView( RenderCore::GetBuffer( myRtScene->myHaltonSamplesBuf ),
-                                                             viewProps, "Halton samples" );
+  myRtScene->mySamplerTableBuf = RenderCore::CreateBuffer( props, "Sampler table", GetSamplerTable() );
+  myRtScene->mySamplerTable = RenderCore::CreateBufferView( RenderCore::GetBuffer( myRtScene->mySamplerTableBuf ),
+                                                            viewProps, "Sampler table" );
 }
 
 PathTracer::~PathTracer() {
@@ -420,14 +719,7 @@ PathTracer::~PathTracer() {
   ImGui::DestroyContext( myImGuiContext );
   myImGuiContext = nullptr;
 
-  if ( myHdrLightTexRead.IsValid() )
-    RenderCore::DeleteTextureView( myHdrLightTexRead );
-  if ( myHdrLightTexWrite.IsValid() )
-    RenderCore::DeleteTextureView( myHdrLightTexWrite );
-  if ( myHdrLightTexRtv.IsValid() )
-    RenderCore::DeleteTextureView( myHdrLightTexRtv );
-  if ( myHdrLightTex.IsValid() )
-    RenderCore::DeleteTexture( myHdrLightTex );
+  DeleteOutputTextures();
   if ( myDepthStencilDsv.IsValid() )
     RenderCore::DeleteTextureView( myDepthStencilDsv );
   if ( myDepthStencilTex.IsValid() )
@@ -461,6 +753,26 @@ void PathTracer::UpdateMainMenuBar() {
           LoadScene( loadInfo.myPath.c_str(), loadInfo.myCamPos );
         }
       }
+      ImGui::Separator();
+      ImGui::Checkbox( "Use Scene Cache", &myUseSceneCache );
+      ImGui::Checkbox( "Use OBJ Importer", &myUseObjImporter );
+      ImGui::Checkbox( "Compact Vertex Data", &myCompactVertexData );
+
+      // Writes a replicated Cornell Box with about 10M triangles and imports it with both importers
+      if ( ImGui::MenuItem( "Run OBJ Import Benchmark" ) )
+        RunObjImportBenchmark();
+
+      if ( myHasObjImportBenchmark ) {
+        const ObjImportBenchmarkResults & bench = myObjImportBenchmark;
+        const ObjImportStats &            stats = bench.myObjImporterStats;
+        ImGui::Text( "%u triangles, %u vertices, %.1f MiB", stats.myNumTriangles, stats.myNumVertices,
+                     ( float ) stats.myFileSize / ( 1024.0f * 1024.0f ) );
+        ImGui::Text( "MeshImporter: %.2f ms%s", ( float ) bench.myMeshImporterTimeMs,
+                     bench.myMeshImporterSuccess ? "" : " (failed)" );
+        ImGui::Text( "ObjImporter: %.2f ms (parse %.2f ms, build %.2f ms, %u chunks)%s",
+                     ( float ) bench.myObjImporterTimeMs, ( float ) stats.myParseTimeMs, ( float ) stats.myBuildTimeMs,
+                     stats.myNumChunks, bench.myObjImporterSuccess ? "" : " (failed)" );
+      }
       ImGui::EndMenu();
     }
 
@@ -497,11 +809,151 @@ void PathTracer::UpdatePathTracingSettings() {
     RestartAccumulation();
   }
 
-  if ( mySupportsRaytracing ) {
+  if ( myScene && !myScene->myInstances.empty() && ImGui::TreeNode( "Instances" ) ) {
+    ImGui::SliderInt( "Instance", &myMovedInstanceIdx, 0, ( int ) myScene->myInstances.size() - 1 );
+    myMovedInstanceIdx = glm::clamp( myMovedInstanceIdx, 0, ( int ) myScene->myInstances.size() - 1 );
+
+    const uint    instanceIdx = ( uint ) myMovedInstanceIdx;
+    glm::float4x4 transform = myScene->myInstances[ instanceIdx ].myTransform;
+    glm::float3   position( transform[ 3 ] );
+    if ( ImGui::DragFloat3( "Position", &position.x ) ) {
+      transform[ 3 ] = glm::float4( position, 1.0f );
+      const uint * pending =
+          eastl::find( myPendingInstanceIndices.begin(), myPendingInstanceIndices.end(), instanceIdx );
+      if ( pending != myPendingInstanceIndices.end() ) {
+        myPendingInstanceTransforms[ pending - myPendingInstanceIndices.begin() ] = transform;
+      } else {
+        myPendingInstanceIndices.push_back( instanceIdx );
+        myPendingInstanceTransforms.push_back( transform );
+      }
+    }
+    ImGui::TreePop();
+  }
+
+  if ( myScene && ImGui::TreeNode( "Raytracing Memory" ) ) {
+    Priv_PathTracer::ShowMemoryReport( "CPU", myCpuMemoryReport );
+    if ( mySupportsRaytracing )
+      Priv_PathTracer::ShowMemoryReport( "GPU", myGpuMemoryReport );
+    ImGui::TreePop();
+  }
+
+  {
     if ( ImGui::Checkbox( "Render Raster", &myRenderRaster ) && !myRenderRaster )
       RestartAccumulation();
 
     if ( !myRenderRaster ) {
+      // Without DXR support the CPU backend is the only way to trace rays
+      if ( mySupportsRaytracing && ImGui::Checkbox( "Render CPU", &myRenderCpu ) )
+        RestartAccumulation();
+
+      if ( ( myRenderCpu || !mySupportsRaytracing ) && ImGui::TreeNode( "CPU BVH" ) ) {
+        const CpuRtScene &       cpuScene = myCpuPathTracer->GetScene();
+        const CpuBvhBuildStats & blasStats = cpuScene.myBlasStats;
+        const CpuBvhBuildStats & tlasStats = cpuScene.myTlas.GetStats();
+        ImGui::Text( "BLAS: %u triangles, %u nodes, %u leaves", blasStats.myNumPrimitives, blasStats.myNumNodes,
+                     blasStats.myNumLeaves );
+        ImGui::Text( "BLAS: max depth %u, max leaf size %u, SAH cost %.2f", blasStats.myMaxDepth,
+                     blasStats.myMaxLeafSize, blasStats.mySahCost );
+        ImGui::Text( "BLAS build: %.2f ms", ( float ) blasStats.myBuildTimeMs );
+        ImGui::Text( "BLAS memory: binary %.2f MiB, BVH4 %.2f MiB",
+                     ( float ) blasStats.myMemorySize / ( 1024.0f * 1024.0f ),
+                     ( float ) cpuScene.myBlasMemorySize / ( 1024.0f * 1024.0f ) );
+        ImGui::Text( "Triangle store: %.2f MiB",
+                     ( float ) cpuScene.myTriangleStoreMemorySize / ( 1024.0f * 1024.0f ) );
+        ImGui::Text( "TLAS: %u instances, %u nodes, max depth %u, SAH cost %.2f", tlasStats.myNumPrimitives,
+                     tlasStats.myNumNodes, tlasStats.myMaxDepth, tlasStats.mySahCost );
+        ImGui::Text( "TLAS build: %.2f ms", ( float ) tlasStats.myBuildTimeMs );
+
+        if ( ImGui::Button( "Run TLAS Update Benchmark" ) ) {
+          const uint numInstances = 10000u;
+          myCpuTlasUpdateBenchmark = myCpuPathTracer->RunTlasUpdateBenchmark( numInstances );
+          myHasCpuTlasUpdateBenchmark = true;
+        }
+
+        if ( myHasCpuTlasUpdateBenchmark ) {
+          const CpuTlasUpdateBenchmarkResults & bench = myCpuTlasUpdateBenchmark;
+          ImGui::Text( "%u instances, %u frames: update %.3f ms (%u rebuilds), rebuild %.3f ms", bench.myNumInstances,
+                       bench.myNumFrames, bench.myUpdateTimeMs, bench.myNumRebuilds, bench.myRebuildTimeMs );
+          ImGui::Text( "SAH cost: %.2f built, %.2f updated, %.2f rebuilt, full rebuild +%.2f ms BLAS",
+                       bench.myBuildSahCost, bench.myUpdateSahCost, bench.myRebuildSahCost, bench.myBlasBuildTimeMs );
+        }
+
+        // Uses the resolution of the last CPU frame
+        if ( ImGui::Button( "Run Traversal Benchmark" ) ) {
+          myCpuTraversalBenchmark = myCpuPathTracer->RunTraversalBenchmark( GetCpuRtConsts() );
+          myHasCpuTraversalBenchmark = true;
+        }
+
+        if ( myHasCpuTraversalBenchmark ) {
+          const CpuTraversalBenchmarkResults & bench = myCpuTraversalBenchmark;
+          ImGui::Text( "Packets: %s, %u lanes", bench.mySimdName, bench.mySimdWidth );
+          ImGui::Text( "Primary (%u rays): scalar %.2f Mrays/s, packet %.2f Mrays/s", bench.myNumPrimaryRays,
+                       bench.myPrimaryScalarMrays, bench.myPrimaryPacketMrays );
+          ImGui::Text( "AO (%u rays): scalar %.2f Mrays/s, packet %.2f Mrays/s", bench.myNumAoRays,
+                       bench.myAoScalarMrays, bench.myAoPacketMrays );
+        }
+        ImGui::TreePop();
+      }
+
+      if ( ( myRenderCpu || !mySupportsRaytracing ) && ImGui::TreeNode( "CPU Wavefront" ) ) {
+        // Only changes the order in which rays are traced, so the accumulation can continue
+        ImGui::Checkbox( "Wavefront", &myCpuWavefront );
+
+        if ( myCpuWavefront && !myRenderAo ) {
+          const eastl::vector< CpuWavefrontBounceStats > & frameStats = myCpuPathTracer->GetWavefrontStats();
+          for ( uint i = 0u; i < ( uint ) frameStats.size(); ++i ) {
+            const CpuWavefrontBounceStats & stats = frameStats[ i ];
+            ImGui::Text( "Bounce %u: %u rays, sort %.2f ms, trace %.2f ms, %.2f Mrays/s", i, stats.myNumRays,
+                         stats.mySortTimeMs, stats.myTraceTimeMs, stats.mySortedPacketMrays );
+          }
+        }
+
+        if ( ImGui::Button( "Run Wavefront Benchmark" ) )
+          myCpuWavefrontBenchmark = myCpuPathTracer->RunWavefrontBenchmark( GetCpuRtConsts() );
+
+        for ( uint i = 0u; i < ( uint ) myCpuWavefrontBenchmark.size(); ++i ) {
+          const CpuWavefrontBounceStats & stats = myCpuWavefrontBenchmark[ i ];
+          ImGui::Text( "Bounce %u (%u rays): depth-first %.2f, unsorted %.2f, sorted %.2f Mrays/s", i,
+                       stats.myNumRays, stats.myDepthFirstMrays, stats.myUnsortedPacketMrays,
+                       stats.mySortedPacketMrays );
+        }
+        ImGui::TreePop();
+      }
+
+      if ( ( myRenderCpu || !mySupportsRaytracing ) && ImGui::TreeNode( "CPU Scheduler" ) ) {
+        // Restarts the accumulation
+        if ( ImGui::Button( "Run Scheduler Benchmark" ) ) {
+          myCpuSchedulerBenchmark = myCpuPathTracer->RunSchedulerBenchmark( GetCpuRtConsts() );
+          RestartAccumulation();
+        }
+
+        for ( const CpuSchedulerBenchmarkResults & bench : myCpuSchedulerBenchmark ) {
+          ImGui::Text( "%u threads: %.2f ms, %.2fx, tiles %.3f ms median, %.3f ms p99, %.3f ms max%s",
+                       bench.myNumThreads, bench.myFrameTimeMs, bench.mySpeedup, bench.myTileMedianMs,
+                       bench.myTileP99Ms, bench.myTileMaxMs, bench.myMatchesSingleThread ? "" : ", differs" );
+        }
+        ImGui::TreePop();
+      }
+
+      if ( ( myRenderCpu || !mySupportsRaytracing ) && ImGui::TreeNode( "CPU Textures" ) ) {
+        CpuTextureCache &          textureCache = myCpuPathTracer->GetTextureCache();
+        const CpuTextureCacheStats stats = textureCache.GetStats();
+        const float                toMiB = 1.0f / ( 1024.0f * 1024.0f );
+        ImGui::Text( "%u textures, %.1f MiB decoded", stats.myNumTextures, ( float ) stats.myTextureSize * toMiB );
+        ImGui::Text( "Resident: %.1f of %.1f MiB", ( float ) stats.myResidentSize * toMiB,
+                     ( float ) stats.myBudget * toMiB );
+        ImGui::Text( "Since the restart: %.2f%% hits, %u misses, %u evictions", stats.GetHitRate() * 100.0f,
+                     ( uint ) stats.myNumMisses, ( uint ) stats.myNumEvictions );
+
+        // Drops the resident tiles
+        int budgetMiB = ( int ) ( textureCache.GetBudget() / ( 1024u * 1024u ) );
+        if ( ImGui::InputInt( "Budget (MiB)", &budgetMiB ) && budgetMiB > 0 ) {
+          textureCache.SetBudget( ( uint64 ) budgetMiB * 1024u * 1024u );
+          RestartAccumulation();
+        }
+        ImGui::TreePop();
+      }
+
       if ( ImGui::Checkbox( "Render AO", &myRenderAo ) )
         RestartAccumulation();
 
@@ -514,9 +966,94 @@ void PathTracer::UpdatePathTracingSettings() {
       if ( !mySampleSky ) {
         if ( ImGui::SliderFloat( "Sky Fallback Intensity", &mySkyFallbackIntensity, 0.0f, 1000.0f ) )
           RestartAccumulation();
+      } else {
+        if ( ImGui::Checkbox( "Sky Radiance LUT", &mySkyRadianceLut ) )
+          RestartAccumulation();
+
+        if ( myRenderCpu || !mySupportsRaytracing ) {
+          const SkyLutStats & skyStats = myCpuPathTracer->GetSkyStats();
+          ImGui::Text( "CPU sky LUTs: transmittance %u computed, %u skipped, sky-view %u computed, %u skipped, "
+                       "radiance %u computed, %u skipped",
+                       skyStats.myNumTransmittanceComputed, skyStats.myNumTransmittanceSkipped,
+                       skyStats.myNumSkyViewComputed, skyStats.myNumSkyViewSkipped, skyStats.myNumRadianceComputed,
+                       skyStats.myNumRadianceSkipped );
+        }
+
+        if ( ImGui::Button( "Run Sky Lookup Benchmark" ) ) {
+          mySkyLookupBenchmark = RunSkyLookupBenchmark( mySky->GetLutParameters(), myCamera.myPosition.y );
+          myHasSkyLookupBenchmark = true;
+        }
+
+        if ( myHasSkyLookupBenchmark ) {
+          const SkyLookupBenchmarkResults & bench = mySkyLookupBenchmark;
+          ImGui::Text( "CPU, %u lookups: integrate %.1f ns, %.1f ns batched", bench.myNumLookups, bench.myIntegrateNs,
+                       bench.myIntegrateBatchNs );
+          ImGui::Text( "Sky-view LUT: %.1f ns, build %.2f ms, rel. RMSE %.4f", bench.mySkyViewLutNs,
+                       bench.mySkyViewLutBuildMs, bench.mySkyViewLutError );
+          ImGui::Text( "Radiance LUT: %.1f ns, build %.2f ms, rel. RMSE %.4f", bench.myRadianceLutNs,
+                       bench.myRadianceLutBuildMs, bench.myRadianceLutError );
+        }
+
+        if ( ImGui::Button( "Run Sky LUT Build Benchmark" ) )
+          mySkyLutBuildBenchmark = RunSkyLutBuildBenchmark( mySky->GetLutParameters(), myCamera.myPosition.y );
+
+        for ( const SkyLutBuildBenchmarkResults & bench : mySkyLutBuildBenchmark ) {
+          ImGui::Text( "%u threads: transmittance %.2f ms, sky-view %.2f ms, radiance %.2f ms", bench.myNumThreads,
+                       bench.myTransmittanceMs, bench.mySkyViewMs, bench.myRadianceMs );
+        }
       }
 
       ImGui::Text( "Accumulation Frame %i", myNumAccumulationFrames );
+      ImGui::Text( "Heap allocations: %u last frame, %u last scene load", ( uint ) myNumFrameAllocations,
+                   ( uint ) myNumLoadAllocations );
+
+      if ( ImGui::BeginCombo( "Sampler", GetSamplerName( ( SamplerType ) mySampler ) ) ) {
+        for ( uint i = 0; i < ( uint ) SamplerType::NUM; ++i ) {
+          if ( ImGui::Selectable( GetSamplerName( ( SamplerType ) i ), mySampler == ( int ) i ) ) {
+            mySampler = ( int ) i;
+            RestartAccumulation();
+          }
+        }
+        ImGui::EndCombo();
+      }
+
+      // Renders a reference and every sampler at increasing sample counts and restarts the accumulation
+      if ( ( myRenderCpu || !mySupportsRaytracing ) && ImGui::Button( "Run Sampler Benchmark" ) ) {
+        myCpuSamplerBenchmark = myCpuPathTracer->RunSamplerBenchmark( GetCpuRtConsts() );
+        myHasCpuSamplerBenchmark = true;
+        RestartAccumulation();
+      }
+
+      if ( myHasCpuSamplerBenchmark ) {
+        const CpuSamplerBenchmarkResults & bench = myCpuSamplerBenchmark;
+        ImGui::Text( "Rel. RMSE against a %u spp reference", bench.myReferenceSpp );
+        for ( uint i = 0; i < ( uint ) SamplerType::NUM; ++i ) {
+          ImGui::Text( "%s, %.1f ms:", GetSamplerName( ( SamplerType ) i ), bench.myTimeMs[ i ] );
+          for ( uint step = 0; step < CpuSamplerBenchmarkResults::NUM_STEPS; ++step ) {
+            ImGui::SameLine();
+            ImGui::Text( "%u spp %.4f", bench.mySpp[ step ], bench.myRmse[ i ][ step ] );
+          }
+        }
+      }
+
+      if ( ImGui::Checkbox( "Adaptive Sampling", &myAdaptiveSampling ) )
+        RestartAccumulation();
+
+      if ( myAdaptiveSampling ) {
+        if ( ImGui::SliderFloat( "Adaptive Error Threshold", &myAdaptiveErrorThreshold, 0.001f, 0.2f, "%.3f" ) )
+          RestartAccumulation();
+
+        // The variance estimate of a pixel needs at least two samples
+        if ( ImGui::InputInt( "Adaptive Min Samples", &myAdaptiveMinSamples, 1 ) ) {
+          myAdaptiveMinSamples = glm::max( myAdaptiveMinSamples, 2 );
+          RestartAccumulation();
+        }
+
+        if ( myRenderCpu || !mySupportsRaytracing ) {
+          ImGui::Text( "CPU tiles: %u of %u active%s", myCpuPathTracer->GetNumActiveTiles(),
+                       myCpuPathTracer->GetNumTiles(), myCpuPathTracer->IsConverged() ? ", converged" : "" );
+        }
+      }
 
       if ( myRenderAo ) {
         if ( ImGui::DragFloat( "Ao Distance", &myAoDistance ) )
@@ -528,6 +1065,76 @@ void PathTracer::UpdatePathTracingSettings() {
         if ( ImGui::InputInt( "Max Recursion Depth", &myMaxRecursionDepth, 1 ) )
           RestartAccumulation();
 
+        if ( ImGui::Checkbox( "Russian Roulette", &myRussianRoulette ) )
+          RestartAccumulation();
+
+        if ( myRussianRoulette ) {
+          if ( ImGui::InputInt( "Russian Roulette Min Bounces", &myRussianRouletteMinBounces, 1 ) ) {
+            myRussianRouletteMinBounces = glm::max( myRussianRouletteMinBounces, 0 );
+            RestartAccumulation();
+          }
+
+          // A survival probability of 0 would give the survivors an infinite weight
+          if ( ImGui::SliderFloat2( "Russian Roulette Survival", &myRussianRouletteSurvival.x, 0.01f, 1.0f ) ) {
+            myRussianRouletteSurvival.x = glm::clamp( myRussianRouletteSurvival.x, 0.01f, 1.0f );
+            myRussianRouletteSurvival.y = glm::clamp( myRussianRouletteSurvival.y, myRussianRouletteSurvival.x, 1.0f );
+            RestartAccumulation();
+          }
+        }
+
+        if ( myRenderCpu || !mySupportsRaytracing )
+          ImGui::Text( "CPU rays per path: %.2f", myCpuPathTracer->GetAveragePathLength() );
+
+        if ( ImGui::Checkbox( "Next-Event Estimation", &myNextEventEstimation ) )
+          RestartAccumulation();
+
+        if ( myNextEventEstimation && ImGui::Checkbox( "Light BVH", &myLightBvh ) )
+          RestartAccumulation();
+
+        if ( ImGui::Button( "Run Light Sampling Benchmark" ) ) {
+          const uint numLights = 4096u;
+          myLightSamplingBenchmark = RunLightSamplingBenchmark( myCpuPathTracer->GetScene(), numLights );
+          myHasLightSamplingBenchmark = true;
+        }
+
+        if ( myHasLightSamplingBenchmark ) {
+          const CpuLightSamplingBenchmarkResults & bench = myLightSamplingBenchmark;
+          ImGui::Text( "%u lights, built in %.2f ms: variance per sample %.3f alias table, %.3f light BVH",
+                       bench.myNumLights, bench.myBuildMs, bench.myAliasTableVariance, bench.myLightBvhVariance );
+          ImGui::Text( "Sampling cost: %.1f ns alias table, %.1f ns light BVH", bench.myAliasTableNs,
+                       bench.myLightBvhNs );
+        }
+
+        // Uses the resolution of the last CPU frame and restarts the accumulation
+        if ( ( myRenderCpu || !mySupportsRaytracing ) && ImGui::Button( "Run Integrator Benchmark" ) ) {
+          myCpuIntegratorBenchmark = myCpuPathTracer->RunIntegratorBenchmark( GetCpuRtConsts() );
+          myHasCpuIntegratorBenchmark = true;
+          RestartAccumulation();
+        }
+
+        if ( myHasCpuIntegratorBenchmark ) {
+          const CpuIntegratorBenchmarkResults & bench = myCpuIntegratorBenchmark;
+          ImGui::Text( "BRDF sampling: %u spp, %.1f ms, rel. RMSE %.4f", bench.myBrdfSpp, bench.myBrdfTimeMs,
+                       bench.myTargetRmse );
+          ImGui::Text( "Next-event estimation: %u spp, %.1f ms, rel. RMSE %.4f", bench.myNeeSpp, bench.myNeeTimeMs,
+                       bench.myNeeRmse );
+        }
+
+        if ( ( myRenderCpu || !mySupportsRaytracing ) && ImGui::Button( "Run Russian Roulette Benchmark" ) ) {
+          myCpuRouletteBenchmark = myCpuPathTracer->RunRussianRouletteBenchmark( GetCpuRtConsts() );
+          myHasCpuRouletteBenchmark = true;
+          RestartAccumulation();
+        }
+
+        if ( myHasCpuRouletteBenchmark ) {
+          const CpuRussianRouletteBenchmarkResults & bench = myCpuRouletteBenchmark;
+          ImGui::Text( "Fixed length: %u spp, %.1f ms, rel. RMSE %.4f, %.2f rays per path", bench.myFixedSpp,
+                       bench.myFixedTimeMs, bench.myTargetRmse, bench.myFixedPathLength );
+          ImGui::Text( "Russian roulette: %u spp, %.1f ms, rel. RMSE %.4f, %.2f rays per path, %.2fx samples/s",
+                       bench.myRouletteSpp, bench.myRouletteTimeMs, bench.myRouletteRmse, bench.myRoulettePathLength,
+                       bench.mySpeedup );
+        }
+
         if ( ImGui::Checkbox( "Enable Light", &myLightEnabled ) )
           RestartAccumulation();
 
@@ -550,6 +1157,10 @@ void PathTracer::UpdatePathTracingSettings() {
 }
 
 void PathTracer::BeginFrame() {
+  const uint64 numAllocations = GetNumHeapAllocations();
+  myNumFrameAllocations = numAllocations - myFrameStartNumAllocations;
+  myFrameStartNumAllocations = numAllocations;
+
   Application::BeginFrame();
   ImGuiRendering::NewFrame();
 }
@@ -567,6 +1178,20 @@ void PathTracer::Update() {
     RestartAccumulation();
   }
 
+  // Dragging an instance in the UI changes its transform every frame, so all moves of a frame are applied together
+  if ( !myPendingInstanceIndices.empty() ) {
+    UpdateInstanceTransforms( myPendingInstanceIndices.data(), myPendingInstanceTransforms.data(),
+                              ( uint ) myPendingInstanceIndices.size() );
+    myPendingInstanceIndices.clear();
+    myPendingInstanceTransforms.clear();
+  }
+
+  if ( myRtScene )
+    myRtScene->DeleteRetiredResources();
+
+  if ( myRtScene && myNextEventEstimation && !myRenderAo )
+    UpdateRtLights();
+
   myLastViewMat = myCamera.myViewProj;
 }
 
@@ -577,10 +1202,13 @@ void PathTracer::Render() {
   {
     GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
 
-    mySky->ComputeTranmittanceLut( ctx );
+    mySky->ResetFrameStats();
+    mySky->UpdateTransmittanceLut( ctx );
 
-    if ( myRenderRaster || !mySupportsRaytracing ) {
+    if ( myRenderRaster ) {
       RenderRaster( ctx );
+    } else if ( myRenderCpu || !mySupportsRaytracing ) {
+      RenderCpu( ctx );
     } else {
       RenderRT( ctx );
     }
@@ -597,7 +1225,7 @@ void PathTracer::Render() {
 void PathTracer::RenderRaster( CommandList * ctx ) {
   GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
 
-  mySky->ComputeSkyViewLut( ctx, myCamera );
+  mySky->UpdateSkyViewLut( ctx, myCamera );
 
   TextureView * hdrLightTexRead = RenderCore::GetTextureView( myHdrLightTexRead );
   uint          dstTexWidth = hdrLightTexRead->GetTexture()->GetProperties().myWidth;
@@ -659,20 +1287,27 @@ void PathTracer::RenderRaster( CommandList * ctx ) {
 void PathTracer::RenderRT( CommandList * ctx ) {
   GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
 
+  if ( mySampleSky && mySkyRadianceLut )
+    mySky->UpdateRadianceLut( ctx, myCamera );
+
   TextureView * hdrLightTexRead = RenderCore::GetTextureView( myHdrLightTexRead );
   uint          dstTexWidth = hdrLightTexRead->GetTexture()->GetProperties().myWidth;
   uint          dstTexHeight = hdrLightTexRead->GetTexture()->GetProperties().myHeight;
 
   TextureView * hdrLightTexWrite = RenderCore::GetTextureView( myHdrLightTexWrite );
 
-  if ( myAccumulationNeedsClear ) {
-    ctx->PrepareResourceShaderAccess( hdrLightTexWrite );
+  TextureView * momentTexWrite = RenderCore::GetTextureView( myHdrMomentTexWrite );
 
-    uint texIdx = hdrLightTexWrite->GetGlobalDescriptorIndex();
-    ctx->BindConstantBuffer( &texIdx, sizeof( texIdx ), 0 );
+  if ( myAccumulationNeedsClear ) {
     ctx->SetShaderPipeline( RenderCore::GetShaderPipeline( myClearTextureShader ) );
-    ctx->Dispatch( glm::ivec3( dstTexWidth, dstTexHeight, 1 ) );
-    ctx->ResourceUAVbarrier( hdrLightTexWrite->GetTexture() );
+    for ( TextureView * texView : { hdrLightTexWrite, momentTexWrite } ) {
+      ctx->PrepareResourceShaderAccess( texView );
+
+      uint texIdx = texView->GetGlobalDescriptorIndex();
+      ctx->BindConstantBuffer( &texIdx, sizeof( texIdx ), 0 );
+      ctx->Dispatch( glm::ivec3( dstTexWidth, dstTexHeight, 1 ) );
+      ctx->ResourceUAVbarrier( texView->GetTexture() );
+    }
     myAccumulationNeedsClear = false;
     myNumAccumulationFrames = 0u;
   }
@@ -697,6 +1332,10 @@ void PathTracer::RenderRT( CommandList * ctx ) {
 
     glm::float2 myRayMarchMinMaxSPP;
     glm::float2 _unused2;
+
+    glm::uvec2 mySkyRadianceLutRes;
+    uint       myUseSkyRadianceLut;
+    uint       mySkyRadianceLutTexIdx;
   } skyConsts;
 
   skyConsts.myAtmosphere = mySky->myAtmosphereParams;
@@ -705,6 +1344,10 @@ void PathTracer::RenderRT( CommandList * ctx ) {
       ctx->GetPrepareDescriptorIndex( RenderCore::GetTextureView( mySky->myTransmittanceLutRead ) );
   skyConsts.mySunIlluminance = mySky->mySunIlluminance;
   skyConsts.myRayMarchMinMaxSPP = glm::float2( 4.0f, 14.0f );
+  skyConsts.mySkyRadianceLutRes = { SkyLutConsts::SKY_RADIANCE_LUT_WIDTH, SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT };
+  skyConsts.myUseSkyRadianceLut = mySampleSky && mySkyRadianceLut ? 1u : 0u;
+  skyConsts.mySkyRadianceLutTexIdx =
+      skyConsts.myUseSkyRadianceLut ? ctx->GetPrepareDescriptorIndex( mySky->GetRadianceLutRead() ) : 0u;
 
   struct RtConsts {
     glm::float3 myNearPlaneCorner;
@@ -720,14 +1363,14 @@ void PathTracer::RenderRT( CommandList * ctx ) {
     uint        myInstanceDataBufferIndex;
 
     uint myMaterialDataBufferIndex;
-    uint mySampleBufferIndex;
+    uint mySamplerTableBufferIndex;
     uint myFrameRandomSeed;
     uint myNumAccumulationFrames;
 
     uint myLinearClampSamplerIndex;
     uint myMaxRecursionDepth;
     uint myLightInstanceId;
-    uint myNumHaltonSamples;
+    uint mySamplerType;
 
     glm::float3 myLightEmission;
     uint        mySampleSky;
@@ -735,13 +1378,36 @@ void PathTracer::RenderRT( CommandList * ctx ) {
     glm::float3 mySkyFallbackEmission;
     float       myPhongSpecularPower;
 
+    uint myNextEventEstimation;
+    uint myLightTriangleBufferIndex;
+    uint myLightInstanceOffsetBufferIndex;
+    uint myNumLightTriangles;
+
+    float myLightTotalPower;
+    uint  myLightBvhBufferIndex;
+    uint  myUseLightBvh;
+    uint  myRussianRoulette;
+
+    uint  myRussianRouletteMinBounces;
+    float myRussianRouletteMinSurvival;
+    float myRussianRouletteMaxSurvival;
+    uint  myMomentTexIndex;
+
+    uint  myAdaptiveSampling;
+    float myAdaptiveErrorThreshold;
+    uint  myTileErrorTexIndex;
+    uint  mySamplerSeed;
+
+    uint       myLinearWrapSamplerIndex;
+    glm::uvec3 _unused;
+
     SkyConstants mySkyConsts;
 
   } rtConsts;
 
   GpuBufferView *           instanceData = RenderCore::GetBufferView( myRtScene->myInstanceData );
   GpuBufferView *           materialData = RenderCore::GetBufferView( myRtScene->myMaterialData );
-  GpuBufferView *           haltonSamples = RenderCore::GetBufferView( myRtScene->myHaltonSamples );
+  GpuBufferView *           samplerTable = RenderCore::GetBufferView( myRtScene->mySamplerTable );
   RtAccelerationStructure * tlas = RenderCore::GetRtAccelerationStructure( myRtScene->myTLAS );
 
   rtConsts.myNearPlaneCorner = nearPlaneVertices[ 0 ];
@@ -753,26 +1419,67 @@ void PathTracer::RenderRT( CommandList * ctx ) {
   rtConsts.myCameraPos = myCamera.myPosition;
   rtConsts.myInstanceDataBufferIndex = instanceData->GetGlobalDescriptorIndex();
   rtConsts.myMaterialDataBufferIndex = materialData->GetGlobalDescriptorIndex();
-  rtConsts.mySampleBufferIndex = haltonSamples->GetGlobalDescriptorIndex();
+  rtConsts.mySamplerTableBufferIndex = samplerTable->GetGlobalDescriptorIndex();
   rtConsts.myLightInstanceId = myLightInstanceIdx;
-  rtConsts.myNumHaltonSamples = haltonSamples->GetBuffer()->GetProperties().myNumElements;
-  rtConsts.myLightEmission = myLightEnabled ? myLightColor * myLightStrength : glm::float3( 0.0f );
+  rtConsts.mySamplerType = ( uint ) mySampler;
+  rtConsts.myLightEmission = GetLightEmission();
   rtConsts.mySampleSky = mySampleSky ? 1u : 0u;
   rtConsts.mySkyFallbackEmission = glm::float3( mySkyFallbackIntensity );
   rtConsts.myPhongSpecularPower = myPhongSpecularPower;
+
+  // The light buffers only exist if there are emissive triangles, see UpdateRtLights()
+  GpuBufferView * lightTriangles = nullptr;
+  GpuBufferView * lightInstanceOffsets = nullptr;
+  GpuBufferView * lightBvh = nullptr;
+  if ( myNextEventEstimation && myRtScene->myLightTriangles.IsValid() ) {
+    lightTriangles = RenderCore::GetBufferView( myRtScene->myLightTriangles );
+    lightInstanceOffsets = RenderCore::GetBufferView( myRtScene->myLightInstanceOffsets );
+    lightBvh = RenderCore::GetBufferView( myRtScene->myLightBvh );
+  }
+  rtConsts.myNextEventEstimation = myNextEventEstimation ? 1u : 0u;
+  rtConsts.myLightTriangleBufferIndex = lightTriangles ? lightTriangles->GetGlobalDescriptorIndex() : 0u;
+  rtConsts.myLightInstanceOffsetBufferIndex =
+      lightInstanceOffsets ? lightInstanceOffsets->GetGlobalDescriptorIndex() : 0u;
+  rtConsts.myNumLightTriangles = lightTriangles ? ( uint ) myRtScene->myLights.myTriangles.size() : 0u;
+  rtConsts.myLightTotalPower = myRtScene->myLights.GetTotalPower();
+  rtConsts.myLightBvhBufferIndex = lightBvh ? lightBvh->GetGlobalDescriptorIndex() : 0u;
+  rtConsts.myUseLightBvh = myLightBvh ? 1u : 0u;
+  rtConsts.myRussianRoulette = myRussianRoulette ? 1u : 0u;
+  rtConsts.myRussianRouletteMinBounces = ( uint ) myRussianRouletteMinBounces;
+  rtConsts.myRussianRouletteMinSurvival = myRussianRouletteSurvival.x;
+  rtConsts.myRussianRouletteMaxSurvival = myRussianRouletteSurvival.y;
+
+  // The tile errors are only computed once every pixel has myAdaptiveMinSamples samples, see ComputeTileErrors()
+  TextureView * tileErrorTexRead = RenderCore::GetTextureView( myTileErrorTexRead );
+  rtConsts.myMomentTexIndex = momentTexWrite->GetGlobalDescriptorIndex();
+  rtConsts.myAdaptiveSampling =
+      myAdaptiveSampling && myNumAccumulationFrames >= ( uint ) myAdaptiveMinSamples ? 1u : 0u;
+  rtConsts.myAdaptiveErrorThreshold = myAdaptiveErrorThreshold;
+  rtConsts.myTileErrorTexIndex = tileErrorTexRead->GetGlobalDescriptorIndex();
+  rtConsts.mySamplerSeed = 0u;
+
   rtConsts.myFrameRandomSeed = ( uint ) Time::ourFrameIdx;
   rtConsts.myNumAccumulationFrames = myNumAccumulationFrames++;
   rtConsts.myLinearClampSamplerIndex =
       RenderCore::GetTextureSampler( RenderCore::ourLinearClampSampler )->GetGlobalDescriptorIndex();
   rtConsts.myMaxRecursionDepth = ( uint ) myMaxRecursionDepth;
+  rtConsts.myLinearWrapSamplerIndex =
+      RenderCore::GetTextureSampler( myRtScene->myLinearWrapSampler )->GetGlobalDescriptorIndex();
   rtConsts.mySkyConsts = skyConsts;
   ctx->BindConstantBuffer( &rtConsts, sizeof( rtConsts ), 0 );
 
   ctx->PrepareResourceShaderAccess( hdrLightTexWrite );
+  ctx->PrepareResourceShaderAccess( momentTexWrite );
+  ctx->PrepareResourceShaderAccess( tileErrorTexRead );
   ctx->PrepareResourceShaderAccess( tlas->GetBufferRead() );
   ctx->PrepareResourceShaderAccess( instanceData );
   ctx->PrepareResourceShaderAccess( materialData );
-  ctx->PrepareResourceShaderAccess( haltonSamples );
+  ctx->PrepareResourceShaderAccess( samplerTable );
+  if ( lightTriangles ) {
+    ctx->PrepareResourceShaderAccess( lightTriangles );
+    ctx->PrepareResourceShaderAccess( lightInstanceOffsets );
+    ctx->PrepareResourceShaderAccess( lightBvh );
+  }
 
   DispatchRaysDesc desc;
   desc.myRayGenShaderTableRange = rtSbt->GetRayGenRange();
@@ -784,6 +1491,165 @@ void PathTracer::RenderRT( CommandList * ctx ) {
   ctx->DispatchRays( desc );
 
   ctx->ResourceUAVbarrier( hdrLightTexWrite->GetTexture() );
+  ctx->ResourceUAVbarrier( momentTexWrite->GetTexture() );
+
+  if ( myAdaptiveSampling && myNumAccumulationFrames >= ( uint ) myAdaptiveMinSamples )
+    ComputeTileErrors( ctx );
+}
+
+void PathTracer::ComputeTileErrors( CommandList * ctx ) {
+  GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
+
+  struct Constants {
+    uint myAccumulationTexIdx;
+    uint myMomentTexIdx;
+    uint myTileErrorTexIdx;
+    uint _unused0;
+
+    glm::uvec2 myResolution;
+  } consts;
+
+  TextureView * hdrLightTexWrite = RenderCore::GetTextureView( myHdrLightTexWrite );
+  TextureView * momentTexWrite = RenderCore::GetTextureView( myHdrMomentTexWrite );
+  TextureView * tileErrorTexWrite = RenderCore::GetTextureView( myTileErrorTexWrite );
+  const TextureProperties & texProps = hdrLightTexWrite->GetTexture()->GetProperties();
+
+  consts.myAccumulationTexIdx = ctx->GetPrepareDescriptorIndex( hdrLightTexWrite );
+  consts.myMomentTexIdx = ctx->GetPrepareDescriptorIndex( momentTexWrite );
+  consts.myTileErrorTexIdx = ctx->GetPrepareDescriptorIndex( tileErrorTexWrite );
+  consts.myResolution = glm::uvec2( texProps.myWidth, texProps.myHeight );
+  ctx->BindConstantBuffer( &consts, sizeof( consts ), 0u );
+
+  // One thread group per tile, the dispatch covers all pixels
+  ctx->SetShaderPipeline( RenderCore::GetShaderPipeline( myTileErrorShader ) );
+  ctx->Dispatch( glm::ivec3( texProps.myWidth, texProps.myHeight, 1 ) );
+  ctx->ResourceUAVbarrier( tileErrorTexWrite->GetTexture() );
+}
+
+CpuRtConsts PathTracer::GetCpuRtConsts() {
+  eastl::fixed_vector< glm::float3, 4 > nearPlaneVertices;
+  myCamera.GetVerticesOnNearPlane( nearPlaneVertices );
+
+  CpuRtConsts rtConsts;
+  rtConsts.myNearPlaneCorner = nearPlaneVertices[ 0 ];
+  rtConsts.myAoDistance = myAoDistance;
+  rtConsts.myXAxis = nearPlaneVertices[ 1 ] - nearPlaneVertices[ 0 ];
+  rtConsts.myYAxis = nearPlaneVertices[ 3 ] - nearPlaneVertices[ 0 ];
+  rtConsts.myCameraPos = myCamera.myPosition;
+  rtConsts.myFrameRandomSeed = ( uint ) Time::ourFrameIdx;
+  rtConsts.myMaxRecursionDepth = ( uint ) myMaxRecursionDepth;
+  rtConsts.myLightInstanceId = myLightInstanceIdx;
+  rtConsts.myLightEmission = GetLightEmission();
+  rtConsts.mySampleSky = mySampleSky;
+  rtConsts.mySkyParams = mySky->GetLutParameters();
+  rtConsts.mySkyLookup = mySkyRadianceLut ? SkyLookup::RADIANCE_LUT : SkyLookup::SKY_VIEW_LUT;
+  rtConsts.mySkyFallbackEmission = glm::float3( mySkyFallbackIntensity );
+  rtConsts.myPhongSpecularPower = myPhongSpecularPower;
+  rtConsts.myNextEventEstimation = myNextEventEstimation;
+  rtConsts.myLightSampling = myLightBvh ? LightSampling::LIGHT_BVH : LightSampling::ALIAS_TABLE;
+  rtConsts.myRussianRoulette = myRussianRoulette;
+  rtConsts.myRussianRouletteMinBounces = ( uint ) myRussianRouletteMinBounces;
+  rtConsts.myRussianRouletteMinSurvival = myRussianRouletteSurvival.x;
+  rtConsts.myRussianRouletteMaxSurvival = myRussianRouletteSurvival.y;
+  rtConsts.myAdaptiveSampling = myAdaptiveSampling;
+  rtConsts.myAdaptiveErrorThreshold = myAdaptiveErrorThreshold;
+  rtConsts.myAdaptiveMinSamples = ( uint ) myAdaptiveMinSamples;
+  rtConsts.mySampler = ( SamplerType ) mySampler;
+  rtConsts.myRenderAo = myRenderAo;
+  rtConsts.myWavefront = myCpuWavefront;
+
+  return rtConsts;
+}
+
+glm::float3 PathTracer::GetLightEmission() const {
+  return myLightEnabled ? myLightColor * myLightStrength : glm::float3( 0.0f );
+}
+
+void PathTracer::UpdateInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                                           uint aNumInstances ) {
+  for ( uint i = 0u; i < aNumInstances; ++i )
+    myScene->myInstances[ someInstanceIndices[ i ] ].myTransform = someTransforms[ i ];
+
+  // The GPU lights are built from the CPU scene, so that one goes first
+  const CpuTlasUpdate cpuTlasUpdate =
+      myCpuPathTracer->UpdateInstanceTransforms( someInstanceIndices, someTransforms, aNumInstances );
+
+  if ( myRtScene ) {
+    myRtScene->UpdateInstanceTransforms( someInstanceIndices, someTransforms, aNumInstances );
+    if ( myRtScene->myLights.ContainsAnyInstance( someInstanceIndices, aNumInstances ) ) {
+      myRtScene->myLights = CpuRtLights();
+      UpdateRtLights();
+    }
+  }
+
+  if ( cpuTlasUpdate == CpuTlasUpdate::REBUILD )
+    Log( "Rebuilt the CPU TLAS after moving %u instances", aNumInstances );
+
+  RestartAccumulation();
+}
+
+void PathTracer::UpdateRtLights() {
+  const uint        lightInstanceId = ( uint ) myLightInstanceIdx;
+  const glm::float3 lightEmission = GetLightEmission();
+  CpuRtLights &     lights = myRtScene->myLights;
+  if ( lights.IsBuiltFor( lightInstanceId, lightEmission ) )
+    return;
+
+  // Moving the light instance rebuilds the lights every frame of the drag, a queued frame may still read the old ones
+  myRtScene->RetireLightBuffers();
+
+  lights.Build( myCpuPathTracer->GetScene(), lightInstanceId, lightEmission );
+  if ( lights.IsEmpty() )
+    return;
+
+  GpuBufferProperties bufferProps;
+  bufferProps.myBindFlags = ( uint ) GpuBufferBindFlags::SHADER_BUFFER;
+  bufferProps.myNumElements = ( uint ) lights.myTriangles.size();
+  bufferProps.myElementSizeBytes = sizeof( CpuRtLightTriangle );
+  GpuBufferViewProperties bufferViewProps;
+  bufferViewProps.myIsRaw = true;
+  myRtScene->myLightTrianglesBuf =
+      RenderCore::CreateBuffer( bufferProps, "Rt light triangles", lights.myTriangles.data() );
+  myRtScene->myLightTriangles = RenderCore::CreateBufferView(
+      RenderCore::GetBuffer( myRtScene->myLightTrianglesBuf ), bufferViewProps, "Rt light triangles" );
+
+  bufferProps.myNumElements = ( uint ) lights.myInstanceFirstTriangles.size();
+  bufferProps.myElementSizeBytes = sizeof( uint );
+  myRtScene->myLightInstanceOffsetsBuf =
+      RenderCore::CreateBuffer( bufferProps, "Rt light instance offsets", lights.myInstanceFirstTriangles.data() );
+  myRtScene->myLightInstanceOffsets = RenderCore::CreateBufferView(
+      RenderCore::GetBuffer( myRtScene->myLightInstanceOffsetsBuf ), bufferViewProps, "Rt light instance offsets" );
+
+  bufferProps.myNumElements = ( uint ) lights.myBvhNodes.size();
+  bufferProps.myElementSizeBytes = sizeof( CpuRtLightBvhNode );
+  myRtScene->myLightBvhBuf = RenderCore::CreateBuffer( bufferProps, "Rt light BVH", lights.myBvhNodes.data() );
+  myRtScene->myLightBvh = RenderCore::CreateBufferView( RenderCore::GetBuffer( myRtScene->myLightBvhBuf ),
+                                                        bufferViewProps, "Rt light BVH" );
+}
+
+void PathTracer::RenderCpu( CommandList * ctx ) {
+  GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
+
+  Texture *                 hdrLightTex = RenderCore::GetTexture( myHdrLightTex );
+  const TextureProperties & texProps = hdrLightTex->GetProperties();
+  myCpuPathTracer->SetResolution( texProps.myWidth, texProps.myHeight );
+
+  if ( myAccumulationNeedsClear ) {
+    myCpuPathTracer->RestartAccumulation();
+    myAccumulationNeedsClear = false;
+    myNumAccumulationFrames = 0u;
+  }
+
+  myCpuPathTracer->RenderFrame( GetCpuRtConsts() );
+  myNumAccumulationFrames = myCpuPathTracer->GetNumAccumulationFrames();
+
+  TextureSubData uploadData;
+  uploadData.myData = ( uint8 * ) myCpuPathTracer->GetAccumulationBuffer();
+  uploadData.myPixelSizeBytes = sizeof( glm::float4 );
+  uploadData.myRowSizeBytes = texProps.myWidth * sizeof( glm::float4 );
+  uploadData.mySliceSizeBytes = uploadData.myRowSizeBytes * texProps.myHeight;
+  uploadData.myTotalSizeBytes = uploadData.mySliceSizeBytes;
+  ctx->UpdateTextureData( hdrLightTex, hdrLightTex->mySubresources, &uploadData, 1u );
 }
 
 void PathTracer::TonemapComposit( CommandList * ctx ) {
@@ -831,9 +1697,7 @@ void PathTracer::OnRtPipelineRecompiled( const RtPipelineState * aRtPipeline ) {
   RestartAccumulation();
 }
 
-void PathTracer::UpdateOutputTexture() {
-  RenderCore::WaitForIdle( CommandListType::Graphics );
-
+void PathTracer::DeleteOutputTextures() {
   if ( myHdrLightTexRead.IsValid() )
     RenderCore::DeleteTextureView( myHdrLightTexRead );
   if ( myHdrLightTexWrite.IsValid() )
@@ -842,6 +1706,22 @@ void PathTracer::UpdateOutputTexture() {
     RenderCore::DeleteTextureView( myHdrLightTexRtv );
   if ( myHdrLightTex.IsValid() )
     RenderCore::DeleteTexture( myHdrLightTex );
+  if ( myHdrMomentTexWrite.IsValid() )
+    RenderCore::DeleteTextureView( myHdrMomentTexWrite );
+  if ( myHdrMomentTex.IsValid() )
+    RenderCore::DeleteTexture( myHdrMomentTex );
+  if ( myTileErrorTexRead.IsValid() )
+    RenderCore::DeleteTextureView( myTileErrorTexRead );
+  if ( myTileErrorTexWrite.IsValid() )
+    RenderCore::DeleteTextureView( myTileErrorTexWrite );
+  if ( myTileErrorTex.IsValid() )
+    RenderCore::DeleteTexture( myTileErrorTex );
+}
+
+void PathTracer::UpdateOutputTexture() {
+  RenderCore::WaitForIdle( CommandListType::Graphics );
+
+  DeleteOutputTextures();
 
   uint width = RenderCore::GetRenderOutput( myRenderOutput )->GetWindow()->GetWidth();
   uint height = RenderCore::GetRenderOutput( myRenderOutput )->GetWindow()->GetHeight();
@@ -875,6 +1755,29 @@ void PathTracer::UpdateOutputTexture() {
   viewProps.myIsShaderWritable = false;
   myHdrLightTexRtv = RenderCore::CreateTextureView( lightTex, viewProps, "Light output texture rtv" );
   ASSERT( myHdrLightTexRtv.IsValid() );
+
+  props.myFormat = DataFormat::R_32F;
+  props.myIsRenderTarget = false;
+  myHdrMomentTex = RenderCore::CreateTexture( props, "Light second moment texture" );
+  ASSERT( myHdrMomentTex.IsValid() );
+
+  TextureViewProperties writeViewProps;
+  writeViewProps.myIsShaderWritable = true;
+  myHdrMomentTexWrite = RenderCore::CreateTextureView( RenderCore::GetTexture( myHdrMomentTex ), writeViewProps,
+                                                       "Light second moment texture write" );
+  ASSERT( myHdrMomentTexWrite.IsValid() );
+
+  props.myWidth = ( width + CPU_RT_TILE_SIZE - 1u ) / CPU_RT_TILE_SIZE;
+  props.myHeight = ( height + CPU_RT_TILE_SIZE - 1u ) / CPU_RT_TILE_SIZE;
+  myTileErrorTex = RenderCore::CreateTexture( props, "Tile error texture" );
+  ASSERT( myTileErrorTex.IsValid() );
+  Texture * tileErrorTex = RenderCore::GetTexture( myTileErrorTex );
+
+  myTileErrorTexRead =
+      RenderCore::CreateTextureView( tileErrorTex, TextureViewProperties(), "Tile error texture read" );
+  ASSERT( myTileErrorTexRead.IsValid() );
+  myTileErrorTexWrite = RenderCore::CreateTextureView( tileErrorTex, writeViewProps, "Tile error texture write" );
+  ASSERT( myTileErrorTexWrite.IsValid() );
 }
 
 void PathTracer::UpdateDepthbuffer() {
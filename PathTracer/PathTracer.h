@@ -5,7 +5,10 @@
 #include "Sky_Imgui.h"
 #include "Common/Application.h"
 #include "Rendering/ResourceHandle.h"
+#include "Rendering/RtAccelerationStructure.h"
 #include "DebugTextureList.h"
+#include "CpuPathTracer.h"
+#include "ObjImporter.h"
 
 class Sky;
 
@@ -35,24 +38,76 @@ struct BlasData {
   GpuBufferViewHandle           myTriangleIndices;
   GpuBufferHandle               myVertexDataBuf;
   GpuBufferViewHandle           myVertexData;
+  GpuBufferHandle               myPositionsBuf;  // Only for meshes of textured instances, for the texture LOD
+  GpuBufferViewHandle           myPositions;
+};
+
+// GPU resource that a queued frame may still use, either a TLAS or a buffer with its view
+struct RetiredRtResource {
+  RtAccelerationStructureHandle myTlas;
+  GpuBufferHandle               myBuffer;
+  GpuBufferViewHandle           myBufferView;
+  uint64                        myFrameIdx = 0u;  // Time::ourFrameIdx of the retirement
 };
 
 struct RaytracingScene {
   ~RaytracingScene();
+  void DeleteLightBuffers();
+
+  // Like DeleteLightBuffers(), but for buffers that a queued frame may still read. They are deleted by
+  // DeleteRetiredResources() once that frame is done, without waiting for the GPU.
+  void RetireLightBuffers();
+
+  // Sets the transforms of the given instances and rebuilds the TLAS from myTlasInstances. The BLAS, the per-instance
+  // data and the pipelines stay as they are. The previous TLAS may still be traced by a queued frame, so it is only
+  // retired and deleted by DeleteRetiredResources() once that frame is done, without waiting for the GPU.
+  void UpdateInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                                 uint aNumInstances );
+  void DeleteRetiredResources();
+
+  // Of the GPU buffers and acceleration structures. The sharing of the meshes is taken from aCpuReport, since
+  // myBlasDatas mirrors the meshes of the CpuRtScene. The positions are only kept for the meshes of textured instances,
+  // for the others they are just an input of the BLAS builds. The textures aren't included.
+  RtMemoryReport GetMemoryReport( const RtMemoryReport & aCpuReport ) const;
 
   GpuBufferHandle            myInstanceDataBuf;
   GpuBufferViewHandle        myInstanceData;
   GpuBufferHandle            myMaterialDataBuf;
   GpuBufferViewHandle        myMaterialData;
-  GpuBufferHandle            myHaltonSamplesBuf;
-  GpuBufferViewHandle        myHaltonSamples;
+  GpuBufferHandle            mySamplerTableBuf;
+  GpuBufferViewHandle        mySamplerTable;
+  GpuBufferHandle            myLightTrianglesBuf;
+  GpuBufferViewHandle        myLightTriangles;
+  GpuBufferHandle            myLightInstanceOffsetsBuf;
+  GpuBufferViewHandle        myLightInstanceOffsets;
+  GpuBufferHandle            myLightBvhBuf;
+  GpuBufferViewHandle        myLightBvh;
   RtPipelineStateHandle      myRtPso;
   RtShaderBindingTableHandle mySBT;
   RtPipelineStateHandle      myAoRtPso;
   RtShaderBindingTableHandle myAoSBT;
 
-  RtAccelerationStructureHandle myTLAS;
-  eastl::vector< BlasData >     myBlasDatas;
+  RtAccelerationStructureHandle                        myTLAS;
+  eastl::vector< RtAccelerationStructureInstanceData > myTlasInstances;  // Of myTLAS, kept for the updates
+  eastl::vector< RetiredRtResource >                   myRetiredResources;
+  eastl::vector< BlasData >                            myBlasDatas;  // One per mesh of the CpuRtScene
+
+  // Source of the light buffers, rebuilt when the light instance or its emission change
+  CpuRtLights myLights;
+
+  // Base-color textures of the materials, one per file, with all mips resident
+  eastl::vector< TextureHandle >     myBaseColorTextures;
+  eastl::vector< TextureViewHandle > myBaseColorTextureViews;
+  TextureSamplerHandle               myLinearWrapSampler;
+  uint64                             myTextureSize = 0u;
+};
+
+struct ObjImportBenchmarkResults {
+  float64        myMeshImporterTimeMs = 0.0;
+  float64        myObjImporterTimeMs = 0.0;
+  ObjImportStats myObjImporterStats;
+  bool           myMeshImporterSuccess = false;
+  bool           myObjImporterSuccess = false;
 };
 
 class PathTracer : public Fancy::Application {
@@ -62,9 +117,19 @@ public:
               const Fancy::WindowParameters &         someWindowParams );
 
   void LoadScene( const char * aPath, const glm::float3 & aCamPos );
+  void RunObjImportBenchmark();
   void InitSky();
-  void InitRtScene( const SceneData & aScene );
-  void InitSampleSequences();
+  void InitRtScene( const SceneData & aScene, const CpuRtScene & aCpuScene );
+  // Uploads the base-color textures of the materials, decoded like the CPU texture cache reads them. Writes the
+  // descriptor index of the texture of each material, or UINT_MAX.
+  void InitRtTextures( const SceneData & aScene, eastl::vector< uint > & someMaterialTexturesOut );
+  void InitSamplerTable();
+
+  // Moves scene instances in the raster scene, the CPU scene and the GPU TLAS, and rebuilds the lights if any of them
+  // emit. The replaced TLAS and light buffers are retired instead of waiting for the GPU. Restarts the accumulation. The UI doesn't call this directly, it queues its moves in
+  // myPendingInstanceIndices/myPendingInstanceTransforms and Update() applies them once per frame.
+  void UpdateInstanceTransforms( const uint * someInstanceIndices, const glm::float4x4 * someTransforms,
+                                 uint aNumInstances );
 
   ~PathTracer() override;
   void OnWindowResized( uint aWidth, uint aHeight ) override;
@@ -76,17 +141,24 @@ public:
 private:
   void OnRtPipelineRecompiled( const RtPipelineState * aRtPipeline );
   void UpdateOutputTexture();
+  void DeleteOutputTextures();
   void UpdateDepthbuffer();
   void RestartAccumulation();
   bool CameraHasChanged();
+  void UpdateRtLights();
 
   void UpdateMainMenuBar();
   void UpdatePathTracingSettings();
 
   void RenderRaster( CommandList * ctx );
   void RenderRT( CommandList * ctx );
+  void ComputeTileErrors( CommandList * ctx );
+  void RenderCpu( CommandList * ctx );
   void TonemapComposit( CommandList * ctx );
 
+  CpuRtConsts GetCpuRtConsts();
+  glm::float3 GetLightEmission() const;
+
   UniquePtr< Sky > mySky;
   Sky_Imgui        mySky_Imgui;
 
@@ -94,14 +166,24 @@ private:
   ShaderPipelineHandle myUnlitMeshShader;
   ShaderPipelineHandle myTonemapCompositShader;
   ShaderPipelineHandle myClearTextureShader;
+  ShaderPipelineHandle myTileErrorShader;
 
   UniquePtr< RaytracingScene > myRtScene;
+  UniquePtr< CpuPathTracer >   myCpuPathTracer;
 
   TextureHandle     myHdrLightTex;
   TextureViewHandle myHdrLightTexRtv;
   TextureViewHandle myHdrLightTexWrite;
   TextureViewHandle myHdrLightTexRead;
 
+  // Adaptive sampling: second moment of the luminance next to myHdrLightTex and the error of each pixel tile, see
+  // compute_tile_error.hlsl
+  TextureHandle     myHdrMomentTex;
+  TextureViewHandle myHdrMomentTexWrite;
+  TextureHandle     myTileErrorTex;
+  TextureViewHandle myTileErrorTexRead;
+  TextureViewHandle myTileErrorTexWrite;
+
   TextureHandle     myDepthStencilTex;
   TextureViewHandle myDepthStencilDsv;
 
@@ -114,12 +196,61 @@ private:
   bool          myAccumulationNeedsClear = true;
   glm::float4x4 myLastViewMat;
 
+  // Instance moves of the UI in this frame, one entry per instance
+  eastl::vector< uint >          myPendingInstanceIndices;
+  eastl::vector< glm::float4x4 > myPendingInstanceTransforms;
+
+  // Heap allocations, see GetNumHeapAllocations(). A frame counts from one BeginFrame() to the next.
+  uint64 myFrameStartNumAllocations = 0u;
+  uint64 myNumFrameAllocations = 0u;
+  uint64 myNumLoadAllocations = 0u;
+
+  // Of the last scene load. myGpuMemoryReport stays empty without raytracing support.
+  RtMemoryReport myCpuMemoryReport;
+  RtMemoryReport myGpuMemoryReport;
+
+  CpuTraversalBenchmarkResults                  myCpuTraversalBenchmark;
+  bool                                          myHasCpuTraversalBenchmark = false;
+  eastl::vector< CpuWavefrontBounceStats >      myCpuWavefrontBenchmark;
+  CpuIntegratorBenchmarkResults                 myCpuIntegratorBenchmark;
+  bool                                          myHasCpuIntegratorBenchmark = false;
+  CpuRussianRouletteBenchmarkResults            myCpuRouletteBenchmark;
+  bool                                          myHasCpuRouletteBenchmark = false;
+  CpuSamplerBenchmarkResults                    myCpuSamplerBenchmark;
+  bool                                          myHasCpuSamplerBenchmark = false;
+  eastl::vector< CpuSchedulerBenchmarkResults > myCpuSchedulerBenchmark;
+  CpuTlasUpdateBenchmarkResults                 myCpuTlasUpdateBenchmark;
+  bool                                          myHasCpuTlasUpdateBenchmark = false;
+  CpuLightSamplingBenchmarkResults              myLightSamplingBenchmark;
+  bool                                          myHasLightSamplingBenchmark = false;
+  ObjImportBenchmarkResults                     myObjImportBenchmark;
+  bool                                          myHasObjImportBenchmark = false;
+  SkyLookupBenchmarkResults                     mySkyLookupBenchmark;
+  bool                                          myHasSkyLookupBenchmark = false;
+  eastl::vector< SkyLutBuildBenchmarkResults >  mySkyLutBuildBenchmark;
+
   ImGuiContext * myImGuiContext = nullptr;
   bool           myRenderRaster = false;
   bool           myRenderAo = false;
+  bool           myRenderCpu = false;
+  bool           myCpuWavefront = false;
+  bool           myUseSceneCache = true;
+  bool           myUseObjImporter = true;
+  bool           myCompactVertexData = false;  // Octahedral normals, half UVs and 16-bit indices for the shading
   bool           myAccumulate = true;
   bool           myHalfResRender = true;
   bool           mySampleSky = true;
+  bool           mySkyRadianceLut = false;  // Ray misses fetch the radiance LUT instead of integrating the atmosphere
+  bool           myNextEventEstimation = true;
+  bool           myLightBvh = true;  // Next-event estimation picks lights with the light BVH instead of the alias table
+  bool           myRussianRoulette = true;
+  int            myRussianRouletteMinBounces = 2;
+  glm::float2    myRussianRouletteSurvival = glm::float2( 0.05f, 0.95f );  // Min and max survival probability
+  bool           myAdaptiveSampling = false;
+  float          myAdaptiveErrorThreshold = 0.02f;  // Relative RMSE at which a tile stops getting samples
+  int            myAdaptiveMinSamples = 16;
+  int            mySampler = ( int ) SamplerType::SOBOL;
+  int            myMovedInstanceIdx = 0;  // Of the instance the UI moves
   float          mySkyFallbackIntensity = 100.0f;
   int            myMaxRecursionDepth = 4;
   int            myLightInstanceIdx = 4;
@@ -2,8 +2,10 @@
 #include <shellapi.h>
 
 #include <array>
+#include <stdio.h>
 #include <EASTL/vector.h>
 
+#include "BatchRender.h"
 #include "PathTracer.h"
 #include "Common/StringUtil.h"
 #include "Common/Window.h"
@@ -36,6 +38,26 @@ _Use_decl_annotations_ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE, LPSTR
 
   LocalFree( commandLineArgs );
 
+  // Headless render without window or GPU device. The report goes to the console the render was started from.
+  if ( IsBatchRender( cStrings.data(), ( uint ) cStrings.size() ) ) {
+    if ( AttachConsole( ATTACH_PARENT_PROCESS ) ) {
+      freopen( "CONOUT$", "w", stdout );
+      freopen( "CONOUT$", "w", stderr );
+    }
+
+    BatchRenderSettings settings;
+    BatchRenderStats    stats;
+    if ( !ParseBatchRenderSettings( cStrings.data(), ( uint ) cStrings.size(), settings ) ||
+         !RunBatchRender( settings, stats ) ) {
+      printf( "Batch render failed\n" );
+      return 1;
+    }
+
+    printf( "%s: load %.2f ms, render %.2f ms, %.0f samples/s\n", settings.myOutputPath.c_str(), stats.myLoadTimeMs,
+            stats.myRenderTimeMs, stats.mySamplesPerSecond );
+    return 0;
+  }
+
   RenderPlatformProperties renderProperties;
   WindowParameters         windowParams;
   windowParams.myWidth = 1280;
@@ -0,0 +1,105 @@
+#include "ProcessStats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined( _WIN32 )
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace Priv_ProcessStats {
+  // Relaxed, the counters are only compared between points that are ordered with the allocating threads anyway
+  std::atomic< uint64 > ourNumHeapAllocations( 0u );
+  std::atomic< uint64 > ourHeapAllocatedBytes( 0u );
+
+  void * CountedAlloc( size_t aSize ) {
+    ourNumHeapAllocations.fetch_add( 1u, std::memory_order_relaxed );
+    ourHeapAllocatedBytes.fetch_add( aSize, std::memory_order_relaxed );
+    return malloc( aSize > 0u ? aSize : 1u );
+  }
+
+  void * CountedAlignedAlloc( size_t aSize, size_t anAlignment ) {
+    ourNumHeapAllocations.fetch_add( 1u, std::memory_order_relaxed );
+    ourHeapAllocatedBytes.fetch_add( aSize, std::memory_order_relaxed );
+#if defined( _WIN32 )
+    return _aligned_malloc( aSize > 0u ? aSize : 1u, anAlignment );
+#else
+    void * result = nullptr;
+    return posix_memalign( &result, anAlignment, aSize > 0u ? aSize : 1u ) == 0 ? result : nullptr;
+#endif
+  }
+
+  void AlignedFree( void * aPtr ) {
+#if defined( _WIN32 )
+    _aligned_free( aPtr );
+#else
+    free( aPtr );
+#endif
+  }
+}  // namespace Priv_ProcessStats
+
+using namespace Priv_ProcessStats;
+
+// Replacements of the global allocation functions that count the allocations. The nothrow and array versions of the
+// standard library forward to these, and so do the EASTL allocation hooks of Fancy (see GetNumHeapAllocations()).
+void * operator new( size_t aSize ) {
+  void * result = CountedAlloc( aSize );
+  if ( result == nullptr )
+    throw std::bad_alloc();
+  return result;
+}
+
+void * operator new( size_t aSize, std::align_val_t anAlignment ) {
+  void * result = CountedAlignedAlloc( aSize, ( size_t ) anAlignment );
+  if ( result == nullptr )
+    throw std::bad_alloc();
+  return result;
+}
+
+void operator delete( void * aPtr ) noexcept {
+  free( aPtr );
+}
+
+void operator delete( void * aPtr, size_t ) noexcept {
+  free( aPtr );
+}
+
+void operator delete( void * aPtr, std::align_val_t ) noexcept {
+  AlignedFree( aPtr );
+}
+
+void operator delete( void * aPtr, size_t, std::align_val_t ) noexcept {
+  AlignedFree( aPtr );
+}
+
+uint64 GetNumHeapAllocations() {
+  return ourNumHeapAllocations.load( std::memory_order_relaxed );
+}
+
+uint64 GetHeapAllocatedBytes() {
+  return ourHeapAllocatedBytes.load( std::memory_order_relaxed );
+}
+
+uint64 GetPeakResidentMemory() {
+#if defined( _WIN32 )
+  PROCESS_MEMORY_COUNTERS counters;
+  if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+    return 0u;
+  return ( uint64 ) counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+    return 0u;
+  #if defined( __APPLE__ )
+  return ( uint64 ) usage.ru_maxrss;
+  #else
+  return ( uint64 ) usage.ru_maxrss * 1024u;  // In KiB on Linux
+  #endif
+#endif
+}
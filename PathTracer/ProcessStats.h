@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Common/FancyCoreDefines.h"
+
+using namespace Fancy;
+
+// Peak resident set size (peak working set on Windows) of this process in bytes, 0 if unavailable
+uint64 GetPeakResidentMemory();
+
+// Heap allocations since the start of the process and the bytes they asked for. Counts every call of the global
+// operator new of this executable, which LinearAllocator chunks go through too. The EASTL containers are only counted
+// because the EASTL allocation hooks of Fancy, operator new[]( size_t, const char *, int, unsigned, const char *, int )
+// and its aligned variant, forward to the global operator new[]. -check-allocations relies on that, so it has to hold
+// if those hooks change. Allocations that bypass operator new, like malloc() in third-party code or the driver, aren't
+// counted. The difference of two calls gives the allocations of a frame or a scene load.
+uint64 GetNumHeapAllocations();
+uint64 GetHeapAllocatedBytes();
@@ -0,0 +1,294 @@
+#include "SceneCache.h"
+
+#include <filesystem>
+#include <system_error>
+
+#include "Common/MathUtil.h"
+#include "IO/MeshImporter.h"
+#include "IO/PathService.h"
+#include "CpuRtScene.h"
+
+namespace Priv_SceneCache {
+  const uint64 MAGIC = 0x48434143454e4353ull;  // "SCNECACH"
+
+  struct Header {
+    uint64 myMagic;
+    uint   myVersion;
+    uint   mySimdWidth;  // The padding of the triangle store depends on it
+    uint64 mySourceSize;
+    int64  mySourceWriteTime;
+    uint64 mySourcePathHash;
+    uint64 myAttributesHash;
+  };
+
+  bool GetHeader( const char * aSourcePath, const VertexShaderAttributeDesc * someAttributes, uint aNumAttributes,
+                  Header & aHeaderOut ) {
+    const eastl::string absolutePath = Path::GetAbsolutePath( aSourcePath );
+
+    std::error_code             error;
+    const std::filesystem::path sourcePath( absolutePath.c_str() );
+    const uintmax_t             sourceSize = std::filesystem::file_size( sourcePath, error );
+    if ( error )
+      return false;
+
+    const std::filesystem::file_time_type writeTime = std::filesystem::last_write_time( sourcePath, error );
+    if ( error )
+      return false;
+
+    eastl::vector< uint > attributes;
+    for ( uint i = 0u; i < aNumAttributes; ++i ) {
+      attributes.push_back( ( uint ) someAttributes[ i ].mySemantic );
+      attributes.push_back( someAttributes[ i ].mySemanticIndex );
+      attributes.push_back( ( uint ) someAttributes[ i ].myFormat );
+    }
+
+    memset( &aHeaderOut, 0, sizeof( aHeaderOut ) );
+    aHeaderOut.myMagic = MAGIC;
+    aHeaderOut.myVersion = SceneCache::VERSION;
+    aHeaderOut.mySimdWidth = CPU_SIMD_WIDTH;
+    aHeaderOut.mySourceSize = ( uint64 ) sourceSize;
+    aHeaderOut.mySourceWriteTime = ( int64 ) writeTime.time_since_epoch().count();
+    aHeaderOut.mySourcePathHash =
+        MathUtil::ByteHash( reinterpret_cast< const uint8 * >( absolutePath.c_str() ), absolutePath.size() );
+    aHeaderOut.myAttributesHash = MathUtil::ByteHash( reinterpret_cast< const uint8 * >( attributes.data() ),
+                                                      attributes.size() * sizeof( uint ) );
+    return true;
+  }
+
+  void WriteVertexLayout( SceneCacheWriter & aWriter, const VertexInputLayoutProperties & aLayout ) {
+    aWriter.WriteArray( aLayout.myAttributes.data(), aLayout.myAttributes.size() );
+    aWriter.WriteArray( aLayout.myBufferBindings.data(), aLayout.myBufferBindings.size() );
+  }
+
+  void ReadVertexLayout( SceneCacheReader & aReader, VertexInputLayoutProperties & aLayoutOut ) {
+    uint64                           numAttributes;
+    const VertexInputAttributeDesc * attributes = aReader.ReadArray< VertexInputAttributeDesc >( numAttributes );
+    aLayoutOut.myAttributes.clear();
+    if ( attributes && numAttributes <= aLayoutOut.myAttributes.max_size() )
+      aLayoutOut.myAttributes.assign( attributes, attributes + numAttributes );
+
+    uint64                       numBindings;
+    const VertexBufferBindDesc * bindings = aReader.ReadArray< VertexBufferBindDesc >( numBindings );
+    aLayoutOut.myBufferBindings.clear();
+    if ( bindings && numBindings <= aLayoutOut.myBufferBindings.max_size() )
+      aLayoutOut.myBufferBindings.assign( bindings, bindings + numBindings );
+  }
+}  // namespace Priv_SceneCache
+
+SceneCacheWriter::~SceneCacheWriter() {
+  if ( myFile )
+    fclose( myFile );
+}
+
+bool SceneCacheWriter::Open( const char * aPath ) {
+  ASSERT( myFile == nullptr );
+  myFile = fopen( aPath, "wb" );
+  myOffset = 0u;
+  myFailed = myFile == nullptr;
+  return !myFailed;
+}
+
+bool SceneCacheWriter::Close() {
+  if ( myFile ) {
+    myFailed |= fclose( myFile ) != 0;
+    myFile = nullptr;
+  }
+  return !myFailed;
+}
+
+void SceneCacheWriter::WriteBytes( const void * someData, uint64 aSize ) {
+  if ( myFailed || aSize == 0u )
+    return;
+
+  myFailed = fwrite( someData, 1, ( size_t ) aSize, myFile ) != ( size_t ) aSize;
+  myOffset += aSize;
+}
+
+void SceneCacheWriter::WriteString( const char * aString ) {
+  WriteArray( aString, strlen( aString ) );
+}
+
+void SceneCacheWriter::Align() {
+  const uint8  padding[ ARRAY_ALIGNMENT ] = {};
+  const uint64 alignedOffset = ( myOffset + ARRAY_ALIGNMENT - 1u ) & ~( uint64 )( ARRAY_ALIGNMENT - 1u );
+  WriteBytes( padding, alignedOffset - myOffset );
+}
+
+SceneCacheReader::SceneCacheReader( const uint8 * someData, uint64 aSize )
+  : myData( someData )
+  , mySize( aSize ) {
+}
+
+const uint8 * SceneCacheReader::ReadBytes( uint64 aSize ) {
+  if ( myFailed || aSize > mySize - myOffset ) {
+    myFailed = true;
+    return nullptr;
+  }
+
+  const uint8 * data = myData + myOffset;
+  myOffset += aSize;
+  return data;
+}
+
+void SceneCacheReader::ReadString( eastl::string & aStringOut ) {
+  uint64       length;
+  const char * chars = ReadArray< char >( length );
+  aStringOut.clear();
+  if ( chars )
+    aStringOut.assign( chars, chars + length );
+}
+
+void SceneCacheReader::Align() {
+  const uint64 alignedOffset = ( myOffset + SceneCacheWriter::ARRAY_ALIGNMENT - 1u ) &
+                               ~( uint64 )( SceneCacheWriter::ARRAY_ALIGNMENT - 1u );
+  if ( alignedOffset > mySize )
+    myFailed = true;
+  else
+    myOffset = alignedOffset;
+}
+
+eastl::string SceneCache::GetCachePath( const char * aSourcePath ) {
+  return Path::GetAbsolutePath( aSourcePath ) + ".ptcache";
+}
+
+bool SceneCache::Write( const char * aSourcePath, const VertexShaderAttributeDesc * someAttributes,
+                        uint aNumAttributes, const SceneData & aScene, const CpuRtScene & aCpuScene ) {
+  using namespace Priv_SceneCache;
+
+  static_assert( std::is_trivially_copyable< MeshDesc >::value, "MeshDesc is written as bytes" );
+
+  Header header;
+  if ( !GetHeader( aSourcePath, someAttributes, aNumAttributes, header ) )
+    return false;
+
+  // Written under a temporary name so an interrupted write never leaves a cache that passes the header check
+  const eastl::string cachePath = GetCachePath( aSourcePath );
+  const eastl::string tempPath = cachePath + ".tmp";
+
+  SceneCacheWriter writer;
+  if ( !writer.Open( tempPath.c_str() ) )
+    return false;
+
+  writer.Write( header );
+  WriteVertexLayout( writer, aScene.myVertexInputLayoutProperties );
+  writer.WriteVector( aScene.myInstances );
+
+  writer.Write( ( uint64 ) aScene.myMaterials.size() );
+  for ( const MaterialDesc & material : aScene.myMaterials ) {
+    for ( const eastl::string & texture : material.myTextures )
+      writer.WriteString( texture.c_str() );
+    writer.Write( material.myParameters );
+  }
+
+  writer.Write( ( uint64 ) aScene.myMeshes.size() );
+  for ( const MeshData & mesh : aScene.myMeshes ) {
+    writer.Write( mesh.myDesc );
+    writer.Write( ( uint64 ) mesh.myParts.size() );
+    for ( const MeshPartData & part : mesh.myParts ) {
+      WriteVertexLayout( writer, part.myVertexLayoutProperties );
+      writer.WriteVector( part.myVertexData );
+      writer.WriteVector( part.myIndexData );
+    }
+  }
+
+  aCpuScene.WriteCache( writer );
+
+  std::error_code error;
+  if ( writer.Close() )
+    std::filesystem::rename( tempPath.c_str(), cachePath.c_str(), error );
+  else
+    error = std::make_error_code( std::errc::io_error );
+
+  if ( error ) {
+    std::filesystem::remove( tempPath.c_str(), error );
+    return false;
+  }
+  return true;
+}
+
+bool SceneCache::Open( const char * aSourcePath, const VertexShaderAttributeDesc * someAttributes,
+                       uint aNumAttributes ) {
+  using namespace Priv_SceneCache;
+
+  Close();
+
+  Header expectedHeader;
+  if ( !GetHeader( aSourcePath, someAttributes, aNumAttributes, expectedHeader ) )
+    return false;
+
+  myFile = eastl::make_shared< MappedFile >();
+  if ( !myFile->Open( GetCachePath( aSourcePath ).c_str() ) ) {
+    myFile.reset();
+    return false;
+  }
+
+  myReader = SceneCacheReader( myFile->GetData(), myFile->GetSize() );
+
+  Header header;
+  myReader.Read( header );
+  if ( myReader.HasFailed() || memcmp( &header, &expectedHeader, sizeof( header ) ) != 0 ) {
+    Log( "Scene cache of %s is outdated", aSourcePath );
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool SceneCache::ReadScene( SceneData & aSceneOut, bool aReadMeshData ) {
+  using namespace Priv_SceneCache;
+
+  ReadVertexLayout( myReader, aSceneOut.myVertexInputLayoutProperties );
+  myReader.ReadVector( aSceneOut.myInstances );
+
+  uint64 numMaterials;
+  myReader.Read( numMaterials );
+  aSceneOut.myMaterials.clear();
+  for ( uint64 i = 0u; i < numMaterials && !myReader.HasFailed(); ++i ) {
+    MaterialDesc & material = aSceneOut.myMaterials.push_back();
+    for ( eastl::string & texture : material.myTextures )
+      myReader.ReadString( texture );
+    myReader.Read( material.myParameters );
+  }
+
+  uint64 numMeshes;
+  myReader.Read( numMeshes );
+  aSceneOut.myMeshes.clear();
+  for ( uint64 i = 0u; i < numMeshes && !myReader.HasFailed(); ++i ) {
+    MeshData & mesh = aSceneOut.myMeshes.push_back();
+    myReader.Read( mesh.myDesc );
+
+    uint64 numParts;
+    myReader.Read( numParts );
+    for ( uint64 iPart = 0u; iPart < numParts && !myReader.HasFailed(); ++iPart ) {
+      MeshPartData & part = mesh.myParts.push_back();
+      ReadVertexLayout( myReader, part.myVertexLayoutProperties );
+      if ( aReadMeshData ) {
+        myReader.ReadVector( part.myVertexData );
+        myReader.ReadVector( part.myIndexData );
+      } else {
+        uint64 count;
+        myReader.ReadArray< uint8 >( count );
+        myReader.ReadArray< uint8 >( count );
+      }
+    }
+  }
+
+  bool isValid = !myReader.HasFailed();
+  for ( const SceneMeshInstance & instance : aSceneOut.myInstances ) {
+    isValid &= instance.myMeshIndex < aSceneOut.myMeshes.size();
+    isValid &= instance.myMaterialIndex < aSceneOut.myMaterials.size();
+  }
+
+  if ( !isValid ) {
+    Log( "Scene cache is corrupt" );
+    aSceneOut = SceneData();
+    Close();
+  }
+  return isValid;
+}
+
+void SceneCache::Close() {
+  myReader = SceneCacheReader();
+  myFile.reset();
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <type_traits>
+#include <EASTL/string.h>
+
+#include "Common/FancyCoreDefines.h"
+#include "Common/Ptr.h"
+#include "MappedFile.h"
+
+class CpuRtScene;
+
+namespace Fancy {
+  struct SceneData;
+  struct VertexShaderAttributeDesc;
+}
+
+using namespace Fancy;
+
+// Sequential writer for scene cache files. Values are stored in their in-memory layout, so a cache is only valid for
+// the build that wrote it (see SceneCache::VERSION). Arrays start at ARRAY_ALIGNMENT so they can be used in place.
+class SceneCacheWriter {
+public:
+  enum { ARRAY_ALIGNMENT = 64 };
+
+  ~SceneCacheWriter();
+
+  bool Open( const char * aPath );
+  bool Close();  // Returns false if any write failed
+
+  void WriteBytes( const void * someData, uint64 aSize );
+
+  template < class T >
+  void Write( const T & aValue ) {
+    static_assert( std::is_trivially_copyable< T >::value, "Only trivially copyable types can be written as bytes" );
+    WriteBytes( &aValue, sizeof( T ) );
+  }
+
+  template < class T >
+  void WriteArray( const T * someValues, uint64 aCount ) {
+    static_assert( std::is_trivially_copyable< T >::value, "Only trivially copyable types can be written as bytes" );
+    Write( aCount );
+    Align();
+    WriteBytes( someValues, aCount * sizeof( T ) );
+  }
+
+  template < class VectorT >
+  void WriteVector( const VectorT & aVector ) {
+    WriteArray( aVector.data(), ( uint64 ) aVector.size() );
+  }
+
+  void WriteString( const char * aString );
+
+private:
+  void Align();
+
+  FILE * myFile = nullptr;
+  uint64 myOffset = 0u;
+  bool   myFailed = false;
+};
+
+// Reads back what a SceneCacheWriter wrote. A read past the end marks the reader as failed and leaves the output
+// zeroed/empty, so callers only need to check HasFailed() once at the end.
+class SceneCacheReader {
+public:
+  SceneCacheReader() = default;
+  SceneCacheReader( const uint8 * someData, uint64 aSize );
+
+  // Returns a pointer into the cache data or nullptr on failure
+  const uint8 * ReadBytes( uint64 aSize );
+
+  template < class T >
+  void Read( T & aValueOut ) {
+    static_assert( std::is_trivially_copyable< T >::value, "Only trivially copyable types can be read as bytes" );
+    const uint8 * data = ReadBytes( sizeof( T ) );
+    if ( data )
+      memcpy( &aValueOut, data, sizeof( T ) );
+    else
+      memset( static_cast< void * >( &aValueOut ), 0, sizeof( T ) );
+  }
+
+  // Returns a pointer to the array inside the cache data, valid as long as the data is
+  template < class T >
+  const T * ReadArray( uint64 & aCountOut ) {
+    static_assert( std::is_trivially_copyable< T >::value, "Only trivially copyable types can be read as bytes" );
+    Read( aCountOut );
+    Align();
+    const uint8 * data = aCountOut <= mySize / sizeof( T ) ? ReadBytes( aCountOut * sizeof( T ) ) : nullptr;
+    if ( !data ) {
+      myFailed = true;
+      aCountOut = 0u;
+    }
+    return reinterpret_cast< const T * >( data );
+  }
+
+  template < class VectorT >
+  void ReadVector( VectorT & aVectorOut ) {
+    uint64                               count;
+    const typename VectorT::value_type * values = ReadArray< typename VectorT::value_type >( count );
+    aVectorOut.clear();
+    if ( values )
+      aVectorOut.assign( values, values + count );
+  }
+
+  void ReadString( eastl::string & aStringOut );
+
+  bool HasFailed() const {
+    return myFailed;
+  }
+
+private:
+  void Align();
+
+  const uint8 * myData = nullptr;
+  uint64        mySize = 0u;
+  uint64        myOffset = 0u;
+  bool          myFailed = false;
+};
+
+// Binary cache of an imported scene, stored next to the source file. It holds the SceneData as MeshImporter returns
+// it and the de-interleaved streams, BVHs and triangle data of the CpuRtScene, so a warm load maps the file and copies
+// the data out without any parsing. A cache is only used if its version, the source path, the size and write time of
+// the source file and the requested vertex attributes all match. Files the source references (e.g. an OBJ's .mtl)
+// are not tracked.
+class SceneCache {
+public:
+  enum { VERSION = 4 };
+
+  static eastl::string GetCachePath( const char * aSourcePath );
+
+  static bool Write( const char * aSourcePath, const VertexShaderAttributeDesc * someAttributes, uint aNumAttributes,
+                     const SceneData & aScene, const CpuRtScene & aCpuScene );
+
+  // Maps the cache of aSourcePath. Fails if there is none or it doesn't match the source file and attributes.
+  bool Open( const char * aSourcePath, const VertexShaderAttributeDesc * someAttributes, uint aNumAttributes );
+  // Without aReadMeshData, the vertex and index data of the mesh parts is skipped and left empty. Enough for a
+  // CpuRtScene whose BLAS are streamed from the cache.
+  bool ReadScene( SceneData & aSceneOut, bool aReadMeshData = true );
+  void Close();
+
+  // Positioned behind the SceneData after ReadScene(), pass the cache on to CpuRtScene::Init()
+  SceneCacheReader & GetReader() {
+    return myReader;
+  }
+
+  // Arrays returned by the reader stay valid as long as a reference to the file is held, even after Close()
+  const SharedPtr< MappedFile > & GetFile() const {
+    return myFile;
+  }
+
+private:
+  SharedPtr< MappedFile > myFile;
+  SceneCacheReader        myReader;
+};
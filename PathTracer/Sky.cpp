@@ -8,68 +8,22 @@
 #include "Rendering/Texture.h"
 #include "imgui.h"
 
-namespace Priv_Sky {
-  struct SkyLutConsts {
-    enum {
-      TRANSMITTANCE_TEXTURE_WIDTH = 256,
-      TRANSMITTANCE_TEXTURE_HEIGHT = 64,
-      SKY_VIEW_TEXTURE_WIDTH = 192,
-      SKY_VIEW_TEXTURE_HEIGHT = 108,
-      SCATTERING_TEXTURE_R_SIZE = 32,
-      SCATTERING_TEXTURE_MU_SIZE = 128,
-      SCATTERING_TEXTURE_MU_S_SIZE = 32,
-      SCATTERING_TEXTURE_NU_SIZE = 8,
-      IRRADIANCE_TEXTURE_WIDTH = 64,
-      IRRADIANCE_TEXTURE_HEIGHT = 16,
-      MULTI_SCATTERING_LUT_RES = 32,
-
-      SCATTERING_TEXTURE_WIDTH = SCATTERING_TEXTURE_NU_SIZE * SCATTERING_TEXTURE_MU_S_SIZE,
-      SCATTERING_TEXTURE_HEIGHT = SCATTERING_TEXTURE_MU_SIZE,
-      SCATTERING_TEXTURE_DEPTH = SCATTERING_TEXTURE_R_SIZE,
-    };
-  };
-
-  void SetupEarthAtmosphere( AtmosphereParameters & someParams ) {
-    // All units in kilometers
-    const float EarthBottomRadius = 6360000.0f;
-    const float EarthTopRadius = 6460000.0f;  // 100km atmosphere radius, less edge visible and it contain 99.99% of the
-                                              // atmosphere medium https://en.wikipedia.org/wiki/K%C3%A1rm%C3%A1n_line
-    const float EarthRayleighScaleHeight = 8000.0f;
-    const float EarthMieScaleHeight = 1200.0f;
-
-    someParams.RayleighScattering = { 0.000005802f, 0.000013558f, 0.000033100f };  // 1/km
-    someParams.RayleighDensityExpScale = -1.0f / EarthRayleighScaleHeight;
-    someParams.AbsorptionExtinction = { 0.000000650f, 0.000001881f, 0.0000000085f };  // 1/km
-    someParams.BottomRadius = EarthBottomRadius;
-    someParams.GroundAlbedo = { 0.0f, 0.0f, 0.0f };
-    someParams.TopRadius = EarthTopRadius;
-    someParams.MieScattering = { 0.000003996f, 0.000003996f, 0.000003996f };  // 1/km
-    someParams.MieDensityExpScale = -1.0f / EarthMieScaleHeight;
-    someParams.MieExtinction = { 0.000004440f, 0.000004440f, 0.000004440f };  // 1/km
-    someParams.MiePhaseG = 0.8f;
-    someParams.MieAbsorption = glm::max( glm::float3( 0, 0, 0 ), someParams.MieExtinction - someParams.MieScattering );
-    someParams.AbsorptionDensity0LayerWidth = 25000.0f;
-    someParams.AbsorptionDensity0ConstantTerm = -2.0f / 3.0f;
-    someParams.AbsorptionDensity0LinearTerm = 1.0f / 15.0f;
-    someParams.AbsorptionDensity1ConstantTerm = 8.0f / 3.0f;
-    someParams.AbsorptionDensity1LinearTerm = -1.0f / 15.0f;
-  }
-}  // namespace Priv_Sky
-
 Sky::Sky( const SkyParameters & someParams ) : myParams( someParams ) {
-  Priv_Sky::SetupEarthAtmosphere( myAtmosphereParams );
+  SetupEarthAtmosphere( myAtmosphereParams );
 
   myComputeTransmittanceLut = RenderCore::CreateComputeShaderPipeline(
       "resources/shaders/sky/compute_transmittance_lut.hlsl", "main", "OPTICAL_DEPTH_ONLY" );
   myComputeSkyViewLut =
       RenderCore::CreateComputeShaderPipeline( "resources/shaders/sky/compute_skyView_lut.hlsl", "main" );
+  myComputeRadianceLut =
+      RenderCore::CreateComputeShaderPipeline( "resources/shaders/sky/compute_sky_radiance_lut.hlsl", "main" );
   myRenderSkyShader = RenderCore::CreateComputeShaderPipeline( "resources/shaders/render_sky.hlsl" );
 
   // Transmittance lut texture
   {
     TextureProperties props;
-    props.myWidth = Priv_Sky::SkyLutConsts::TRANSMITTANCE_TEXTURE_WIDTH;
-    props.myHeight = Priv_Sky::SkyLutConsts::TRANSMITTANCE_TEXTURE_HEIGHT;
+    props.myWidth = SkyLutConsts::TRANSMITTANCE_TEXTURE_WIDTH;
+    props.myHeight = SkyLutConsts::TRANSMITTANCE_TEXTURE_HEIGHT;
     props.myFormat = DataFormat::RGBA_16F;
     props.myIsShaderWritable = true;
     myTransmittanceLutTex = RenderCore::CreateTexture( props, "Transmittance Lut" );
@@ -82,21 +36,38 @@ Sky::Sky( const SkyParameters & someParams ) : myParams( someParams ) {
     myTransmittanceLutWrite = RenderCore::CreateTextureView( transmittanceLutTex, viewProps, "Transmittance Lut Uav" );
   }
 
-  // Sky view lut texture
-  {
+  // Sky view lut textures, one per cache slot
+  for ( uint i = 0u; i < SkyLutCache::NUM_SLOTS; ++i ) {
     TextureProperties props;
-    props.myWidth = Priv_Sky::SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH;
-    props.myHeight = Priv_Sky::SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT;
+    props.myWidth = SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH;
+    props.myHeight = SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT;
     props.myFormat = DataFormat::RGB_11_11_10F;
     props.myIsShaderWritable = true;
-    mySkyViewLutTex = RenderCore::CreateTexture( props, "Sky view Lut" );
-    Texture * skyViewLutTex = RenderCore::GetTexture( mySkyViewLutTex );
+    mySkyViewLutTex[ i ] = RenderCore::CreateTexture( props, "Sky view Lut" );
+    Texture * skyViewLutTex = RenderCore::GetTexture( mySkyViewLutTex[ i ] );
 
     TextureViewProperties viewProps;
-    mySkyViewLutRead = RenderCore::CreateTextureView( skyViewLutTex, viewProps, "Sky view Lut Srv" );
+    mySkyViewLutRead[ i ] = RenderCore::CreateTextureView( skyViewLutTex, viewProps, "Sky view Lut Srv" );
 
     viewProps.myIsShaderWritable = true;
-    mySkyViewLutWrite = RenderCore::CreateTextureView( skyViewLutTex, viewProps, "Sky view Lut Uav" );
+    mySkyViewLutWrite[ i ] = RenderCore::CreateTextureView( skyViewLutTex, viewProps, "Sky view Lut Uav" );
+  }
+
+  // Full-sphere radiance lut textures, one per cache slot
+  for ( uint i = 0u; i < SkyLutCache::NUM_SLOTS; ++i ) {
+    TextureProperties props;
+    props.myWidth = GetSkyRadianceLutTextureWidth();
+    props.myHeight = SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT;
+    props.myFormat = DataFormat::RGBA_16F;
+    props.myIsShaderWritable = true;
+    myRadianceLutTex[ i ] = RenderCore::CreateTexture( props, "Sky radiance Lut" );
+    Texture * radianceLutTex = RenderCore::GetTexture( myRadianceLutTex[ i ] );
+
+    TextureViewProperties viewProps;
+    myRadianceLutRead[ i ] = RenderCore::CreateTextureView( radianceLutTex, viewProps, "Sky radiance Lut Srv" );
+
+    viewProps.myIsShaderWritable = true;
+    myRadianceLutWrite[ i ] = RenderCore::CreateTextureView( radianceLutTex, viewProps, "Sky radiance Lut Uav" );
   }
 
   // Linear clamp sampler
@@ -115,18 +86,89 @@ Sky::~Sky() {
     RenderCore::DeleteTextureView( myTransmittanceLutWrite );
   if ( myTransmittanceLutTex.IsValid() )
     RenderCore::DeleteTexture( myTransmittanceLutTex );
-  if ( mySkyViewLutRead.IsValid() )
-    RenderCore::DeleteTextureView( mySkyViewLutRead );
-  if ( mySkyViewLutWrite.IsValid() )
-    RenderCore::DeleteTextureView( mySkyViewLutWrite );
-  if ( mySkyViewLutTex.IsValid() )
-    RenderCore::DeleteTexture( mySkyViewLutTex );
+  for ( uint i = 0u; i < SkyLutCache::NUM_SLOTS; ++i ) {
+    if ( mySkyViewLutRead[ i ].IsValid() )
+      RenderCore::DeleteTextureView( mySkyViewLutRead[ i ] );
+    if ( mySkyViewLutWrite[ i ].IsValid() )
+      RenderCore::DeleteTextureView( mySkyViewLutWrite[ i ] );
+    if ( mySkyViewLutTex[ i ].IsValid() )
+      RenderCore::DeleteTexture( mySkyViewLutTex[ i ] );
+    if ( myRadianceLutRead[ i ].IsValid() )
+      RenderCore::DeleteTextureView( myRadianceLutRead[ i ] );
+    if ( myRadianceLutWrite[ i ].IsValid() )
+      RenderCore::DeleteTextureView( myRadianceLutWrite[ i ] );
+    if ( myRadianceLutTex[ i ].IsValid() )
+      RenderCore::DeleteTexture( myRadianceLutTex[ i ] );
+  }
   // Shader pipelines and sampler are cached resources; not owned by Sky
 }
 
-void Sky::ComputeTranmittanceLut( CommandList * ctx ) {
-  using namespace Priv_Sky;
+void Sky::UpdateTransmittanceLut( CommandList * ctx ) {
+  const uint64 atmosphereHash = GetAtmosphereHash( myAtmosphereParams );
+  if ( myHasTransmittanceLut && atmosphereHash == myTransmittanceLutHash ) {
+    ++myFrameStats.myNumTransmittanceSkipped;
+    return;
+  }
+
+  ComputeTranmittanceLut( ctx );
+  myTransmittanceLutHash = atmosphereHash;
+  myHasTransmittanceLut = true;
+  ++myFrameStats.myNumTransmittanceComputed;
+}
+
+void Sky::UpdateSkyViewLut( CommandList * ctx, const Camera & aCamera ) {
+  bool      needsCompute;
+  const int heightBucket = GetSkyLutHeightBucket( aCamera.myPosition.y );
+  myCurrentSkyViewLut = mySkyViewLutCache.Acquire( GetSkyLutParametersHash( GetLutParameters() ), heightBucket,
+                                                   needsCompute );
+  if ( !needsCompute ) {
+    ++myFrameStats.myNumSkyViewSkipped;
+    return;
+  }
+
+  ComputeSkyViewLut( ctx, myCurrentSkyViewLut, GetSkyLutBucketHeight( heightBucket ) );
+  ++myFrameStats.myNumSkyViewComputed;
+}
+
+void Sky::UpdateRadianceLut( CommandList * ctx, const Camera & aCamera ) {
+  bool      needsCompute;
+  const int heightBucket = GetSkyLutHeightBucket( aCamera.myPosition.y );
+  myCurrentRadianceLut = myRadianceLutCache.Acquire( GetSkyLutParametersHash( GetLutParameters() ), heightBucket,
+                                                     needsCompute );
+  if ( !needsCompute ) {
+    ++myFrameStats.myNumRadianceSkipped;
+    return;
+  }
+
+  ComputeRadianceLut( ctx, myCurrentRadianceLut, GetSkyLutBucketHeight( heightBucket ) );
+  ++myFrameStats.myNumRadianceComputed;
+}
+
+SkyLutParameters Sky::GetLutParameters() const {
+  SkyLutParameters params;
+  params.myAtmosphere = myAtmosphereParams;
+  params.mySunDirection = mySunDir;
+  params.mySunIlluminance = mySunIlluminance;
+  return params;
+}
+
+void Sky::ResetFrameStats() {
+  myFrameStats = SkyLutStats();
+}
+
+const SkyLutStats & Sky::GetFrameStats() const {
+  return myFrameStats;
+}
+
+TextureView * Sky::GetSkyViewLutRead() const {
+  return RenderCore::GetTextureView( mySkyViewLutRead[ myCurrentSkyViewLut ] );
+}
 
+TextureView * Sky::GetRadianceLutRead() const {
+  return RenderCore::GetTextureView( myRadianceLutRead[ myCurrentRadianceLut ] );
+}
+
+void Sky::ComputeTranmittanceLut( CommandList * ctx ) {
   GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
 
   struct Constants {
@@ -147,9 +189,7 @@ void Sky::ComputeTranmittanceLut( CommandList * ctx ) {
   ctx->ResourceUAVbarrier( RenderCore::GetTextureView( myTransmittanceLutWrite )->GetTexture() );
 }
 
-void Sky::ComputeSkyViewLut( CommandList * ctx, const Camera & aCamera ) {
-  using namespace Priv_Sky;
-
+void Sky::ComputeSkyViewLut( CommandList * ctx, uint aSlot, float aCameraHeight ) {
   GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
 
   struct Constants {
@@ -171,29 +211,64 @@ void Sky::ComputeSkyViewLut( CommandList * ctx, const Camera & aCamera ) {
   } consts;
 
   consts.myAtmosphereParameters = myAtmosphereParams;
-  consts.myInvViewProj = glm::inverse( aCamera.myViewProj );
+  // Only the camera height is used by the shader, the view directions are derived from the LUT coordinates
+  consts.myInvViewProj = glm::float4x4( 1.0f );
   consts.mySunIlluminance = mySunIlluminance;
   consts.myLinearClampSamplerIdx = RenderCore::GetTextureSampler( myLinearClampSampler )->GetGlobalDescriptorIndex();
   consts.mySunDirection = mySunDir;
   consts.myTransmissionLutTexIdx =
       ctx->GetPrepareDescriptorIndex( RenderCore::GetTextureView( myTransmittanceLutRead ) );
-  consts.myCameraPos = aCamera.myPosition;
-  consts.myOutTexIdx = ctx->GetPrepareDescriptorIndex( RenderCore::GetTextureView( mySkyViewLutWrite ) );
+  consts.myCameraPos = glm::float3( 0.0f, aCameraHeight, 0.0f );
+  consts.myOutTexIdx = ctx->GetPrepareDescriptorIndex( RenderCore::GetTextureView( mySkyViewLutWrite[ aSlot ] ) );
   consts.myRayMarchMinMaxSPP = glm::float2( 4.0f, 14.0f );
   consts.mySkyViewTextureRes = { SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH, SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT };
   ctx->BindConstantBuffer( &consts, sizeof( consts ), 0u );
 
   ctx->SetShaderPipeline( RenderCore::GetShaderPipeline( myComputeSkyViewLut ) );
   ctx->Dispatch( { SkyLutConsts::SKY_VIEW_TEXTURE_WIDTH, SkyLutConsts::SKY_VIEW_TEXTURE_HEIGHT, 1 } );
-  ctx->ResourceUAVbarrier( RenderCore::GetTextureView( mySkyViewLutWrite )->GetTexture() );
+  ctx->ResourceUAVbarrier( RenderCore::GetTextureView( mySkyViewLutWrite[ aSlot ] )->GetTexture() );
+}
+
+void Sky::ComputeRadianceLut( CommandList * ctx, uint aSlot, float aCameraHeight ) {
+  GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
+
+  struct Constants {
+    AtmosphereParameters myAtmosphereParameters;
+
+    glm::float3 mySunIlluminance;
+    uint        myLinearClampSamplerIdx;
+
+    glm::float3 mySunDirection;
+    uint        myTransmissionLutTexIdx;
+
+    glm::float3 myCameraPos;
+    uint        myOutTexIdx;
+
+    glm::float2 myRayMarchMinMaxSPP;
+    glm::uvec2  mySkyRadianceLutRes;
+  } consts;
+
+  consts.myAtmosphereParameters = myAtmosphereParams;
+  consts.mySunIlluminance = mySunIlluminance;
+  consts.myLinearClampSamplerIdx = RenderCore::GetTextureSampler( myLinearClampSampler )->GetGlobalDescriptorIndex();
+  consts.mySunDirection = mySunDir;
+  consts.myTransmissionLutTexIdx =
+      ctx->GetPrepareDescriptorIndex( RenderCore::GetTextureView( myTransmittanceLutRead ) );
+  consts.myCameraPos = glm::float3( 0.0f, aCameraHeight, 0.0f );
+  consts.myOutTexIdx = ctx->GetPrepareDescriptorIndex( RenderCore::GetTextureView( myRadianceLutWrite[ aSlot ] ) );
+  consts.myRayMarchMinMaxSPP = glm::float2( 4.0f, 14.0f );
+  consts.mySkyRadianceLutRes = { SkyLutConsts::SKY_RADIANCE_LUT_WIDTH, SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT };
+  ctx->BindConstantBuffer( &consts, sizeof( consts ), 0u );
+
+  ctx->SetShaderPipeline( RenderCore::GetShaderPipeline( myComputeRadianceLut ) );
+  ctx->Dispatch( { GetSkyRadianceLutTextureWidth(), SkyLutConsts::SKY_RADIANCE_LUT_HEIGHT, 1 } );
+  ctx->ResourceUAVbarrier( RenderCore::GetTextureView( myRadianceLutWrite[ aSlot ] )->GetTexture() );
 }
 
 void Sky::Render( CommandList * ctx, TextureView * aDestTextureWrite, TextureView * aDepthBufferRead,
                   const Camera & aCamera ) {
   GPU_SCOPED_PROFILER_FUNCTION( ctx, 0u );
 
-  using namespace Priv_Sky;
-
   glm::uvec2 texSize = { aDestTextureWrite->GetTexture()->GetProperties().myWidth,
                          aDestTextureWrite->GetTexture()->GetProperties().myHeight };
 
@@ -215,16 +290,14 @@ void Sky::Render( CommandList * ctx, TextureView * aDestTextureWrite, TextureVie
 
   cbuffer.myInvResolution = glm::float2( 1.0f, 1.0f ) / glm::float2( texSize );
   cbuffer.myOutTexIdx = ctx->GetPrepareDescriptorIndex( aDestTextureWrite );
-  cbuffer.mySkyViewLutTextureIndex = ctx->GetPrepareDescriptorIndex( RenderCore::GetTextureView( mySkyViewLutRead ) );
+  cbuffer.mySkyViewLutTextureIndex = ctx->GetPrepareDescriptorIndex( GetSkyViewLutRead() );
   cbuffer.myInvViewProj = glm::inverse( aCamera.myViewProj );
   cbuffer.myViewPos = aCamera.myPosition;
   cbuffer.myAtmosphereBottomRadius = myAtmosphereParams.BottomRadius;
   cbuffer.mySunDirection = mySunDir;
   cbuffer.myLinearClampSamplerIndex = RenderCore::GetTextureSampler( myLinearClampSampler )->GetGlobalDescriptorIndex();
-  cbuffer.mySkyViewLutTextureRes = {
-    RenderCore::GetTextureView( mySkyViewLutRead )->GetTexture()->GetProperties().myWidth,
-    RenderCore::GetTextureView( mySkyViewLutRead )->GetTexture()->GetProperties().myHeight
-  };
+  cbuffer.mySkyViewLutTextureRes = { GetSkyViewLutRead()->GetTexture()->GetProperties().myWidth,
+                                     GetSkyViewLutRead()->GetTexture()->GetProperties().myHeight };
   ctx->BindConstantBuffer( &cbuffer, sizeof( cbuffer ), 0 );
 
   ctx->SetShaderPipeline( RenderCore::GetShaderPipeline( myRenderSkyShader ) );
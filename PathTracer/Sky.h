@@ -4,6 +4,8 @@
 #include "Common/MathIncludes.h"
 #include "Rendering/ResourceHandle.h"
 
+#include "CpuSky.h"
+
 namespace Fancy {
   class Camera;
   class CommandList;
@@ -24,43 +26,6 @@ namespace Fancy {
   class TextureSampler;
 }  // namespace Fancy
 
-struct AtmosphereParameters {
-  // Rayleigh scattering coefficients
-  glm::float3 RayleighScattering;
-  // Rayleigh scattering exponential distribution scale in the atmosphere
-  float RayleighDensityExpScale;
-
-  // This other medium only absorb light, e.g. useful to represent ozone in the earth atmosphere
-  glm::float3 AbsorptionExtinction;
-  // Radius of the planet (center to ground)
-  float BottomRadius;
-
-  // The albedo of the ground.
-  glm::float3 GroundAlbedo;
-  // Maximum considered atmosphere height (center to atmosphere top)
-  float TopRadius;
-
-  // Mie scattering coefficients
-  glm::float3 MieScattering;
-  // Mie scattering exponential distribution scale in the atmosphere
-  float MieDensityExpScale;
-
-  // Mie extinction coefficients
-  glm::float3 MieExtinction;
-  // Mie phase function excentricity
-  float MiePhaseG;
-
-  // Mie absorption coefficients
-  glm::float3 MieAbsorption;
-  // Another medium type in the atmosphere
-  float AbsorptionDensity0LayerWidth;
-
-  float AbsorptionDensity0ConstantTerm;
-  float AbsorptionDensity0LinearTerm;
-  float AbsorptionDensity1ConstantTerm;
-  float AbsorptionDensity1LinearTerm;
-};
-
 using namespace Fancy;
 
 struct SkyParameters {};
@@ -72,25 +37,48 @@ public:
   Sky( const SkyParameters & someParams );
   ~Sky();
 
-  void ComputeTranmittanceLut( CommandList * ctx );
-  void ComputeSkyViewLut( CommandList * ctx, const Camera & aCamera );
+  // Recompute the LUTs only if the parameters they depend on changed since their last computation
+  void UpdateTransmittanceLut( CommandList * ctx );
+  void UpdateSkyViewLut( CommandList * ctx, const Camera & aCamera );
+  void UpdateRadianceLut( CommandList * ctx, const Camera & aCamera );
   void Render( CommandList * ctx, TextureView * aDestTextureWrite, TextureView * aDepthBufferRead,
                const Camera & aCamera );
 
+  SkyLutParameters    GetLutParameters() const;
+  void                ResetFrameStats();
+  const SkyLutStats & GetFrameStats() const;
+  TextureView *       GetSkyViewLutRead() const;
+  TextureView *       GetRadianceLutRead() const;
+
   float                myMultiScatteringFactor = 0.0f;
   glm::float3          mySunDir = glm::float3( 0, 1, 0 );
   glm::float3          mySunIlluminance = glm::float3( 1000.0f );
   AtmosphereParameters myAtmosphereParams;
 
   // private:
+  void ComputeTranmittanceLut( CommandList * ctx );
+  void ComputeSkyViewLut( CommandList * ctx, uint aSlot, float aCameraHeight );
+  void ComputeRadianceLut( CommandList * ctx, uint aSlot, float aCameraHeight );
+
   TextureHandle        myTransmittanceLutTex;
   TextureViewHandle    myTransmittanceLutRead;
   TextureViewHandle    myTransmittanceLutWrite;
-  TextureHandle        mySkyViewLutTex;
-  TextureViewHandle    mySkyViewLutRead;
-  TextureViewHandle    mySkyViewLutWrite;
+  uint64               myTransmittanceLutHash = 0u;
+  bool                 myHasTransmittanceLut = false;
+  TextureHandle        mySkyViewLutTex[ SkyLutCache::NUM_SLOTS ];
+  TextureViewHandle    mySkyViewLutRead[ SkyLutCache::NUM_SLOTS ];
+  TextureViewHandle    mySkyViewLutWrite[ SkyLutCache::NUM_SLOTS ];
+  SkyLutCache          mySkyViewLutCache;
+  uint                 myCurrentSkyViewLut = 0u;
+  TextureHandle        myRadianceLutTex[ SkyLutCache::NUM_SLOTS ];
+  TextureViewHandle    myRadianceLutRead[ SkyLutCache::NUM_SLOTS ];
+  TextureViewHandle    myRadianceLutWrite[ SkyLutCache::NUM_SLOTS ];
+  SkyLutCache          myRadianceLutCache;
+  uint                 myCurrentRadianceLut = 0u;
+  SkyLutStats          myFrameStats;
   ShaderPipelineHandle myComputeTransmittanceLut;
   ShaderPipelineHandle myComputeSkyViewLut;
+  ShaderPipelineHandle myComputeRadianceLut;
   ShaderPipelineHandle myComputeRaymarching;
   ShaderPipelineHandle myRenderSkyShader;
   TextureSamplerHandle myLinearClampSampler;
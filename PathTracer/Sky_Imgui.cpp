@@ -12,7 +12,15 @@ bool Sky_Imgui::Update( Sky * aSky ) {
   // ImGui::Begin("Sky", &myImgui_windowOpen);
 
   myImgui_TransmittanceLutImg.Update( RenderCore::GetTextureView( aSky->myTransmittanceLutRead ), "Transmittance LUT" );
-  myImgui_SkyViewLutImg.Update( RenderCore::GetTextureView( aSky->mySkyViewLutRead ), "Sky-View LUT" );
+  myImgui_SkyViewLutImg.Update( aSky->GetSkyViewLutRead(), "Sky-View LUT" );
+  myImgui_RadianceLutImg.Update( aSky->GetRadianceLutRead(), "Radiance LUT" );
+
+  const SkyLutStats & lutStats = aSky->GetFrameStats();
+  ImGui::Text( "Transmittance LUT: %u computed, %u skipped", lutStats.myNumTransmittanceComputed,
+               lutStats.myNumTransmittanceSkipped );
+  ImGui::Text( "Sky-View LUT: %u computed, %u skipped", lutStats.myNumSkyViewComputed, lutStats.myNumSkyViewSkipped );
+  ImGui::Text( "Radiance LUT: %u computed, %u skipped", lutStats.myNumRadianceComputed,
+               lutStats.myNumRadianceSkipped );
 
   bool skyParamsChanged = false;
 
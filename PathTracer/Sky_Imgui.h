@@ -20,4 +20,5 @@ private:
   bool                   myImgui_settingsChanged = false;
   Fancy::ImGuiDebugImage myImgui_TransmittanceLutImg;
   Fancy::ImGuiDebugImage myImgui_SkyViewLutImg;
+  Fancy::ImGuiDebugImage myImgui_RadianceLutImg;
 };
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <chrono>
+
+#include "Common/FancyCoreDefines.h"
+
+inline float64 SampleTimeMs() {
+  const std::chrono::duration< float64, std::milli > now( std::chrono::system_clock::now().time_since_epoch() );
+  return now.count();
+}
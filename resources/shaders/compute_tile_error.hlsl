@@ -0,0 +1,66 @@
+#include "fancy/resources/shaders/GlobalResources.h"
+
+// Same as CPU_RT_TILE_SIZE in CpuPathTracer.h and RT_TILE_SIZE in raytracing/Common.hlsl
+#define TILE_SIZE 16
+
+cbuffer CB0 : register(b0, Space_LocalCBuffer)
+{
+  uint myAccumulationTexIdx;  // Mean radiance in rgb, sample count in a
+  uint myMomentTexIdx;        // Mean squared luminance
+  uint myTileErrorTexIdx;
+  uint _unused0;
+
+  uint2 myResolution;
+};
+
+groupshared float theErrorSqSums[TILE_SIZE * TILE_SIZE];
+groupshared uint theNumPixels[TILE_SIZE * TILE_SIZE];
+
+float GetLuminance(float3 radiance)
+{
+  return dot(radiance, float3(0.2126, 0.7152, 0.0722));
+}
+
+// Squared standard error of the mean luminance of a pixel, relative to the squared mean like ComputeRelativeRmse().
+// Same as GetRelativeErrorSq() in CpuPathTracer.cpp.
+float GetRelativeErrorSq(float4 anAccumulation, float aMoment)
+{
+  float numSamples = anAccumulation.a;
+  if (numSamples < 2.0)
+    return 3.402823466e+38;
+
+  float mean = GetLuminance(anAccumulation.rgb);
+  float meanVariance = max(aMoment - mean * mean, 0.0) / (numSamples - 1.0);
+  return meanVariance / (mean * mean + 0.01);
+}
+
+// One group per tile. The error of a tile is the root of the mean squared relative error of its pixels, an estimate
+// of its contribution to the relative RMSE of the image.
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void main(uint3 aDTid : SV_DispatchThreadID, uint3 aGTid : SV_GroupThreadID, uint3 aGid : SV_GroupID)
+{
+  uint threadIdx = aGTid.y * TILE_SIZE + aGTid.x;
+  theErrorSqSums[threadIdx] = 0.0;
+  theNumPixels[threadIdx] = 0;
+  if (all(aDTid.xy < myResolution))
+  {
+    float4 accumulation = theRwTextures2D[myAccumulationTexIdx][aDTid.xy];
+    float moment = theRwTextures2D[myMomentTexIdx][aDTid.xy].x;
+    theErrorSqSums[threadIdx] = GetRelativeErrorSq(accumulation, moment);
+    theNumPixels[threadIdx] = 1;
+  }
+  GroupMemoryBarrierWithGroupSync();
+
+  for (uint stride = TILE_SIZE * TILE_SIZE / 2; stride > 0; stride >>= 1)
+  {
+    if (threadIdx < stride)
+    {
+      theErrorSqSums[threadIdx] += theErrorSqSums[threadIdx + stride];
+      theNumPixels[threadIdx] += theNumPixels[threadIdx + stride];
+    }
+    GroupMemoryBarrierWithGroupSync();
+  }
+
+  if (threadIdx == 0)
+    theRwTextures2D[myTileErrorTexIdx][aGid.xy] = sqrt(theErrorSqSums[0] / max(theNumPixels[0], 1)).xxxx;
+}
@@ -2,6 +2,7 @@
 #include "fancy/resources/shaders/GlobalResources.h"
 #include "Random.hlsl"
 #include "SampleSky.hlsl"
+#include "Sampler.hlsl"
 
 struct HitInfoPrimary
 {
@@ -18,7 +19,7 @@ void ClosestHitPrimary(inout HitInfoPrimary payload, Attributes attrib)
     MaterialData matData = LoadMaterialData(instanceData.myMaterialIndex);
 
     uint primitiveIndex = PrimitiveIndex();
-    VertexData vertexData = LoadInterpolatedVertexData(instanceData.myVertexBufferIndex, instanceData.myIndexBufferIndex, primitiveIndex, attrib.bary);
+    VertexData vertexData = LoadInterpolatedVertexData(instanceData, primitiveIndex, attrib.bary);
 
     payload.myHasHit = true;
     payload.myHitNormal = vertexData.myNormal;
@@ -41,11 +42,15 @@ void RayGen()
 {
     uint2 uPixel = DispatchRaysIndex().xy;
     uint2 resolution = DispatchRaysDimensions().xy;
+
+    if (IsTileConverged(uPixel))
+        return;
+
     RngStateType rngState = InitRNG(uPixel, resolution, myFrameRandomSeed);
 
     float2 pixel = uPixel;
 
-    float2 jitter = float2(GetRand01(rngState), GetRand01(rngState));
+    float2 jitter = float2(GetSample01(rngState), GetSample01(rngState));
     pixel += lerp(-0.5.xx, 0.5.xx, jitter);
     pixel = clamp(pixel, 0, resolution);
 
@@ -72,7 +77,7 @@ void RayGen()
         uint numAoHits = 0;
         for (uint i = 0u; i < numAoRays; ++i) 
         {
-            float2 rand11 = float2(GetRand01(rngState), GetRand01(rngState)) * 2 - 1;
+            float2 rand11 = float2(GetSample01(rngState), GetSample01(rngState)) * 2 - 1;
             float3 dir = GetHemisphereDirection(rand11, primaryHitInfo.myHitNormal);
 
             rayDesc.Origin = primaryHitInfo.myHitPos;
@@ -96,8 +101,5 @@ void RayGen()
         pixelLuminance = SampleSkyLuminance(origin, dir);
     }
 
-    float4 accumLight = theRwTextures2D[myOutTexIndex][pixel] * myNumAccumulationFrames;
-    accumLight += float4(pixelLuminance, 0.0);
-    accumLight /= float(myNumAccumulationFrames + 1);
-    theRwTextures2D[myOutTexIndex][pixel] = accumLight;
+    AccumulateSample(uPixel, pixelLuminance);
 }
\ No newline at end of file
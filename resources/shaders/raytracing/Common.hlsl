@@ -19,6 +19,10 @@ struct SkyConstants
 
   float2 myRayMarchMinMaxSPP;
   float2 _unused2;
+
+  uint2 mySkyRadianceLutRes;
+  uint myUseSkyRadianceLut;  // Misses fetch the radiance LUT instead of integrating the atmosphere
+  uint mySkyRadianceLutTexIdx;
 };
 
 cbuffer Constants : register(b0, Space_LocalCBuffer)
@@ -36,14 +40,14 @@ cbuffer Constants : register(b0, Space_LocalCBuffer)
   uint myInstanceDataBufferIndex;
 
   uint myMaterialDataBufferIndex;
-  uint mySampleBufferIndex;
+  uint mySamplerTableBufferIndex;  // Sobol matrices and blue-noise ranks, see Sampler.hlsl
   uint myFrameRandomSeed;
   uint myNumAccumulationFrames;
 
   uint myLinearClampSamplerIndex;
   uint myMaxRecursionDepth;
   uint myLightInstanceId;
-  uint myNumHaltonSamples;
+  uint mySamplerType;  // SAMPLER_* in Sampler.hlsl
 
   float3 myLightEmission;
   uint mySampleSky;
@@ -51,6 +55,29 @@ cbuffer Constants : register(b0, Space_LocalCBuffer)
   float3 mySkyFallbackEmission;
   float myPhongSpecularPower;
 
+  uint myNextEventEstimation;
+  uint myLightTriangleBufferIndex;
+  uint myLightInstanceOffsetBufferIndex;  // First light triangle per instance, ~0u if the instance doesn't emit
+  uint myNumLightTriangles;
+
+  float myLightTotalPower;
+  uint myLightBvhBufferIndex;
+  uint myUseLightBvh;  // Picks light triangles with the light BVH instead of the alias table
+  uint myRussianRoulette;
+
+  uint myRussianRouletteMinBounces;
+  float myRussianRouletteMinSurvival;
+  float myRussianRouletteMaxSurvival;
+  uint myMomentTexIndex;  // Running average of the squared luminance per pixel, for adaptive sampling
+
+  uint myAdaptiveSampling;  // Skips the pixels of tiles whose error in myTileErrorTexIndex is below the threshold
+  float myAdaptiveErrorThreshold;
+  uint myTileErrorTexIndex;
+  uint mySamplerSeed;  // Scrambles the quasi-random sequences, stays the same over the accumulation
+
+  uint myLinearWrapSamplerIndex;  // Trilinear, for the material textures
+  uint3 _unused;
+
   SkyConstants mySkyConsts;
 };
 
@@ -65,11 +92,23 @@ struct VertexData
   float2 myUv;
 };
 
+// Same values as RtVertexFlags in CpuRtScene.h
+#define VERTEX_FLAG_COMPACT 1  // CompactVertexData instead of VertexData
+#define VERTEX_FLAG_INDEX16 2  // 16-bit triangle indices
+
+struct CompactVertexData
+{
+  uint myNormal;  // Octahedral, two snorm16
+  uint myUv;  // Two halfs
+};
+
 struct InstanceData
 {
   uint myIndexBufferIndex;
   uint myVertexBufferIndex;
   uint myMaterialIndex;
+  uint myVertexFlags;  // VERTEX_FLAG_* of the mesh
+  uint myPositionBufferIndex;  // Object-space float3 positions, only for meshes of textured instances, ~0u otherwise
 };
 
 InstanceData LoadInstanceData(uint anInstanceId)
@@ -77,16 +116,20 @@ InstanceData LoadInstanceData(uint anInstanceId)
   return theBuffers[myInstanceDataBufferIndex].Load<InstanceData>(anInstanceId * sizeof(InstanceData));
 }
 
+#define NO_TEXTURE 0xFFFFFFFF
+
 struct MaterialDataEncoded
 {
   float3 myEmission;
   uint myColor;
+  uint myBaseColorTextureIndex;  // sRGB, multiplies myColor. NO_TEXTURE without.
 };
 
 struct MaterialData
 {
   float3 myEmission;
   float4 myColor;
+  uint myBaseColorTextureIndex;
 };
 
 MaterialData LoadMaterialData(uint aMaterialIndex)
@@ -96,27 +139,99 @@ MaterialData LoadMaterialData(uint aMaterialIndex)
   MaterialData data;
   data.myEmission = enc.myEmission;
   data.myColor = Decode_Unorm_RGBA(enc.myColor);
+  data.myBaseColorTextureIndex = enc.myBaseColorTextureIndex;
   return data;
 };
 
-uint3 LoadTriangleIndices(uint anIndexBufferIndex, uint aTriangleIndex)
+uint3 LoadTriangleIndices(uint anIndexBufferIndex, uint aTriangleIndex, uint aVertexFlags)
 {
+  if (aVertexFlags & VERTEX_FLAG_INDEX16)
+  {
+    // The indices of a triangle start at a 2-byte aligned offset. The buffer is padded to a multiple of 4 bytes, so
+    // the two words that hold them are always inside of it.
+    uint byteOffset = aTriangleIndex * 6;
+    uint2 words = theBuffers[NonUniformResourceIndex(anIndexBufferIndex)].Load2(byteOffset & ~3u);
+    if (byteOffset & 2)
+      return uint3(words.x >> 16, words.y & 0xffff, words.y >> 16);
+    return uint3(words.x & 0xffff, words.x >> 16, words.y & 0xffff);
+  }
+
   return theBuffers[NonUniformResourceIndex(anIndexBufferIndex)].Load<uint3>(aTriangleIndex * sizeof(uint3));
 }
 
-VertexData LoadVertexData(uint aVertexBufferIndex, uint aVertexIndex)
+float3 DecodeOctahedralNormal(uint anEncoded)
+{
+  int2 snorm = int2(anEncoded << 16, anEncoded) >> 16;
+  float2 f = max(float2(snorm) / 32767.0, -1.0);
+  float3 n = float3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
+// Mip of a texture of aTextureSize at aPos on the triangle, for a pixel footprint given by the camera-facing steps
+// aPixelStepX/Y at the distance of aPos. The steps are projected onto the triangle along the view direction and mapped
+// to UV steps through the barycentric derivatives, the longer of the two picks the mip.
+float GetTextureLod(float3 aPos, float3 aCameraPos, float3 aPixelStepX, float3 aPixelStepY, float3 somePositions[3],
+                    float2 someUvs[3], float2 aTextureSize)
+{
+  float3 e1 = somePositions[1] - somePositions[0];
+  float3 e2 = somePositions[2] - somePositions[0];
+  float e1e1 = dot(e1, e1);
+  float e1e2 = dot(e1, e2);
+  float e2e2 = dot(e2, e2);
+  float det = e1e1 * e2e2 - e1e2 * e1e2;
+  if (det <= 1e-12 * e1e1 * e2e2)
+    return 0.0;
+
+  // Grazing angles give a large footprint instead of an infinite one
+  float3 normal = cross(e1, e2);
+  float3 viewDir = normalize(aPos - aCameraPos);
+  float viewDotNormal = dot(viewDir, normal);
+  float minViewDotNormal = 1e-4 * length(normal);
+  if (abs(viewDotNormal) < minViewDotNormal)
+    viewDotNormal = viewDotNormal < 0.0 ? -minViewDotNormal : minViewDotNormal;
+
+  float3 pixelSteps[2] = { aPixelStepX, aPixelStepY };
+  float maxUvStepSq = 0.0;
+  for (uint i = 0; i < 2; ++i)
+  {
+    float3 step = pixelSteps[i] - viewDir * (dot(pixelSteps[i], normal) / viewDotNormal);
+    float stepE1 = dot(step, e1);
+    float stepE2 = dot(step, e2);
+    float b1 = (e2e2 * stepE1 - e1e2 * stepE2) / det;
+    float b2 = (e1e1 * stepE2 - e1e2 * stepE1) / det;
+    float2 uvStep = (b1 * (someUvs[1] - someUvs[0]) + b2 * (someUvs[2] - someUvs[0])) * aTextureSize;
+    maxUvStepSq = max(maxUvStepSq, dot(uvStep, uvStep));
+  }
+  return maxUvStepSq > 0.0 ? 0.5 * log2(maxUvStepSq) : 0.0;
+}
+
+VertexData LoadVertexData(uint aVertexBufferIndex, uint aVertexIndex, uint aVertexFlags)
 {
+  if (aVertexFlags & VERTEX_FLAG_COMPACT)
+  {
+    CompactVertexData compact = theBuffers[NonUniformResourceIndex(aVertexBufferIndex)].Load<CompactVertexData>(aVertexIndex * sizeof(CompactVertexData));
+
+    VertexData data;
+    data.myNormal = DecodeOctahedralNormal(compact.myNormal);
+    data.myUv = float2(f16tof32(compact.myUv), f16tof32(compact.myUv >> 16));
+    return data;
+  }
+
   return theBuffers[NonUniformResourceIndex(aVertexBufferIndex)].Load<VertexData>(aVertexIndex * sizeof(VertexData));
 }
 
-VertexData LoadInterpolatedVertexData(uint aVertexBufferIndex, uint anIndexBufferIndex, uint aTriangleIndex, float2 aBarycentrics)
+VertexData LoadInterpolatedVertexData(InstanceData anInstanceData, uint aTriangleIndex, float2 aBarycentrics)
 {
-  uint3 indices = LoadTriangleIndices(anIndexBufferIndex, aTriangleIndex);
+  uint vertexFlags = anInstanceData.myVertexFlags;
+  uint3 indices = LoadTriangleIndices(anInstanceData.myIndexBufferIndex, aTriangleIndex, vertexFlags);
 
   VertexData vertexDatas[3];
-  vertexDatas[0] = LoadVertexData(aVertexBufferIndex, indices.x);
-  vertexDatas[1] = LoadVertexData(aVertexBufferIndex, indices.y);
-  vertexDatas[2] = LoadVertexData(aVertexBufferIndex, indices.z);
+  vertexDatas[0] = LoadVertexData(anInstanceData.myVertexBufferIndex, indices.x, vertexFlags);
+  vertexDatas[1] = LoadVertexData(anInstanceData.myVertexBufferIndex, indices.y, vertexFlags);
+  vertexDatas[2] = LoadVertexData(anInstanceData.myVertexBufferIndex, indices.z, vertexFlags);
 
   float baryZ = 1 - (aBarycentrics.x + aBarycentrics.y);
   VertexData returnData;
@@ -171,13 +286,9 @@ float3 TransformToNormalFrame(float3 aNormal, float3 aDir)
   float3 bitangent;
   GetCoordinateFrame(aNormal, tangent, bitangent);
 
+  // aDir is in tangent space with y along the normal
   float3x3 tbn = float3x3(tangent, aNormal, bitangent);
-  return mul(tbn, aDir);
-}
-
-float2 GetHaltonSample( uint index ) {
-  uint i = index % myNumHaltonSamples;
-  return theBuffers[mySampleBufferIndex].Load<float2>( i * sizeof(float2));
+  return mul(aDir, tbn);
 }
 
 void GetPrimaryRay(float2 pixel, uint2 resolution, out float3 origin, out float3 dir)
@@ -188,6 +299,46 @@ void GetPrimaryRay(float2 pixel, uint2 resolution, out float3 origin, out float3
   dir = normalize(origin - myCameraPos);
 }
 
+// Offsets of one pixel along the x- and y-axis of the image, in the plane parallel to the near plane through aPos
+void GetPixelSteps(float3 aPos, uint2 aResolution, out float3 aStepXOut, out float3 aStepYOut)
+{
+  // The steps on the near plane, scaled by the distance of aPos along the view axis relative to the near plane
+  float3 viewAxis = cross(myXAxis, myYAxis);
+  float nearDist = dot(myNearPlaneCorner - myCameraPos, viewAxis);
+  float scale = dot(aPos - myCameraPos, viewAxis) / nearDist;
+  aStepXOut = myXAxis * (scale / aResolution.x);
+  aStepYOut = myYAxis * (scale / aResolution.y);
+}
+
+// Trilinear lookup with the mip of the pixel footprint at the hit. Hits of later bounces use the footprint the camera
+// would see, which is too sharp after rough bounces but cheap. Same as CpuPathTracer::SampleBaseColorTexture().
+float3 SampleBaseColorTexture(uint aTextureIndex, InstanceData anInstanceData, float3x4 anObjectToWorld,
+                              uint aTriangleIndex, float3 aHitPos, float2 aUv, uint2 aResolution)
+{
+  uint3 indices = LoadTriangleIndices(anInstanceData.myIndexBufferIndex, aTriangleIndex, anInstanceData.myVertexFlags);
+
+  float3 positions[3];
+  float2 uvs[3];
+  for (uint i = 0; i < 3; ++i)
+  {
+    float3 objectPos = theBuffers[NonUniformResourceIndex(anInstanceData.myPositionBufferIndex)].Load<float3>(indices[i] * sizeof(float3));
+    positions[i] = mul(anObjectToWorld, float4(objectPos, 1.0));
+    uvs[i] = LoadVertexData(anInstanceData.myVertexBufferIndex, indices[i], anInstanceData.myVertexFlags).myUv;
+  }
+
+  float3 pixelStepX;
+  float3 pixelStepY;
+  GetPixelSteps(aHitPos, aResolution, pixelStepX, pixelStepY);
+
+  Texture2D baseColorTex = theTextures2D[NonUniformResourceIndex(aTextureIndex)];
+  uint width, height, numMips;
+  baseColorTex.GetDimensions(0, width, height, numMips);
+  float lod = GetTextureLod(aHitPos, myCameraPos, pixelStepX, pixelStepY, positions, uvs, float2(width, height));
+
+  SamplerState linearWrapSampler = theSamplers[myLinearWrapSamplerIndex];
+  return baseColorTex.SampleLevel(linearWrapSampler, aUv, lod).rgb;
+}
+
 float GetLuminance(float3 radiance) 
 {
   return dot(radiance, float3(0.2126f, 0.7152f, 0.0722f));
@@ -200,4 +351,29 @@ float GetFresnelSchlick(float3 aNormal, float3 aView)
   return saturate( f0 + (1.0f - f0) * pow(1.0f - cosTheta, 5.0f) );
 }
 
+#define RT_TILE_SIZE 16  // Same as CPU_RT_TILE_SIZE in CpuPathTracer.h
+
+// Adaptive sampling skips the pixels of tiles whose error is below the threshold, see compute_tile_error.hlsl
+bool IsTileConverged(uint2 aPixel)
+{
+  return myAdaptiveSampling && theTextures2D[myTileErrorTexIndex][aPixel / RT_TILE_SIZE].x <= myAdaptiveErrorThreshold;
+}
+
+// Pixels count their own samples in alpha, adaptive sampling skips some of them in a frame. The second moment of the
+// luminance gives the variance estimate of compute_tile_error.hlsl. Accumulating into the dispatch pixel instead of the
+// jittered one keeps neighboring pixels from racing for the counts. Same as CpuPathTracer::AccumulateSample().
+void AccumulateSample(uint2 aPixel, float3 aLuminance)
+{
+  float4 accumLight = theRwTextures2D[myOutTexIndex][aPixel];
+  float numSamples = myNumAccumulationFrames > 0 ? accumLight.a : 0.0;
+  accumLight.rgb = (accumLight.rgb * numSamples + aLuminance) / (numSamples + 1.0);
+  accumLight.a = numSamples + 1.0;
+  theRwTextures2D[myOutTexIndex][aPixel] = accumLight;
+
+  float luminance = GetLuminance(aLuminance);
+  float moment = theRwTextures2D[myMomentTexIndex][aPixel].x;
+  moment = (moment * numSamples + luminance * luminance) / (numSamples + 1.0);
+  theRwTextures2D[myMomentTexIndex][aPixel] = moment.xxxx;
+}
+
 #endif  // INC_RT_COMMON
\ No newline at end of file
@@ -0,0 +1,230 @@
+#ifndef INC_RT_LIGHTS
+#define INC_RT_LIGHTS
+
+#include "Common.hlsl"
+
+#define LIGHT_BVH_LEAF_FLAG 0x80000000u
+
+// World-space triangle of an emissive instance, same layout as CpuRtLightTriangle
+struct LightTriangle
+{
+  float3 myV0;
+  float myAliasProbability;  // Of keeping this triangle when the alias table picks its entry
+  float3 myEdge1;
+  float myArea;
+  float3 myEdge2;
+  uint myAlias;  // Triangle picked instead, with 1 - myAliasProbability
+  float3 myEmission;
+  uint myBvhBitTrail;  // Bit i selects the second child at depth i on the way from the root to the leaf
+};
+
+// Node of the light BVH in depth-first order, same layout as CpuRtLightBvhNode
+struct LightBvhNode
+{
+  float3 myBoundsMin;
+  float myPower;  // Of all triangles below the node
+  float3 myBoundsMax;
+  uint myChildOrTriangle;  // Second child of inner nodes, the first one follows the node. Triangle | LEAF_FLAG.
+};
+
+struct LightSample
+{
+  float3 myDirection;
+  float myDistance;
+  float3 myEmission;
+  float myPdf;  // Over solid angle
+};
+
+LightTriangle LoadLightTriangle(uint aTriangleIdx)
+{
+  return theBuffers[myLightTriangleBufferIndex].Load<LightTriangle>(aTriangleIdx * sizeof(LightTriangle));
+}
+
+LightBvhNode LoadLightBvhNode(uint aNodeIdx)
+{
+  return theBuffers[myLightBvhBufferIndex].Load<LightBvhNode>(aNodeIdx * sizeof(LightBvhNode));
+}
+
+// Light triangle of the primitive of an instance, ~0u if the instance doesn't emit
+uint GetLightTriangleIndex(uint anInstanceId, uint aPrimitiveIdx)
+{
+  if (myNumLightTriangles == 0)
+    return ~0u;
+
+  uint firstTriangle = theBuffers[myLightInstanceOffsetBufferIndex].Load<uint>(anInstanceId * sizeof(uint));
+  return firstTriangle != ~0u ? firstTriangle + aPrimitiveIdx : ~0u;
+}
+
+float GetLightTrianglePower(LightTriangle aTriangle)
+{
+  return GetLuminance(aTriangle.myEmission) * aTriangle.myArea;
+}
+
+// Power over the squared distance, times the largest cosine between aNormal and a direction into the bounding sphere of
+// the node. Inside or close to the bounds, the distance to their center says little about the distance to the
+// triangles, so it is clamped to the radius.
+float GetLightBvhNodeImportance(LightBvhNode aNode, float3 aPos, float3 aNormal)
+{
+  float3 diagonal = aNode.myBoundsMax - aNode.myBoundsMin;
+  float3 toCenter = (aNode.myBoundsMin + aNode.myBoundsMax) * 0.5 - aPos;
+  float distanceSq = dot(toCenter, toCenter);
+  float radiusSq = 0.25 * dot(diagonal, diagonal);
+
+  float cosIncidence = 1.0;
+  if (distanceSq > radiusSq)
+  {
+    float cosCenter = dot(aNormal, toCenter) / sqrt(distanceSq);
+    float sinCenter = sqrt(max(1.0 - cosCenter * cosCenter, 0.0));
+    float sinBounds = sqrt(radiusSq / distanceSq);
+    float cosBounds = sqrt(1.0 - sinBounds * sinBounds);
+    if (cosCenter < cosBounds)
+      cosIncidence = max(cosCenter * cosBounds + sinCenter * sinBounds, 0.0);
+  }
+
+  return aNode.myPower * cosIncidence / max(max(distanceSq, radiusSq), 1.175494351e-38);
+}
+
+// Picks a triangle with the alias table or by descending the light BVH. Returns false if no triangle can light aPos.
+bool PickLightTriangle(float3 aPos, float3 aNormal, float aRand01, out uint aTriangleIdxOut, out float aPmfOut)
+{
+  aTriangleIdxOut = 0;
+  aPmfOut = 0.0;
+
+  if (!myUseLightBvh)
+  {
+    float scaledRand = aRand01 * myNumLightTriangles;
+    uint entry = min(uint(scaledRand), myNumLightTriangles - 1);
+    LightTriangle entryTri = LoadLightTriangle(entry);
+    aTriangleIdxOut = scaledRand - entry < entryTri.myAliasProbability ? entry : entryTri.myAlias;
+    aPmfOut = GetLightTrianglePower(LoadLightTriangle(aTriangleIdxOut)) / myLightTotalPower;
+    return true;
+  }
+
+  // Descends into either child with the probability of its importance and rescales the random number to reuse it
+  uint nodeIdx = 0;
+  LightBvhNode node = LoadLightBvhNode(0);
+  float rand = aRand01;
+  float pmf = 1.0;
+  while ((node.myChildOrTriangle & LIGHT_BVH_LEAF_FLAG) == 0)
+  {
+    uint secondChild = node.myChildOrTriangle;
+    LightBvhNode child0 = LoadLightBvhNode(nodeIdx + 1);
+    LightBvhNode child1 = LoadLightBvhNode(secondChild);
+    float importance0 = GetLightBvhNodeImportance(child0, aPos, aNormal);
+    float importance1 = GetLightBvhNodeImportance(child1, aPos, aNormal);
+    if (importance0 + importance1 <= 0.0)
+      return false;
+
+    float probability0 = importance0 / (importance0 + importance1);
+    if (rand < probability0)
+    {
+      nodeIdx = nodeIdx + 1;
+      node = child0;
+      rand = rand / probability0;
+      pmf *= probability0;
+    }
+    else
+    {
+      nodeIdx = secondChild;
+      node = child1;
+      rand = (rand - probability0) / (1.0 - probability0);
+      pmf *= 1.0 - probability0;
+    }
+    rand = min(rand, 0.99999994);
+  }
+
+  aTriangleIdxOut = node.myChildOrTriangle & ~LIGHT_BVH_LEAF_FLAG;
+  aPmfOut = pmf;
+  return true;
+}
+
+// Probability with which PickLightTriangle() picks the triangle from aPos and aNormal
+float GetLightTrianglePmf(float3 aPos, float3 aNormal, LightTriangle aTriangle)
+{
+  if (!myUseLightBvh)
+    return GetLightTrianglePower(aTriangle) / myLightTotalPower;
+
+  // Follows the bit trail of the triangle down from the root, with the same probabilities as PickLightTriangle()
+  uint bitTrail = aTriangle.myBvhBitTrail;
+  uint nodeIdx = 0;
+  LightBvhNode node = LoadLightBvhNode(0);
+  float pmf = 1.0;
+  while ((node.myChildOrTriangle & LIGHT_BVH_LEAF_FLAG) == 0)
+  {
+    uint secondChild = node.myChildOrTriangle;
+    LightBvhNode child0 = LoadLightBvhNode(nodeIdx + 1);
+    LightBvhNode child1 = LoadLightBvhNode(secondChild);
+    float importance0 = GetLightBvhNodeImportance(child0, aPos, aNormal);
+    float importance1 = GetLightBvhNodeImportance(child1, aPos, aNormal);
+    if (importance0 + importance1 <= 0.0)
+      return 0.0;
+
+    if (bitTrail & 1)
+    {
+      pmf *= importance1 / (importance0 + importance1);
+      nodeIdx = secondChild;
+      node = child1;
+    }
+    else
+    {
+      pmf *= importance0 / (importance0 + importance1);
+      nodeIdx = nodeIdx + 1;
+      node = child0;
+    }
+    bitTrail >>= 1;
+  }
+  return pmf;
+}
+
+// Points are uniform over the area of the triangle. Emitters are two-sided, like in ClosestHit.
+float GetLightTrianglePdf(float aTrianglePmf, LightTriangle aTriangle, float3 aDirection, float aDistanceSq)
+{
+  if (aTriangle.myArea <= 0.0)
+    return 0.0;
+
+  float3 normal = cross(aTriangle.myEdge1, aTriangle.myEdge2) / (2.0 * aTriangle.myArea);
+  float cosLight = abs(dot(normal, aDirection));
+  if (cosLight < 1e-6)
+    return 0.0;
+
+  return aTrianglePmf / aTriangle.myArea * aDistanceSq / cosLight;
+}
+
+// Picks a triangle and a point uniformly on it. Returns false if the point can't light aPos.
+bool SampleLightTriangle(float3 aPos, float3 aNormal, float3 aRand01, out LightSample aSampleOut)
+{
+  aSampleOut = (LightSample) 0;
+
+  uint triangleIdx;
+  float trianglePmf;
+  if (!PickLightTriangle(aPos, aNormal, aRand01.x, triangleIdx, trianglePmf))
+    return false;
+
+  LightTriangle tri = LoadLightTriangle(triangleIdx);
+
+  float sqrtRand = sqrt(aRand01.y);
+  float3 lightPos = tri.myV0 + tri.myEdge1 * (sqrtRand * (1.0 - aRand01.z)) + tri.myEdge2 * (sqrtRand * aRand01.z);
+  float3 toLight = lightPos - aPos;
+  float distanceSq = dot(toLight, toLight);
+  if (distanceSq <= 0.0)
+    return false;
+
+  aSampleOut.myDistance = sqrt(distanceSq);
+  aSampleOut.myDirection = toLight / aSampleOut.myDistance;
+  aSampleOut.myEmission = tri.myEmission;
+  aSampleOut.myPdf = GetLightTrianglePdf(trianglePmf, tri, aSampleOut.myDirection, distanceSq);
+  return aSampleOut.myPdf > 0.0;
+}
+
+// Solid angle density with which SampleLightTriangle() from aPos and aNormal picks the point at aDistance along
+// aDirection on the triangle
+float GetLightPdf(float3 aPos, float3 aNormal, uint aLightTriangleIdx, float3 aDirection, float aDistance)
+{
+  if (aLightTriangleIdx == ~0u)
+    return 0.0;
+
+  LightTriangle tri = LoadLightTriangle(aLightTriangleIdx);
+  return GetLightTrianglePdf(GetLightTrianglePmf(aPos, aNormal, tri), tri, aDirection, aDistance * aDistance);
+}
+
+#endif // INC_RT_LIGHTS
@@ -3,6 +3,8 @@
 #include "Random.hlsl"
 #include "SampleSky.hlsl"
 #include "brdfSampling.hlsl"
+#include "Lights.hlsl"
+#include "Sampler.hlsl"
 
 struct HitInfo
 {
@@ -10,6 +12,12 @@ struct HitInfo
     float3 myHitNormal;
     float3 myColor;
     float3 myEmission;
+    uint myLightTriangleIdx;
+    bool myHasHit;
+};
+
+struct ShadowHitInfo
+{
     bool myHasHit;
 };
 
@@ -21,13 +29,17 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
     MaterialData matData = LoadMaterialData(instanceData.myMaterialIndex);
 
     uint primitiveIndex = PrimitiveIndex();
-    VertexData vertexData = LoadInterpolatedVertexData(instanceData.myVertexBufferIndex, instanceData.myIndexBufferIndex, primitiveIndex, attrib.bary);
+    VertexData vertexData = LoadInterpolatedVertexData(instanceData, primitiveIndex, attrib.bary);
 
     payload.myHasHit = true;
     payload.myHitNormal = vertexData.myNormal;
     payload.myHitPos = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
     payload.myColor = matData.myColor.xyz;
+    if (matData.myBaseColorTextureIndex != NO_TEXTURE)
+        payload.myColor *= SampleBaseColorTexture(matData.myBaseColorTextureIndex, instanceData, ObjectToWorld3x4(), primitiveIndex,
+                                                  payload.myHitPos, vertexData.myUv, DispatchRaysDimensions().xy);
     payload.myEmission = matData.myEmission;
+    payload.myLightTriangleIdx = GetLightTriangleIndex(instanceId, primitiveIndex);
 
     if (dot(payload.myHitNormal, -WorldRayDirection()) < 0)
         payload.myHitNormal = -payload.myHitNormal;
@@ -37,16 +49,94 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
         payload.myEmission = myLightEmission;
 }
 
+[shader("closesthit")] 
+void ClosestHitShadow(inout ShadowHitInfo payload, Attributes attrib) 
+{
+    payload.myHasHit = true;
+}
+
+bool IsOccluded(float3 origin, float3 dir, float tMax)
+{
+    RayDesc shadowRayDesc;
+    shadowRayDesc.Origin = origin;
+    shadowRayDesc.TMin = 0.001;
+    shadowRayDesc.Direction = dir;
+    shadowRayDesc.TMax = tMax;
+
+    ShadowHitInfo shadowHitInfo;
+    shadowHitInfo.myHasHit = false;
+    TraceRay(theRtAccelerationStructures[myAsIndex], RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, 0xFF, 1, 0, 0, shadowRayDesc, shadowHitInfo);
+    return shadowHitInfo.myHasHit;
+}
+
+// The sun disc along a ray that left the scene, weighted against the sun samples of SampleDirectLight()
+float3 GetWeightedSunDiscLuminance(float3 origin, float3 dir, float lastBrdfPdf)
+{
+    if (!mySampleSky)
+        return float3(0, 0, 0);
+
+    float3 sunLuminance = GetSunDiscLuminance(origin, dir);
+    if (!myNextEventEstimation || lastBrdfPdf <= 0.0)
+        return sunLuminance;
+
+    return sunLuminance * GetPowerHeuristic(lastBrdfPdf, 1.0 / GetSunSolidAngle());
+}
+
+// Next-event estimation: one sample of the sun disc and one of the emissive triangles, weighted against the BRDF samples
+float3 SampleDirectLight(float3 pos, float3 N, float3 V, float3 baseColor, float fresnel, float specRayProbability, float specularStrength,
+                         float specularPower, uint bounceIdx, inout RngStateType rngState)
+{
+    float3 luminance = float3(0, 0, 0);
+
+    if (mySampleSky)
+    {
+        SetSamplerDimension(rngState, bounceIdx, SAMPLER_SUN_DIMENSION);
+        float rand0 = GetSample01(rngState);
+        float rand1 = GetSample01(rngState);
+        float3 sunDir = SampleSunDisc(float2(rand0, rand1));
+        float3 brdf = EvaluateBrdf(N, sunDir, V, baseColor, fresnel, specularStrength, specularPower);
+        if (any(brdf != 0.0) && !IsOccluded(pos, sunDir, 10000.0))
+        {
+            // The sun luminance over the pdf of the disc samples is its illuminance
+            float brdfPdf = GetBrdfPDF(N, sunDir, specRayProbability, specularPower);
+            luminance += brdf * GetSunIlluminance(pos) * GetPowerHeuristic(1.0 / GetSunSolidAngle(), brdfPdf);
+        }
+    }
+
+    if (myNumLightTriangles == 0)
+        return luminance;
+
+    SetSamplerDimension(rngState, bounceIdx, SAMPLER_LIGHT_DIMENSION);
+    float rand0 = GetSample01(rngState);
+    float rand1 = GetSample01(rngState);
+    float rand2 = GetSample01(rngState);
+
+    LightSample lightSample;
+    if (!SampleLightTriangle(pos, N, float3(rand0, rand1, rand2), lightSample))
+        return luminance;
+
+    float3 brdf = EvaluateBrdf(N, lightSample.myDirection, V, baseColor, fresnel, specularStrength, specularPower);
+    if (all(brdf == 0.0) || IsOccluded(pos, lightSample.myDirection, lightSample.myDistance * (1.0 - 1e-3)))
+        return luminance;
+
+    float brdfPdf = GetBrdfPDF(N, lightSample.myDirection, specRayProbability, specularPower);
+    return luminance + brdf * lightSample.myEmission * (GetPowerHeuristic(lightSample.myPdf, brdfPdf) / lightSample.myPdf);
+}
+
 [shader("raygeneration")] 
 void RayGen() 
 {
     uint2 uPixel = DispatchRaysIndex().xy;
     uint2 resolution = DispatchRaysDimensions().xy;
+
+    if (IsTileConverged(uPixel))
+        return;
+
     RngStateType rngState = InitRNG(uPixel, resolution, myFrameRandomSeed);
 
     float2 pixel = uPixel;
 
-    float2 jitter = float2(GetRand01(rngState), GetRand01(rngState));
+    float2 jitter = float2(GetSample01(rngState), GetSample01(rngState));
     pixel += lerp(-0.5.xx, 0.5.xx, jitter);
     pixel = clamp(pixel, 0, resolution);
 
@@ -64,6 +154,8 @@ void RayGen()
     
     float3 luminance = float3(0, 0, 0);
     float3 transmission = float3(1, 1, 1);
+    float lastBrdfPdf = 0.0;  // Of rayDesc.Direction, 0 for the camera ray
+    float3 lastNormal = float3(0, 0, 0);  // At rayDesc.Origin, for the light BVH
     
     for ( uint bounceIdx = 0u; bounceIdx <= myMaxRecursionDepth; ++bounceIdx ) {
             
@@ -72,12 +164,18 @@ void RayGen()
 
         if (!hitInfo.myHasHit) 
         {
-            luminance += transmission * SampleSkyLuminance(rayDesc.Origin, rayDesc.Direction);
+            luminance += transmission * (SampleSkyLuminance(rayDesc.Origin, rayDesc.Direction) + GetWeightedSunDiscLuminance(rayDesc.Origin, rayDesc.Direction, lastBrdfPdf));
             break;
         }
 
-        
-        // TODO: Evaluate local lighting
+        // Emission that next-event estimation could also have sampled from the previous hit is weighted against it
+        float emissionWeight = 1.0;
+        if (myNextEventEstimation && lastBrdfPdf > 0.0)
+        {
+            float hitDistance = length(hitInfo.myHitPos - rayDesc.Origin);
+            emissionWeight = GetPowerHeuristic(lastBrdfPdf, GetLightPdf(rayDesc.Origin, lastNormal, hitInfo.myLightTriangleIdx, rayDesc.Direction, hitDistance));
+        }
+        luminance += transmission * hitInfo.myEmission * emissionWeight;
 
         // DEBUG values:
         float specularStrength = 0.9f;
@@ -85,11 +183,17 @@ void RayGen()
 
         float fresnel = GetFresnelSchlick( hitInfo.myHitNormal, -rayDesc.Direction );
         float specRayProbability = EstimateSpecularRayProbability( specularStrength, hitInfo.myColor, fresnel );
+
+        // The BRDF sample of the last bounce is never traced, so light sampled from there would have no MIS counterpart
+        if (myNextEventEstimation && bounceIdx < myMaxRecursionDepth)
+            luminance += transmission * SampleDirectLight(hitInfo.myHitPos, hitInfo.myHitNormal, -rayDesc.Direction, hitInfo.myColor, fresnel,
+                                                          specRayProbability, specularStrength, specularPower, bounceIdx, rngState);
         
-        if (GetRand01(rngState) < specRayProbability)
+        SetSamplerDimension(rngState, bounceIdx, SAMPLER_BRDF_DIMENSION);
+        if (GetSample01(rngState) < specRayProbability)
         {   
             float pdf;
-            float3 nextSampleDir = SampleModifiedPhong( float2(GetRand01(rngState), GetRand01(rngState)), hitInfo.myHitNormal, specularPower, pdf );
+            float3 nextSampleDir = SampleModifiedPhong( float2(GetSample01(rngState), GetSample01(rngState)), hitInfo.myHitNormal, specularPower, pdf );
             float3 brdf = fresnel * EvaluateModifiedPhong( hitInfo.myHitNormal, nextSampleDir, -rayDesc.Direction, specularStrength, specularPower );
             
             transmission *= brdf / max( 0.01f, pdf );
@@ -102,26 +206,24 @@ void RayGen()
             float pdf = GetLambertianPDF( hitInfo.myHitNormal, -rayDesc.Direction );
             transmission *= brdf / pdf;
             transmission /= (1.0f - specRayProbability);
-            rayDesc.Direction = GetCosineWeightedHemisphereDirection(float2(GetRand01(rngState), GetRand01(rngState)), hitInfo.myHitNormal, hitInfo.myHitPos);
+            rayDesc.Direction = GetCosineWeightedHemisphereDirection(float2(GetSample01(rngState), GetSample01(rngState)), hitInfo.myHitNormal, hitInfo.myHitPos);
         }
 
-        luminance += transmission * hitInfo.myEmission; 
+        lastBrdfPdf = GetBrdfPDF( hitInfo.myHitNormal, rayDesc.Direction, specRayProbability, specularPower );
+        lastNormal = hitInfo.myHitNormal;
 
-        // Check if ray should be terminated (russian roulette)
-        /*
-        const uint minBounces = 3;
-        if (bounceIdx > minBounces) 
+        // Russian roulette. Paths that carry little light are likely to end, the others are reweighted so the estimate
+        // stays the same. The largest channel of the throughput keeps saturated paths alive more often than their
+        // luminance would. Clamping the survival probability bounds the weight of the survivors.
+        if (myRussianRoulette && bounceIdx >= myRussianRouletteMinBounces && bounceIdx < myMaxRecursionDepth)
         {
-            float terminationProbability = clamp(GetRand01(rngState), 0.001, 0.95);
-            if (GetLuminance(transmission) < terminationProbability) {
+            float throughput = max(transmission.x, max(transmission.y, transmission.z));
+            float survivalProbability = clamp(throughput, myRussianRouletteMinSurvival, myRussianRouletteMaxSurvival);
+            SetSamplerDimension(rngState, bounceIdx, SAMPLER_ROULETTE_DIMENSION);
+            if (GetSample01(rngState) >= survivalProbability)
                 break;
-            }
-            else { 
-                transmission /= terminationProbability;  // Results in fireflies
-            }
-
+            transmission /= survivalProbability;
         }
-        */
         
         rayDesc.Origin = hitInfo.myHitPos;
         rayDesc.TMin = 0.001;
@@ -131,8 +233,5 @@ void RayGen()
         isinf(luminance.x) || isinf(luminance.y) || isinf(luminance.z))
         luminance = float3(0, 0, 0);
 
-    float4 accumLight = theRwTextures2D[myOutTexIndex][pixel] * myNumAccumulationFrames;
-    accumLight += float4(luminance, 0.0);
-    accumLight /= float(myNumAccumulationFrames + 1);
-    theRwTextures2D[myOutTexIndex][pixel] = accumLight;
+    AccumulateSample(uPixel, luminance);
 }
\ No newline at end of file
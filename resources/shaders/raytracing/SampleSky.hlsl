@@ -9,6 +9,13 @@ float3 SampleSkyLuminance(float3 viewPos, float3 viewDir)
     if (!mySampleSky)
         return mySkyFallbackEmission;
 
+    if (mySkyConsts.myUseSkyRadianceLut)
+    {
+        float2 uv = SkyRadianceLutDirToUv(viewDir, mySkyConsts.mySkyRadianceLutRes);
+        SamplerState linearClampSampler = theSamplers[myLinearClampSamplerIndex];
+        return theTextures2D[mySkyConsts.mySkyRadianceLutTexIdx].SampleLevel(linearClampSampler, uv, 0).rgb;
+    }
+
 	float3 worldPos = viewPos + float3(0, mySkyConsts.myAtmosphere.BottomRadius, 0);
 	float viewHeight = length(worldPos);
 	float3 upVector = worldPos / viewHeight;
@@ -46,5 +53,54 @@ float3 SampleSkyLuminance(float3 viewPos, float3 viewDir)
     return skyLuminance;
 }
 
+// Illuminance of the sun at viewPos after the transmittance of the atmosphere, 0 if the sun is below the horizon
+float3 GetSunIlluminance(float3 viewPos)
+{
+	float3 worldPos = viewPos + float3(0, mySkyConsts.myAtmosphere.BottomRadius, 0);
+	if (raySphereIntersectNearest(worldPos, mySkyConsts.mySunDirection, float3(0, 0, 0), mySkyConsts.myAtmosphere.BottomRadius) >= 0.0)
+		return float3(0, 0, 0);
+
+	float viewHeight = length(worldPos);
+	float sunZenithCosAngle = dot(mySkyConsts.mySunDirection, worldPos / viewHeight);
+	float2 uv;
+	LutTransmittanceParamsToUv(mySkyConsts.myAtmosphere.BottomRadius, mySkyConsts.myAtmosphere.TopRadius, viewHeight, sunZenithCosAngle, uv);
+	SamplerState linearClampSampler = theSamplers[myLinearClampSamplerIndex];
+	return mySkyConsts.mySunIlluminance * theTextures2D[mySkyConsts.myTransmissionLutTexIdx].SampleLevel(linearClampSampler, uv, 0).rgb;
+}
+
+// The sun is a disc of 0.505 degrees, like GetSunLuminance() in sky/Common.hlsl, with the illuminance of GetSunIlluminance()
+// spread evenly over it. 1 - cos of its angular radius is computed as 2 sin^2(radius / 2) to keep its precision.
+static const float SUN_ANGULAR_RADIUS = 0.5 * 0.505 * PI / 180.0;
+static const float SUN_ONE_MINUS_COS_RADIUS = 2.0 * sin(0.5 * SUN_ANGULAR_RADIUS) * sin(0.5 * SUN_ANGULAR_RADIUS);
+
+float GetSunSolidAngle()
+{
+    return 2.0 * PI * SUN_ONE_MINUS_COS_RADIUS;
+}
+
+bool IsInSunDisc(float3 dir)
+{
+    return 1.0 - dot(dir, mySkyConsts.mySunDirection) <= SUN_ONE_MINUS_COS_RADIUS;
+}
+
+// Uniform over the cone of directions
+float3 SampleSunDisc(float2 aRand01)
+{
+    float oneMinusCosTheta = aRand01.x * SUN_ONE_MINUS_COS_RADIUS;
+    float sinTheta = sqrt(oneMinusCosTheta * (2.0 - oneMinusCosTheta));
+    float phi = 2.0 * PI * aRand01.y;
+
+    float3 sampleDir = float3(cos(phi) * sinTheta, 1.0 - oneMinusCosTheta, sin(phi) * sinTheta);
+    return normalize(TransformToNormalFrame(mySkyConsts.mySunDirection, sampleDir));
+}
+
+float3 GetSunDiscLuminance(float3 viewPos, float3 viewDir)
+{
+    if (!IsInSunDisc(viewDir))
+        return float3(0, 0, 0);
+
+    return GetSunIlluminance(viewPos) / GetSunSolidAngle();
+}
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+#ifndef INC_RT_SAMPLER
+#define INC_RT_SAMPLER
+
+#include "Common.hlsl"
+
+// Same values as SamplerType in CpuRtSampler.h
+#define SAMPLER_RANDOM 0
+#define SAMPLER_HALTON 1
+#define SAMPLER_SOBOL 2
+#define SAMPLER_BLUE_NOISE 3
+
+// Dimensions of the decisions of a path and layout of the sampler table, same as in CpuRtSampler.h
+#define SAMPLER_SET_DIMENSIONS 4
+#define SAMPLER_CAMERA_DIMENSIONS 4
+#define SAMPLER_BOUNCE_DIMENSIONS 16
+#define SAMPLER_LIGHT_DIMENSION 0
+#define SAMPLER_SUN_DIMENSION 4
+#define SAMPLER_BRDF_DIMENSION 8
+#define SAMPLER_ROULETTE_DIMENSION 12
+
+#define SAMPLER_SOBOL_BITS 32
+#define SAMPLER_BLUE_NOISE_SIZE 64
+#define SAMPLER_TABLE_BLUE_NOISE_OFFSET (SAMPLER_SET_DIMENSIONS * SAMPLER_SOBOL_BITS)
+#define BLUE_NOISE_RANK_SHIFT 20
+#define HALTON_MAX_INDEX_OFFSET (1u << 16)
+
+static const uint theHaltonBases[SAMPLER_SET_DIMENSIONS] = { 2, 3, 5, 7 };
+
+uint LoadSamplerTable(uint anIndex)
+{
+  return theBuffers[mySamplerTableBufferIndex].Load<uint>(anIndex * sizeof(uint));
+}
+
+uint SamplerHash(uint x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+uint SamplerHashCombine(uint aSeed, uint aValue)
+{
+  return aSeed ^ (SamplerHash(aValue) + 0x9e3779b9u + (aSeed << 6) + (aSeed >> 2));
+}
+
+// Burley, "Practical Hash-based Owen Scrambling"
+uint LaineKarrasPermutation(uint x, uint aSeed)
+{
+  x += aSeed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return x;
+}
+
+uint NestedUniformScramble(uint x, uint aSeed)
+{
+  return reversebits(LaineKarrasPermutation(reversebits(x), aSeed));
+}
+
+uint GetSobol(uint anIndex, uint aSobolDimension)
+{
+  uint result = 0;
+  for (uint bit = 0; anIndex != 0; anIndex >>= 1, ++bit)
+  {
+    if (anIndex & 1)
+      result ^= LoadSamplerTable(aSobolDimension * SAMPLER_SOBOL_BITS + bit);
+  }
+  return result;
+}
+
+// Each set of dimensions shuffles the sample order and scrambles the values with its own seed
+uint GetOwenScrambledSobol(uint aSampleIdx, uint aDimension, uint aSeed)
+{
+  uint setSeed = SamplerHashCombine(aSeed, aDimension / SAMPLER_SET_DIMENSIONS);
+  uint sobolDimension = aDimension % SAMPLER_SET_DIMENSIONS;
+  uint index = NestedUniformScramble(aSampleIdx, setSeed);
+  return NestedUniformScramble(GetSobol(index, sobolDimension), SamplerHashCombine(setSeed, sobolDimension + 1));
+}
+
+// In 0.32 fixed point
+uint GetRadicalInverse(uint anIndex, uint aBase)
+{
+  if (aBase == 2)
+    return reversebits(anIndex);
+
+  float invBase = 1.0 / aBase;
+  float result = 0.0;
+  float digitWeight = invBase;
+  for (; anIndex != 0; anIndex /= aBase, digitWeight *= invBase)
+    result += (anIndex % aBase) * digitWeight;
+  return uint(result * 4294967296.0);
+}
+
+uint GetPixelSeed(uint2 aPixelCoords, uint aScrambleSeed)
+{
+  return SamplerHashCombine(SamplerHashCombine(SamplerHash(aScrambleSeed), aPixelCoords.x), aPixelCoords.y);
+}
+
+// Number in [0, 1) of the next dimension of the path of the RNG state from InitRNG(). The quasi-random sequences are
+// indexed by myNumAccumulationFrames and scrambled with mySamplerSeed.
+float GetSample01(inout RngStateType aRngState)
+{
+  if (mySamplerType == SAMPLER_RANDOM)
+    return GetRand01(aRngState);
+
+  uint2 pixel = aRngState.xy;
+  uint dimension = aRngState.w++;
+
+  uint sample;
+  if (mySamplerType == SAMPLER_HALTON)
+  {
+    // The Cranley-Patterson rotation keeps the points of the pixel stratified and makes the estimate unbiased
+    uint pixelSeed = GetPixelSeed(pixel, mySamplerSeed);
+    uint setSeed = SamplerHashCombine(pixelSeed, dimension / SAMPLER_SET_DIMENSIONS);
+    uint index = myNumAccumulationFrames + SamplerHash(setSeed) % HALTON_MAX_INDEX_OFFSET;
+    uint haltonDimension = dimension % SAMPLER_SET_DIMENSIONS;
+    sample = GetRadicalInverse(index, theHaltonBases[haltonDimension]) +
+             SamplerHashCombine(setSeed, haltonDimension + 1);
+  }
+  else if (mySamplerType == SAMPLER_SOBOL)
+  {
+    sample = GetOwenScrambledSobol(myNumAccumulationFrames, dimension, GetPixelSeed(pixel, mySamplerSeed));
+  }
+  else
+  {
+    // All pixels share the sequence and only differ by the rotation from the ranks of the blue-noise tile
+    uint offset = SamplerHash(dimension);
+    uint2 tileCoords = (pixel + uint2(offset, offset >> 8)) & (SAMPLER_BLUE_NOISE_SIZE - 1);
+    uint tileIdx = tileCoords.y * SAMPLER_BLUE_NOISE_SIZE + tileCoords.x;
+    uint rank = LoadSamplerTable(SAMPLER_TABLE_BLUE_NOISE_OFFSET + tileIdx);
+    sample = GetOwenScrambledSobol(myNumAccumulationFrames, dimension, SamplerHash(mySamplerSeed));
+    sample += (rank << BLUE_NOISE_RANK_SHIFT) + (1u << (BLUE_NOISE_RANK_SHIFT - 1));
+  }
+
+  return uintToFloat(sample);
+}
+
+// Continues the path at aBounceDimension of bounce aBounceIdx
+void SetSamplerDimension(inout RngStateType aRngState, uint aBounceIdx, uint aBounceDimension)
+{
+  aRngState.w = SAMPLER_CAMERA_DIMENSIONS + aBounceIdx * SAMPLER_BOUNCE_DIMENSIONS + aBounceDimension;
+}
+
+#endif // INC_RT_SAMPLER
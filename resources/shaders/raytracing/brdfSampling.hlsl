@@ -27,7 +27,7 @@ float3 SampleModifiedPhong(float2 aRand01, float3 aNormal, float specularPower,
   float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
   float phi = TWO_PI * aRand01.y;
 
-  pdf = ((specularPower + 2.0f) / TWO_PI) * pow(cosTheta, specularPower);
+  pdf = ((specularPower + 2.0f) / TWO_PI) * pow(cosTheta, specularPower + 1.0f);
 
   float3 sampleDir = float3(
       cos(phi) * sinTheta,
@@ -38,6 +38,12 @@ float3 SampleModifiedPhong(float2 aRand01, float3 aNormal, float specularPower,
   return TransformToNormalFrame(aNormal, sampleDir);
 }
 
+float GetModifiedPhongPDF(float3 aNormal, float3 aDir, float specularPower)
+{
+  float cosTheta = max( 0, dot( aNormal, aDir ) );
+  return ((specularPower + 2.0f) / TWO_PI) * pow(cosTheta, specularPower + 1.0f);
+}
+
 float EstimateSpecularRayProbability( float aMaterialSpecularStrength, float3 aMaterialBaseColor, float aFresnel ) 
 {
   float spec = aFresnel * aMaterialSpecularStrength;
@@ -48,4 +54,24 @@ float EstimateSpecularRayProbability( float aMaterialSpecularStrength, float3 aM
   return specRayProbability;
 }
 
+// Both lobes of the material, weighted like the lobe selection in RayGen. Includes the cosine term, like the functions above.
+float3 EvaluateBrdf(float3 N, float3 L, float3 V, float3 baseColor, float fresnel, float specularStrength, float specularPower)
+{
+  return (1.0f - fresnel) * GetLambertianBRDF( baseColor, N, L ) + fresnel * EvaluateModifiedPhong( N, L, V, specularStrength, specularPower );
+}
+
+// Density of the directions that RayGen samples, over both lobes
+float GetBrdfPDF(float3 N, float3 L, float specRayProbability, float specularPower)
+{
+  return specRayProbability * GetModifiedPhongPDF( N, L, specularPower ) + (1.0f - specRayProbability) * GetLambertianPDF( N, L );
+}
+
+// Multiple importance sampling weight of the strategy with aPdf against the one with anOtherPdf
+float GetPowerHeuristic(float aPdf, float anOtherPdf)
+{
+  float pdfSq = aPdf * aPdf;
+  float sumSq = pdfSq + anOtherPdf * anOtherPdf;
+  return sumSq > 0.0f ? pdfSq / sumSq : 0.0f;
+}
+
 #endif // INC_BRDF_SAMPLING
\ No newline at end of file
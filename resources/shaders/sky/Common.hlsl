@@ -148,6 +148,24 @@ void SkyViewLutParamsToUv(float anAtmosphereBottomRadius, uint2 aSkyViewTextureS
 	uv = float2(fromUnitToSubUvs(uv.x, aSkyViewTextureSize.x), fromUnitToSubUvs(uv.y, aSkyViewTextureSize.y));
 }
 
+// Full-sphere sky radiance LUT: an equirect map whose texel centers lie on the corners of an aSkyRadianceLutRes.x x
+// (aSkyRadianceLutRes.y - 1) grid. The texture is one texel wider than aSkyRadianceLutRes.x and repeats the first column
+// at the end, so bilinear filtering with a clamp sampler has no seam at phi = +-PI.
+float2 SkyRadianceLutDirToUv(in float3 aDir, in uint2 aSkyRadianceLutRes)
+{
+	float phi = atan2(aDir.z, aDir.x);
+	float theta = acos(clamp(aDir.y, -1.0, 1.0));
+	float2 texel = float2(phi / (2.0 * PI) + 0.5, theta / PI) * float2(aSkyRadianceLutRes.x, aSkyRadianceLutRes.y - 1);
+	return (texel + 0.5) / float2(aSkyRadianceLutRes.x + 1, aSkyRadianceLutRes.y);
+}
+
+float3 SkyRadianceLutTexelToDir(in uint2 aTexel, in uint2 aSkyRadianceLutRes)
+{
+	float phi = ((float) aTexel.x / aSkyRadianceLutRes.x - 0.5) * 2.0 * PI;
+	float theta = (float) aTexel.y / (aSkyRadianceLutRes.y - 1) * PI;
+	return float3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
+
 #define RAYDPOS 0.00001f
 
 #define PLANET_RADIUS_OFFSET 10.0 // 0.01
@@ -0,0 +1,66 @@
+#ifndef INC_COMPUTE_SKY_RADIANCE_LUT
+#define INC_COMPUTE_SKY_RADIANCE_LUT
+
+#include "../../../fancy/resources/shaders/GlobalResources.h"
+#include "../../../fancy/resources/shaders/common_types.h"
+#include "Common.hlsl"
+
+cbuffer CONSTANT_BUFFER : register(b0, Space_LocalCBuffer)
+{
+	AtmosphereParameters myAtmosphereParameters;
+
+	float3 mySunIlluminance;
+	uint myLinearClampSamplerIdx;
+
+	float3 mySunDirection;
+	uint myTransmissionLutTexIdx;
+
+	float3 myCameraPos;
+	uint myOutTexIdx;
+
+	float2 myRayMarchMinMaxSPP;
+	uint2 mySkyRadianceLutRes;
+};
+
+// Same integration as SampleSkyLuminance() in raytracing/SampleSky.hlsl, for every direction of the radiance LUT
+[numthreads(8, 8, 1)]
+void main(uint3 aDTid : SV_DispatchThreadID)
+{
+	if (aDTid.x > mySkyRadianceLutRes.x || aDTid.y >= mySkyRadianceLutRes.y)
+		return;
+
+	float3 worldDir = SkyRadianceLutTexelToDir(aDTid.xy, mySkyRadianceLutRes);
+	float3 worldPos = myCameraPos + float3(0, myAtmosphereParameters.BottomRadius, 0);
+
+	float3 L = float3(0, 0, 0);
+	if (MoveToTopAtmosphere(worldPos, worldDir, myAtmosphereParameters.TopRadius))
+	{
+		const bool ground = false;
+		const float sampleCountIni = 30;
+		const float depthBufferValue = -1.0;
+		const bool variableSampleCount = true;
+		const bool mieRayPhase = true;
+		SingleScatteringResult ss = IntegrateScatteredLuminance(
+			float2(0, 0),
+			worldPos,
+			worldDir,
+			mySunDirection,
+			myAtmosphereParameters,
+			ground,
+			sampleCountIni,
+			depthBufferValue,
+			variableSampleCount,
+			mieRayPhase,
+			(float4x4) 0,
+			myRayMarchMinMaxSPP,
+			mySunIlluminance,
+			myLinearClampSamplerIdx,
+			myTransmissionLutTexIdx);
+
+		L = ss.L;
+	}
+
+	theRwTextures2D[myOutTexIdx][aDTid.xy] = float4(L, 1.0);
+}
+
+#endif  // INC_COMPUTE_SKY_RADIANCE_LUT